@@ -0,0 +1,287 @@
+#version 330 core
+
+// capacity of the Lights block, this must match light_sources.hpp
+#define MAX_DIR_LIGHTS 4
+// capacity of the cascade uniforms, this must match shadows.hpp
+#define MAX_CASCADES 4
+
+#ifdef LIGHT_VOLUME
+flat in int LightIndex;
+flat in float LightRadius;
+#endif
+
+out vec4 FragColor;
+
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// point and spot lights share one layout, a point light has a cutoff below -1
+struct LocalLight {
+    vec3 position;
+    float constant;
+    vec3 direction;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutoff;
+    vec3 specular;
+    float outerCutoff;
+};
+
+// what the g-buffer doesn't carry
+struct Material {
+    float shininess;
+};
+
+layout (std140) uniform Lights {
+    ivec4 lightCounts;
+    DirLight dirLights[MAX_DIR_LIGHTS];
+};
+
+// the g-buffer (see gbuffer.hpp) and what turns its depth back into view positions
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gEmission;
+uniform sampler2D gDepth;
+uniform mat4 inverseProjection;
+
+// 5 texels per clustered light, the volumes index it directly
+uniform samplerBuffer clusterLights;
+
+// the same shadows lighting.frag samples
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[MAX_CASCADES];
+uniform vec4 cascadeSplits;
+uniform vec4 cascadeTexels;
+uniform int shadowCascades;
+uniform sampler2DShadow shadowAtlas;
+uniform samplerBuffer lightShadows;
+uniform samplerBuffer shadowTiles;
+uniform mat4 inverseView;
+uniform int atlasShadows;
+
+uniform Material material;
+uniform float emissionStrength;
+
+// Definitions, read from the g-buffer in main
+
+vec3 FragPos;
+// how far apart two neighbouring depth values lie here, the rebuilt position is a few of them off and
+// the shadow offsets grow by that much
+float depthStep;
+vec3 Normal;
+vec3 diffuseMap;
+float specularMap;
+vec3 emissionMap;
+float diffuseLit;
+
+// Function Prototypes
+
+vec3 CalcDirLight(DirLight light, float shadow);
+float ComputeShadow();
+vec3 CalcLocalLight(LocalLight light, float shadow);
+float ComputeLightShadow(int index, LocalLight light);
+LocalLight FetchLight(int index);
+vec3 ViewPosition(float depth);
+vec3 DecodeNormal(vec2 e);
+vec3 ComputeAmbient(vec3 color);
+vec3 ComputeDiffuse(vec3 color, vec3 lightDir);
+vec3 ComputeSpecular(vec3 color, vec3 lightDir);
+float ComputeAttenuation(vec3 position, float c, float l, float q);
+float ComputeIntensity(LocalLight light, vec3 lightDir);
+
+// Program
+
+#ifdef STENCIL_ONLY
+// a light volume's stencil marking pass, only the depth test of its faces matters
+void main() {
+}
+#else
+// The directional pass covers the screen and writes every lit pixel, each light volume then adds its
+// light where the scene lies inside its range. Stencil keeps both off the pixels nothing was drawn to.
+// Nothing discards, so stencil and depth are still tested before the shader runs
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    FragPos = ViewPosition(depth);
+
+#ifdef LIGHT_VOLUME
+    // the sphere's flat faces lie a little past the range, what they cover beyond it adds nothing
+    if (length(texelFetch(clusterLights, LightIndex * 5).xyz - FragPos) > LightRadius) {
+        FragColor = vec4(0.0);
+        return;
+    }
+#endif
+    depthStep = length(ViewPosition(depth + 1.0 / 16777215.0) - FragPos);
+
+    vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+    vec4 emission = texelFetch(gEmission, pixel, 0);
+    Normal = DecodeNormal(texelFetch(gNormal, pixel, 0).xy);
+    diffuseMap = albedo.rgb;
+    specularMap = albedo.a;
+    emissionMap = emission.rgb;
+    diffuseLit = emission.a;
+
+    vec3 result = vec3(0);
+#ifdef LIGHT_VOLUME
+    LocalLight light = FetchLight(LightIndex);
+    result = CalcLocalLight(light, ComputeLightShadow(LightIndex, light));
+#else
+    for(int i = 0; i < lightCounts.x; i++) {
+        result += CalcDirLight(dirLights[i], i == 0 ? ComputeShadow() : 1.0);
+    }
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
+#endif
+
+// Light Casters
+
+vec3 CalcDirLight(DirLight light, float shadow) {
+    vec3 ambient  = ComputeAmbient(light.ambient);
+    vec3 diffuse  = ComputeDiffuse(light.diffuse, -light.direction);
+    vec3 specular = ComputeSpecular(light.specular, -light.direction);
+
+    return ambient + (diffuse + specular) * shadow;
+}
+
+vec3 CalcLocalLight(LocalLight light, float shadow) {
+    vec3 lightDir = normalize(light.position - FragPos);
+    float attenuation = ComputeAttenuation(light.position, light.constant, light.linear, light.quadratic);
+    float intensity = light.cutoff < -1.0 ? 1.0 : ComputeIntensity(light, -lightDir);
+
+    vec3 ambient  = ComputeAmbient(light.ambient);
+    vec3 diffuse = ComputeDiffuse(light.diffuse, lightDir);
+    vec3 specular = ComputeSpecular(light.specular, lightDir);
+
+    ambient *= attenuation;
+    diffuse *= attenuation * intensity * shadow;
+    specular *= attenuation * intensity * shadow;
+
+    return ambient + diffuse + specular;
+}
+
+// Shadows, as lighting.frag takes them
+
+float ComputeShadow() {
+    if (shadowCascades == 0)
+        return 1.0;
+
+    float depth = -FragPos.z;
+    int cascade = 0;
+    while (cascade < shadowCascades - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+
+    vec3 position = FragPos + Normal * (cascadeTexels[cascade] * 1.5 + depthStep * 4.0);
+    vec3 coords = vec3(shadowMatrices[cascade] * vec4(position, 1.0));
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+        }
+    }
+    return depth > cascadeSplits[shadowCascades - 1] ? 1.0 : lit / 9.0;
+}
+
+float ComputeLightShadow(int index, LocalLight light) {
+    if (atlasShadows == 0)
+        return 1.0;
+    vec4 record = texelFetch(lightShadows, index);
+    if (record.x < 0.0)
+        return 1.0;
+
+    vec3 toFrag = FragPos - light.position;
+    int tile = int(record.x);
+    if (light.cutoff < -1.0) {
+        vec3 axis = mat3(inverseView) * toFrag;
+        vec3 size = abs(axis);
+        if (size.x >= size.y && size.x >= size.z)
+            tile += axis.x > 0.0 ? 0 : 1;
+        else if (size.y >= size.z)
+            tile += axis.y > 0.0 ? 2 : 3;
+        else
+            tile += axis.z > 0.0 ? 4 : 5;
+    }
+
+    vec3 position = FragPos + Normal * (length(toFrag) * record.y * 1.5 + depthStep * 4.0);
+    mat4 transform = mat4(texelFetch(shadowTiles, tile * 4), texelFetch(shadowTiles, tile * 4 + 1),
+                          texelFetch(shadowTiles, tile * 4 + 2), texelFetch(shadowTiles, tile * 4 + 3));
+    vec4 clip = transform * (inverseView * vec4(position, 1.0));
+    vec3 coords = clip.xyz / clip.w;
+    if (clip.w <= 0.0 || coords.z > 1.0)
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    float lit = 0.0;
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            lit += texture(shadowAtlas, vec3(coords.xy + (vec2(x, y) - 0.5) * texel, coords.z));
+        }
+    }
+    return lit * 0.25;
+}
+
+// G-Buffer
+
+vec3 ViewPosition(float depth) {
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+    vec4 position = inverseProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+LocalLight FetchLight(int index) {
+    int base = index * 5;
+    vec4 t0 = texelFetch(clusterLights, base);
+    vec4 t1 = texelFetch(clusterLights, base + 1);
+    vec4 t2 = texelFetch(clusterLights, base + 2);
+    vec4 t3 = texelFetch(clusterLights, base + 3);
+    vec4 t4 = texelFetch(clusterLights, base + 4);
+
+    return LocalLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.xyz, t4.w);
+}
+
+// the inverse of gbuffer.frag's octahedral mapping
+vec3 DecodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// Helpers
+
+float ComputeIntensity(LocalLight light, vec3 lightDir) {
+    float theta = dot(lightDir, light.direction);
+    float epsilon = light.cutoff - light.outerCutoff;
+    return clamp((theta - light.outerCutoff) / epsilon, 0.0, 1.0);
+}
+
+float ComputeAttenuation(vec3 position, float c, float l, float q) {
+    float dist = length(position - FragPos);
+    return 1.0 / (c + l * dist + q * (dist * dist));
+}
+
+vec3 ComputeDiffuse(vec3 color, vec3 lightDir) {
+    float diffuseAngle = max(dot(lightDir, Normal), 0.0);
+    vec3 emission = emissionMap * (color * emissionStrength) * diffuseAngle;
+
+    return (color * diffuseAngle * diffuseMap + emission) * diffuseLit;
+}
+
+vec3 ComputeSpecular(vec3 color, vec3 lightDir) {
+    vec3 viewDir = normalize(-FragPos);
+    vec3 reflectDir = reflect(-lightDir, Normal);
+    float shininess = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    return color * shininess * specularMap;
+}
+
+vec3 ComputeAmbient(vec3 color) {
+  return color * diffuseMap;
+}
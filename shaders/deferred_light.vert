@@ -0,0 +1,30 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+#ifdef LIGHT_VOLUME
+// the clustered light a volume belongs to
+flat out int LightIndex;
+flat out float LightRadius;
+
+uniform mat4 projection;
+// view space position and range of every clustered light, in clusterLights order
+uniform samplerBuffer lightBounds;
+// the light instance 0 draws, volumes are drawn in runs
+uniform int firstLight;
+#endif
+
+// compiled per pass (see Stage::render_deferred_lighting), LIGHT_VOLUME draws a sphere per instance and
+// the directional pass without it one triangle over the whole screen
+void main() {
+#ifdef LIGHT_VOLUME
+    int light = firstLight + gl_InstanceID;
+    vec4 bounds = texelFetch(lightBounds, light);
+    gl_Position = projection * vec4(bounds.xyz + aPos * bounds.w, 1.0);
+    LightIndex = light;
+    LightRadius = bounds.w;
+#else
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+#endif
+}
@@ -0,0 +1,57 @@
+#version 330 core
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+// the g-buffer targets (see gbuffer.hpp)
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+layout (location = 2) out vec4 gEmission;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    sampler2D emission;
+};
+
+uniform Material material;
+uniform float time;
+uniform float emissionSpeed;
+
+vec2 EncodeNormal(vec3 n);
+
+// What lighting.frag would read from the maps, packed for deferred_light.frag, with the same feature
+// defines. Without a diffuse map the albedo is white so ambient light keeps its color and gEmission.a
+// turns diffuse lighting off, the emission only shows where there is no specular highlight and is lit by
+// every light like the diffuse term
+void main() {
+    vec4 albedo = vec4(1.0, 1.0, 1.0, 0.0);
+    vec4 emission = vec4(0.0);
+#ifdef DIFFUSE_MAP
+    albedo.rgb = vec3(texture(material.diffuse, TexCoords));
+    emission.a = 1.0;
+#endif
+#ifdef SPECULAR_MAP
+    vec3 specularMap = vec3(texture(material.specular, TexCoords));
+    albedo.a = max(max(specularMap.r, specularMap.g), specularMap.b);
+#endif
+#if defined(DIFFUSE_MAP) && defined(EMISSION_MAP)
+    emission.rgb = vec3(texture(material.emission, TexCoords + vec2(0.0, time * emissionSpeed)));
+#ifdef SPECULAR_MAP
+    emission.rgb *= specularMap == vec3(0) ? 1.0 : 0.0;
+#endif
+#endif
+
+    gAlbedo = albedo;
+    gNormal = EncodeNormal(normalize(Normal));
+    gEmission = emission;
+}
+
+// octahedral mapping, the lower half folded over the diagonals
+vec2 EncodeNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
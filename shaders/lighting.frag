@@ -1,8 +1,9 @@
 #version 330 core
 
-#define NR_DIR_LIGHTS 1
-#define NR_SPOT_LIGHTS 1
-#define NR_POINT_LIGHTS 4
+// capacity of the Lights block, this must match light_sources.hpp
+#define MAX_DIR_LIGHTS 4
+// capacity of the cascade uniforms, this must match shadows.hpp
+#define MAX_CASCADES 4
 
 in vec3 FragPos;
 in vec3 Normal;
@@ -11,38 +12,23 @@ in vec2 TexCoords;
 out vec4 FragColor;
 
 struct DirLight {
-    bool enabled;
     vec3 direction;
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
 };
 
-struct PointLight {
-    bool enabled;
+// point and spot lights share one layout, a point light has a cutoff below -1
+struct LocalLight {
     vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
     float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    bool enabled;
-    vec3 position;
     vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
     float linear;
+    vec3 ambient;
     float quadratic;
-
+    vec3 diffuse;
     float cutoff;
+    vec3 specular;
     float outerCutoff;
 };
 
@@ -53,50 +39,94 @@ struct Material {
     float shininess;
 };
 
-uniform DirLight dirLights[NR_DIR_LIGHTS];
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+// only enabled lights are packed, lightCounts holds how many of each (directional, spot, point)
+layout (std140) uniform Lights {
+    ivec4 lightCounts;
+    DirLight dirLights[MAX_DIR_LIGHTS];
+};
+
+// clustered point and spot lights (see clusters.hpp): 5 texels per light, an (offset, count)
+// range per cluster and the light indices those ranges point into
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+uniform ivec3 clusterGrid;
+uniform float clusterScale;
+uniform float clusterBias;
+uniform mat4 projection;
+
+// cascaded shadow maps of the first directional light (see shadows.hpp), shadowCascades is 0 without them.
+// The matrices take view space to map coordinates and depth, cascadeSplits holds where each one ends and
+// cascadeTexels the world size of its texels
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[MAX_CASCADES];
+uniform vec4 cascadeSplits;
+uniform vec4 cascadeTexels;
+uniform int shadowCascades;
+
+// spot and point light shadows packed in one atlas (see shadow_atlas.hpp), atlasShadows is 0 without them.
+// lightShadows holds a texel per clustered light: its first tile or -1 and the world size of a tile texel
+// one unit from the light. shadowTiles holds 4 matrix columns per tile, world to atlas coordinates and depth
+uniform sampler2DShadow shadowAtlas;
+uniform samplerBuffer lightShadows;
+uniform samplerBuffer shadowTiles;
+uniform mat4 inverseView;
+uniform int atlasShadows;
+
 uniform Material material;
 uniform float time;
-uniform bool emissive;
-uniform bool specular;
-uniform bool diffuse;
 uniform float emissionSpeed;
 uniform float emissionStrength;
 
-// Definitions
+// Definitions, sampled in main. DIFFUSE_MAP, SPECULAR_MAP and EMISSION_MAP are defined for the maps the
+// material draws with (see Material::features), the rest are never read
 
-vec3 specularMap = vec3(texture(material.specular, TexCoords));
-vec3 diffuseMap = vec3(texture(material.diffuse, TexCoords));
-vec3 emissionMap = vec3(texture(material.emission, TexCoords + vec2(0.0, time * emissionSpeed)));
+vec3 specularMap;
+vec3 diffuseMap;
+vec3 emissionMap;
 
 // Function Prototypes
 
-vec3 CalcDirLight(DirLight light);
-vec3 CalcPointLight(PointLight light);
-vec3 CalcSpotLight(SpotLight light);
+vec3 CalcDirLight(DirLight light, float shadow);
+float ComputeShadow();
+vec3 CalcLocalLight(LocalLight light, float shadow);
+float ComputeLightShadow(int index, LocalLight light);
+LocalLight FetchLight(int index);
+int FindCluster();
 vec3 ComputeAmbient(vec3 color);
 vec3 ComputeDiffuse(vec3 color, vec3 lightDir);
 vec3 ComputeSpecular(vec3 color, vec3 lightDir);
 float ComputeAttenuation(vec3 position, float c, float l, float q);
-float ComputeIntensity(SpotLight light, vec3 lightDir);
+float ComputeIntensity(LocalLight light, vec3 lightDir);
 
 // Program
 
 void main() {
+#ifdef DIFFUSE_MAP
+    diffuseMap = vec3(texture(material.diffuse, TexCoords));
+#endif
+#ifdef SPECULAR_MAP
+    specularMap = vec3(texture(material.specular, TexCoords));
+#endif
+#if defined(DIFFUSE_MAP) && defined(EMISSION_MAP)
+    // the emission only shows where there is no specular highlight
+    emissionMap = vec3(texture(material.emission, TexCoords + vec2(0.0, time * emissionSpeed)));
+#ifdef SPECULAR_MAP
+    emissionMap *= specularMap == vec3(0) ? 1.0 : 0.0;
+#endif
+#endif
+
     vec3 result = vec3(0);
 
-    for(int i = 0; i < NR_DIR_LIGHTS; i++) {
-        if (!dirLights[i].enabled) continue;
-        result += CalcDirLight(dirLights[i]);
-    }
-    for(int i = 0; i < NR_SPOT_LIGHTS; i++) {
-        if (!spotLights[i].enabled) continue;
-        result += CalcSpotLight(spotLights[i]);
+    for(int i = 0; i < lightCounts.x; i++) {
+        result += CalcDirLight(dirLights[i], i == 0 ? ComputeShadow() : 1.0);
     }
-    for(int i = 0; i < NR_POINT_LIGHTS; i++) {
-        if (!pointLights[i].enabled) continue;
-        result += CalcPointLight(pointLights[i]);
+
+    uvec2 range = texelFetch(clusterRanges, FindCluster()).xy;
+    for(uint i = 0u; i < range.y; i++) {
+        int index = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        LocalLight light = FetchLight(index);
+        result += CalcLocalLight(light, ComputeLightShadow(index, light));
     }
 
     FragColor = vec4(result, 1.0);
@@ -104,48 +134,122 @@ void main() {
 
 // Light Casters
 
-vec3 CalcDirLight(DirLight light) {
+vec3 CalcDirLight(DirLight light, float shadow) {
     vec3 ambient  = ComputeAmbient(light.ambient);
     vec3 diffuse  = ComputeDiffuse(light.diffuse, -light.direction);
     vec3 specular = ComputeSpecular(light.specular, -light.direction);
 
-    return ambient + diffuse + specular;
+    return ambient + (diffuse + specular) * shadow;
 }
 
-vec3 CalcPointLight(PointLight light) {
+vec3 CalcLocalLight(LocalLight light, float shadow) {
     vec3 lightDir = normalize(light.position - FragPos);
     float attenuation = ComputeAttenuation(light.position, light.constant, light.linear, light.quadratic);
+    float intensity = light.cutoff < -1.0 ? 1.0 : ComputeIntensity(light, -lightDir);
 
     vec3 ambient  = ComputeAmbient(light.ambient);
-    vec3 diffuse  = ComputeDiffuse(light.diffuse, lightDir);
+    vec3 diffuse = ComputeDiffuse(light.diffuse, lightDir);
     vec3 specular = ComputeSpecular(light.specular, lightDir);
 
-    ambient  *= attenuation;
-    diffuse  *= attenuation;
-    specular *= attenuation;
+    ambient *= attenuation;
+    diffuse *= attenuation * intensity * shadow;
+    specular *= attenuation * intensity * shadow;
 
     return ambient + diffuse + specular;
 }
 
-vec3 CalcSpotLight(SpotLight light) {
-    vec3 lightDir = normalize(light.position - FragPos);
-    float attenuation = ComputeAttenuation(light.position, light.constant, light.linear, light.quadratic);
-    float intensity = ComputeIntensity(light, -lightDir);
+// Shadows
+
+// 3x3 percentage closer filter in the first cascade reaching this deep, every tap a bilinear compare.
+// The position is pushed out along the normal by a texel or so, which keeps surfaces from shadowing
+// themselves where the offsets set while rendering the casters don't reach
+float ComputeShadow() {
+    if (shadowCascades == 0)
+        return 1.0;
+
+    float depth = -FragPos.z;
+    int cascade = 0;
+    while (cascade < shadowCascades - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+
+    vec3 position = FragPos + Normal * cascadeTexels[cascade] * 1.5;
+    vec3 coords = vec3(shadowMatrices[cascade] * vec4(position, 1.0));
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+        }
+    }
+    return depth > cascadeSplits[shadowCascades - 1] ? 1.0 : lit / 9.0;
+}
 
-    vec3 ambient  = ComputeAmbient(light.ambient);
-    vec3 diffuse = ComputeDiffuse(light.diffuse, lightDir);
-    vec3 specular = ComputeSpecular(light.specular, lightDir);
+// 2x2 bilinear compares in the light's tile, a point light's cube face is picked by the major axis of the
+// direction to the fragment in the order the atlas lays them out (+x, -x, +y, -y, +z, -z). The normal
+// offset is a texel and a half at the fragment's distance, like ComputeShadow
+float ComputeLightShadow(int index, LocalLight light) {
+    if (atlasShadows == 0)
+        return 1.0;
+    vec4 record = texelFetch(lightShadows, index);
+    if (record.x < 0.0)
+        return 1.0;
+
+    vec3 toFrag = FragPos - light.position;
+    int tile = int(record.x);
+    if (light.cutoff < -1.0) {
+        vec3 axis = mat3(inverseView) * toFrag;
+        vec3 size = abs(axis);
+        if (size.x >= size.y && size.x >= size.z)
+            tile += axis.x > 0.0 ? 0 : 1;
+        else if (size.y >= size.z)
+            tile += axis.y > 0.0 ? 2 : 3;
+        else
+            tile += axis.z > 0.0 ? 4 : 5;
+    }
 
-    ambient *= attenuation;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
+    vec3 position = FragPos + Normal * length(toFrag) * record.y * 1.5;
+    mat4 transform = mat4(texelFetch(shadowTiles, tile * 4), texelFetch(shadowTiles, tile * 4 + 1),
+                          texelFetch(shadowTiles, tile * 4 + 2), texelFetch(shadowTiles, tile * 4 + 3));
+    vec4 clip = transform * (inverseView * vec4(position, 1.0));
+    vec3 coords = clip.xyz / clip.w;
+    if (clip.w <= 0.0 || coords.z > 1.0)
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    float lit = 0.0;
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            lit += texture(shadowAtlas, vec3(coords.xy + (vec2(x, y) - 0.5) * texel, coords.z));
+        }
+    }
+    return lit * 0.25;
+}
 
-    return ambient + diffuse + specular;
+// Clusters
+
+int FindCluster() {
+    vec4 clip = projection * vec4(FragPos, 1.0);
+    vec2 tile = (clip.xy / clip.w * 0.5 + 0.5) * vec2(clusterGrid.xy);
+    int slice = int(floor(log(-FragPos.z) * clusterScale + clusterBias));
+
+    ivec3 cluster = clamp(ivec3(ivec2(tile), slice), ivec3(0), clusterGrid - 1);
+    return cluster.x + clusterGrid.x * (cluster.y + clusterGrid.y * cluster.z);
+}
+
+LocalLight FetchLight(int index) {
+    int base = index * 5;
+    vec4 t0 = texelFetch(clusterLights, base);
+    vec4 t1 = texelFetch(clusterLights, base + 1);
+    vec4 t2 = texelFetch(clusterLights, base + 2);
+    vec4 t3 = texelFetch(clusterLights, base + 3);
+    vec4 t4 = texelFetch(clusterLights, base + 4);
+
+    return LocalLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.xyz, t4.w);
 }
 
 // Helpers
 
-float ComputeIntensity(SpotLight light, vec3 lightDir) {
+float ComputeIntensity(LocalLight light, vec3 lightDir) {
     float theta = dot(lightDir, light.direction);
     float epsilon = light.cutoff - light.outerCutoff;
     return clamp((theta - light.outerCutoff) / epsilon, 0.0, 1.0);
@@ -157,28 +261,34 @@ float ComputeAttenuation(vec3 position, float c, float l, float q) {
 }
 
 vec3 ComputeDiffuse(vec3 color, vec3 lightDir) {
-    if (!diffuse)
-      return vec3(0);
-
+#ifndef DIFFUSE_MAP
+    return vec3(0);
+#else
     float diffuseAngle = max(dot(lightDir, Normal), 0.0);
-    vec3 emissivenes = emissionMap * (specularMap == vec3(0) ? vec3(1) : vec3(0));
-    vec3 emission = emissive ? emissivenes * (color * emissionStrength) * diffuseAngle : vec3(0);
+    vec3 diffuse = color * diffuseAngle * diffuseMap;
+#ifdef EMISSION_MAP
+    diffuse += emissionMap * (color * emissionStrength) * diffuseAngle;
+#endif
 
-    return color * diffuseAngle * diffuseMap + emission;
+    return diffuse;
+#endif
 }
 
 vec3 ComputeSpecular(vec3 color, vec3 lightDir) {
-    if (!specular)
-      return vec3(0);
-
+#ifndef SPECULAR_MAP
+    return vec3(0);
+#else
     vec3 viewDir = normalize(-FragPos);
     vec3 reflectDir = reflect(-lightDir, Normal);
     float shininess = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     return color * shininess * specularMap;
+#endif
 }
 
 vec3 ComputeAmbient(vec3 color) {
-  vec3 output = diffuse ? color * diffuseMap : color;
-
-  return output;
+#ifdef DIFFUSE_MAP
+  return color * diffuseMap;
+#else
+  return color;
+#endif
 }
\ No newline at end of file
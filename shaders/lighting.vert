@@ -3,6 +3,8 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
 
 out vec3 FragPos;
 out vec3 Normal;
@@ -11,11 +13,17 @@ out vec2 TexCoords;
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
-uniform mat3 normalView;
+uniform mat3 normalMatrix;
+uniform bool instanced;
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    FragPos = vec3(view * model * vec4(aPos, 1.0));
-    Normal = normalize(normalView * aNormal);
+    mat4 world = instanced ? aModel : model;
+    mat3 normalWorld = instanced ? aNormalMatrix : normalMatrix;
+    vec4 viewPos = view * world * vec4(aPos, 1.0);
+
+    gl_Position = projection * viewPos;
+    FragPos = vec3(viewPos);
+    // the view matrix is a rigid transform, so its upper 3x3 is its own normal matrix
+    Normal = normalize(mat3(view) * normalWorld * aNormal);
     TexCoords = aTexCoords;
 }
\ No newline at end of file
@@ -0,0 +1,5 @@
+#version 330 core
+
+// depth only, casters write nothing else
+void main() {
+}
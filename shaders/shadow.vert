@@ -0,0 +1,13 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aModel;
+
+uniform mat4 lightViewProjection;
+uniform mat4 model;
+uniform bool instanced;
+
+void main() {
+    mat4 world = instanced ? aModel : model;
+    gl_Position = lightViewProjection * world * vec4(aPos, 1.0);
+}
@@ -8,6 +8,10 @@
 #include "utils.hpp"
 #include "vertex_array.hpp"
 #include "editor.hpp"
+#include "resources.hpp"
+#include "gl_ext.hpp"
+#include "gl_stats.hpp"
+#include "profiler.hpp"
 
 #include <stb_image.hpp>
 #include <glm/glm.hpp>
@@ -24,46 +28,63 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 // body
 
 void Application::initialize(unsigned int screen_w, unsigned int screen_h, const char *label, Stage *stage_in) {
+  ProfileZone zone{"Application::initialize"};
+  {
+    ProfileZone glfw_zone{"glfw init"};
+    // initialize glfw
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    screen_width, screen_height = screen_w, screen_h;
+
+    // window creation
+    window_ = glfwCreateWindow(screen_w, screen_h, label, nullptr, nullptr);
+    if (window_ == nullptr) {
+      throw std::runtime_error("!failed to create glfw window");
+    }
 
-  // initialize glfw
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  screen_width, screen_height = screen_w, screen_h;
-
-  // window creation
-  window_ = glfwCreateWindow(screen_w, screen_h, label, nullptr, nullptr);
-  if (window_ == nullptr) {
-    throw std::runtime_error("!failed to create glfw window");
+    // configure glfw
+    glfwMakeContextCurrent(window_);
+    glfwSetFramebufferSizeCallback(window_, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window_, mouse_callback);
+    glfwSetScrollCallback(window_, scroll_callback);
+    glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
   }
 
-  // configure glfw
-  glfwMakeContextCurrent(window_);
-  glfwSetFramebufferSizeCallback(window_, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window_, mouse_callback);
-  glfwSetScrollCallback(window_, scroll_callback);
-  glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-
-  // load all OpenGL function pointers
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    glfwTerminate();
-    throw std::runtime_error("!failed to initialize glad");
+  {
+    ProfileZone glad_zone{"glad load"};
+    // load all OpenGL function pointers
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+      glfwTerminate();
+      throw std::runtime_error("!failed to initialize glad");
+    }
+    // optional, the stage falls back to cpu culling without it
+    load_gl_4_3((GLADloadproc)glfwGetProcAddress);
+    // optional too, without them every launch compiles its shaders one at a time
+    load_shader_extensions((GLADloadproc)glfwGetProcAddress);
   }
 
   // configure global opengl state
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_STENCIL_TEST);
 
-  initialize_imgui(window_);
+  {
+    ProfileZone imgui_zone{"imgui init"};
+    initialize_imgui(window_);
+  }
 
-  stage_in->setup();
+  {
+    ProfileZone setup_zone{"Stage::setup"};
+    stage_in->setup();
+  }
   stage = stage_in;
   glClearColor(stage->clear_.x, stage->clear_.y, stage->clear_.z, 1.0f);
 }
 
 void Application::input() {
+  ProfileZone zone{"Application::input"};
   glfwPollEvents();
 
   Camera &camera = stage->camera;
@@ -106,7 +127,10 @@ void Application::input() {
   if (glfwGetKey(window_, GLFW_KEY_E) == GLFW_PRESS) {
     light_offset += glm::vec3(0.0f, -1.0f, 0.0f);
   }
-  stage->spot_lights[0].position += light_offset * delta_time_;
+  if (light_offset != glm::vec3{0}) {
+    stage->spot_lights[0].position += light_offset * delta_time_;
+    stage->lights_dirty = true;
+  }
 
   if (glfwGetKey(window_, GLFW_KEY_C) == GLFW_PRESS) {
     if (!stage->can_press)
@@ -130,17 +154,29 @@ void Application::input() {
 }
 
 void Application::update(float delta_time) {
+  ProfileZone zone{"Application::update"};
   delta_time_ = delta_time;
   stage->update(delta_time);
 }
 
 void Application::render() {
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-
-  stage->render();
-  render_imgui(*stage);
+  {
+    ProfileZone zone{"Application::render"};
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    stage->render();
+    {
+      ProfileZone imgui_zone{"ImGui"};
+      GpuZone imgui_gpu_zone{"ImGui"};
+      render_imgui(*stage);
+    }
 
-  glfwSwapBuffers(window_);
+    ProfileZone swap_zone{"swap"};
+    glfwSwapBuffers(window_);
+  }
+  ResourceRegistry::instance().collect();
+  gl_stats().end_frame();
+  profiler().end_frame();
 }
 
 void Application::shutdown() {
@@ -148,6 +184,8 @@ void Application::shutdown() {
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
 
+  ResourceRegistry::instance().shutdown();
+  profiler().shutdown();
   glfwDestroyWindow(window_);
   glfwTerminate();
 }
@@ -0,0 +1,61 @@
+#include "bounds.hpp"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BOUNDS_SSE2
+#endif
+
+Frustum::Frustum(const glm::mat4 &view_projection) {
+  // Gribb & Hartmann: each plane is the w row plus or minus the x, y or z row of the matrix
+  glm::vec4 rows[4];
+  for (int i{0}; i < 4; i++) {
+    rows[i] = glm::vec4{view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]};
+  }
+  glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                         rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]};
+
+  for (int i{0}; i < 8; i++) {
+    glm::vec4 plane = {i < 6 ? planes[i] / glm::length(glm::vec3{planes[i]}) : glm::vec4{0.0f, 0.0f, 0.0f, 1.0f}};
+    nx_[i] = plane.x, ny_[i] = plane.y, nz_[i] = plane.z, d_[i] = plane.w;
+  }
+}
+
+auto Frustum::classify(const AABB &box) const -> Containment {
+  glm::vec3 center = {(box.min + box.max) * 0.5f};
+  glm::vec3 half = {(box.max - box.min) * 0.5f};
+
+#ifdef BOUNDS_SSE2
+  __m128 sign_mask = {_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))};
+  __m128 cx = {_mm_set1_ps(center.x)}, cy = {_mm_set1_ps(center.y)}, cz = {_mm_set1_ps(center.z)};
+  __m128 hx = {_mm_set1_ps(half.x)}, hy = {_mm_set1_ps(half.y)}, hz = {_mm_set1_ps(half.z)};
+  int outside{0}, inside{0};
+
+  for (int i{0}; i < 8; i += 4) {
+    __m128 nx = {_mm_load_ps(nx_ + i)}, ny = {_mm_load_ps(ny_ + i)}, nz = {_mm_load_ps(nz_ + i)};
+    // signed distance of the center and the box's projected radius onto each plane normal
+    __m128 dist = {_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                              _mm_add_ps(_mm_mul_ps(nz, cz), _mm_load_ps(d_ + i)))};
+    __m128 radius = {_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, sign_mask), hx), _mm_mul_ps(_mm_and_ps(ny, sign_mask), hy)),
+                                _mm_mul_ps(_mm_and_ps(nz, sign_mask), hz))};
+    outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+    inside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), _mm_setzero_ps()));
+  }
+
+  if (outside != 0)
+    return Containment::OUTSIDE;
+  return inside == 0 ? Containment::INSIDE : Containment::INTERSECTS;
+#else
+  Containment result = {Containment::INSIDE};
+  for (int i{0}; i < 6; i++) {
+    float dist = {nx_[i] * center.x + ny_[i] * center.y + nz_[i] * center.z + d_[i]};
+    float radius = {std::abs(nx_[i]) * half.x + std::abs(ny_[i]) * half.y + std::abs(nz_[i]) * half.z};
+    if (dist + radius < 0.0f)
+      return Containment::OUTSIDE;
+    if (dist - radius < 0.0f)
+      result = Containment::INTERSECTS;
+  }
+  return result;
+#endif
+}
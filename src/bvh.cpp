@@ -0,0 +1,189 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+auto DynamicBvh::allocate_node() -> int {
+  if (free_list_ == -1) {
+    nodes_.emplace_back();
+    return static_cast<int>(nodes_.size()) - 1;
+  }
+
+  int node = {free_list_};
+  free_list_ = nodes_[node].parent;
+  nodes_[node] = BvhNode{};
+  return node;
+}
+
+void DynamicBvh::free_node(int node) {
+  nodes_[node].parent = free_list_;
+  nodes_[node].height = -1;
+  free_list_ = node;
+}
+
+auto DynamicBvh::create_proxy(const AABB &box, unsigned int user) -> int {
+  int proxy = {allocate_node()};
+  nodes_[proxy].box = box.fattened(MARGIN);
+  nodes_[proxy].user = user;
+  insert_leaf(proxy);
+  proxy_count_++;
+  return proxy;
+}
+
+void DynamicBvh::destroy_proxy(int proxy) {
+  remove_leaf(proxy);
+  free_node(proxy);
+  proxy_count_--;
+}
+
+auto DynamicBvh::move_proxy(int proxy, const AABB &box) -> bool {
+  if (nodes_[proxy].box.contains(box))
+    return false;
+
+  remove_leaf(proxy);
+  nodes_[proxy].box = box.fattened(MARGIN);
+  insert_leaf(proxy);
+  return true;
+}
+
+void DynamicBvh::insert_leaf(int leaf) {
+  if (root_ == -1) {
+    root_ = leaf;
+    nodes_[root_].parent = -1;
+    return;
+  }
+
+  // walk down towards the sibling whose enlargement costs the least surface area
+  AABB box = {nodes_[leaf].box};
+  int index = {root_};
+  while (!nodes_[index].leaf()) {
+    int left = {nodes_[index].left};
+    int right = {nodes_[index].right};
+
+    float area = {nodes_[index].box.perimeter()};
+    float combined = {nodes_[index].box.merged(box).perimeter()};
+    // cost of making a new parent for this node and the leaf, and the minimum cost pushed further down
+    float cost = {2.0f * combined};
+    float inheritance = {2.0f * (combined - area)};
+
+    auto descend_cost = [&](int child) {
+      float grown = {nodes_[child].box.merged(box).perimeter()};
+      return nodes_[child].leaf() ? grown + inheritance : grown - nodes_[child].box.perimeter() + inheritance;
+    };
+    float left_cost = {descend_cost(left)};
+    float right_cost = {descend_cost(right)};
+
+    if (cost < left_cost && cost < right_cost)
+      break;
+    index = left_cost < right_cost ? left : right;
+  }
+
+  int sibling = {index};
+  int old_parent = {nodes_[sibling].parent};
+  int new_parent = {allocate_node()};
+  nodes_[new_parent].parent = old_parent;
+  nodes_[new_parent].box = nodes_[sibling].box.merged(box);
+  nodes_[new_parent].height = nodes_[sibling].height + 1;
+  nodes_[new_parent].left = sibling;
+  nodes_[new_parent].right = leaf;
+  nodes_[sibling].parent = new_parent;
+  nodes_[leaf].parent = new_parent;
+
+  if (old_parent == -1) {
+    root_ = new_parent;
+  } else if (nodes_[old_parent].left == sibling) {
+    nodes_[old_parent].left = new_parent;
+  } else {
+    nodes_[old_parent].right = new_parent;
+  }
+
+  refit(nodes_[leaf].parent);
+}
+
+void DynamicBvh::remove_leaf(int leaf) {
+  if (leaf == root_) {
+    root_ = -1;
+    return;
+  }
+
+  int parent = {nodes_[leaf].parent};
+  int grand_parent = {nodes_[parent].parent};
+  int sibling = {nodes_[parent].left == leaf ? nodes_[parent].right : nodes_[parent].left};
+
+  if (grand_parent == -1) {
+    root_ = sibling;
+    nodes_[sibling].parent = -1;
+    free_node(parent);
+    return;
+  }
+
+  // the sibling takes the parent's place
+  if (nodes_[grand_parent].left == parent) {
+    nodes_[grand_parent].left = sibling;
+  } else {
+    nodes_[grand_parent].right = sibling;
+  }
+  nodes_[sibling].parent = grand_parent;
+  free_node(parent);
+
+  refit(grand_parent);
+}
+
+// walks up from index restoring heights and boxes, rotating wherever the tree leans
+void DynamicBvh::refit(int index) {
+  while (index != -1) {
+    index = balance(index);
+
+    int left = {nodes_[index].left};
+    int right = {nodes_[index].right};
+    nodes_[index].height = 1 + std::max(nodes_[left].height, nodes_[right].height);
+    nodes_[index].box = nodes_[left].box.merged(nodes_[right].box);
+
+    index = nodes_[index].parent;
+  }
+}
+
+// promotes the taller child of a when the subtree is unbalanced, returns the subtree's new root
+auto DynamicBvh::balance(int a) -> int {
+  BvhNode &node_a = {nodes_[a]};
+  if (node_a.leaf() || node_a.height < 2)
+    return a;
+
+  int b = {node_a.left};
+  int c = {node_a.right};
+  int lean = {nodes_[c].height - nodes_[b].height};
+  if (std::abs(lean) <= 1)
+    return a;
+
+  // rotate the taller child up, its taller grandchild stays with it and the shorter one moves under a
+  int up = {lean > 0 ? c : b};
+  int other = {lean > 0 ? b : c};
+  int f = {nodes_[up].left};
+  int g = {nodes_[up].right};
+  int keep = {nodes_[f].height > nodes_[g].height ? f : g};
+  int give = {keep == f ? g : f};
+
+  nodes_[up].left = a;
+  nodes_[up].right = keep;
+  nodes_[up].parent = nodes_[a].parent;
+  nodes_[a].parent = up;
+
+  if (nodes_[up].parent == -1) {
+    root_ = up;
+  } else if (nodes_[nodes_[up].parent].left == a) {
+    nodes_[nodes_[up].parent].left = up;
+  } else {
+    nodes_[nodes_[up].parent].right = up;
+  }
+
+  nodes_[a].left = other;
+  nodes_[a].right = give;
+  nodes_[give].parent = a;
+  nodes_[a].box = nodes_[other].box.merged(nodes_[give].box);
+  nodes_[a].height = 1 + std::max(nodes_[other].height, nodes_[give].height);
+
+  nodes_[up].box = nodes_[a].box.merged(nodes_[keep].box);
+  nodes_[up].height = 1 + std::max(nodes_[a].height, nodes_[keep].height);
+
+  return up;
+}
@@ -0,0 +1,53 @@
+#include "camera_path.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+auto load_camera_path(const std::string &path, std::vector<PathKey> &keys) -> bool {
+  std::ifstream file{path};
+  if (!file)
+    return false;
+
+  keys.clear();
+  std::string line{};
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields{line};
+    PathKey key{};
+    if (!(fields >> key.time))
+      continue;
+    fields >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch >> key.light.x >> key.light.y >> key.light.z;
+    if (fields.fail())
+      return false;
+    keys.push_back(key);
+  }
+  return !keys.empty();
+}
+
+auto write_camera_path(const std::string &path, const std::vector<PathKey> &keys) -> bool {
+  std::ofstream file{path};
+  if (!file)
+    return false;
+
+  file << "# time  x y z  yaw pitch  light_x light_y light_z\n";
+  for (const PathKey &key : keys) {
+    file << key.time << "  " << key.position.x << ' ' << key.position.y << ' ' << key.position.z << "  " << key.yaw << ' '
+         << key.pitch << "  " << key.light.x << ' ' << key.light.y << ' ' << key.light.z << '\n';
+  }
+  return static_cast<bool>(file);
+}
+
+auto sample_camera_path(const std::vector<PathKey> &keys, float time) -> PathKey {
+  auto after = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const PathKey &key) { return t < key.time; });
+  if (after == keys.begin())
+    return keys.front();
+  if (after == keys.end())
+    return keys.back();
+
+  const PathKey &a = {*(after - 1)};
+  const PathKey &b = {*after};
+  float t = {(time - a.time) / std::max(b.time - a.time, 1e-6f)};
+  return PathKey{time, glm::mix(a.position, b.position, t), glm::mix(a.yaw, b.yaw, t), glm::mix(a.pitch, b.pitch, t),
+                 glm::mix(a.light, b.light, t)};
+}
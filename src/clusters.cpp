@@ -0,0 +1,209 @@
+#include "clusters.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLUSTERS_SSE2
+#endif
+
+// everything closer than this shares the first depth slice, exponential slicing from the real near plane
+// would otherwise spend most slices on the first few centimeters
+constexpr float CLUSTER_NEAR = {0.5f};
+// below this many lights the cost of waking worker threads outweighs the assignment itself
+constexpr size_t PARALLEL_LIGHTS = {256};
+
+// lights as structure of arrays padded to a multiple of 4, padding never intersects anything
+struct LightLanes {
+  std::vector<float> x, y, z, r2;
+  std::vector<unsigned int> index;
+
+  void clear() {
+    x.clear(), y.clear(), z.clear(), r2.clear(), index.clear();
+  }
+
+  void push(const LightBounds &light, unsigned int i) {
+    x.push_back(light.position.x), y.push_back(light.position.y), z.push_back(light.position.z);
+    r2.push_back(light.radius * light.radius);
+    index.push_back(i);
+  }
+
+  void pad() {
+    while (index.size() % 4 != 0) {
+      x.push_back(0.0f), y.push_back(0.0f), z.push_back(0.0f), r2.push_back(-1.0f);
+      index.push_back(0);
+    }
+  }
+};
+
+// one bit per lane for the 4 spheres starting at i that touch the box
+static unsigned int sphere_box_mask(const LightLanes &lanes, size_t i, const glm::vec3 &lo, const glm::vec3 &hi) {
+#ifdef CLUSTERS_SSE2
+  __m128 zero = {_mm_setzero_ps()};
+  __m128 x = {_mm_loadu_ps(&lanes.x[i])};
+  __m128 y = {_mm_loadu_ps(&lanes.y[i])};
+  __m128 z = {_mm_loadu_ps(&lanes.z[i])};
+  __m128 dx = {_mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(lo.x), x), _mm_sub_ps(x, _mm_set1_ps(hi.x))), zero)};
+  __m128 dy = {_mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(lo.y), y), _mm_sub_ps(y, _mm_set1_ps(hi.y))), zero)};
+  __m128 dz = {_mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(lo.z), z), _mm_sub_ps(z, _mm_set1_ps(hi.z))), zero)};
+  __m128 d2 = {_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz))};
+  return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&lanes.r2[i]))));
+#else
+  unsigned int mask{0};
+  for (size_t k{0}; k < 4; k++) {
+    float dx{std::max(std::max(lo.x - lanes.x[i + k], lanes.x[i + k] - hi.x), 0.0f)};
+    float dy{std::max(std::max(lo.y - lanes.y[i + k], lanes.y[i + k] - hi.y), 0.0f)};
+    float dz{std::max(std::max(lo.z - lanes.z[i + k], lanes.z[i + k] - hi.z), 0.0f)};
+    if (dx * dx + dy * dy + dz * dz <= lanes.r2[i + k])
+      mask |= 1u << k;
+  }
+  return mask;
+#endif
+}
+
+void ClusterGrid::set_projection(float fov_y, float aspect, float near, float far) {
+  if (fov_y == fov_y_ && aspect == aspect_ && near == near_ && far == far_ && !min_.empty())
+    return;
+
+  fov_y_ = fov_y, aspect_ = aspect, near_ = near, far_ = far;
+
+  float cluster_near = {std::max(near, std::min(CLUSTER_NEAR, far * 0.5f))};
+  float log_range = {std::log(far / cluster_near)};
+  slice_scale_ = SLICES / log_range;
+  slice_bias_ = -(SLICES * std::log(cluster_near)) / log_range;
+
+  float tan_y = {std::tan(fov_y * 0.5f)};
+  float tan_x = {tan_y * aspect};
+
+  min_.resize(COUNT);
+  max_.resize(COUNT);
+  for (unsigned int z{0}; z < SLICES; z++) {
+    float d0 = {z == 0 ? near : cluster_near * std::pow(far / cluster_near, float(z) / SLICES)};
+    float d1 = {cluster_near * std::pow(far / cluster_near, float(z + 1) / SLICES)};
+
+    for (unsigned int y{0}; y < TILES_Y; y++) {
+      float y0 = {(-1.0f + 2.0f * y / TILES_Y) * tan_y};
+      float y1 = {(-1.0f + 2.0f * (y + 1) / TILES_Y) * tan_y};
+
+      for (unsigned int x{0}; x < TILES_X; x++) {
+        float x0 = {(-1.0f + 2.0f * x / TILES_X) * tan_x};
+        float x1 = {(-1.0f + 2.0f * (x + 1) / TILES_X) * tan_x};
+
+        // the tile's side planes pass through the eye, so its extremes are at either end of the slice
+        unsigned int c = {cluster_of(x, y, z)};
+        min_[c] = glm::vec3{std::min(x0 * d0, x0 * d1), std::min(y0 * d0, y0 * d1), -d1};
+        max_[c] = glm::vec3{std::max(x1 * d0, x1 * d1), std::max(y1 * d0, y1 * d1), -d0};
+      }
+    }
+  }
+}
+
+auto ClusterGrid::slice_of(float depth) const -> int {
+  int slice = {static_cast<int>(std::floor(std::log(std::max(depth, 1e-6f)) * slice_scale_ + slice_bias_))};
+  return std::clamp(slice, 0, static_cast<int>(SLICES) - 1);
+}
+
+void ClusterGrid::assign(const std::vector<LightBounds> &lights, bool parallel) {
+  ranges_.assign(COUNT, ClusterRange{0, 0});
+  indices_.clear();
+  slice_lights_.resize(SLICES);
+  slice_indices_.resize(SLICES);
+  for (unsigned int z{0}; z < SLICES; z++) {
+    slice_lights_[z].clear();
+  }
+
+  // bin lights into every depth slice their sphere overlaps
+  for (size_t i{0}; i < lights.size(); i++) {
+    float depth = {-lights[i].position.z};
+    float radius = {lights[i].radius};
+    if (depth + radius < near_ || depth - radius > far_)
+      continue;
+
+    int first = {slice_of(std::max(depth - radius, near_))};
+    int last = {slice_of(std::min(depth + radius, far_))};
+    for (int z{first}; z <= last; z++) {
+      slice_lights_[z].push_back(static_cast<unsigned int>(i));
+    }
+  }
+
+  // slices are independent, workers pull them one at a time so uneven near and far slices balance out
+  if (parallel && lights.size() >= PARALLEL_LIGHTS) {
+    worker_pool().parallel_for(SLICES, [&](unsigned int z) { assign_slice(z, lights); });
+  } else {
+    for (unsigned int z{0}; z < SLICES; z++) {
+      assign_slice(z, lights);
+    }
+  }
+
+  // concatenate the per slice lists, their ranges are relative to the slice until now
+  for (unsigned int z{0}; z < SLICES; z++) {
+    unsigned int base = {static_cast<unsigned int>(indices_.size())};
+    for (unsigned int c{cluster_of(0, 0, z)}; c < cluster_of(0, 0, z + 1); c++) {
+      ranges_[c].offset += base;
+    }
+    indices_.insert(indices_.end(), slice_indices_[z].begin(), slice_indices_[z].end());
+  }
+}
+
+void ClusterGrid::assign_slice(unsigned int z, const std::vector<LightBounds> &lights) {
+  thread_local LightLanes slice_lanes{};
+  thread_local LightLanes column_lanes{};
+
+  std::vector<unsigned int> &out = {slice_indices_[z]};
+  out.clear();
+
+  slice_lanes.clear();
+  for (unsigned int i : slice_lights_[z]) {
+    slice_lanes.push(lights[i], i);
+  }
+  slice_lanes.pad();
+
+  for (unsigned int x{0}; x < TILES_X; x++) {
+    // narrow the candidates down to this column of tiles first, then test its clusters one by one
+    glm::vec3 column_min = {min_[cluster_of(x, 0, z)]};
+    glm::vec3 column_max = {max_[cluster_of(x, 0, z)]};
+    for (unsigned int y{1}; y < TILES_Y; y++) {
+      column_min = glm::min(column_min, min_[cluster_of(x, y, z)]);
+      column_max = glm::max(column_max, max_[cluster_of(x, y, z)]);
+    }
+
+    column_lanes.clear();
+    for (size_t i{0}; i < slice_lanes.index.size(); i += 4) {
+      unsigned int mask = {sphere_box_mask(slice_lanes, i, column_min, column_max)};
+      for (size_t k{0}; mask != 0; k++, mask >>= 1) {
+        if (mask & 1u)
+          column_lanes.push(lights[slice_lanes.index[i + k]], slice_lanes.index[i + k]);
+      }
+    }
+    column_lanes.pad();
+
+    for (unsigned int y{0}; y < TILES_Y; y++) {
+      unsigned int c = {cluster_of(x, y, z)};
+      unsigned int offset = {static_cast<unsigned int>(out.size())};
+
+      for (size_t i{0}; i < column_lanes.index.size(); i += 4) {
+        unsigned int mask = {sphere_box_mask(column_lanes, i, min_[c], max_[c])};
+        for (size_t k{0}; mask != 0; k++, mask >>= 1) {
+          if (mask & 1u)
+            out.push_back(column_lanes.index[i + k]);
+        }
+      }
+      ranges_[c] = ClusterRange{offset, static_cast<unsigned int>(out.size()) - offset};
+    }
+  }
+}
+
+float attenuation_range(float intensity, float constant, float linear, float quadratic) {
+  // solve intensity / (c + l * d + q * d^2) = 1 / 256 for d
+  float target = {intensity * 256.0f};
+  if (target <= constant)
+    return 0.0f;
+  if (quadratic > 0.0f)
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - target))) / (2.0f * quadratic);
+  if (linear > 0.0f)
+    return (target - constant) / linear;
+  return std::numeric_limits<float>::max();
+}
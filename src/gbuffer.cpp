@@ -0,0 +1,125 @@
+#include "gbuffer.hpp"
+#include "resources.hpp"
+
+#include <glad/glad.h>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+
+GBuffer::~GBuffer() {
+  release();
+}
+
+void GBuffer::release() {
+  if (!ready())
+    return;
+  ResourceRegistry &registry = {ResourceRegistry::instance()};
+  for (unsigned int texture : textures_) {
+    registry.defer_delete_texture(texture);
+  }
+  registry.defer_delete_framebuffer(framebuffer_);
+  width_ = height_ = 0;
+}
+
+void GBuffer::setup(unsigned int width, unsigned int height) {
+  release();
+  width_ = width;
+  height_ = height;
+  int framebuffer = {0};
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+  struct Format {
+    GLenum internal;
+    GLenum format;
+    GLenum type;
+  };
+  const Format formats[GBUFFER_TARGETS] = {{GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+                                           {GL_RG16F, GL_RG, GL_HALF_FLOAT},
+                                           {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+                                           {GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8}};
+  glGenTextures(GBUFFER_TARGETS, textures_);
+  for (unsigned int i{0}; i < GBUFFER_TARGETS; i++) {
+    glBindTexture(GL_TEXTURE_2D, textures_[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, formats[i].internal, width, height, 0, formats[i].format, formats[i].type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  const GLenum attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+  for (unsigned int i{0}; i < GBUFFER_DEPTH; i++) {
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, textures_[i], 0);
+  }
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, textures_[GBUFFER_DEPTH], 0);
+  glDrawBuffers(3, attachments);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void GBuffer::fit_viewport() {
+  int viewport[4] = {};
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  // a minimized window has no size, the old targets are kept until it is back
+  if (viewport[2] <= 0 || viewport[3] <= 0)
+    return;
+  unsigned int width = {static_cast<unsigned int>(viewport[2])};
+  unsigned int height = {static_cast<unsigned int>(viewport[3])};
+  if (width != width_ || height != height_)
+    setup(width, height);
+}
+
+void GBuffer::begin() {
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &saved_framebuffer_);
+  glGetIntegerv(GL_VIEWPORT, saved_viewport_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glViewport(0, 0, static_cast<int>(width_), static_cast<int>(height_));
+  const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (int i{0}; i < static_cast<int>(GBUFFER_DEPTH); i++) {
+    glClearBufferfv(GL_COLOR, i, zero);
+  }
+  glStencilMask(0xff);
+  glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+  stencil_test_ = glIsEnabled(GL_STENCIL_TEST) == GL_TRUE;
+  glEnable(GL_STENCIL_TEST);
+  glStencilFunc(GL_ALWAYS, 1, 0xff);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+}
+
+void GBuffer::end() {
+  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  glStencilFunc(GL_ALWAYS, 0, 0xff);
+  if (!stencil_test_)
+    glDisable(GL_STENCIL_TEST);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, saved_framebuffer_);
+  int width = {static_cast<int>(width_)};
+  int height = {static_cast<int>(height_)};
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, saved_framebuffer_);
+  glViewport(saved_viewport_[0], saved_viewport_[1], saved_viewport_[2], saved_viewport_[3]);
+}
+
+auto light_volume_sphere(unsigned int rings, unsigned int segments) -> std::vector<glm::vec3> {
+  // a face's center sits closest to the origin, at the product of both half step cosines
+  float scale = {1.0f / (std::cos(glm::pi<float>() / rings * 0.5f) * std::cos(glm::pi<float>() / segments))};
+  auto point = [&](unsigned int ring, unsigned int segment) {
+    float theta = {glm::pi<float>() * ring / rings};
+    float phi = {glm::two_pi<float>() * segment / segments};
+    return glm::vec3{std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)} * scale;
+  };
+
+  std::vector<glm::vec3> triangles;
+  for (unsigned int ring{0}; ring < rings; ring++) {
+    for (unsigned int segment{0}; segment < segments; segment++) {
+      glm::vec3 a = {point(ring, segment)};
+      glm::vec3 b = {point(ring + 1, segment)};
+      glm::vec3 c = {point(ring + 1, segment + 1)};
+      glm::vec3 d = {point(ring, segment + 1)};
+      triangles.insert(triangles.end(), {a, c, b, a, d, c});
+    }
+  }
+  return triangles;
+}
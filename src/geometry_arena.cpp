@@ -0,0 +1,195 @@
+#include "geometry_arena.hpp"
+#include "gl_stats.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+// starting sizes, 2 MB of float vertices and 1 MB of indices
+constexpr size_t INITIAL_VERTICES = {1 << 16};
+constexpr size_t INITIAL_INDEX_BYTES = {1 << 20};
+// index ranges start 4 byte aligned so 32 bit indices can follow 16 bit ones
+constexpr size_t INDEX_ALIGNMENT = {4};
+
+void RangeAllocator::grow(size_t capacity) {
+  if (capacity <= capacity_)
+    return;
+  used_ += capacity - capacity_;
+  release(capacity_, capacity - capacity_);
+  capacity_ = capacity;
+}
+
+auto RangeAllocator::allocate(size_t size, size_t alignment) -> size_t {
+  if (size == 0)
+    return 0;
+
+  for (auto it = free_.begin(); it != free_.end(); it++) {
+    size_t block = {it->first};
+    size_t block_end = {block + it->second};
+    size_t offset = {(block + alignment - 1) / alignment * alignment};
+    if (offset + size > block_end)
+      continue;
+
+    free_.erase(it);
+    if (offset > block)
+      free_.emplace(block, offset - block);
+    if (offset + size < block_end)
+      free_.emplace(offset + size, block_end - offset - size);
+    used_ += size;
+    return offset;
+  }
+  return INVALID;
+}
+
+void RangeAllocator::release(size_t offset, size_t size) {
+  if (size == 0)
+    return;
+
+  used_ -= size;
+  auto next = free_.lower_bound(offset);
+  // merge into the block before, then swallow the one after
+  if (next != free_.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      offset = previous->first;
+      size += previous->second;
+      free_.erase(previous);
+    }
+  }
+  if (next != free_.end() && offset + size == next->first) {
+    size += next->second;
+    free_.erase(next);
+  }
+  free_.emplace(offset, size);
+}
+
+auto RangeAllocator::largest_free() const -> size_t {
+  size_t largest{0};
+  for (const auto &[offset, size] : free_) {
+    largest = std::max(largest, size);
+  }
+  return largest;
+}
+
+GeometryArena::GeometryArena(VertexFormat format)
+    : format_{format}, stride_{format == VertexFormat::QUANTIZED ? sizeof(PackedVertex) : sizeof(Vertex)} {}
+
+auto GeometryArena::allocate(const void *vertices, size_t vertex_count, const void *indices, size_t index_count,
+                             size_t index_size) -> GpuMesh {
+  std::lock_guard<std::mutex> lock{mutex_};
+  size_t index_bytes = {index_count * index_size};
+  size_t first_vertex = {vertex_ranges_.allocate(vertex_count)};
+  size_t index_offset = {index_ranges_.allocate(index_bytes, INDEX_ALIGNMENT)};
+  if (first_vertex == RangeAllocator::INVALID || index_offset == RangeAllocator::INVALID) {
+    if (first_vertex != RangeAllocator::INVALID)
+      vertex_ranges_.release(first_vertex, vertex_count);
+    if (index_offset != RangeAllocator::INVALID)
+      index_ranges_.release(index_offset, index_bytes);
+    reserve(vertex_count, index_bytes + INDEX_ALIGNMENT);
+    first_vertex = vertex_ranges_.allocate(vertex_count);
+    index_offset = index_ranges_.allocate(index_bytes, INDEX_ALIGNMENT);
+  }
+
+  // the copy targets leave the element binding of whatever vao is bound alone
+  glBindBuffer(GL_COPY_WRITE_BUFFER, vbo_);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, first_vertex * stride_, vertex_count * stride_, vertices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, ebo_);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, index_offset, index_bytes, indices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  gl_stats().add(BUFFER_BYTES, vertex_count * stride_ + index_bytes);
+
+  allocations_++;
+  GLenum index_type = {static_cast<GLenum>(index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT)};
+  return GpuMesh{vao_, this, first_vertex, vertex_count, index_offset, index_count, index_type};
+}
+
+void GeometryArena::release(const GpuMesh &mesh) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  size_t index_size = {mesh.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int)};
+  vertex_ranges_.release(mesh.first_vertex, mesh.vertex_count);
+  index_ranges_.release(mesh.index_offset, mesh.index_count * index_size);
+  allocations_--;
+}
+
+auto GeometryArena::stats() -> GeometryArenaStats {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto fragmentation = [](const RangeAllocator &ranges) {
+    size_t free_total = {ranges.capacity() - ranges.used()};
+    return free_total ? 1.0f - static_cast<float>(ranges.largest_free()) / free_total : 0.0f;
+  };
+  return GeometryArenaStats{vertex_ranges_.capacity(),
+                            vertex_ranges_.used(),
+                            index_ranges_.capacity(),
+                            index_ranges_.used(),
+                            allocations_,
+                            vertex_ranges_.free_blocks() + index_ranges_.free_blocks(),
+                            std::max(fragmentation(vertex_ranges_), fragmentation(index_ranges_))};
+}
+
+// grows both buffers to fit at least the given extra space, keeping everything already placed
+void GeometryArena::reserve(size_t vertex_count, size_t index_bytes) {
+  auto grown = [](size_t capacity, size_t needed, size_t initial) {
+    size_t size = {std::max(capacity, initial)};
+    while (size < capacity + needed) {
+      size *= 2;
+    }
+    return size;
+  };
+  auto resize = [](unsigned int &buffer, size_t old_size, size_t new_size) {
+    unsigned int replacement{};
+    glGenBuffers(1, &replacement);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, replacement);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+    if (buffer != 0 && old_size != 0) {
+      glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    buffer = replacement;
+  };
+
+  size_t vertex_capacity = {grown(vertex_ranges_.capacity(), vertex_count, INITIAL_VERTICES)};
+  size_t index_capacity = {grown(index_ranges_.capacity(), index_bytes, INITIAL_INDEX_BYTES)};
+  if (vertex_capacity != vertex_ranges_.capacity() || vbo_ == 0) {
+    resize(vbo_, vertex_ranges_.capacity() * stride_, vertex_capacity * stride_);
+    vertex_ranges_.grow(vertex_capacity);
+  }
+  if (index_capacity != index_ranges_.capacity() || ebo_ == 0) {
+    resize(ebo_, index_ranges_.capacity(), index_capacity);
+    index_ranges_.grow(index_capacity);
+  }
+  configure_attributes();
+}
+
+// points the vao at the current buffers
+void GeometryArena::configure_attributes() {
+  if (vao_ == 0)
+    glGenVertexArrays(1, &vao_);
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  if (format_ == VertexFormat::QUANTIZED) {
+    // the shader sees positions in [0, 1], normals in [-1, 1] and plain float uvs
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void *)offsetof(PackedVertex, position));
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void *)offsetof(PackedVertex, normal));
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void *)offsetof(PackedVertex, tex_coords));
+  } else {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, normal));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, tex_coords));
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// never destroyed, a mesh held by a static can be released after every other static is gone
+auto geometry_arena(VertexFormat format) -> GeometryArena & {
+  static GeometryArena *float_arena = {new GeometryArena{VertexFormat::FLOAT}};
+  static GeometryArena *quantized_arena = {new GeometryArena{VertexFormat::QUANTIZED}};
+  return format == VertexFormat::QUANTIZED ? *quantized_arena : *float_arena;
+}
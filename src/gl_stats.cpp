@@ -0,0 +1,58 @@
+#include "gl_stats.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+auto frame_counter_name(FrameCounter counter) -> const char * {
+  static const char *names[FRAME_COUNTERS] = {"draw_calls", "triangles",     "uniform_uploads", "program_binds",
+                                              "vao_binds",  "texture_binds", "buffer_bytes",    "texture_bytes"};
+  return names[counter];
+}
+
+void GlStats::end_frame() {
+  history_[next_] = current_;
+  next_ = (next_ + 1) % HISTORY;
+  recorded_ = std::min(recorded_ + 1, HISTORY);
+  current_ = {};
+}
+
+auto GlStats::recorded(size_t index) const -> const Frame & {
+  return history_[(next_ + HISTORY - recorded_ + index) % HISTORY];
+}
+
+auto GlStats::last(FrameCounter counter) const -> size_t {
+  return recorded_ == 0 ? 0 : recorded(recorded_ - 1)[counter];
+}
+
+auto GlStats::series(FrameCounter counter, float *out) const -> size_t {
+  for (size_t i{0}; i < recorded_; i++) {
+    out[i] = static_cast<float>(recorded(i)[counter]);
+  }
+  return recorded_;
+}
+
+auto GlStats::write_csv(const std::string &path) const -> bool {
+  std::ofstream file{path};
+  if (!file)
+    return false;
+
+  file << "frame";
+  for (unsigned int i{0}; i < FRAME_COUNTERS; i++) {
+    file << ',' << frame_counter_name(static_cast<FrameCounter>(i));
+  }
+  file << '\n';
+
+  for (size_t frame{0}; frame < recorded_; frame++) {
+    file << frame;
+    for (size_t value : recorded(frame)) {
+      file << ',' << value;
+    }
+    file << '\n';
+  }
+  return static_cast<bool>(file);
+}
+
+auto gl_stats() -> GlStats & {
+  static GlStats stats{};
+  return stats;
+}
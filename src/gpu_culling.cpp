@@ -0,0 +1,166 @@
+#include "gpu_culling.hpp"
+#include "gl_ext.hpp"
+#include "gl_stats.hpp"
+#include "profiler.hpp"
+#include "resources.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+constexpr unsigned int CULL_GROUP_SIZE = {64}; // local_size_x of cull.comp
+constexpr unsigned int OBJECTS_BINDING = {0};
+constexpr unsigned int COMMANDS_BINDING = {1};
+constexpr unsigned int INSTANCES_BINDING = {2};
+
+GpuCulling::~GpuCulling() {
+  ResourceRegistry &registry = {ResourceRegistry::instance()};
+  registry.defer_delete_buffer(object_buffer_);
+  registry.defer_delete_buffer(command_buffer_);
+  registry.defer_delete_buffer(instance_buffer_);
+}
+
+auto GpuCulling::setup() -> bool {
+  if (!has_gl_4_3())
+    return false;
+
+  shader_ = Shader{"shaders/cull.comp"};
+  planes_ = shader_.uniform<glm::vec4>("planes");
+  object_count_ = shader_.uniform<int>("objectCount");
+  frustum_culling_ = shader_.uniform<bool>("frustumCulling");
+  glGenBuffers(1, &object_buffer_);
+  glGenBuffers(1, &command_buffer_);
+  glGenBuffers(1, &instance_buffer_);
+  ready_ = true;
+  return true;
+}
+
+auto GpuCulling::add_draw(unsigned int count, unsigned int first, int base_vertex, unsigned int index_type) -> unsigned int {
+  commands_.push_back(IndirectCommand{count, 0, first, base_vertex, 0});
+  draw_objects_.push_back(0);
+  draw_indexed_.push_back(index_type != 0);
+  layout_dirty_ = true;
+  return static_cast<unsigned int>(commands_.size() - 1);
+}
+
+void GpuCulling::set_range(unsigned int draw, unsigned int count, unsigned int first) {
+  commands_[draw].count = count;
+  commands_[draw].first = first;
+}
+
+auto GpuCulling::add_object(unsigned int draw, const glm::mat4 &model, const glm::mat3 &normal, const AABB &bounds)
+    -> unsigned int {
+  objects_.push_back(GpuObject{});
+  draw_objects_[draw]++;
+  layout_dirty_ = true;
+  unsigned int object = {static_cast<unsigned int>(objects_.size() - 1)};
+  objects_[object].draw = draw;
+  move_object(object, model, normal, bounds);
+  return object;
+}
+
+void GpuCulling::move_object(unsigned int object, const glm::mat4 &model, const glm::mat3 &normal, const AABB &bounds) {
+  GpuObject &target = {objects_[object]};
+  target.model = model;
+  for (int i{0}; i < 3; i++) {
+    target.normal[i] = glm::vec4{normal[i], 0.0f};
+  }
+  target.bounds_min = bounds.min;
+  target.bounds_max = bounds.max;
+
+  if (dirty_first_ == dirty_last_) {
+    dirty_first_ = object;
+    dirty_last_ = object + 1;
+  } else {
+    dirty_first_ = std::min(dirty_first_, size_t{object});
+    dirty_last_ = std::max(dirty_last_, size_t{object} + 1);
+  }
+}
+
+void GpuCulling::clear() {
+  objects_.clear();
+  commands_.clear();
+  draw_objects_.clear();
+  draw_indexed_.clear();
+  dirty_first_ = dirty_last_ = 0;
+  layout_dirty_ = true;
+}
+
+void GpuCulling::attach(unsigned int vao) {
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+  // the model matrix's 4 columns, then the normal matrix's 3
+  for (unsigned int i{0}; i < 7; i++) {
+    size_t offset = {i < 4 ? offsetof(InstanceData, model) + i * sizeof(glm::vec4)
+                           : offsetof(InstanceData, normal) + (i - 4) * sizeof(glm::vec3)};
+    glVertexAttribPointer(INSTANCE_LOCATION + i, i < 4 ? 4 : 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)offset);
+    glVertexAttribDivisor(INSTANCE_LOCATION + i, 1);
+    glEnableVertexAttribArray(INSTANCE_LOCATION + i);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// grows the buffers in place so attached vertex arrays keep pointing at them, then sends the moved objects
+void GpuCulling::upload() {
+  if (objects_.size() > capacity_) {
+    capacity_ = std::max(objects_.size(), capacity_ * 2);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_buffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity_ * sizeof(GpuObject), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity_ * sizeof(InstanceData), nullptr, GL_DYNAMIC_COPY);
+    dirty_first_ = 0;
+    dirty_last_ = objects_.size();
+  }
+  if (dirty_first_ < dirty_last_) {
+    size_t size = {(dirty_last_ - dirty_first_) * sizeof(GpuObject)};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_buffer_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirty_first_ * sizeof(GpuObject), size, objects_.data() + dirty_first_);
+    gl_stats().add(BUFFER_BYTES, size);
+    dirty_first_ = dirty_last_ = 0;
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  // every draw owns a run of the instance buffer as long as its object count
+  if (layout_dirty_) {
+    unsigned int base_instance = {0};
+    for (size_t i{0}; i < commands_.size(); i++) {
+      commands_[i].base_instance = base_instance;
+      if (!draw_indexed_[i])
+        commands_[i].base_vertex = static_cast<int>(base_instance);
+      base_instance += draw_objects_[i];
+    }
+    layout_dirty_ = false;
+  }
+
+  // orphaned every frame, last frame's draws may still be reading the old counts
+  size_t size = {commands_.size() * sizeof(IndirectCommand)};
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, size, commands_.data(), GL_STREAM_DRAW);
+  gl_stats().add(BUFFER_BYTES, size);
+}
+
+void GpuCulling::cull(const glm::mat4 &view_projection, bool frustum_culling, GlState &state) {
+  ProfileZone zone{"gpu cull"};
+  upload();
+  if (objects_.empty())
+    return;
+
+  Frustum frustum{view_projection};
+  glm::vec4 planes[6];
+  for (int i{0}; i < 6; i++) {
+    planes[i] = frustum.plane(i);
+  }
+
+  profiler().begin_gpu("cull");
+  state.use_program(shader_.id());
+  shader_.set(planes_, planes, 6);
+  shader_.set(object_count_, static_cast<int>(objects_.size()));
+  shader_.set(frustum_culling_, frustum_culling);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECTS_BINDING, object_buffer_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, command_buffer_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, instance_buffer_);
+  glDispatchCompute(static_cast<unsigned int>((objects_.size() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+  // the draws read the commands and the instances as attributes
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  profiler().end_gpu();
+}
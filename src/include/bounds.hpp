@@ -0,0 +1,67 @@
+#ifndef __BOUNDS_H__
+#define __BOUNDS_H__
+
+#include <glm/glm.hpp>
+
+#include <limits>
+
+struct AABB {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{-std::numeric_limits<float>::max()};
+
+  void grow(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  auto merged(const AABB &other) const -> AABB {
+    return AABB{glm::min(min, other.min), glm::max(max, other.max)};
+  }
+
+  auto contains(const AABB &other) const -> bool {
+    return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+  }
+
+  auto fattened(float margin) const -> AABB {
+    return AABB{min - glm::vec3{margin}, max + glm::vec3{margin}};
+  }
+
+  // half the surface area, only ever compared against other boxes
+  auto perimeter() const -> float {
+    glm::vec3 size = {max - min};
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+  }
+
+  // bounds of this box after an affine transform
+  auto transformed(const glm::mat4 &transform) const -> AABB {
+    glm::vec3 center = {transform * glm::vec4{(min + max) * 0.5f, 1.0f}};
+    glm::mat3 axes = {transform};
+    glm::vec3 half = {(max - min) * 0.5f};
+    glm::vec3 extent = {glm::abs(axes[0]) * half.x + glm::abs(axes[1]) * half.y + glm::abs(axes[2]) * half.z};
+    return AABB{center - extent, center + extent};
+  }
+};
+
+enum class Containment { OUTSIDE, INTERSECTS, INSIDE };
+
+// The six clip planes of a view projection matrix, stored as structure of arrays so a box is tested
+// against four planes per SSE instruction. The last two lanes hold planes that accept everything.
+class Frustum {
+public:
+  Frustum() = default;
+  explicit Frustum(const glm::mat4 &view_projection);
+
+  auto classify(const AABB &box) const -> Containment;
+  // plane i as (normal, distance), normals point inwards and are unit length
+  auto plane(int i) const -> glm::vec4 {
+    return glm::vec4{nx_[i], ny_[i], nz_[i], d_[i]};
+  }
+
+private:
+  alignas(16) float nx_[8]{};
+  alignas(16) float ny_[8]{};
+  alignas(16) float nz_[8]{};
+  alignas(16) float d_[8]{};
+};
+
+#endif // __BOUNDS_H__
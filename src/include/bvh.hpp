@@ -0,0 +1,93 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include "bounds.hpp"
+
+#include <vector>
+
+struct BvhNode {
+  AABB box;
+  int parent{-1}; // doubles as the next link while the node sits in the free list
+  int left{-1};
+  int right{-1};
+  int height{0};
+  unsigned int user{};
+
+  auto leaf() const -> bool {
+    return left == -1;
+  }
+};
+
+// A dynamic AABB tree of scene objects. Leaves store a fattened box so objects moving a little don't
+// touch the tree, and inserts pick the sibling with the cheapest surface area growth and rebalance
+// with rotations on the way up.
+class DynamicBvh {
+public:
+  static constexpr float MARGIN = {0.1f};
+
+  auto create_proxy(const AABB &box, unsigned int user) -> int;
+  void destroy_proxy(int proxy);
+  // returns true when the proxy left its fattened box and was reinserted
+  auto move_proxy(int proxy, const AABB &box) -> bool;
+
+  // calls visit(user) for every proxy whose box is not fully outside the frustum, subtrees entirely
+  // inside it are reported without testing their children
+  template <typename Visit> void query(const Frustum &frustum, Visit &&visit) const {
+    if (root_ == -1)
+      return;
+
+    int stack[64];
+    int count = {0};
+    stack[count++] = root_;
+    while (count > 0) {
+      const BvhNode &node = {nodes_[stack[--count]]};
+      Containment containment = {frustum.classify(node.box)};
+      if (containment == Containment::OUTSIDE)
+        continue;
+      if (node.leaf()) {
+        visit(node.user);
+      } else if (containment == Containment::INSIDE) {
+        visit_leaves(node.left, visit);
+        visit_leaves(node.right, visit);
+      } else {
+        stack[count++] = node.left;
+        stack[count++] = node.right;
+      }
+    }
+  }
+
+  auto user(int proxy) const -> unsigned int {
+    return nodes_[proxy].user;
+  }
+  auto height() const -> int {
+    return root_ == -1 ? 0 : nodes_[root_].height;
+  }
+  auto proxies() const -> size_t {
+    return proxy_count_;
+  }
+
+private:
+  template <typename Visit> void visit_leaves(int index, Visit &visit) const {
+    const BvhNode &node = {nodes_[index]};
+    if (node.leaf()) {
+      visit(node.user);
+      return;
+    }
+    visit_leaves(node.left, visit);
+    visit_leaves(node.right, visit);
+  }
+
+  auto allocate_node() -> int;
+  void free_node(int node);
+  void insert_leaf(int leaf);
+  void remove_leaf(int leaf);
+  auto balance(int node) -> int;
+  void refit(int node);
+
+  std::vector<BvhNode> nodes_;
+  int root_{-1};
+  int free_list_{-1};
+  size_t proxy_count_{0};
+};
+
+#endif // __BVH_H__
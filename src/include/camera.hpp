@@ -99,6 +99,13 @@ public:
       update_camera_vectors();
    }
 
+   // points the camera along the given euler angles, for replaying recorded paths
+   void set_orientation(float yaw, float pitch) {
+      Yaw = yaw;
+      Pitch = pitch;
+      update_camera_vectors();
+   }
+
    // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
    void process_mouse_scroll(float yoffset) {
       Zoom -= (float)yoffset;
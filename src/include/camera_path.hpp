@@ -0,0 +1,25 @@
+#ifndef __CAMERA_PATH_H__
+#define __CAMERA_PATH_H__
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// one sample of a recorded fly through, light is where the first spot light sits
+struct PathKey {
+  float time{};
+  glm::vec3 position{};
+  float yaw{};
+  float pitch{};
+  glm::vec3 light{};
+};
+
+// Paths are plain text, one key per line ordered by time and '#' starting a comment:
+//
+//   time  x y z  yaw pitch  light_x light_y light_z
+auto load_camera_path(const std::string &path, std::vector<PathKey> &keys) -> bool;
+auto write_camera_path(const std::string &path, const std::vector<PathKey> &keys) -> bool;
+// the path at time, linearly interpolated and held at both ends
+auto sample_camera_path(const std::vector<PathKey> &keys, float time) -> PathKey;
+
+#endif // __CAMERA_PATH_H__
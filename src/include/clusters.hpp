@@ -0,0 +1,71 @@
+#ifndef __CLUSTERS_H__
+#define __CLUSTERS_H__
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// a light reduced to the sphere it can affect, in view space
+struct LightBounds {
+  glm::vec3 position;
+  float radius;
+};
+
+// where a cluster's light indices start in the index list and how many there are
+struct ClusterRange {
+  unsigned int offset;
+  unsigned int count;
+};
+
+// Splits the view frustum into a 3D grid of clusters, ndc tiles in x/y and exponential depth slices in z,
+// and assigns each light to every cluster its sphere touches. CPU only, it owns no OpenGL state.
+class ClusterGrid {
+public:
+  static constexpr unsigned int TILES_X = {16};
+  static constexpr unsigned int TILES_Y = {9};
+  static constexpr unsigned int SLICES = {24};
+  static constexpr unsigned int COUNT = {TILES_X * TILES_Y * SLICES};
+
+  // rebuilds the cluster bounds, cheap to call every frame since nothing happens unless the projection changed
+  void set_projection(float fov_y, float aspect, float near, float far);
+  // spreads the slices over the worker pool once there are enough lights to be worth waking it
+  void assign(const std::vector<LightBounds> &lights, bool parallel = true);
+
+  auto ranges() const -> const std::vector<ClusterRange> & {
+    return ranges_;
+  }
+  auto indices() const -> const std::vector<unsigned int> & {
+    return indices_;
+  }
+  // slice = log(depth) * scale + bias, clamped to [0, SLICES)
+  auto slice_scale() const -> float {
+    return slice_scale_;
+  }
+  auto slice_bias() const -> float {
+    return slice_bias_;
+  }
+  auto slice_of(float depth) const -> int;
+  // clusters are stored x fastest, then y, then depth slice
+  auto cluster_of(unsigned int x, unsigned int y, unsigned int z) const -> unsigned int {
+    return x + TILES_X * (y + TILES_Y * z);
+  }
+  auto bounds_of(unsigned int cluster) const -> std::pair<glm::vec3, glm::vec3> {
+    return {min_[cluster], max_[cluster]};
+  }
+
+private:
+  void assign_slice(unsigned int z, const std::vector<LightBounds> &lights);
+
+  float fov_y_{}, aspect_{}, near_{}, far_{};
+  float slice_scale_{}, slice_bias_{};
+  std::vector<glm::vec3> min_, max_;
+
+  std::vector<std::vector<unsigned int>> slice_lights_;
+  std::vector<std::vector<unsigned int>> slice_indices_;
+  std::vector<ClusterRange> ranges_;
+  std::vector<unsigned int> indices_;
+};
+
+// distance at which a light with the given peak intensity attenuates below 1/256
+float attenuation_range(float intensity, float constant, float linear, float quadratic);
+
+#endif // __CLUSTERS_H__
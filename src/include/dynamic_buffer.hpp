@@ -0,0 +1,124 @@
+#ifndef __DYNAMIC_BUFFER_H__
+#define __DYNAMIC_BUFFER_H__
+
+#include "gl_stats.hpp"
+#include "resources.hpp"
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// A gpu buffer that remembers what it last uploaded, so rewriting it only sends the bytes that changed.
+class DynamicBuffer {
+public:
+  DynamicBuffer() = default;
+  DynamicBuffer(GLenum target, size_t size) : target_{target}, shadow_(size) {
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(target_, buffer_);
+    glBufferData(target_, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(target_, 0);
+    dirty_ = true;
+  }
+
+  // owns its gl buffer, so it moves but never copies
+  DynamicBuffer(const DynamicBuffer &) = delete;
+  DynamicBuffer &operator=(const DynamicBuffer &) = delete;
+
+  DynamicBuffer(DynamicBuffer &&other) noexcept {
+    *this = std::move(other);
+  }
+
+  DynamicBuffer &operator=(DynamicBuffer &&other) noexcept {
+    if (this == &other)
+      return *this;
+
+    release();
+    target_ = other.target_;
+    buffer_ = std::exchange(other.buffer_, 0);
+    dirty_ = other.dirty_;
+    shadow_ = std::move(other.shadow_);
+    return *this;
+  }
+
+  ~DynamicBuffer() {
+    release();
+  }
+
+  // grows the storage to hold at least size bytes, the next update then uploads everything
+  void reserve(size_t size) {
+    if (size <= shadow_.size())
+      return;
+
+    shadow_.resize(size);
+    glBindBuffer(target_, buffer_);
+    glBufferData(target_, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(target_, 0);
+    dirty_ = true;
+  }
+
+  // replaces the whole contents without diffing, for data that changes completely every time
+  auto stream(const void *data, size_t size) -> size_t {
+    reserve(size);
+    glBindBuffer(target_, buffer_);
+    glBufferData(target_, shadow_.size(), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(target_, 0, size, data);
+    glBindBuffer(target_, 0);
+    dirty_ = true;
+    gl_stats().add(BUFFER_BYTES, size);
+
+    return size;
+  }
+
+  // attaches the buffer to an indexed binding point (uniform blocks)
+  void bind_base(unsigned int index) const {
+    glBindBufferBase(target_, index, buffer_);
+  }
+
+  // compares data against the previous upload and sends only the changed byte range, returns the bytes uploaded
+  auto update(const void *data, size_t size) -> size_t {
+    const unsigned char *bytes = {static_cast<const unsigned char *>(data)};
+    size = size < shadow_.size() ? size : shadow_.size();
+
+    size_t first{0};
+    size_t last{size};
+    if (!dirty_) {
+      while (first < size && bytes[first] == shadow_[first]) {
+        first++;
+      }
+      if (first == size)
+        return 0;
+      while (last > first && bytes[last - 1] == shadow_[last - 1]) {
+        last--;
+      }
+    }
+
+    std::memcpy(shadow_.data() + first, bytes + first, last - first);
+    glBindBuffer(target_, buffer_);
+    glBufferSubData(target_, first, last - first, bytes + first);
+    glBindBuffer(target_, 0);
+    dirty_ = false;
+    gl_stats().add(BUFFER_BYTES, last - first);
+
+    return last - first;
+  }
+
+  auto id() const -> unsigned int {
+    return buffer_;
+  }
+
+private:
+  // deleted by the registry on the context thread, like VertexArray's buffers
+  void release() {
+    ResourceRegistry::instance().defer_delete_buffer(buffer_);
+    buffer_ = 0;
+  }
+
+  GLenum target_{};
+  unsigned int buffer_{};
+  bool dirty_{false};
+  std::vector<unsigned char> shadow_;
+};
+
+#endif // __DYNAMIC_BUFFER_H__
@@ -1,7 +1,11 @@
 #ifndef __EDITOR_H__
 #define __EDITOR_H__
 
+#include "geometry_arena.hpp"
+#include "gl_stats.hpp"
 #include "light_sources.hpp"
+#include "profiler.hpp"
+#include "program_cache.hpp"
 #include "stage.hpp"
 
 #include <GLFW/glfw3.h>
@@ -9,6 +13,8 @@
 #include <imgui/imgui_impl_glfw.h>
 #include <imgui/imgui_impl_opengl3.h>
 
+#include <cstring>
+
 void initialize_imgui(GLFWwindow *window) {
   IMGUI_CHECKVERSION();
   ImGui::CreateContext();
@@ -27,53 +33,60 @@ void initialize_imgui(GLFWwindow *window) {
   ImGui_ImplOpenGL3_Init("#version 330");
 }
 
-void tree_directional(const char *label, DirectionalLight *directional_light) {
+bool tree_directional(const char *label, DirectionalLight *directional_light) {
+  bool changed = {false};
   if (ImGui::TreeNode(label)) {
-    ImGui::Checkbox("Enabled", (bool *)(&directional_light->enabled));
-    ImGui::DragFloat3("Direction", (float *)(&directional_light->direction), 0.01f, -1.0f, 1.0f);
-    ImGui::ColorEdit3("Color", (float *)(&directional_light->color));
-    ImGui::SliderFloat("Ambient Strength", (float *)(&directional_light->ambient_strength), 0.0f, 1.0f);
-    ImGui::SliderFloat("Diffuse Strength", (float *)(&directional_light->diffuse_strength), 0.0f, 10.0f);
-    ImGui::SliderFloat("Specular Strength", (float *)(&directional_light->specular_strength), 0.0f, 10.0f);
+    changed |= ImGui::Checkbox("Enabled", (bool *)(&directional_light->enabled));
+    changed |= ImGui::DragFloat3("Direction", (float *)(&directional_light->direction), 0.01f, -1.0f, 1.0f);
+    changed |= ImGui::ColorEdit3("Color", (float *)(&directional_light->color));
+    changed |= ImGui::SliderFloat("Ambient Strength", (float *)(&directional_light->ambient_strength), 0.0f, 1.0f);
+    changed |= ImGui::SliderFloat("Diffuse Strength", (float *)(&directional_light->diffuse_strength), 0.0f, 10.0f);
+    changed |= ImGui::SliderFloat("Specular Strength", (float *)(&directional_light->specular_strength), 0.0f, 10.0f);
     ImGui::Separator();
     ImGui::TreePop();
   }
+  return changed;
 }
 
-void tree_points(const char *label, PointLight *point_light) {
+bool tree_points(const char *label, PointLight *point_light) {
+  bool changed = {false};
   if (ImGui::TreeNode(label)) {
-    ImGui::Checkbox("Enabled", (bool *)(&point_light->enabled));
-    ImGui::DragFloat3("Position", (float *)(&point_light->position), 0.1f);
-    ImGui::ColorEdit3("Color", (float *)(&point_light->color));
-    ImGui::SliderFloat("Ambient Strength", (float *)(&point_light->ambient_strength), 0.0f, 1.0f);
-    ImGui::SliderFloat("Diffuse Strength", (float *)(&point_light->diffuse_strength), 0.0f, 10.0f);
-    ImGui::SliderFloat("Specular Strength", (float *)(&point_light->specular_strength), 0.0f, 10.0f);
+    changed |= ImGui::Checkbox("Enabled", (bool *)(&point_light->enabled));
+    changed |= ImGui::Checkbox("Cast Shadows", &point_light->cast_shadows);
+    changed |= ImGui::DragFloat3("Position", (float *)(&point_light->position), 0.1f);
+    changed |= ImGui::ColorEdit3("Color", (float *)(&point_light->color));
+    changed |= ImGui::SliderFloat("Ambient Strength", (float *)(&point_light->ambient_strength), 0.0f, 1.0f);
+    changed |= ImGui::SliderFloat("Diffuse Strength", (float *)(&point_light->diffuse_strength), 0.0f, 10.0f);
+    changed |= ImGui::SliderFloat("Specular Strength", (float *)(&point_light->specular_strength), 0.0f, 10.0f);
     if (ImGui::TreeNode("Attenuation")) {
       ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! The distance traveled by the light.");
       ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! Stronger lights have a significantly lower quadratic value.");
-      ImGui::SliderFloat("Linear", (float *)(&point_light->linear), 0.0f, 1.0f, "%f");
-      ImGui::SliderFloat("Quadratic", (float *)(&point_light->quadratic), 0.0f, 2.0f, "%f");
+      changed |= ImGui::SliderFloat("Linear", (float *)(&point_light->linear), 0.0f, 1.0f, "%f");
+      changed |= ImGui::SliderFloat("Quadratic", (float *)(&point_light->quadratic), 0.0f, 2.0f, "%f");
       ImGui::TreePop();
     }
     ImGui::Separator();
     ImGui::TreePop();
   }
+  return changed;
 }
 
-void tree_spot(const char *label, SpotLight *spot_light) {
+bool tree_spot(const char *label, SpotLight *spot_light) {
+  bool changed = {false};
   if (ImGui::TreeNode(label)) {
-    ImGui::Checkbox("Enabled", (bool *)(&spot_light->enabled));
-    ImGui::DragFloat3("Position", (float *)(&spot_light->position), 0.1f);
-    ImGui::DragFloat3("Direction", (float *)(&spot_light->direction), 0.01f, -1.0f, 1.0f);
-    ImGui::ColorEdit3("Color", (float *)(&spot_light->color));
-    ImGui::SliderFloat("Ambient Strength", (float *)(&spot_light->ambient_strength), 0.0f, 1.0f);
-    ImGui::SliderFloat("Diffuse Strength", (float *)(&spot_light->diffuse_strength), 0.0f, 10.0f);
-    ImGui::SliderFloat("Specular Strength", (float *)(&spot_light->specular_strength), 0.0f, 10.0f);
+    changed |= ImGui::Checkbox("Enabled", (bool *)(&spot_light->enabled));
+    changed |= ImGui::Checkbox("Cast Shadows", &spot_light->cast_shadows);
+    changed |= ImGui::DragFloat3("Position", (float *)(&spot_light->position), 0.1f);
+    changed |= ImGui::DragFloat3("Direction", (float *)(&spot_light->direction), 0.01f, -1.0f, 1.0f);
+    changed |= ImGui::ColorEdit3("Color", (float *)(&spot_light->color));
+    changed |= ImGui::SliderFloat("Ambient Strength", (float *)(&spot_light->ambient_strength), 0.0f, 1.0f);
+    changed |= ImGui::SliderFloat("Diffuse Strength", (float *)(&spot_light->diffuse_strength), 0.0f, 10.0f);
+    changed |= ImGui::SliderFloat("Specular Strength", (float *)(&spot_light->specular_strength), 0.0f, 10.0f);
     if (ImGui::TreeNode("Attenuation")) {
       ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! The distance traveled by the light.");
       ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! Stronger lights have a significantly lower quadratic value.");
-      ImGui::SliderFloat("Linear", (float *)(&spot_light->linear), 0.0f, 1.0f, "%f");
-      ImGui::SliderFloat("Quadratic", (float *)(&spot_light->quadratic), 0.0f, 2.0f, "%f");
+      changed |= ImGui::SliderFloat("Linear", (float *)(&spot_light->linear), 0.0f, 1.0f, "%f");
+      changed |= ImGui::SliderFloat("Quadratic", (float *)(&spot_light->quadratic), 0.0f, 2.0f, "%f");
       ImGui::TreePop();
     }
     if (ImGui::TreeNode("Intensity")) {
@@ -84,9 +97,10 @@ void tree_spot(const char *label, SpotLight *spot_light) {
 
       if (initial_outer < initial_inner) {
         spot_light->outer_cutoff = spot_light->cutoff;
+        changed = true;
       }
-      ImGui::SliderFloat("Inner Cutoff", (float *)(&spot_light->cutoff), 0.0f, 100.0f);
-      ImGui::SliderFloat("Outer Cutoff", (float *)(&spot_light->outer_cutoff), 0.0f, 100.0f);
+      changed |= ImGui::SliderFloat("Inner Cutoff", (float *)(&spot_light->cutoff), 0.0f, 100.0f);
+      changed |= ImGui::SliderFloat("Outer Cutoff", (float *)(&spot_light->outer_cutoff), 0.0f, 100.0f);
       if (initial_outer < initial_inner) {
         spot_light->cutoff = spot_light->outer_cutoff;
       }
@@ -95,6 +109,53 @@ void tree_spot(const char *label, SpotLight *spot_light) {
     ImGui::Separator();
     ImGui::TreePop();
   }
+  return changed;
+}
+
+// the last frame's zones as bars, one row per thread and nesting level with the gpu at the bottom
+void profiler_timeline(const Profiler &profiler) {
+  const std::vector<ProfileEvent> &events = {profiler.frame()};
+  double frame_start = {profiler.frame_start()};
+  double frame_length = {std::max(profiler.frame_end() - frame_start, 1.0)};
+
+  unsigned int rows = {1};
+  for (const ProfileEvent &event : events) {
+    if (event.thread == 0)
+      rows = std::max(rows, event.depth + 1);
+  }
+  const float ROW_HEIGHT = {18.0f};
+  ImVec2 origin = {ImGui::GetCursorScreenPos()};
+  float width = {ImGui::GetContentRegionAvail().x};
+  ImGui::Dummy(ImVec2{width, ROW_HEIGHT * (rows + 1)});
+
+  // only the main thread and the gpu fit a frame, worker zones are in the trace
+  ImDrawList *draw_list = {ImGui::GetWindowDrawList()};
+  for (const ProfileEvent &event : events) {
+    if (event.thread != 0 && event.thread != Profiler::GPU_THREAD)
+      continue;
+    unsigned int row = {event.thread == Profiler::GPU_THREAD ? rows : event.depth};
+    float x0 = {origin.x + width * static_cast<float>((event.start - frame_start) / frame_length)};
+    float x1 = {std::max(x0 + 1.0f, x0 + width * static_cast<float>(event.duration / frame_length))};
+    float y0 = {origin.y + row * ROW_HEIGHT};
+    ImU32 color = {event.thread == Profiler::GPU_THREAD ? IM_COL32(200, 90, 60, 255) : IM_COL32(80, 120, 200, 255)};
+    draw_list->AddRectFilled(ImVec2{x0, y0}, ImVec2{x1, y0 + ROW_HEIGHT - 2.0f}, color, 3.0f);
+    draw_list->PushClipRect(ImVec2{x0, y0}, ImVec2{x1, y0 + ROW_HEIGHT}, true);
+    draw_list->AddText(ImVec2{x0 + 3.0f, y0 + 1.0f}, IM_COL32_WHITE, event.name);
+    draw_list->PopClipRect();
+    if (ImGui::IsMouseHoveringRect(ImVec2{x0, y0}, ImVec2{x1, y0 + ROW_HEIGHT})) {
+      ImGui::SetTooltip("%s%s: %.3f ms", event.thread == Profiler::GPU_THREAD ? "GPU " : "", event.name, event.duration / 1000.0);
+    }
+  }
+}
+
+// gpu milliseconds the last frame spent in zones of this name
+float gpu_zone_ms(const Profiler &profiler, const char *name) {
+  double total = {0.0};
+  for (const ProfileEvent &event : profiler.frame()) {
+    if (event.thread == Profiler::GPU_THREAD && std::strcmp(event.name, name) == 0)
+      total += event.duration;
+  }
+  return static_cast<float>(total / 1000.0);
 }
 
 void render_imgui(Stage &stage) {
@@ -121,6 +182,12 @@ void render_imgui(Stage &stage) {
   ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.74f, 1.0f}, "HINTS: Press C to toggle cursor | WASD to move | SPACE to elevate");
   ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.74f, 1.0f}, "HINTS: Arrow Keys & Q / E controls the first spot light");
   ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+  if (stage.gpu_driven()) {
+    ImGui::Text("Objects: %zu culled on the gpu into %zu indirect draws", stage.gpu_culler.objects(), stage.gpu_culler.draws());
+  } else {
+    ImGui::Text("Objects: %zu visible | %zu culled | %zu occluded", stage.visible_objects, stage.culled_objects,
+                stage.occluded_objects);
+  }
 
   ImGui::Separator();
   ImGui::TextColored(ImVec4{0.8f, 0.4f, 1.00f, 1.0f}, "AMBIENT: Anything in range of the light (directional is global)");
@@ -139,29 +206,174 @@ void render_imgui(Stage &stage) {
   ImGui::SliderFloat("Material Shine", &stage.material_shininess, 0.0f, 1.0f);
   ImGui::SliderFloat("Emission Speed", &stage.emission_speed, 0.0f, 10.0f);
   ImGui::SliderFloat("Emission Strength", &stage.emission_strength, 0.0f, 10.0f);
+  ImGui::Checkbox("Instanced Cubes", &stage.instanced_cubes);
+  ImGui::Checkbox("Frustum Culling", &stage.frustum_culling);
+  if (stage.gpu_culler.ready())
+    ImGui::Checkbox("GPU Culling", &stage.gpu_culling);
+  if (!stage.gpu_driven())
+    ImGui::Checkbox("Occlusion Culling", &stage.occlusion_culling);
+  ImGui::Checkbox("Mesh LODs", &stage.mesh_lods);
+  ImGui::SliderFloat("LOD Error (px)", &stage.lod_error_pixels, 0.25f, 8.0f);
+  // stopping writes what was recorded, testbed_bench replays it with --path
+  if (ImGui::Checkbox("Record Camera Path", &stage.recording_path)) {
+    if (stage.recording_path) {
+      stage.recorded_path.clear();
+    } else if (!write_camera_path("camera.path", stage.recorded_path)) {
+      std::cerr << "ERROR::CAMERA_PATH::could not write camera.path" << std::endl;
+    }
+  }
 
   ImGui::Separator();
   if (ImGui::CollapsingHeader("Model Properties")) {
     ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f},
                        "! Models won't always contain specified masks; \nBut also won't cause errors if not supported.");
-    ImGui::Checkbox("With Diffuse", &stage.backpack.has_diffuse);
-    ImGui::Checkbox("With Specular", &stage.backpack.has_specular);
-    ImGui::Checkbox("With Emission", &stage.backpack.has_emission);
+    for (const std::shared_ptr<Material> &material : stage.backpack.materials()) {
+      ImGui::PushID(static_cast<int>(material->id()));
+      ImGui::Text("Material #%u", material->id());
+      ImGui::Checkbox("With Diffuse", &material->diffuse);
+      ImGui::SameLine();
+      ImGui::Checkbox("With Specular", &material->specular);
+      ImGui::SameLine();
+      ImGui::Checkbox("With Emission", &material->emissive);
+      ImGui::PopID();
+    }
+    const std::vector<MeshOptimizeReport> &reports = {stage.backpack.optimize_reports()};
+    if (reports.empty())
+      ImGui::Text("Mesh Optimizer: loaded cooked, nothing ran");
+    for (size_t i{0}; i < reports.size(); i++) {
+      ImGui::Text("Mesh #%zu: %zu -> %zu vertices | acmr %.3f -> %.3f | atvr %.3f -> %.3f", i, reports[i].vertices_before,
+                  reports[i].vertices_after, reports[i].before.acmr, reports[i].after.acmr, reports[i].before.atvr,
+                  reports[i].after.atvr);
+    }
   }
 
   if (ImGui::CollapsingHeader("Directional Lighting")) {
     for (size_t i{0}; i < 1; i++) {
-      tree_directional(("Directional Light #" + std::to_string(i + 1)).c_str(), &stage.dir_lights[i]);
+      stage.lights_dirty |= tree_directional(("Directional Light #" + std::to_string(i + 1)).c_str(), &stage.dir_lights[i]);
     }
   }
   if (ImGui::CollapsingHeader("Spot Lighting")) {
-    for (size_t i{0}; i < 1; i++) {
-      tree_spot(("Spot Light #" + std::to_string(i + 1)).c_str(), &stage.spot_lights[i]);
+    for (size_t i{0}; i < stage.spot_lights.size(); i++) {
+      stage.lights_dirty |= tree_spot(("Spot Light #" + std::to_string(i + 1)).c_str(), &stage.spot_lights[i]);
     }
   }
   if (ImGui::CollapsingHeader("Point Lighting")) {
-    for (size_t i{0}; i < 4; i++) {
-      tree_points(("Point Light #" + std::to_string(i + 1)).c_str(), &stage.point_lights[i]);
+    for (size_t i{0}; i < Stage::NUM_SCENE_LIGHTS; i++) {
+      stage.lights_dirty |= tree_points(("Point Light #" + std::to_string(i + 1)).c_str(), &stage.point_lights[i]);
+    }
+    ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! Scatters extra short ranged lights over the cube floor.");
+    if (ImGui::SliderInt("Light Field", &stage.light_field, 0, 8192)) {
+      stage.spawn_light_field(stage.light_field);
+    }
+  }
+
+  if (ImGui::CollapsingHeader("Shadows")) {
+    ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! Cast by the first directional light once it is enabled.");
+    ImGui::Checkbox("Cascaded Shadows", &stage.shadows_enabled);
+    int cascades = {static_cast<int>(stage.shadow_cascades)};
+    if (ImGui::SliderInt("Cascades", &cascades, 1, MAX_CASCADES))
+      stage.shadow_cascades = static_cast<unsigned int>(cascades);
+    ImGui::SliderFloat("Shadow Distance", &stage.shadow_distance, 10.0f, 200.0f);
+    if (stage.shadows_active()) {
+      for (unsigned int i{0}; i < stage.shadows.count(); i++) {
+        const ShadowCascade &cascade = {stage.shadows.cascade(i)};
+        ImGui::Text("Cascade %u: %.1f - %.1f | %zu static (%u refits) | %zu dynamic | %.3f ms", i, cascade.split_near,
+                    cascade.split_far, cascade.static_casters, cascade.refits, cascade.dynamic_casters, cascade.cpu_ms);
+      }
+    }
+    ImGui::Separator();
+    ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! Spot and point lights share one atlas, only dirty tiles are redrawn.");
+    ImGui::Checkbox("Light Shadows", &stage.light_shadows);
+    ImGui::SliderInt("Tiles Per Frame", &stage.shadow_tile_budget, 1, 64);
+    if (stage.light_shadows_active()) {
+      const ShadowAtlas &atlas = {stage.shadow_atlas};
+      ImGui::Text("Lights: %zu | Tiles: %zu (%zu dirty) | Rendered: %zu", atlas.lights(), atlas.used_tiles(), atlas.dirty_tiles(),
+                  stage.atlas_tiles_rendered);
+    }
+  }
+
+  if (ImGui::CollapsingHeader("Shading")) {
+    ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! Deferred lights each covered pixel once, point and spot lights as volumes.");
+    int path = {stage.deferred_shading ? 1 : 0};
+    ImGui::RadioButton("Forward", &path, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("Deferred", &path, 1);
+    stage.deferred_shading = path == 1;
+    // the opaque draws and their lighting, each path keeps what was measured the last time it ran
+    static float shading_ms[2] = {0.0f, 0.0f};
+    const Profiler &instance = {profiler()};
+    shading_ms[stage.deferred_active() ? 1 : 0] = gpu_zone_ms(instance, "cubes") + gpu_zone_ms(instance, "model") +
+                                                  gpu_zone_ms(instance, "deferred lighting");
+    ImGui::Text("GPU Forward: %.3f ms | Deferred: %.3f ms", shading_ms[0], shading_ms[1]);
+    ImGui::Text("Shader Variants: %zu forward | %zu g-buffer", stage.lighting_shaders.compiled(), stage.gbuffer_shaders.compiled());
+    ImGui::Checkbox("Stencil Light Volumes", &stage.stencil_light_volumes);
+    ImGui::SliderFloat("Stencil Volume Size", &stage.stencil_volume_size, 0.0f, 2.0f);
+    if (stage.deferred_active()) {
+      ImGui::Text("Light Volumes: %zu stencil masked | %zu depth tested", stage.stencil_volumes,
+                  stage.local_lights.size() - stage.stencil_volumes);
+    }
+  }
+
+  if (ImGui::CollapsingHeader("Light Clusters")) {
+    const ClusterGrid &clusters = {stage.clusters};
+    ImGui::Text("Grid: %u x %u x %u", ClusterGrid::TILES_X, ClusterGrid::TILES_Y, ClusterGrid::SLICES);
+    ImGui::Text("Lights: %zu | Cluster Entries: %zu", stage.local_lights.size(), clusters.indices().size());
+    ImGui::Text("Build: %.3f ms", stage.cluster_build_ms);
+  }
+
+  if (ImGui::CollapsingHeader("Frame Statistics")) {
+    const GlStats &stats = {gl_stats()};
+    static float samples[GlStats::HISTORY];
+    static const char *export_status = {""};
+    for (unsigned int i{0}; i < FRAME_COUNTERS; i++) {
+      FrameCounter counter = {static_cast<FrameCounter>(i)};
+      size_t count = {stats.series(counter, samples)};
+      std::string label = {std::string{frame_counter_name(counter)} + ": " + std::to_string(stats.last(counter))};
+      ImGui::PlotLines(label.c_str(), samples, static_cast<int>(count), 0, nullptr, 0.0f, FLT_MAX, ImVec2{0.0f, 40.0f});
+    }
+    if (ImGui::Button("Export CSV")) {
+      export_status = stats.write_csv("frame_stats.csv") ? "Wrote frame_stats.csv" : "Could not write frame_stats.csv";
+    }
+    ImGui::SameLine();
+    ImGui::Text("%s (%zu frames)", export_status, stats.frames());
+  }
+
+  if (ImGui::CollapsingHeader("Profiler")) {
+    Profiler &instance = {profiler()};
+    profiler_timeline(instance);
+    for (const ProfileEvent &event : instance.frame()) {
+      if (event.thread == Profiler::GPU_THREAD || (event.thread == 0 && event.depth == 0))
+        ImGui::Text("%s %s: %.3f ms", event.thread == Profiler::GPU_THREAD ? "GPU" : "CPU", event.name, event.duration / 1000.0);
+    }
+    if (instance.gpu_dropped() > 0 || instance.gpu_nested() > 0) {
+      ImGui::TextColored(ImVec4{0.8f, 0.4f, 0.20f, 1.0f}, "! GPU Zones: %zu dropped | %zu nested in another zone", instance.gpu_dropped(),
+                         instance.gpu_nested());
+    }
+
+    static const char *trace_status = {""};
+    bool recording = {instance.recording()};
+    if (ImGui::Checkbox("Record Trace", &recording)) {
+      instance.set_recording(recording);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Write Trace")) {
+      trace_status = instance.write_trace("trace.json") ? "Wrote trace.json" : "Could not write trace.json";
+    }
+    ImGui::Text("%s (%zu events)", trace_status, instance.trace_events());
+  }
+
+  if (ImGui::CollapsingHeader("Resources")) {
+    ResourceRegistry &registry = {ResourceRegistry::instance()};
+    ImGui::Text("Textures: %zu | Meshes: %zu", registry.textures(), registry.meshes());
+    ImGui::Text("Pending Deletes: %zu", registry.pending());
+    const ProgramCache &programs = {program_cache()};
+    ImGui::Text("Program Cache: %s | %zu loaded | %zu compiled | %zu rejected", programs.enabled() ? "on" : "off",
+                programs.hits(), programs.misses(), programs.rejected());
+    for (VertexFormat format : {VertexFormat::FLOAT, VertexFormat::QUANTIZED}) {
+      GeometryArenaStats arena = {geometry_arena(format).stats()};
+      ImGui::Text("%s Arena: %zu meshes | %zu / %zu vertices | %zu / %zu KB indices", format == VertexFormat::FLOAT ? "Float" : "Quantized",
+                  arena.allocations, arena.vertex_used, arena.vertex_capacity, arena.index_used / 1024, arena.index_capacity / 1024);
+      ImGui::Text("  %zu free blocks, %.1f%% fragmented", arena.free_blocks, arena.fragmentation * 100.0f);
     }
   }
 
@@ -0,0 +1,65 @@
+#ifndef __GBUFFER_H__
+#define __GBUFFER_H__
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// the deferred path's surfaces, colors in the order gbuffer.frag writes them
+enum GBufferTarget : unsigned int { GBUFFER_ALBEDO, GBUFFER_NORMAL, GBUFFER_EMISSION, GBUFFER_DEPTH, GBUFFER_TARGETS };
+
+// What the deferred lighting passes read back of the opaque surfaces. gbuffer.frag fills three compact
+// color targets from the material maps: the diffuse map with a specular intensity (RGBA8), an octahedral
+// view space normal (RG16F) and the emission with a switch for diffuse lighting (RGBA8). Depth and stencil
+// sit in a texture so view positions can be rebuilt from it, every covered pixel is given stencil 1 and
+// lighting only runs where it is set.
+class GBuffer {
+public:
+  GBuffer() = default;
+  GBuffer(const GBuffer &) = delete;
+  auto operator=(const GBuffer &) -> GBuffer & = delete;
+  ~GBuffer();
+
+  // allocates the targets, releasing any it had
+  void setup(unsigned int width, unsigned int height);
+  // the targets follow the viewport, which changes with the window and is larger than it on hidpi screens.
+  // Reallocates them when its size no longer matches
+  void fit_viewport();
+  auto ready() const -> bool {
+    return width_ != 0;
+  }
+
+  // remembers the bound framebuffer and viewport, then binds and clears the targets with stencil writes on
+  void begin();
+  // copies depth and stencil into the framebuffer begin saved and binds it again, so the lighting passes
+  // and anything drawn forward afterwards test against the scene. Stencil state and the viewport are left
+  // as begin found them
+  void end();
+
+  auto texture(GBufferTarget target) const -> unsigned int {
+    return textures_[target];
+  }
+  auto width() const -> unsigned int {
+    return width_;
+  }
+  auto height() const -> unsigned int {
+    return height_;
+  }
+
+private:
+  void release();
+
+  unsigned int width_{0};
+  unsigned int height_{0};
+  unsigned int framebuffer_{};
+  unsigned int textures_[GBUFFER_TARGETS]{};
+  int saved_framebuffer_{0};
+  int saved_viewport_[4]{};
+  bool stencil_test_{false};
+};
+
+// triangles of a sphere around the origin wound outwards, pushed out far enough that its flat faces never
+// cut inside the unit sphere, a light volume scaled by the light's range
+auto light_volume_sphere(unsigned int rings, unsigned int segments) -> std::vector<glm::vec3>;
+
+#endif // __GBUFFER_H__
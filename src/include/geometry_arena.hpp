@@ -0,0 +1,88 @@
+#ifndef __GEOMETRY_ARENA_H__
+#define __GEOMETRY_ARENA_H__
+
+#include "structs.hpp"
+
+#include <map>
+#include <mutex>
+
+// First fit sub-allocation of a linear range. Free blocks are kept sorted by offset and merged with their
+// neighbours on release, so freeing everything always leaves one block.
+class RangeAllocator {
+public:
+  static constexpr size_t INVALID = {~size_t{0}};
+
+  // extends the range to capacity, the new tail becomes free
+  void grow(size_t capacity);
+  // offset of size free units starting on a multiple of alignment, INVALID when no block fits
+  auto allocate(size_t size, size_t alignment = 1) -> size_t;
+  void release(size_t offset, size_t size);
+
+  auto capacity() const -> size_t {
+    return capacity_;
+  }
+  auto used() const -> size_t {
+    return used_;
+  }
+  auto free_blocks() const -> size_t {
+    return free_.size();
+  }
+  auto largest_free() const -> size_t;
+
+private:
+  std::map<size_t, size_t> free_; // offset -> size
+  size_t capacity_{0};
+  size_t used_{0};
+};
+
+struct GeometryArenaStats {
+  size_t vertex_capacity; // vertices
+  size_t vertex_used;
+  size_t index_capacity; // bytes
+  size_t index_used;
+  size_t allocations;
+  size_t free_blocks;
+  // share of the free space outside the largest free block (the worse of the two buffers), 0 when any
+  // request that fits the free total also fits one block
+  float fragmentation;
+};
+
+// Shared vertex and index buffers for every mesh of one vertex format. All of them draw through one VAO,
+// offset by their base vertex and first index, so switching meshes needs no binds at all. Both buffers
+// double when a mesh doesn't fit, copying their contents on the gpu.
+class GeometryArena {
+public:
+  explicit GeometryArena(VertexFormat format);
+  GeometryArena(const GeometryArena &) = delete;
+  auto operator=(const GeometryArena &) -> GeometryArena & = delete;
+
+  // places and uploads a mesh, needs the context current. index_size is 2 or 4 bytes, the indices are
+  // relative to the mesh's own first vertex
+  auto allocate(const void *vertices, size_t vertex_count, const void *indices, size_t index_count, size_t index_size)
+      -> GpuMesh;
+  // returns a mesh's ranges, safe from any thread since it touches no gl state
+  void release(const GpuMesh &mesh);
+
+  auto stats() -> GeometryArenaStats;
+  auto format() const -> VertexFormat {
+    return format_;
+  }
+
+private:
+  void reserve(size_t vertex_count, size_t index_bytes);
+  void configure_attributes();
+
+  VertexFormat format_;
+  size_t stride_;
+  unsigned int vao_{};
+  unsigned int vbo_{};
+  unsigned int ebo_{};
+  RangeAllocator vertex_ranges_;
+  RangeAllocator index_ranges_;
+  size_t allocations_{0};
+  std::mutex mutex_;
+};
+
+auto geometry_arena(VertexFormat format) -> GeometryArena &;
+
+#endif // __GEOMETRY_ARENA_H__
@@ -0,0 +1,145 @@
+#ifndef __GL_EXT_H__
+#define __GL_EXT_H__
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// tokens and entry points past the core 3.3 profile glad was generated for
+
+// GL_EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// GL 4.3 compute shaders, shader storage buffers and indirect multi draws, for the gpu driven path. The
+// entry points stay null on older contexts, load_gl_4_3 says whether they can be used
+#ifndef GL_VERSION_4_3
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+
+typedef void(APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void(APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void(APIENTRYP PFNGLMULTIDRAWARRAYSINDIRECTPROC)(GLenum mode, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void(APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount,
+                                                           GLsizei stride);
+inline PFNGLDISPATCHCOMPUTEPROC glad_glDispatchCompute = {nullptr};
+inline PFNGLMEMORYBARRIERPROC glad_glMemoryBarrier = {nullptr};
+inline PFNGLMULTIDRAWARRAYSINDIRECTPROC glad_glMultiDrawArraysIndirect = {nullptr};
+inline PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect = {nullptr};
+#define glDispatchCompute glad_glDispatchCompute
+#define glMemoryBarrier glad_glMemoryBarrier
+#define glMultiDrawArraysIndirect glad_glMultiDrawArraysIndirect
+#define glMultiDrawElementsIndirect glad_glMultiDrawElementsIndirect
+
+inline bool gl_4_3_loaded = {false};
+
+// call once after gladLoadGLLoader with the same loader
+inline auto load_gl_4_3(GLADloadproc load) -> bool {
+  gl_4_3_loaded = false;
+  if (GLVersion.major * 10 + GLVersion.minor < 43)
+    return false;
+
+  glad_glDispatchCompute = reinterpret_cast<PFNGLDISPATCHCOMPUTEPROC>(load("glDispatchCompute"));
+  glad_glMemoryBarrier = reinterpret_cast<PFNGLMEMORYBARRIERPROC>(load("glMemoryBarrier"));
+  glad_glMultiDrawArraysIndirect = reinterpret_cast<PFNGLMULTIDRAWARRAYSINDIRECTPROC>(load("glMultiDrawArraysIndirect"));
+  glad_glMultiDrawElementsIndirect = reinterpret_cast<PFNGLMULTIDRAWELEMENTSINDIRECTPROC>(load("glMultiDrawElementsIndirect"));
+  gl_4_3_loaded = glad_glDispatchCompute && glad_glMemoryBarrier && glad_glMultiDrawArraysIndirect && glad_glMultiDrawElementsIndirect;
+  return gl_4_3_loaded;
+}
+
+inline auto has_gl_4_3() -> bool {
+  return gl_4_3_loaded;
+}
+#else
+inline auto load_gl_4_3(GLADloadproc) -> bool {
+  return GLAD_GL_VERSION_4_3;
+}
+
+inline auto has_gl_4_3() -> bool {
+  return GLAD_GL_VERSION_4_3;
+}
+#endif
+
+// true when the current context advertises the extension, call with a context current
+inline auto has_gl_extension(const char *name) -> bool {
+  GLint count{0};
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i{0}; i < count; i++) {
+    const char *extension = {reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i))};
+    if (extension && std::strcmp(extension, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+// GL_ARB_get_program_binary (core in 4.1) for the program cache, and GL_KHR_parallel_shader_compile for
+// compiling programs on driver threads. The entry points stay null where the context has neither,
+// load_shader_extensions says which can be used
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat,
+                                                  void *binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+inline PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary = {nullptr};
+inline PFNGLPROGRAMBINARYPROC glad_glProgramBinary = {nullptr};
+inline PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri = {nullptr};
+#define glGetProgramBinary glad_glGetProgramBinary
+#define glProgramBinary glad_glProgramBinary
+#define glProgramParameteri glad_glProgramParameteri
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+inline PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR = {nullptr};
+#define glMaxShaderCompilerThreadsKHR glad_glMaxShaderCompilerThreadsKHR
+#endif
+
+inline bool program_binary_loaded = {false};
+inline bool parallel_compile_loaded = {false};
+
+// call once after gladLoadGLLoader with the same loader. Program binaries also need the driver to offer
+// at least one format, parallel compiling is handed as many threads as the driver likes
+inline void load_shader_extensions(GLADloadproc load) {
+  program_binary_loaded = false;
+  if (GLVersion.major * 10 + GLVersion.minor >= 41 || has_gl_extension("GL_ARB_get_program_binary")) {
+    glad_glGetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>(load("glGetProgramBinary"));
+    glad_glProgramBinary = reinterpret_cast<PFNGLPROGRAMBINARYPROC>(load("glProgramBinary"));
+    glad_glProgramParameteri = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>(load("glProgramParameteri"));
+    GLint formats{0};
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    program_binary_loaded = glad_glGetProgramBinary && glad_glProgramBinary && glad_glProgramParameteri && formats > 0;
+  }
+
+  // the ARB extension is the same one under its own suffix
+  glad_glMaxShaderCompilerThreadsKHR = {nullptr};
+  if (has_gl_extension("GL_KHR_parallel_shader_compile")) {
+    glad_glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsKHR"));
+  } else if (has_gl_extension("GL_ARB_parallel_shader_compile")) {
+    glad_glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsARB"));
+  }
+  parallel_compile_loaded = glad_glMaxShaderCompilerThreadsKHR != nullptr;
+  if (parallel_compile_loaded)
+    glMaxShaderCompilerThreadsKHR(0xffffffffu);
+}
+
+inline auto has_program_binary() -> bool {
+  return program_binary_loaded;
+}
+
+inline auto has_parallel_compile() -> bool {
+  return parallel_compile_loaded;
+}
+
+#endif // __GL_EXT_H__
@@ -0,0 +1,70 @@
+#ifndef __GL_STATE_H__
+#define __GL_STATE_H__
+
+#include "gl_stats.hpp"
+
+#include <glad/glad.h>
+
+// Shadow copy of the bindings the renderer changes most, calls that would set what is already bound
+// never reach the driver. Anything binding behind its back (the ui, uploads, vertex array setup) makes
+// it stale, so reset() runs at the start of every frame.
+class GlState {
+public:
+  static constexpr unsigned int TEXTURE_UNITS = {16};
+
+  GlState() {
+    reset();
+  }
+
+  void use_program(unsigned int program) {
+    if (program == program_)
+      return;
+    glUseProgram(program);
+    gl_stats().add(PROGRAM_BINDS);
+    program_ = program;
+  }
+
+  void bind_vertex_array(unsigned int vao) {
+    if (vao == vao_)
+      return;
+    glBindVertexArray(vao);
+    gl_stats().add(VAO_BINDS);
+    vao_ = vao;
+  }
+
+  void bind_texture(unsigned int unit, GLenum target, unsigned int texture) {
+    if (textures_[unit] == texture && targets_[unit] == target)
+      return;
+    if (unit != active_unit_) {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      active_unit_ = unit;
+    }
+    glBindTexture(target, texture);
+    gl_stats().add(TEXTURE_BINDS);
+    textures_[unit] = texture;
+    targets_[unit] = target;
+  }
+
+  void reset() {
+    program_ = vao_ = active_unit_ = UNKNOWN;
+    for (unsigned int i{0}; i < TEXTURE_UNITS; i++) {
+      textures_[i] = UNKNOWN;
+      targets_[i] = GL_NONE;
+    }
+  }
+
+  auto program() const -> unsigned int {
+    return program_;
+  }
+
+private:
+  static constexpr unsigned int UNKNOWN = {~0u};
+
+  unsigned int program_;
+  unsigned int vao_;
+  unsigned int active_unit_;
+  unsigned int textures_[TEXTURE_UNITS];
+  GLenum targets_[TEXTURE_UNITS];
+};
+
+#endif // __GL_STATE_H__
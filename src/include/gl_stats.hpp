@@ -0,0 +1,63 @@
+#ifndef __GL_STATS_H__
+#define __GL_STATS_H__
+
+#include <array>
+#include <string>
+#include <vector>
+
+// what the renderer asks of the driver each frame
+enum FrameCounter : unsigned int {
+  DRAW_CALLS,
+  TRIANGLES,
+  UNIFORM_UPLOADS,
+  PROGRAM_BINDS,
+  VAO_BINDS,
+  TEXTURE_BINDS,
+  BUFFER_BYTES,
+  TEXTURE_BYTES,
+  FRAME_COUNTERS
+};
+
+auto frame_counter_name(FrameCounter counter) -> const char *;
+
+// Counters bumped next to the gl calls they describe and rolled into a fixed window of past frames at
+// every end_frame(). Only the context thread issues gl calls, so nothing here is synchronized.
+class GlStats {
+public:
+  static constexpr size_t HISTORY = {300};
+  using Frame = std::array<size_t, FRAME_COUNTERS>;
+
+  void add(FrameCounter counter, size_t amount = 1) {
+    current_[counter] += amount;
+  }
+
+  void draw(size_t vertices, size_t instances = 1) {
+    current_[DRAW_CALLS]++;
+    current_[TRIANGLES] += vertices / 3 * instances;
+  }
+
+  void end_frame();
+
+  // the last finished frame
+  auto last(FrameCounter counter) const -> size_t;
+  // counter over the recorded frames oldest first, out holds HISTORY values, returns how many were written
+  auto series(FrameCounter counter, float *out) const -> size_t;
+  auto frames() const -> size_t {
+    return recorded_;
+  }
+
+  // one row per recorded frame, oldest first, headed by the counter names
+  auto write_csv(const std::string &path) const -> bool;
+
+private:
+  auto recorded(size_t index) const -> const Frame &;
+
+  Frame current_{};
+  std::vector<Frame> history_ = std::vector<Frame>(HISTORY);
+  size_t next_{0};
+  size_t recorded_{0};
+};
+
+auto gl_stats() -> GlStats &;
+
+#endif // __GL_STATS_H__
@@ -0,0 +1,101 @@
+#ifndef __GPU_CULLING_H__
+#define __GPU_CULLING_H__
+
+#include "bounds.hpp"
+#include "gl_state.hpp"
+#include "shader.hpp"
+#include "structs.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// DrawElementsIndirectCommand. Array draws read the first four words as DrawArraysIndirectCommand,
+// so their base instance sits in base_vertex as well
+struct IndirectCommand {
+  unsigned int count;
+  unsigned int instance_count; // written by the culling pass
+  unsigned int first;
+  int base_vertex;
+  unsigned int base_instance;
+};
+
+// one culled object, laid out as std430 reads it in cull.comp
+struct GpuObject {
+  glm::mat4 model;
+  glm::vec4 normal[3]; // mat3 columns padded to vec4
+  glm::vec3 bounds_min; // world space
+  unsigned int draw;
+  glm::vec3 bounds_max;
+  float padding;
+};
+
+// Gpu driven culling and submission (gl 4.3). Objects live in a storage buffer, each one repeating a
+// single indirect draw. Every frame a compute pass tests all of them against the frustum, counting the
+// survivors into their draw's instance count and copying their InstanceData into that draw's run of an
+// instance buffer. Attached vertex arrays read it as the lighting shader's instanced attributes, so a
+// draw's base instance selects its run and the shader needs no changes. The cpu only uploads the objects
+// that moved, its cost doesn't grow with the object count.
+class GpuCulling {
+public:
+  // first of the 7 attribute locations an InstanceData takes, as in lighting.vert
+  static constexpr unsigned int INSTANCE_LOCATION = {3};
+
+  GpuCulling() = default;
+  GpuCulling(const GpuCulling &) = delete;
+  auto operator=(const GpuCulling &) -> GpuCulling & = delete;
+  ~GpuCulling();
+
+  // compiles the culling pass, false on contexts before 4.3 where nothing else may be called
+  auto setup() -> bool;
+  auto ready() const -> bool {
+    return ready_;
+  }
+
+  // a draw of count indices from first (vertices when index_type is 0), returns its command
+  auto add_draw(unsigned int count, unsigned int first, int base_vertex, unsigned int index_type) -> unsigned int;
+  // changes the range a draw repeats, for level of detail switches
+  void set_range(unsigned int draw, unsigned int count, unsigned int first);
+  auto add_object(unsigned int draw, const glm::mat4 &model, const glm::mat3 &normal, const AABB &bounds) -> unsigned int;
+  void move_object(unsigned int object, const glm::mat4 &model, const glm::mat3 &normal, const AABB &bounds);
+  // forgets every draw and object, attached vertex arrays stay attached
+  void clear();
+
+  // points the instanced attributes of vao at the culled instances, only draws through the indirect
+  // commands read them
+  void attach(unsigned int vao);
+
+  // uploads what changed and culls every object into the commands, which stay bound as the draw
+  // indirect buffer
+  void cull(const glm::mat4 &view_projection, bool frustum_culling, GlState &state);
+
+  auto objects() const -> size_t {
+    return objects_.size();
+  }
+  auto draws() const -> size_t {
+    return commands_.size();
+  }
+
+private:
+  void upload();
+
+  bool ready_{false};
+  Shader shader_;
+  Uniform<glm::vec4> planes_;
+  Uniform<int> object_count_;
+  Uniform<bool> frustum_culling_;
+
+  unsigned int object_buffer_{};
+  unsigned int command_buffer_{};
+  unsigned int instance_buffer_{};
+  size_t capacity_{0};
+
+  std::vector<GpuObject> objects_;
+  std::vector<IndirectCommand> commands_; // instance counts always 0, the pass starts from these
+  std::vector<unsigned int> draw_objects_;
+  std::vector<bool> draw_indexed_;
+  bool layout_dirty_{false};
+  size_t dirty_first_{0};
+  size_t dirty_last_{0};
+};
+
+#endif // __GPU_CULLING_H__
@@ -9,6 +9,7 @@ struct LightSource {
    float ambient_strength{0.3f};
    float diffuse_strength{2.0f};
    float specular_strength{7.0f};
+   bool cast_shadows{true}; // spot and point lights only, through the shadow atlas
 };
 
 struct PointLight : LightSource {
@@ -42,4 +43,48 @@ struct SpotLight : LightSource {
    float outer_cutoff{13.0f};
 };
 
-#endif // __LIGHT_SOURCE_H__
\ No newline at end of file
+// capacity of the Lights uniform block, this must match the define in lighting.frag
+constexpr unsigned int MAX_DIR_LIGHTS = 4;
+constexpr unsigned int LIGHTS_BINDING = 0;
+// a cutoff below -1 can never be reached by a cosine, it marks a packed point light
+constexpr float POINT_LIGHT_CUTOFF = -2.0f;
+
+// std140 mirror of a directional light as lighting.frag's Lights block reads it: view space,
+// colors premultiplied by their strengths.
+struct DirLightData {
+   glm::vec3 direction;
+   float padding0;
+   glm::vec3 ambient;
+   float padding1;
+   glm::vec3 diffuse;
+   float padding2;
+   glm::vec3 specular;
+   float padding3;
+};
+
+// Point and spot lights are clustered and share this layout, 5 RGBA32F texels per light in the
+// clusterLights texture buffer. Scalars ride in the fourth component of the preceding vec3 and
+// point lights are spot lights with a POINT_LIGHT_CUTOFF.
+struct LocalLightData {
+   glm::vec3 position;
+   float constant;
+   glm::vec3 direction;
+   float linear;
+   glm::vec3 ambient;
+   float quadratic;
+   glm::vec3 diffuse;
+   float cutoff;
+   glm::vec3 specular;
+   float outer_cutoff;
+};
+
+// only enabled lights are packed, counts holds how many of each (directional, spot, point)
+struct LightBlock {
+   glm::ivec4 counts;
+   DirLightData dir_lights[MAX_DIR_LIGHTS];
+};
+
+static_assert(sizeof(DirLightData) == 64, "directional lights must follow the std140 layout of the Lights block");
+static_assert(sizeof(LocalLightData) == 5 * sizeof(glm::vec4), "local lights must fill whole texels");
+
+#endif // __LIGHT_SOURCE_H__
@@ -0,0 +1,35 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+#include <string>
+
+// A read only view of a whole file through the os page cache, nothing is copied until the pages are touched.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  auto open(const std::string &path) -> bool;
+  void close();
+
+  auto data() const -> const unsigned char * {
+    return data_;
+  }
+  auto size() const -> size_t {
+    return size_;
+  }
+
+private:
+  const unsigned char *data_{nullptr};
+  size_t size_{0};
+#ifdef _WIN32
+  void *file_{nullptr};
+  void *mapping_{nullptr};
+#endif
+};
+
+#endif // __MAPPED_FILE_H__
@@ -0,0 +1,62 @@
+#ifndef __MATERIAL_H__
+#define __MATERIAL_H__
+
+#include "gl_state.hpp"
+#include "shader.hpp"
+#include "structs.hpp"
+
+#include <string>
+#include <vector>
+
+// the maps the lighting shader samples, each bound to the texture unit of the same number
+enum MaterialMap : unsigned int { DIFFUSE_MAP, SPECULAR_MAP, EMISSION_MAP, MATERIAL_MAPS };
+
+// the defines lighting style shaders are compiled with, feature bit i samples map i (see Material::features)
+inline const std::vector<std::string> MATERIAL_FEATURES = {"DIFFUSE_MAP", "SPECULAR_MAP", "EMISSION_MAP"};
+constexpr unsigned int MATERIAL_VARIANTS = {1u << MATERIAL_MAPS};
+
+// the lighting shader's material uniforms, resolved once after it links
+struct MaterialUniforms {
+  Uniform<int> maps[MATERIAL_MAPS];
+
+  void resolve(const Shader &shader);
+  // points every sampler at its unit, only needs doing once per program
+  void bind_samplers(const Shader &shader) const;
+};
+
+// Texture maps and the switches for sampling them, built once when a model is imported. Binding is a
+// fixed handful of gl calls through the state cache, so maps already bound to their unit cost nothing. Ids are unique for the life of
+// the process so draws can be sorted and batched by material. Which maps are sampled isn't a uniform, the
+// draws go through the shader variant compiled for the material's features.
+class Material {
+public:
+  Material();
+  Material(const Material &) = delete;
+  Material &operator=(const Material &) = delete;
+
+  void set_map(MaterialMap map, TextureRef texture);
+  auto map(MaterialMap map) const -> unsigned int {
+    return maps_[map] ? maps_[map]->id : 0;
+  }
+  auto id() const -> unsigned int {
+    return id_;
+  }
+
+  void bind(GlState &state) const;
+  // the MATERIAL_FEATURES bits to draw with, set for every map that exists and is switched on
+  auto features() const -> unsigned int;
+
+  // a map is only sampled while it exists and its switch is on
+  bool diffuse{true};
+  bool specular{true};
+  bool emissive{true};
+
+private:
+  unsigned int id_;
+  TextureRef maps_[MATERIAL_MAPS];
+};
+
+// the map a model texture of the given type ("texture_diffuse", ...) goes into, MATERIAL_MAPS when none
+auto material_map(const std::string &type) -> MaterialMap;
+
+#endif // __MATERIAL_H__
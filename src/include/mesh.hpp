@@ -1,29 +1,75 @@
 #ifndef __MESH_H__
 #define __MESH_H__
 
+#include "bounds.hpp"
+#include "material.hpp"
 #include "structs.hpp"
 #include "shader.hpp"
 
+#include <memory>
 #include <vector>
 
-class Model;
+struct CookedMesh;
 
 class Mesh {
 public:
-   Mesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const std::vector<Texture> &textures);
+   // indices hold every level in lods, no lods means a single level covering all of them
+   Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::shared_ptr<Material> material,
+        std::vector<MeshLod> lods = {}, VertexFormat format = VertexFormat::FLOAT);
+   // uploads the streams of a mapped cache file as they are and keeps the file for the occluder arrays,
+   // vertices and indices stay empty. format has to be the one the file was cooked for
+   Mesh(const CookedMesh &cooked, std::shared_ptr<Material> material, VertexFormat format = VertexFormat::FLOAT);
 
-   void draw(const Shader &shader, const Model &parent);
+   // picks the coarsest level whose error stays under max_pixels, pixels_per_unit being how large one
+   // object space unit at the mesh appears on screen. Coarser levels are only taken with some margin
+   // so a mesh sitting at a switch distance doesn't flicker between two of them
+   void select_lod(float pixels_per_unit, float max_pixels);
+   // the same choice for another view without hysteresis, leaving lod alone
+   auto lod_for(float pixels_per_unit, float max_pixels) const -> unsigned int;
 
+   auto vao() const -> unsigned int {
+      return gpu_->vao;
+   }
+   auto index_count() const -> unsigned int {
+      return static_cast<unsigned int>(gpu_->index_count);
+   }
+   auto index_type() const -> unsigned int {
+      return gpu_->index_type;
+   }
+   // where the mesh sits in its geometry arena, indices are relative to the base vertex
+   auto base_vertex() const -> int {
+      return static_cast<int>(gpu_->first_vertex);
+   }
+   auto first_index() const -> unsigned int {
+      size_t index_size = {gpu_->index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int)};
+      return static_cast<unsigned int>(gpu_->index_offset / index_size);
+   }
+   // applied before the model matrix, takes quantized positions back into bounds (identity for floats)
+   auto position_transform() const -> const glm::mat4 & {
+      return position_transform_;
+   }
+
+   // cpu copies, only kept until the model has been cooked
    std::vector<Vertex> vertices;
    std::vector<unsigned int> indices;
-   std::vector<Texture> textures;
+   // object space positions and every level's indices for occlusion culling on the cpu, they point into
+   // the mapped cache file or into arrays shared with the mesh's copies
+   const glm::vec3 *occluder_positions{};
+   size_t occluder_vertex_count{0};
+   const unsigned int *occluder_indices{};
+   std::shared_ptr<Material> material;
+   AABB bounds;
+   std::vector<MeshLod> lods; // the full mesh first, each a range of the index buffer
+   unsigned int lod{0};       // level drawn this frame
+   bool visible{true};
 
 private:
-   void setup_mesh();
+   void upload(const void *vertices, size_t vertex_count, const void *indices, size_t index_count, size_t index_size,
+               VertexFormat format);
 
-   unsigned int vao_;
-   unsigned int vbo_;
-   unsigned int ebo_;
+   MeshRef gpu_;
+   std::shared_ptr<const void> occluder_source_; // whatever holds the occluder arrays
+   glm::mat4 position_transform_{1.0f};
 };
 
 #endif // __MESH_H__
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include "bounds.hpp"
+#include "mapped_file.hpp"
+#include "structs.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Mesh;
+
+// one mesh inside a mapped cache file, the arrays point straight into the mapping and stay valid while
+// file is held
+struct CookedMesh {
+  const void *vertices; // in the vertex format the file was cooked for
+  unsigned int vertex_count;
+  const void *indices; // index_size bytes each
+  unsigned int index_count;
+  unsigned int index_size;
+  const glm::vec3 *positions;           // object space, for occlusion culling
+  const unsigned int *occluder_indices; // the same indices at 32 bits
+  AABB bounds;
+  std::vector<MeshLod> lods;
+  std::vector<unsigned int> textures; // slots in MeshCache::textures()
+  std::shared_ptr<const MappedFile> file;
+};
+
+// Cooked models stored next to their source as <source>.meshcache, or <source>.quantized.meshcache for
+// the QUANTIZED format. A file is only used while the source's size, modification time, the import flags
+// and the vertex format match the ones it was cooked from. It holds the vertex and index streams exactly
+// as the format uploads them and the float positions occlusion culling reads, so loading one is a single
+// mmap with nothing to parse or convert.
+class MeshCache {
+public:
+  static constexpr const char *EXTENSION = {".meshcache"};
+
+  // maps the cooked file for source, false when there is none, it no longer matches the source or
+  // anything in it is out of range
+  auto open(const std::string &source, unsigned int import_flags, VertexFormat format) -> bool;
+
+  auto meshes() const -> const std::vector<CookedMesh> & {
+    return meshes_;
+  }
+  // paths relative to the model's directory, ids are left at 0
+  auto textures() const -> const std::vector<Texture> & {
+    return textures_;
+  }
+
+  // cooks imported meshes for format, mesh_textures[i] lists the slots in textures that meshes[i] samples
+  static auto write(const std::string &source, unsigned int import_flags, VertexFormat format, const Mesh *meshes, size_t mesh_count,
+                    const std::vector<std::vector<unsigned int>> &mesh_textures, const std::vector<Texture> &textures) -> bool;
+
+private:
+  std::shared_ptr<MappedFile> file_;
+  std::vector<CookedMesh> meshes_;
+  std::vector<Texture> textures_;
+};
+
+#endif // __MESH_CACHE_H__
@@ -0,0 +1,48 @@
+#ifndef __MESH_OPTIMIZER_H__
+#define __MESH_OPTIMIZER_H__
+
+#include "structs.hpp"
+
+#include <vector>
+
+// post-transform cache efficiency of an index buffer, simulated with a FIFO cache
+struct VertexCacheStats {
+  float acmr; // misses per triangle, 0.5 is the ideal for a large regular grid, 3 means no reuse at all
+  float atvr; // misses per referenced vertex, 1 means every vertex is transformed exactly once
+};
+
+struct MeshOptimizeReport {
+  size_t vertices_before;
+  size_t vertices_after;
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+constexpr unsigned int STATS_CACHE_SIZE = {16};
+
+auto analyze_vertex_cache(const std::vector<unsigned int> &indices, size_t vertex_count,
+                          unsigned int cache_size = STATS_CACHE_SIZE) -> VertexCacheStats;
+
+// merges bitwise identical vertices, kept in order of first occurrence
+void weld_vertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+// reorders triangles for post-transform cache hits (Forsyth's linear speed optimizer), dropping degenerate ones
+void optimize_vertex_cache(std::vector<unsigned int> &indices, size_t vertex_count);
+// splits a cache optimized stream into clusters and draws the outward facing ones first, threshold
+// bounds how much worse than the input acmr each cluster may get (Sander et al., Tipsify)
+void optimize_overdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, float threshold = 1.05f);
+// renumbers vertices in the order the indices first use them and drops the unused ones
+void optimize_vertex_fetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// every pass above in order, deterministic so the result can be cooked
+auto optimize_mesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) -> MeshOptimizeReport;
+
+// collapses edges in quadric error order until at most target_count indices are left. Vertices on
+// borders and uv or normal seams stay put so the result never cracks, error receives the largest
+// quadric error (as a distance) of the collapses made
+auto simplify_mesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, size_t target_count,
+                   float &error) -> std::vector<unsigned int>;
+// appends simplified levels of indices to it (sharing the vertices), returns every level's range with
+// the full mesh first. Stops early once simplifying no longer removes much
+auto build_lods(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) -> std::vector<MeshLod>;
+
+#endif // __MESH_OPTIMIZER_H__
@@ -2,6 +2,7 @@
 #define __MODEL_H__
 
 #include "mesh.hpp"
+#include "mesh_optimizer.hpp"
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
@@ -12,23 +13,41 @@
 class Model {
 public:
   Model() = default;
-  Model(const char *path);
+  Model(const char *path, VertexFormat format = VertexFormat::FLOAT);
 
-  void draw(const Shader &shader);
+  auto meshes() -> std::vector<Mesh> & {
+    return meshes_;
+  }
 
-  bool has_diffuse{false};
-  bool has_specular{false};
-  bool has_emission{false};
+  // every distinct material the meshes use, shared with other models loaded from the same file
+  auto materials() const -> const std::vector<std::shared_ptr<Material>> & {
+    return materials_;
+  }
+
+  // what the optimizer did to each mesh, empty unless this model ran the import itself (not cooked or shared)
+  auto optimize_reports() const -> const std::vector<MeshOptimizeReport> & {
+    return optimize_reports_;
+  }
 
 private:
   void load_model(const std::string &path);
-  void process_node(const aiNode *node, const aiScene *scene);
-  Mesh process_mesh(const aiMesh *mesh, const aiScene *scene);
-  std::vector<Texture> load_material_textures(const aiMaterial *mat, aiTextureType type, const std::string &type_name);
+  auto load_cooked(const std::string &path) -> bool;
+  auto import_model(const std::string &path) -> bool;
+  void collect_meshes(const aiNode *node, std::vector<unsigned int> &meshes) const;
+  // registers the material's textures for decoding, returns their slots in textures_loaded_
+  std::vector<unsigned int> load_material_textures(const aiMaterial *mat, aiTextureType type, const std::string &type_name);
+  // the material sampling the given slots in textures_loaded_, built the first time that set is seen
+  auto material_for(const std::vector<unsigned int> &slots) -> std::shared_ptr<Material>;
 
   std::vector<Mesh> meshes_;
+  VertexFormat format_{VertexFormat::FLOAT};
+  ModelRef source_; // the registry's copy, shared with every model loaded from the same file
   std::string directory_;
   std::vector<Texture> textures_loaded_;
+  std::map<std::string, unsigned int> texture_slots_;
+  std::map<std::vector<unsigned int>, std::shared_ptr<Material>> material_slots_;
+  std::vector<std::shared_ptr<Material>> materials_;
+  std::vector<MeshOptimizeReport> optimize_reports_;
 };
 
 #endif // __MODEL_H__
\ No newline at end of file
@@ -0,0 +1,105 @@
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+#include "bounds.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// one 32x4 pixel tile of the occlusion buffer
+struct alignas(16) OcclusionTile {
+  uint32_t mask[4]; // a row of 32 pixels per word, set where the working layer covers
+  float reference;  // the whole tile has an occluder at most this far away
+  float working;    // the farthest occluder under mask
+};
+
+// Software occlusion culling over a masked depth buffer (Hasselgren et al., Masked Software Occlusion
+// Culling). The buffer is split into 32x4 pixel tiles that each keep two depths instead of one per pixel:
+// a reference the whole tile lies in front of, and a working layer covering the pixels in a bit mask.
+// Occluders are merged in as they come and the working layer replaces the reference once its mask fills
+// the tile. Depths are view distances (clip w), an occluder triangle counts at its farthest corner.
+//
+// Coverage is sampled at pixel centers like the gpu does, so sized like the screen a box is only reported
+// hidden when none of the pixels it could shade would survive the depth test. A smaller buffer is cheaper
+// but no longer exact, gaps thinner than its pixels close up and hide what is behind them.
+class OcclusionBuffer {
+public:
+  static constexpr int TILE_WIDTH = {32};
+  static constexpr int TILE_HEIGHT = {4};
+
+  OcclusionBuffer(unsigned int width, unsigned int height);
+
+  // starts a frame seen through view_projection, every tile back at infinity and no occluders queued
+  void clear(const glm::mat4 &view_projection);
+  // queues indexed triangles in object space, either winding. The arrays are only read by rasterize,
+  // they have to outlive it
+  void add_occluder(const glm::vec3 *positions, size_t vertex_count, const unsigned int *indices, size_t index_count,
+                    const glm::mat4 &model);
+  // transforms every queued occluder and rasterizes them, both spread over the worker pool
+  void rasterize();
+  // whether everything inside the box is behind what was rasterized, safe from several threads
+  auto occluded(const AABB &box) const -> bool;
+
+  auto width() const -> unsigned int {
+    return width_;
+  }
+  auto height() const -> unsigned int {
+    return height_;
+  }
+  // row major, tiles_x() per row
+  auto tiles() const -> const std::vector<OcclusionTile> & {
+    return tiles_;
+  }
+  auto tiles_x() const -> int {
+    return tiles_x_;
+  }
+  // triangles that reached the rasterizer last frame, after near plane, size and screen rejection
+  auto triangles() const -> size_t {
+    return triangles_;
+  }
+
+private:
+  // a triangle in buffer pixels wound counter clockwise, y up
+  struct ScreenTriangle {
+    float x[3];
+    float y[3];
+    float depth;
+    int x_begin; // the pixels whose centers lie inside its bounds
+    int x_end;
+    int y_begin;
+    int y_end;
+  };
+  struct Occluder {
+    const glm::vec3 *positions;
+    size_t vertex_count;
+    const unsigned int *indices;
+    size_t index_count;
+    glm::mat4 transform; // object space to clip space
+  };
+  // the triangles set up from a run of occluders, binned by the bands of tile rows they touch
+  struct Batch {
+    std::vector<glm::vec4> clip;
+    std::vector<ScreenTriangle> triangles;
+    std::vector<unsigned int> band_offsets; // band i's triangles start at band_offsets[i]
+    std::vector<unsigned int> band_triangles;
+  };
+
+  void setup_batch(unsigned int batch);
+  void rasterize_band(unsigned int band);
+  void rasterize_triangle(const ScreenTriangle &triangle, int first_row, int last_row);
+  auto bands() const -> int;
+
+  unsigned int width_;
+  unsigned int height_;
+  int tiles_x_;
+  int tiles_y_;
+  glm::mat4 view_projection_{1.0f};
+  std::vector<OcclusionTile> tiles_;
+  std::vector<Occluder> occluders_;
+  std::vector<Batch> batches_;
+  size_t triangles_{0};
+};
+
+#endif // __OCCLUSION_H__
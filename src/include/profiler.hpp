@@ -0,0 +1,126 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// a finished zone, times in microseconds since the profiler started
+struct ProfileEvent {
+  const char *name;
+  double start;
+  double duration;
+  unsigned int thread; // GPU_THREAD for gpu zones
+  unsigned int depth;  // nesting level on its thread
+};
+
+// Collects cpu zones from any thread and gpu zones from the context thread. Every event lands in the
+// trace while recording, which is on from launch so startup and asset loading show up; the finished
+// frame is also kept apart for the editor's timeline.
+//
+// Gpu zones time GL_TIME_ELAPSED queries and can't nest, a zone opened inside another is timed as part of
+// the outer one. Their queries rotate through two frames of slots and a result is only read once the
+// driver says it is ready, so waiting on the gpu never happens; one that isn't ready in time, or that
+// finds every slot taken, is dropped. Gpu events start at the cpu time the zone was opened.
+class Profiler {
+public:
+  static constexpr unsigned int GPU_THREAD = {~0u};
+  static constexpr size_t MAX_TRACE_EVENTS = {1u << 20};
+
+  auto now() const -> double;
+  void record(const char *name, double start, double duration, unsigned int depth);
+
+  void begin_gpu(const char *name);
+  void end_gpu();
+
+  // reads back finished gpu zones and starts a new frame, call once per frame on the context thread
+  void end_frame();
+  // deletes the gpu queries, call before the context goes away
+  void shutdown();
+
+  auto frame() const -> const std::vector<ProfileEvent> & {
+    return last_frame_;
+  }
+  auto frame_start() const -> double {
+    return last_frame_start_;
+  }
+  auto frame_end() const -> double {
+    return last_frame_end_;
+  }
+  // gpu zones that went without a timing of their own, counted up to the last end_frame
+  auto gpu_dropped() const -> size_t {
+    return last_gpu_dropped_;
+  }
+  auto gpu_nested() const -> size_t {
+    return last_gpu_nested_;
+  }
+
+  void set_recording(bool recording);
+  auto recording() const -> bool {
+    return recording_;
+  }
+  auto trace_events() const -> size_t;
+  // writes the trace as chrome trace_event json (chrome://tracing, perfetto) and empties it
+  auto write_trace(const std::string &path) -> bool;
+
+private:
+  struct GpuQuery {
+    unsigned int query{};
+    const char *name{};
+    double start{};
+    bool pending{false};
+  };
+  static constexpr size_t GPU_SLOTS = {2};
+  static constexpr size_t GPU_ZONES = {16};
+
+  std::chrono::steady_clock::time_point epoch_ = {std::chrono::steady_clock::now()};
+  mutable std::mutex mutex_;
+  std::vector<ProfileEvent> trace_;
+  std::vector<ProfileEvent> current_frame_;
+  std::vector<ProfileEvent> last_frame_;
+  double frame_start_{0.0};
+  double last_frame_start_{0.0};
+  double last_frame_end_{0.0};
+  bool recording_{true};
+
+  GpuQuery gpu_queries_[GPU_SLOTS][GPU_ZONES];
+  size_t gpu_slot_{0};
+  size_t gpu_used_{0};
+  unsigned int gpu_depth_{0};
+  bool gpu_open_{false}; // the outermost zone got a query
+  size_t gpu_dropped_{0};
+  size_t gpu_nested_{0};
+  size_t last_gpu_dropped_{0};
+  size_t last_gpu_nested_{0};
+};
+
+auto profiler() -> Profiler &;
+
+// times its scope on the calling thread, name must outlive the profiler (a literal)
+class ProfileZone {
+public:
+  explicit ProfileZone(const char *name);
+  ~ProfileZone();
+  ProfileZone(const ProfileZone &) = delete;
+  ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+  const char *name_;
+  double start_;
+};
+
+// times its scope on the gpu
+class GpuZone {
+public:
+  explicit GpuZone(const char *name) {
+    profiler().begin_gpu(name);
+  }
+  ~GpuZone() {
+    profiler().end_gpu();
+  }
+  GpuZone(const GpuZone &) = delete;
+  GpuZone &operator=(const GpuZone &) = delete;
+};
+
+#endif // __PROFILER_H__
@@ -0,0 +1,50 @@
+#ifndef __PROGRAM_CACHE_H__
+#define __PROGRAM_CACHE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Linked programs kept on disk as <DIRECTORY>/<key>.bin, read back with glProgramBinary instead of being
+// compiled again. The key hashes the sources exactly as they are compiled (defines included) together
+// with the driver's vendor, renderer and version strings, so an edited shader or an updated driver only
+// misses. A binary the driver refuses is deleted and the program is compiled as if it never existed.
+class ProgramCache {
+public:
+  static constexpr const char *DIRECTORY = {"shader_cache"};
+
+  // false without program binaries on this context, or when switched off
+  auto enabled() const -> bool;
+  void set_enabled(bool enabled) {
+    enabled_ = enabled;
+  }
+
+  // needs a current context the first time, for the driver strings
+  auto key(const std::vector<const std::string *> &sources) -> uint64_t;
+  // a linked program made from the binary stored under key, 0 when there is none or it was rejected
+  auto load(uint64_t key) -> unsigned int;
+  // keeps a linked program's binary under key
+  auto store(uint64_t key, unsigned int program) -> bool;
+
+  // programs loaded from binaries, and compiled instead (rejected binaries included)
+  auto hits() const -> size_t {
+    return hits_;
+  }
+  auto misses() const -> size_t {
+    return misses_;
+  }
+  auto rejected() const -> size_t {
+    return rejected_;
+  }
+
+private:
+  bool enabled_{true};
+  std::string driver_;
+  size_t hits_{0};
+  size_t misses_{0};
+  size_t rejected_{0};
+};
+
+auto program_cache() -> ProgramCache &;
+
+#endif // __PROGRAM_CACHE_H__
@@ -0,0 +1,90 @@
+#ifndef __RENDER_QUEUE_H__
+#define __RENDER_QUEUE_H__
+
+#include "gl_state.hpp"
+#include "material.hpp"
+#include "shader.hpp"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// passes run in this order, their number is the top of every sort key
+enum class RenderPass : unsigned int { OPAQUE_PASS, UNLIT_PASS, TRANSPARENT_PASS };
+
+// a shader and the handles the queue writes per draw, unused handles stay at -1
+struct RenderProgram {
+  const Shader *shader{};
+  Uniform<glm::mat4> model;
+  Uniform<glm::mat3> normal_matrix;
+  Uniform<glm::vec3> color;
+  Uniform<bool> instanced;
+  // its items are runs of gpu culling commands (first, count) drawn with one multi draw indirect, the
+  // per object data comes in as instances
+  bool indirect{false};
+};
+
+// per draw uniforms, pushed once and shared by every item using the same index
+struct DrawConstants {
+  glm::mat4 model;
+  glm::mat3 normal;
+  glm::vec3 color;
+};
+
+struct DrawItem {
+  uint64_t key;
+  const RenderProgram *program;
+  const Material *material; // null when the program samples no maps
+  unsigned int vao;
+  unsigned int constants;
+  unsigned int count;      // vertices, or indices when indexed (commands for indirect programs)
+  unsigned int first;      // first vertex or index (command)
+  int base_vertex;         // added to every index
+  unsigned int instances;  // 0 for a plain draw
+  unsigned int index_type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, 0 draws arrays
+  const char *zone; // gpu profiler zone, consecutive items with the same one are timed together
+};
+
+// 64 bit key, most significant first: pass | program | material | vertex array | depth. Opaque depth
+// sorts front to back for early z rejection, transparent depth back to front.
+auto sort_key(RenderPass pass, unsigned int program, unsigned int material, unsigned int vao, float depth) -> uint64_t;
+
+// Draws collected over a frame, radix sorted by key and issued through a GlState so runs of items with
+// the same program, material and vertex array only pay for their draw calls. Indexed runs that also
+// share their constants become a single glMultiDrawElementsBaseVertex, and indirect items whose command
+// runs follow each other a single multi draw indirect.
+class RenderQueue {
+public:
+  auto push_constants(const glm::mat4 &model, const glm::mat3 &normal, const glm::vec3 &color = glm::vec3{1.0f}) -> unsigned int;
+  void submit(const DrawItem &item);
+
+  void sort();
+  void execute(GlState &state) const;
+  // only the items of one pass, for renderers that need work between passes
+  void execute(GlState &state, RenderPass pass) const;
+  // empties the queue keeping its storage
+  void clear();
+
+  auto size() const -> size_t {
+    return items_.size();
+  }
+
+private:
+  struct SortEntry {
+    uint64_t key;
+    unsigned int item;
+  };
+
+  void execute_range(GlState &state, size_t begin, size_t end) const;
+
+  std::vector<DrawItem> items_;
+  std::vector<DrawConstants> constants_;
+  std::vector<SortEntry> order_;
+  std::vector<SortEntry> scratch_;
+  // argument arrays of the multi draw being issued
+  mutable std::vector<GLsizei> multi_counts_;
+  mutable std::vector<const void *> multi_offsets_;
+  mutable std::vector<GLint> multi_base_vertices_;
+};
+
+#endif // __RENDER_QUEUE_H__
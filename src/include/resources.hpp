@@ -0,0 +1,85 @@
+#ifndef __RESOURCES_H__
+#define __RESOURCES_H__
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct GpuTexture {
+  unsigned int id;
+};
+
+class GeometryArena;
+
+// a mesh's ranges inside the geometry arena of its vertex format
+struct GpuMesh {
+  unsigned int vao; // the arena's, shared by every mesh of the same format
+  GeometryArena *arena;
+  size_t first_vertex;
+  size_t vertex_count;
+  size_t index_offset; // bytes into the arena's index buffer
+  size_t index_count;
+  unsigned int index_type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+};
+
+class Mesh;
+
+// Handles are reference counted, copying one shares the gpu object and the last copy to go away queues it
+// for deletion.
+using TextureRef = std::shared_ptr<const GpuTexture>;
+using MeshRef = std::shared_ptr<const GpuMesh>;
+using ModelRef = std::shared_ptr<const std::vector<Mesh>>;
+
+// Process wide owner of textures and meshes. Loads are looked up by key (a file path) so every user of
+// the same file shares one gpu copy. Released objects aren't deleted on the spot, a handle can die on
+// any thread or after the context is gone, so they wait for collect() on the context thread.
+class ResourceRegistry {
+public:
+  static auto instance() -> ResourceRegistry &;
+
+  auto find_texture(const std::string &key) -> TextureRef;
+  auto add_texture(const std::string &key, unsigned int id) -> TextureRef;
+  // the texture at path, decoded and uploaded on the first request
+  auto load_texture(const std::string &path) -> TextureRef;
+
+  auto add_mesh(const GpuMesh &mesh) -> MeshRef;
+
+  // the meshes of an imported model file, shared by every Model loaded from it
+  auto find_model(const std::string &key) -> ModelRef;
+  auto add_model(const std::string &key, std::vector<Mesh> meshes) -> ModelRef;
+
+  // deletes everything released since the last call, needs the context current
+  void collect();
+  // flushes the pending deletes before the context is destroyed, handles released afterwards die with it
+  void shutdown();
+
+  auto textures() const -> size_t;
+  auto meshes() const -> size_t;
+  auto pending() -> size_t;
+
+  // for gl objects owned outside the registry (VertexArray, GpuCulling, ShadowCascades), deleted on the next collect()
+  void defer_delete_buffer(unsigned int buffer);
+  void defer_delete_vertex_array(unsigned int vao);
+  void defer_delete_texture(unsigned int texture);
+  void defer_delete_framebuffer(unsigned int framebuffer);
+
+private:
+  ResourceRegistry() = default;
+
+  void retire(std::vector<unsigned int> &dead, unsigned int id);
+
+  std::unordered_map<std::string, std::weak_ptr<const GpuTexture>> textures_;
+  std::unordered_map<std::string, std::weak_ptr<const std::vector<Mesh>>> models_;
+  std::vector<std::weak_ptr<const GpuMesh>> meshes_;
+
+  std::mutex pending_mutex_;
+  std::vector<unsigned int> dead_textures_;
+  std::vector<unsigned int> dead_buffers_;
+  std::vector<unsigned int> dead_vertex_arrays_;
+  std::vector<unsigned int> dead_framebuffers_;
+  bool closed_{false};
+};
+
+#endif // __RESOURCES_H__
@@ -5,17 +5,62 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <initializer_list>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+// a uniform location resolved once, typed by the value it accepts
+template <typename T> struct Uniform {
+   int location{-1};
+};
+
+// A linked program and its uniform locations. Programs come from the program cache when it holds them,
+// otherwise they are only submitted for compiling: the driver may work on them in the background (see
+// has_parallel_compile) until finish() checks the result, stores the binary and reflects the uniforms.
 class Shader {
 public:
    Shader() {}
    Shader(const char *vertexPath, const char *fragmentPath);
+   // a compute program, needs a gl 4.3 context. Finished right away
+   explicit Shader(const char *computePath);
+   // a program from sources already read, compiled with the given #defines
+   static auto from_source(const std::string &vertexCode, const std::string &fragmentCode,
+                           const std::vector<std::string> &defines = {}) -> Shader;
+
+   // true when finish() won't wait on the driver, never blocks
+   auto ready() const -> bool;
+   // waits for the program, reports compile and link errors and keeps its binary, a no-op once done
+   void finish();
+   auto finished() const -> bool {
+      return stages_[0] == 0;
+   }
 
    void use();
+   auto id() const -> unsigned int {
+      return id_;
+   }
+
+   void bind_block(const std::string &name, unsigned int binding) const;
+
+   auto location(const std::string &name) const -> int;
+   template <typename T> auto uniform(const std::string &name) const -> Uniform<T> {
+      return Uniform<T>{location(name)};
+   }
+
+   void set(Uniform<bool> uniform, bool value) const;
+   void set(Uniform<int> uniform, int value) const;
+   void set(Uniform<float> uniform, float value) const;
+   void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const;
+   void set(Uniform<glm::ivec3> uniform, const glm::ivec3 &value) const;
+   void set(Uniform<glm::mat3> uniform, const glm::mat3 &value) const;
+   void set(Uniform<glm::mat4> uniform, const glm::mat4 &value) const;
+   void set(Uniform<glm::vec4> uniform, const glm::vec4 *values, int count) const;
+   void set(Uniform<glm::mat4> uniform, const glm::mat4 *values, int count) const;
 
    void set_bool(const std::string &name, bool value) const;
    void set_int(const std::string &name, int value) const;
@@ -27,7 +72,40 @@ public:
    void set_matrix(const std::string &name, const glm::mat3 &matrix) const;
 
 private:
+   void reflect_uniforms();
+
    unsigned int id_;
+   std::unordered_map<std::string, int> uniforms_;
+   // shader objects still attached while the program is compiling, and its cache key
+   unsigned int stages_[2]{};
+   uint64_t key_{0};
+};
+
+// finishes every shader, the ones the driver is done with first so a program still compiling on another
+// thread is only waited on when nothing else is left
+void finish_shaders(std::initializer_list<Shader *> shaders);
+
+// One shader compiled as a separate program per combination of features, bit i of a key defines the i-th
+// feature name. A combination is compiled the first time it is asked for and kept from then on, so the
+// branches a feature guards are resolved by the compiler instead of per fragment.
+class ShaderVariants {
+public:
+   ShaderVariants() {}
+   ShaderVariants(const char *vertexPath, const char *fragmentPath, std::vector<std::string> features);
+
+   // submits the variant for compiling without waiting on it
+   void prepare(unsigned int key);
+   // the finished variant, references stay valid while the variants live
+   auto get(unsigned int key) -> const Shader &;
+   auto compiled() const -> size_t {
+      return variants_.size();
+   }
+
+private:
+   std::string vertex_code_;
+   std::string fragment_code_;
+   std::vector<std::string> features_;
+   std::unordered_map<unsigned int, Shader> variants_;
 };
 
 #endif // __SHADER_H__
\ No newline at end of file
@@ -0,0 +1,145 @@
+#ifndef __SHADOW_ATLAS_H__
+#define __SHADOW_ATLAS_H__
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// a light that wants a shadow this frame, in world space
+struct ShadowRequest {
+  unsigned int light; // the caller's index, point and spot lights are counted separately
+  bool point;
+  glm::vec3 position;
+  glm::vec3 direction; // spots only
+  float outer_cutoff;  // spots only, degrees from the axis
+  float range;         // how far the light reaches, the far plane of its tiles
+  float importance;    // pixels its range covers on screen, the tile size it gets is picked from it
+};
+
+// one square of the atlas, a spot light's view or one cube face of a point light
+struct AtlasTile {
+  glm::uvec2 origin{0};
+  unsigned int size{0};
+  int light{-1};                   // the owning slot in lights_, -1 while free
+  glm::mat4 view_projection{1.0f}; // what it should hold, world to light clip space
+  glm::vec3 eye{0.0f};             // the light's position
+  float texel{0.0f};               // world size of a texel one unit from the light
+  glm::mat4 transform{1.0f};       // what it holds, world to atlas coordinates and depth
+  bool valid{false};               // rendered at least once since it was allocated
+  bool dirty{true};
+  bool moving{false};      // moving casters were in it when it was last rendered
+  bool moving_seen{false}; // and when the caller last looked
+  unsigned int waited{0};  // frames it has been dirty
+};
+
+// Shadows of spot and point lights packed into one depth texture. A spot light takes one square tile, a
+// point light six for its cube faces, all sized by how much of the screen the light can reach. Tiles are
+// powers of two laid out on an aligned grid so they never straddle a larger one's place.
+//
+// Tiles are only rendered when they have to be. Lights that moved, or tiles the caller saw moving casters
+// in, are marked dirty and a bounded number of dirty tiles is rendered each frame, new ones first and then
+// by importance times how long they have waited. Anything not rendered keeps its last contents and the
+// transform they were rendered with, so a static light's shadow costs nothing once drawn.
+class ShadowAtlas {
+public:
+  static constexpr unsigned int MIN_TILE = {128};
+  static constexpr unsigned int MAX_TILE = {1024};
+  // tiles see a little past their face or cone so filter taps at the edge stay inside
+  static constexpr unsigned int BORDER_TEXELS = {2};
+  static constexpr float NEAR_PLANE = {0.05f};
+  static constexpr float MAX_RANGE = {100.0f};
+
+  ShadowAtlas() = default;
+  ShadowAtlas(const ShadowAtlas &) = delete;
+  auto operator=(const ShadowAtlas &) -> ShadowAtlas & = delete;
+  ~ShadowAtlas();
+
+  // allocates a size squared depth texture, a multiple of MAX_TILE
+  void setup(unsigned int size);
+  auto ready() const -> bool {
+    return size_ != 0;
+  }
+
+  // takes this frame's lights, the most important claiming space first and taking it from less important
+  // ones when the atlas is full. Lights no longer asked for give their tiles back
+  void update(std::vector<ShadowRequest> &requests);
+  // tells whether the caller sees moving casters in a tile, it is rendered again while they are there
+  // and once more after they left
+  void touch(unsigned int tile, bool moving);
+  // the dirty tiles to render this frame, at most budget of them
+  auto schedule(unsigned int budget) -> const std::vector<unsigned int> &;
+
+  // remembers the bound framebuffer and viewport and binds the atlas
+  void begin();
+  // clears a scheduled tile and points the viewport at it, the caller draws its casters
+  void begin_tile(unsigned int tile);
+  // restores what begin saved
+  void end();
+
+  // what lighting.frag reads per light: its first tile and the size of a texel one unit away, first is
+  // -1 while the light has no shadow or some of its tiles were never rendered
+  auto record(bool point, unsigned int light) const -> glm::vec4;
+  // whether records or tile transforms changed since the last call
+  auto take_changed() -> bool;
+
+  auto tile(unsigned int index) const -> const AtlasTile & {
+    return tiles_[index];
+  }
+  auto tiles() const -> const std::vector<AtlasTile> & {
+    return tiles_;
+  }
+  // the rendered transforms of every tile, 4 columns each
+  auto transforms() const -> const std::vector<glm::vec4> & {
+    return transforms_;
+  }
+  auto texture() const -> unsigned int {
+    return texture_;
+  }
+  auto size() const -> unsigned int {
+    return size_;
+  }
+  auto lights() const -> size_t {
+    return light_slots_.size();
+  }
+  auto used_tiles() const -> size_t;
+  auto dirty_tiles() const -> size_t;
+
+private:
+  struct AtlasLight {
+    ShadowRequest request;
+    unsigned int first_tile;
+    unsigned int tile_count; // 0 when it didn't fit
+    unsigned int size;
+    bool seen;
+  };
+
+  static auto key(bool point, unsigned int light) -> uint32_t {
+    return light | (point ? 0x80000000u : 0u);
+  }
+  auto allocate(unsigned int size, glm::uvec2 &origin) -> bool;
+  void release(AtlasLight &light);
+  // claims tile_count tiles of size for the light, or nothing
+  auto claim(unsigned int slot, unsigned int size) -> bool;
+  void aim(AtlasLight &light);
+  auto fov(const AtlasLight &light) const -> float;
+
+  unsigned int size_{0};
+  unsigned int cells_{0}; // MIN_TILE cells per row
+  std::vector<uint8_t> occupied_;
+  unsigned int texture_{};
+  unsigned int framebuffer_{};
+  int saved_framebuffer_{0};
+  int saved_viewport_[4]{};
+
+  std::vector<AtlasLight> lights_;
+  std::vector<unsigned int> free_lights_;
+  std::unordered_map<uint32_t, unsigned int> light_slots_;
+  std::vector<AtlasTile> tiles_; // a light's tiles are consecutive, free ones are reused
+  std::vector<glm::vec4> transforms_;
+  std::vector<unsigned int> scheduled_;
+  bool changed_{true};
+};
+
+#endif // __SHADOW_ATLAS_H__
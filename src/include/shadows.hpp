@@ -0,0 +1,110 @@
+#ifndef __SHADOWS_H__
+#define __SHADOWS_H__
+
+#include "bounds.hpp"
+
+#include <glm/glm.hpp>
+
+// capacity of the cascade uniforms, this must match the define in lighting.frag
+constexpr unsigned int MAX_CASCADES = {4};
+
+// one slice of the view frustum and the light space square its shadow map covers
+struct ShadowCascade {
+  float split_near{0.0f}; // view depths the cascade is sampled for
+  float split_far{0.0f};
+  glm::mat4 view_projection{1.0f}; // world to light clip space
+  float texel{0.0f};               // world size of one shadow map texel
+  // the square the cached layer was fitted to, in light space
+  glm::vec2 center{0.0f};
+  float radius{0.0f}; // of the slice's bounding sphere
+  float half_extent{0.0f};
+  bool refit{true};    // the cached static layer is rendered again this frame
+  bool dynamic{false}; // the sampled layer holds dynamic casters on top of the cached one
+  // what the last frame drew, static casters only change on refits
+  size_t static_casters{0};
+  size_t dynamic_casters{0};
+  unsigned int refits{0};
+  float cpu_ms{0.0f};
+};
+
+// Cascaded shadow maps for one directional light. The view frustum is split up to a shadow distance and
+// every slice gets a square orthographic map in a depth texture array, fitted around the slice's bounding
+// sphere and snapped to whole texels so edges don't crawl as the camera moves.
+//
+// Every cascade has two layers. The cached one holds only static casters and is rendered when the cascade
+// is refitted: the light turned, or the slice left the padded square it was last fitted to. The sampled
+// one starts as a copy of it with the dynamic casters drawn on top, and is left alone on frames where
+// neither changed. Casters are culled and drawn by the caller between begin and end.
+class ShadowCascades {
+public:
+  // slices are spread between uniform and logarithmic splits by this much
+  static constexpr float SPLIT_LAMBDA = {0.75f};
+  // how much larger than its slice a cascade is fitted, the room the camera has before a refit
+  static constexpr float FIT_PADDING = {1.25f};
+
+  ShadowCascades() = default;
+  ShadowCascades(const ShadowCascades &) = delete;
+  auto operator=(const ShadowCascades &) -> ShadowCascades & = delete;
+  ~ShadowCascades();
+
+  // allocates both depth arrays at resolution squared per cascade
+  void setup(unsigned int resolution);
+  auto ready() const -> bool {
+    return resolution_ != 0;
+  }
+
+  // splits the camera frustum between near and distance into count cascades and fits each one, scene
+  // bounding every caster so none between the light and a slice is clipped away
+  void fit(const glm::mat4 &view, float fov_y, float aspect, float near, float distance, unsigned int count,
+           const glm::vec3 &light_direction, const AABB &scene);
+  // every cached layer is rendered again next frame, for when static casters changed
+  void invalidate();
+
+  // remembers the bound framebuffer and viewport and sets up depth only rendering
+  void begin();
+  // binds the cached layer of a refitted cascade as the cleared render target
+  void begin_static(unsigned int cascade);
+  // binds the sampled layer starting from a copy of the cached one. False when nothing changed since it
+  // was last drawn, the caller then skips its dynamic casters
+  auto begin_dynamic(unsigned int cascade, bool has_dynamic) -> bool;
+  // restores what begin saved, the refitted cascades are cached from here on
+  void end();
+
+  // view space to shadow map coordinates and depth per cascade, what lighting.frag compares against
+  void shadow_matrices(const glm::mat4 &view, glm::mat4 *matrices) const;
+
+  auto cascade(unsigned int index) -> ShadowCascade & {
+    return cascades_[index];
+  }
+  auto cascade(unsigned int index) const -> const ShadowCascade & {
+    return cascades_[index];
+  }
+  auto count() const -> unsigned int {
+    return count_;
+  }
+  auto resolution() const -> unsigned int {
+    return resolution_;
+  }
+  // the sampled layers, compared against with a shadow sampler
+  auto texture() const -> unsigned int {
+    return maps_;
+  }
+
+private:
+  void fit_cascade(ShadowCascade &cascade, const glm::vec3 &center, float radius);
+
+  unsigned int resolution_{0};
+  unsigned int count_{0};
+  unsigned int static_maps_{};
+  unsigned int maps_{};
+  unsigned int static_framebuffers_[MAX_CASCADES]{};
+  unsigned int framebuffers_[MAX_CASCADES]{};
+  glm::vec3 direction_{0.0f};
+  glm::mat3 light_rotation_{1.0f}; // world to light space, the light looking down -z
+  AABB scene_;
+  int saved_framebuffer_{0};
+  int saved_viewport_[4]{};
+  ShadowCascade cascades_[MAX_CASCADES];
+};
+
+#endif // __SHADOWS_H__
@@ -1,16 +1,81 @@
 #ifndef __STAGE_H__
 #define __STAGE_H__
 
+#include "bvh.hpp"
 #include "camera.hpp"
+#include "camera_path.hpp"
+#include "clusters.hpp"
+#include "dynamic_buffer.hpp"
+#include "gbuffer.hpp"
+#include "gpu_culling.hpp"
 #include "light_sources.hpp"
+#include "material.hpp"
 #include "shader.hpp"
 #include "vertex_array.hpp"
 #include "model.hpp"
+#include "occlusion.hpp"
+#include "profiler.hpp"
+#include "render_queue.hpp"
+#include "shadow_atlas.hpp"
+#include "shadows.hpp"
 #include "utils.hpp"
 
 #include <stb_image.hpp>
 #include <glm/glm.hpp>
-#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+// uniform handles of the lighting shader, resolved once after it links
+struct LightingUniforms {
+  Uniform<glm::mat4> projection, view, model;
+  Uniform<glm::mat3> normal_matrix;
+  MaterialUniforms material;
+  Uniform<float> material_shininess, emission_speed, emission_strength, time;
+  Uniform<int> cluster_lights, cluster_ranges, cluster_indices;
+  Uniform<glm::ivec3> cluster_grid;
+  Uniform<float> cluster_scale, cluster_bias;
+  Uniform<int> shadow_map, shadow_cascades;
+  Uniform<glm::mat4> shadow_matrices;
+  Uniform<glm::vec4> cascade_splits, cascade_texels;
+  Uniform<int> shadow_atlas, light_shadows, shadow_tiles, atlas_shadows;
+  Uniform<glm::mat4> inverse_view;
+};
+
+// the deferred lighting programs, DEFERRED_KEYS holds their keys into Stage::deferred_shaders where bit 0
+// defines LIGHT_VOLUME and bit 1 STENCIL_ONLY
+enum DeferredPass : unsigned int { DIRECTIONAL_LIGHT_PASS, LIGHT_VOLUME_PASS, LIGHT_STENCIL_PASS, DEFERRED_PASSES };
+constexpr unsigned int DEFERRED_KEYS[DEFERRED_PASSES] = {0, 1, 3};
+
+// uniform handles only the deferred lighting passes have, on top of their LightingUniforms
+struct DeferredUniforms {
+  Uniform<glm::mat4> inverse_projection;
+  Uniform<int> targets[GBUFFER_TARGETS];
+  Uniform<int> light_bounds, first_light;
+};
+
+// a lighting style program compiled for one combination of material features, with its handles and the
+// queue programs drawing through it
+struct LightingVariant {
+  const Shader *shader{};
+  LightingUniforms uniforms;
+  RenderProgram lit;
+  RenderProgram indirect;
+};
+
+// texture units the clustered light buffers are bound to, after the material maps
+constexpr unsigned int CLUSTER_LIGHTS_UNIT = {3};
+constexpr unsigned int CLUSTER_RANGES_UNIT = {4};
+constexpr unsigned int CLUSTER_INDICES_UNIT = {5};
+constexpr unsigned int SHADOW_MAP_UNIT = {6};
+constexpr unsigned int SHADOW_ATLAS_UNIT = {7};
+constexpr unsigned int LIGHT_SHADOWS_UNIT = {8};
+constexpr unsigned int SHADOW_TILES_UNIT = {9};
+// the g-buffer targets take GBUFFER_UNIT onwards in GBufferTarget order
+constexpr unsigned int GBUFFER_UNIT = {10};
+constexpr unsigned int LIGHT_BOUNDS_UNIT = {GBUFFER_UNIT + GBUFFER_TARGETS};
 
 struct Stage {
   bool imgui_hovering = {false};
@@ -24,39 +89,181 @@ struct Stage {
   float last_x = {SCR_WIDTH / 2.0f};
   float last_y = {SCR_HEIGHT / 2.0f};
   glm::vec3 clear_{0.094f, 0.086f, 0.063f};
+  // seconds of simulation, advanced only by update so a fixed timestep replays identically
+  float time = {0.0f};
+  bool recording_path = {false};
+  std::vector<PathKey> recorded_path;
 
   // lights / objects
   static constexpr size_t NUM_CUBES = {1210};
+  static constexpr size_t NUM_ROTATING_CUBES = {10};
+  // cubes placed by setup, the ones past the first 10 extend the floor grid (testbed_bench --cubes)
+  size_t cube_count = {NUM_CUBES};
+  static inline const AABB CUBE_BOUNDS = {glm::vec3{-0.5f}, glm::vec3{0.5f}};
+  // corner i sits on the max side of x, y and z for bits 1, 2 and 4, two triangles per face
+  static inline const glm::vec3 CUBE_CORNERS[8] = {{-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f},
+                                                  {0.5f, 0.5f, -0.5f},   {-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f},
+                                                  {-0.5f, 0.5f, 0.5f},   {0.5f, 0.5f, 0.5f}};
+  static inline const unsigned int CUBE_INDICES[36] = {0, 2, 6, 0, 6, 4, 1, 3, 7, 1, 7, 5, 0, 1, 5, 0, 5, 4,
+                                                       2, 3, 7, 2, 7, 6, 0, 1, 3, 0, 3, 2, 4, 5, 7, 4, 7, 6};
+  bool instanced_cubes = {true};
+  static constexpr size_t NUM_SCENE_LIGHTS = {4};
   DirectionalLight dir_lights[1];
-  SpotLight spot_lights[1];
-  PointLight point_lights[4];
+  std::vector<SpotLight> spot_lights = std::vector<SpotLight>(1);
+  std::vector<PointLight> point_lights = std::vector<PointLight>(NUM_SCENE_LIGHTS);
+  int light_field = {0};
   glm::mat4 projection;
   glm::mat4 view;
+  bool lights_dirty = {true};
+  glm::mat4 lights_view{0.0f};
+  glm::mat4 lights_projection{0.0f};
+  LightBlock light_block;
+  DynamicBuffer light_buffer;
+
+  // clustered point and spot lights
+  ClusterGrid clusters;
+  std::vector<LocalLightData> local_lights;
+  std::vector<LightBounds> local_bounds;
+  DynamicBuffer local_light_buffer;
+  DynamicBuffer cluster_range_buffer;
+  DynamicBuffer cluster_index_buffer;
+  unsigned int cluster_textures[3];
+  float cluster_build_ms = {0.0f};
+  size_t cluster_builds = {0};
+
+  // frustum culling
+  bool frustum_culling = {true};
+  DynamicBvh scene_bvh;
+  std::vector<int> cube_proxies;
+  std::vector<int> mesh_proxies;
+  std::vector<unsigned int> visible_cubes;
+  std::vector<InstanceData> visible_instances;
+  size_t visible_objects = {0};
+  size_t culled_objects = {0};
+
+  // occlusion culling on the cpu path, whatever frustum culling kept is rasterized as it is drawn and
+  // then tested against that
+  bool occlusion_culling = {true};
+  OcclusionBuffer occlusion{SCR_WIDTH, SCR_HEIGHT};
+  size_t occluded_objects = {0};
+
+  // gpu driven path on gl 4.3, cubes and meshes are culled by a compute pass into indirect draws. Turned
+  // off (or without 4.3) everything goes through cull() and the render queue's own draws instead
+  bool gpu_culling = {true};
+  GpuCulling gpu_culler;
+  unsigned int cube_draw = {0};
+  std::vector<unsigned int> mesh_draws;
+
+  // cascaded shadow maps of the first directional light. The floor and the model are static casters cached
+  // per cascade, only the rotating cubes are drawn every frame
+  static constexpr unsigned int SHADOW_RESOLUTION = {1024};
+  bool shadows_enabled = {true};
+  unsigned int shadow_cascades = {MAX_CASCADES};
+  float shadow_distance = {60.0f};
+  ShadowCascades shadows;
+  AABB shadow_scene; // bounds of every caster, whichever way the rotating cubes turn
+  std::vector<unsigned int> shadow_cubes;
+  std::vector<unsigned int> shadow_meshes;
+  std::vector<InstanceData> shadow_instances;
+
+  // shadows of the spot and point lights reaching into view, all in one atlas. At most shadow_tile_budget
+  // tiles are rendered a frame, the rest keep what they last held
+  static constexpr unsigned int SHADOW_ATLAS_SIZE = {4096};
+  bool light_shadows = {true};
+  int shadow_tile_budget = {8};
+  ShadowAtlas shadow_atlas;
+  std::vector<ShadowRequest> shadow_requests;
+  std::vector<glm::vec4> light_shadow_records;
+  DynamicBuffer light_shadow_buffer;
+  DynamicBuffer shadow_tile_buffer;
+  unsigned int atlas_textures[2];
+  bool shadow_records_dirty = {true};
+  size_t atlas_tiles_rendered = {0};
+
+  // deferred shading, the opaque draws fill a g-buffer that is lit once per covered pixel: the directional
+  // light over the whole screen, point and spot lights as spheres around their range. Lamps are still
+  // drawn forward on top
+  bool deferred_shading = {false};
+  // with stencil_light_volumes, volumes spanning more than stencil_volume_size of the screen's height are
+  // stencil masked before they are lit. Off by default, on llvmpipe the extra passes cost more than the
+  // pixels they skip
+  bool stencil_light_volumes = {false};
+  float stencil_volume_size = {1.0f};
+  size_t stencil_volumes = {0};
+  GBuffer gbuffer;
+  DynamicBuffer light_bounds_buffer;
+  unsigned int light_bounds_texture = {0};
+  unsigned int light_volume_vertices = {0};
+
+  // level of detail, the coarsest level whose error stays under lod_error_pixels on screen is drawn
+  bool mesh_lods = {true};
+  float lod_error_pixels = {1.0f};
+
   float material_shininess = {0.02f};
   float emission_strength = {1.3f};
   float emission_speed = {0.45f};
   Model backpack;
-  unsigned int diffuse_map;
-  unsigned int specular_map;
-  unsigned int emission_map;
+  glm::vec3 backpack_position{9.0f, 0.0f, 0.0f};
+  Material cube_material;
 
   // opengl
-  Shader lighting_shader;
+  ShaderVariants lighting_shaders;
+  ShaderVariants gbuffer_shaders;
   Shader light_cube_shader;
+  Shader shadow_shader;
+  ShaderVariants deferred_shaders;
+  // forward and g-buffer variants by material features, made on first use. frame_variants lists the
+  // ones the queued draws use this frame
+  std::unique_ptr<LightingVariant> lighting_variants[2][MATERIAL_VARIANTS];
+  std::vector<LightingVariant *> frame_variants;
+  const Shader *deferred_programs[DEFERRED_PASSES]{};
+  LightingUniforms deferred_lighting[DEFERRED_PASSES];
+  DeferredUniforms deferred[DEFERRED_PASSES];
+  RenderProgram lamp_program;
+  RenderProgram shadow_program;
+  Uniform<glm::mat4> shadow_view_projection;
+  Uniform<glm::mat4> lamp_view, lamp_projection;
+  RenderQueue render_queue;
+  RenderQueue shadow_queue;
+  GlState gl_state;
   VertexArray cube_vao;
+  VertexArray culled_cube_vao;
   VertexArray light_vao;
+  VertexArray indirect_cube_vao;
+  VertexArray shadow_cube_vao;
+  VertexArray light_volume_vao;
+  std::vector<InstanceData> cube_instances;
 
-  glm::vec3 cube_positions[NUM_CUBES] = {glm::vec3(0.0f, 0.0f, 0.0f),    glm::vec3(2.0f, 5.0f, -15.0f),
-                                         glm::vec3(-1.5f, -2.2f, -2.5f), glm::vec3(-3.8f, -2.0f, -12.3f),
-                                         glm::vec3(2.4f, -0.4f, -3.5f),  glm::vec3(-1.7f, 3.0f, -7.5f),
-                                         glm::vec3(1.3f, -2.0f, -2.5f),  glm::vec3(1.5f, 2.0f, -2.5f),
-                                         glm::vec3(1.5f, 0.2f, -1.2f),   glm::vec3(-1.3f, 1.0f, -1.4f)};
+  std::vector<glm::vec3> cube_positions = {glm::vec3(0.0f, 0.0f, 0.0f),    glm::vec3(2.0f, 5.0f, -15.0f),
+                                           glm::vec3(-1.5f, -2.2f, -2.5f), glm::vec3(-3.8f, -2.0f, -12.3f),
+                                           glm::vec3(2.4f, -0.4f, -3.5f),  glm::vec3(-1.7f, 3.0f, -7.5f),
+                                           glm::vec3(1.3f, -2.0f, -2.5f),  glm::vec3(1.5f, 2.0f, -2.5f),
+                                           glm::vec3(1.5f, 0.2f, -1.2f),   glm::vec3(-1.3f, 1.0f, -1.4f)};
 
   void setup() {
     stbi_set_flip_vertically_on_load(true);
-    // create shader programs
-    lighting_shader = Shader{"shaders/lighting.vert", "shaders/lighting.frag"};
+    // create shader programs, they compile while the rest is set up and are finished at the end
+    lighting_shaders = {"shaders/lighting.vert", "shaders/lighting.frag", MATERIAL_FEATURES};
+    gbuffer_shaders = {"shaders/lighting.vert", "shaders/gbuffer.frag", MATERIAL_FEATURES};
     light_cube_shader = Shader{"shaders/light.vert", "shaders/light.frag"};
+    shadow_shader = Shader{"shaders/shadow.vert", "shaders/shadow.frag"};
+    deferred_shaders = {"shaders/deferred_light.vert", "shaders/deferred_light.frag", {"LIGHT_VOLUME", "STENCIL_ONLY"}};
+    for (unsigned int key : DEFERRED_KEYS) {
+      deferred_shaders.prepare(key);
+    }
+    light_buffer = {GL_UNIFORM_BUFFER, sizeof(LightBlock)};
+    local_light_buffer = {GL_TEXTURE_BUFFER, 64 * sizeof(LocalLightData)};
+    cluster_range_buffer = {GL_TEXTURE_BUFFER, ClusterGrid::COUNT * sizeof(ClusterRange)};
+    cluster_index_buffer = {GL_TEXTURE_BUFFER, 1024 * sizeof(unsigned int)};
+    cluster_textures[0] = texture_buffer(local_light_buffer.id(), GL_RGBA32F);
+    cluster_textures[1] = texture_buffer(cluster_range_buffer.id(), GL_RG32UI);
+    cluster_textures[2] = texture_buffer(cluster_index_buffer.id(), GL_R32UI);
+    light_shadow_buffer = {GL_TEXTURE_BUFFER, 64 * sizeof(glm::vec4)};
+    shadow_tile_buffer = {GL_TEXTURE_BUFFER, 256 * sizeof(glm::vec4)};
+    atlas_textures[0] = texture_buffer(light_shadow_buffer.id(), GL_RGBA32F);
+    atlas_textures[1] = texture_buffer(shadow_tile_buffer.id(), GL_RGBA32F);
+    light_bounds_buffer = {GL_TEXTURE_BUFFER, 64 * sizeof(LightBounds)};
+    light_bounds_texture = texture_buffer(light_bounds_buffer.id(), GL_RGBA32F);
 
     // initial setup
     dir_lights[0] = DirectionalLight{{0.0f, -1.0f, -0.3f}};
@@ -81,10 +288,7 @@ struct Stage {
     point_lights[3].diffuse_strength = 0.919f;
     point_lights[3].specular_strength = 2.31f;
 
-    backpack = Model{"res/models/backpack/backpack.obj"};
-    backpack.has_diffuse = true;
-    backpack.has_specular = true;
-    backpack.has_emission = true;
+    backpack = Model{"res/models/backpack/backpack.obj", VertexFormat::QUANTIZED};
 
     // NDCs -- normals -- texture coords for cube
     float vertices[] = {
@@ -113,7 +317,8 @@ struct Stage {
         -0.5f, 0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, -0.5f, 0.5f,  -0.5f, 0.0f,  1.0f,  0.0f,  0.0f, 1.0f};
 
     unsigned const int WIDTH{40};
-    for (unsigned int i{10}; i < NUM_CUBES; i++) {
+    cube_positions.resize(std::max(cube_count, NUM_ROTATING_CUBES));
+    for (unsigned int i{10}; i < cube_count; i++) {
       float x{(i - 10) / WIDTH + (i * 0.0005f)};
       float y{-6.0f};
       unsigned int z_step = {(i - 10) % WIDTH};
@@ -121,158 +326,967 @@ struct Stage {
       cube_positions[i] = glm::vec3{x, y, z};
     }
 
-    // configure the standard cube VAO
-    cube_vao = {sizeof(vertices), 8 * sizeof(float), vertices}; // why
-    // VertexArray cube_va = {sizeof(vertices), 8 * sizeof(float), vertices};
-    // std::memcpy(&cube_vao, &cube_va, sizeof(VertexArray));
-    cube_vao.bind();
-    cube_vao.push_data<float>(3);
-    cube_vao.push_data<float>(3);
-    cube_vao.push_data<float>(2);
-    cube_vao.unbind();
+    // per-instance model and normal matrices, the static cubes are only ever uploaded here
+    cube_instances.resize(cube_count);
+    for (size_t i{0}; i < cube_count; i++) {
+      cube_instances[i] = cube_instance(0.0f, cube_positions[i]);
+    }
+
+    // configure the standard cube VAO, and one fed only the instances that survive culling each frame
+    auto configure_cubes = [&](VertexArray &vao, const void *instances, GLenum usage) {
+      vao = {sizeof(vertices), 8 * sizeof(float), vertices};
+      vao.bind();
+      vao.push_data<float>(3);
+      vao.push_data<float>(3);
+      vao.push_data<float>(2);
+      vao.push_instances(cube_count * sizeof(InstanceData), sizeof(InstanceData), instances, usage);
+      for (size_t i{0}; i < 4; i++) {
+        vao.push_data<float>(4, false, 1);
+      }
+      for (size_t i{0}; i < 3; i++) {
+        vao.push_data<float>(3, false, 1);
+      }
+      vao.unbind();
+    };
+    configure_cubes(cube_vao, cube_instances.data(), GL_DYNAMIC_DRAW);
+    configure_cubes(culled_cube_vao, nullptr, GL_STREAM_DRAW);
+    configure_cubes(shadow_cube_vao, nullptr, GL_STREAM_DRAW);
+
+    // world space bounds of every placed object
+    for (size_t i{0}; i < cube_count; i++) {
+      cube_proxies.push_back(scene_bvh.create_proxy(CUBE_BOUNDS.transformed(cube_instances[i].model), i));
+    }
+    glm::mat4 backpack_model = {model_transform(backpack_position)};
+    for (size_t i{0}; i < backpack.meshes().size(); i++) {
+      AABB bounds = {backpack.meshes()[i].bounds.transformed(backpack_model)};
+      mesh_proxies.push_back(scene_bvh.create_proxy(bounds, cube_count + i));
+    }
+    shadow_scene = {};
+    for (size_t i{0}; i < cube_count; i++) {
+      shadow_scene = shadow_scene.merged(AABB{cube_positions[i] - glm::vec3{0.87f}, cube_positions[i] + glm::vec3{0.87f}});
+    }
+    for (const Mesh &mesh : backpack.meshes()) {
+      shadow_scene = shadow_scene.merged(mesh.bounds.transformed(backpack_model));
+    }
+    shadows.setup(SHADOW_RESOLUTION);
+    shadow_atlas.setup(SHADOW_ATLAS_SIZE);
+
+    // the cube vertices once more, their instances come from the culling pass
+    if (gpu_culler.setup()) {
+      indirect_cube_vao = {sizeof(vertices), 8 * sizeof(float), vertices};
+      indirect_cube_vao.bind();
+      indirect_cube_vao.push_data<float>(3);
+      indirect_cube_vao.push_data<float>(3);
+      indirect_cube_vao.push_data<float>(2);
+      indirect_cube_vao.unbind();
+      build_gpu_scene();
+    }
 
     // configure the light's VAO
     light_vao = {sizeof(vertices), 8 * sizeof(float), vertices};
-    VertexArray light_va = {sizeof(vertices), 8 * sizeof(float), vertices};
-    std::memcpy(&light_vao, &light_va, sizeof(Vertex));
     light_vao.bind();
     light_vao.push_data<float>(3);
     light_vao.unbind();
 
-    diffuse_map = load_texture("res/textures/container2.png");
-    specular_map = load_texture("res/textures/container2_specular.png");
-    emission_map = load_texture("res/textures/matrix.jpg");
+    // the deferred path's targets and the sphere its light volumes are drawn with
+    gbuffer.fit_viewport();
+    std::vector<glm::vec3> sphere = {light_volume_sphere(8, 12)};
+    light_volume_vertices = static_cast<unsigned int>(sphere.size());
+    light_volume_vao = {sphere.size() * sizeof(glm::vec3), sizeof(glm::vec3), sphere.data()};
+    light_volume_vao.bind();
+    light_volume_vao.push_data<float>(3);
+    light_volume_vao.unbind();
+
+    cube_material.set_map(DIFFUSE_MAP, load_texture("res/textures/container2.png"));
+    cube_material.set_map(SPECULAR_MAP, load_texture("res/textures/container2_specular.png"));
+    cube_material.set_map(EMISSION_MAP, load_texture("res/textures/matrix.jpg"));
+
+    // the variants the scene's materials draw with on the path in use, the first frame finishes them
+    ShaderVariants &variants = {deferred_shading ? gbuffer_shaders : lighting_shaders};
+    variants.prepare(cube_material.features());
+    for (const std::shared_ptr<Material> &material : backpack.materials()) {
+      variants.prepare(material->features());
+    }
+    finish_shaders({&light_cube_shader, &shadow_shader});
+    resolve_lighting_uniforms();
+  }
+
+  // registers every cube and model mesh with the culling pass, run it again after replacing the model
+  void build_gpu_scene() {
+    gpu_culler.clear();
+    gpu_culler.attach(indirect_cube_vao.vao());
+    cube_draw = gpu_culler.add_draw(36, 0, 0, 0);
+    for (size_t i{0}; i < cube_count; i++) {
+      const InstanceData &instance = {cube_instances[i]};
+      gpu_culler.add_object(cube_draw, instance.model, instance.normal, CUBE_BOUNDS.transformed(instance.model));
+    }
+
+    glm::mat4 backpack_model = {model_transform(backpack_position)};
+    glm::mat3 backpack_normal = {glm::transpose(glm::inverse(backpack_model))};
+    mesh_draws.clear();
+    for (const Mesh &mesh : backpack.meshes()) {
+      const MeshLod &lod = {mesh.lods[0]};
+      unsigned int draw = {gpu_culler.add_draw(lod.count, mesh.first_index() + lod.first, mesh.base_vertex(), mesh.index_type())};
+      gpu_culler.attach(mesh.vao());
+      gpu_culler.add_object(draw, backpack_model * mesh.position_transform(), backpack_normal, mesh.bounds.transformed(backpack_model));
+      mesh_draws.push_back(draw);
+    }
+  }
+
+  auto gpu_driven() const -> bool {
+    return gpu_culling && gpu_culler.ready();
   }
 
   void update(float delta_time) {
+    time += delta_time;
+    if (recording_path) {
+      recorded_path.push_back(PathKey{time, camera.Position, camera.Yaw, camera.Pitch, spot_lights[0].position});
+    }
     glClearColor(clear_.x, clear_.y, clear_.z, 1.0f);
     camera.MovementSpeed = move_speed;
     projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.01f, 1000.0f);
     view = camera.get_view_matrix();
   }
 
+  // moves the camera and the first spot light to a recorded key
+  void apply_path_key(const PathKey &key) {
+    camera.Position = key.position;
+    camera.set_orientation(key.yaw, key.pitch);
+    if (spot_lights[0].position != key.light) {
+      spot_lights[0].position = key.light;
+      lights_dirty = true;
+    }
+  }
+
+  // collects the cubes and model meshes that intersect the view frustum
+  void cull() {
+    ProfileZone zone{"cull"};
+    std::vector<Mesh> &meshes = {backpack.meshes()};
+    visible_cubes.clear();
+
+    if (!frustum_culling) {
+      for (size_t i{0}; i < cube_count; i++) {
+        visible_cubes.push_back(i);
+      }
+      for (Mesh &mesh : meshes) {
+        mesh.visible = true;
+      }
+      visible_objects = cube_count + meshes.size();
+      culled_objects = 0;
+      return;
+    }
+
+    for (Mesh &mesh : meshes) {
+      mesh.visible = false;
+    }
+    visible_objects = 0;
+    scene_bvh.query(Frustum{projection * view}, [&](unsigned int object) {
+      if (object < cube_count) {
+        visible_cubes.push_back(object);
+      } else {
+        meshes[object - cube_count].visible = true;
+      }
+      visible_objects++;
+    });
+    culled_objects = scene_bvh.proxies() - visible_objects;
+  }
+
+  // rasterizes the visible cubes and meshes at the levels they are drawn with, then drops those hidden
+  // behind the rest. Nothing can hide itself, an occluder always counts as farther than its own bounds
+  void occlude() {
+    ProfileZone zone{"occlusion"};
+    std::vector<Mesh> &meshes = {backpack.meshes()};
+    glm::mat4 backpack_model = {model_transform(backpack_position)};
+    occlusion.clear(projection * view);
+    for (unsigned int cube : visible_cubes) {
+      occlusion.add_occluder(CUBE_CORNERS, 8, CUBE_INDICES, 36, cube_instances[cube].model);
+    }
+    for (const Mesh &mesh : meshes) {
+      if (!mesh.visible)
+        continue;
+      const MeshLod &lod = {mesh.lods[mesh.lod]};
+      occlusion.add_occluder(mesh.occluder_positions, mesh.occluder_vertex_count, mesh.occluder_indices + lod.first, lod.count,
+                             backpack_model);
+    }
+    occlusion.rasterize();
+
+    size_t tested = {visible_cubes.size()};
+    visible_cubes.erase(std::remove_if(visible_cubes.begin(), visible_cubes.end(),
+                                       [&](unsigned int cube) {
+                                         return occlusion.occluded(CUBE_BOUNDS.transformed(cube_instances[cube].model));
+                                       }),
+                        visible_cubes.end());
+    occluded_objects = tested - visible_cubes.size();
+    for (Mesh &mesh : meshes) {
+      if (mesh.visible && occlusion.occluded(mesh.bounds.transformed(backpack_model))) {
+        mesh.visible = false;
+        occluded_objects++;
+      }
+    }
+    visible_objects -= occluded_objects;
+  }
+
+  // projects each visible mesh's simplification error from its nearest point to the camera
+  void select_lods() {
+    glm::mat4 backpack_model = {model_transform(backpack_position)};
+    glm::mat3 axes = {backpack_model};
+    float scale = {std::max({glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2])})};
+    float pixels_at_unit_distance = {SCR_HEIGHT / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f))};
+    for (Mesh &mesh : backpack.meshes()) {
+      if (!mesh.visible)
+        continue;
+      if (!mesh_lods) {
+        mesh.lod = 0;
+        continue;
+      }
+      AABB bounds = {mesh.bounds.transformed(backpack_model)};
+      glm::vec3 outside = {glm::max(glm::max(bounds.min - camera.Position, camera.Position - bounds.max), glm::vec3{0.0f})};
+      float distance = {std::max(glm::length(outside), 0.01f)};
+      mesh.select_lod(scale * pixels_at_unit_distance / distance, lod_error_pixels);
+    }
+  }
+
   void render() {
-    // cubes
-    use_lighting(*this);
-    cube_vao.bind();
-    for (size_t i{0}; i < NUM_CUBES; i++) {
-      // rotate only the first 10 cubes
-      float angle{i < 10 ? 20.0f * i + glfwGetTime() / 4 : 0.0f};
-      render_cube(lighting_shader, angle, cube_positions[i], view);
+    ProfileZone zone{"Stage::render"};
+    // rotate only the first 10 cubes, they are the only instances rewritten and refit each frame
+    for (size_t i{0}; i < NUM_ROTATING_CUBES; i++) {
+      cube_instances[i] = cube_instance(20.0f * i + time / 4, cube_positions[i]);
+      AABB bounds = {CUBE_BOUNDS.transformed(cube_instances[i].model)};
+      scene_bvh.move_proxy(cube_proxies[i], bounds);
+      if (gpu_culler.ready())
+        gpu_culler.move_object(i, cube_instances[i].model, cube_instances[i].normal, bounds);
     }
+    cube_vao.update_instances(0, NUM_ROTATING_CUBES * sizeof(InstanceData), cube_instances.data());
 
-    // model
-    render_model(backpack, lighting_shader, glm::vec3{9.0f, 0.0f, 0.0f});
+    if (deferred_shading)
+      gbuffer.fit_viewport();
+    gl_state.reset();
+    if (gpu_driven()) {
+      // which meshes survive is only known on the gpu, every one gets a level and the pass skips the rest
+      for (Mesh &mesh : backpack.meshes()) {
+        mesh.visible = true;
+      }
+      select_lods();
+      std::vector<Mesh> &meshes = {backpack.meshes()};
+      for (size_t i{0}; i < meshes.size(); i++) {
+        const MeshLod &lod = {meshes[i].lods[meshes[i].lod]};
+        gpu_culler.set_range(mesh_draws[i], lod.count, meshes[i].first_index() + lod.first);
+      }
+      gpu_culler.cull(projection * view, frustum_culling, gl_state);
+      visible_objects = culled_objects = 0;
+    } else {
+      cull();
+      select_lods();
+      occluded_objects = 0;
+      if (occlusion_culling)
+        occlude();
+    }
+    if (shadows_active())
+      render_shadows();
+    if (light_shadows_active())
+      render_light_shadows();
 
-    // lamp objects
-    light_vao.bind();
-    light_cube_shader.use();
-    light_cube_shader.set_matrix("view", view);
-    light_cube_shader.set_matrix("projection", projection);
+    render_queue.clear();
+    submit_draws();
 
-    // spotlights
-    for (size_t i{0}; i < 1; i++) {
-      if (!spot_lights[i].enabled)
+    // per frame uniforms, then every draw in key order
+    bool deferred_pass = {deferred_active()};
+    if (deferred_pass) {
+      use_gbuffer();
+    } else {
+      use_lighting(*this);
+    }
+    gl_state.use_program(light_cube_shader.id());
+    light_cube_shader.set(lamp_view, view);
+    light_cube_shader.set(lamp_projection, projection);
+    {
+      ProfileZone sort_zone{"sort"};
+      render_queue.sort();
+    }
+    ProfileZone execute_zone{"execute"};
+    if (!deferred_pass) {
+      render_queue.execute(gl_state);
+      return;
+    }
+
+    // opaque surfaces into the g-buffer and lit from there, then the lamps on top against its depth
+    gbuffer.begin();
+    render_queue.execute(gl_state, RenderPass::OPAQUE_PASS);
+    gbuffer.end();
+    render_deferred_lighting();
+    render_queue.execute(gl_state, RenderPass::UNLIT_PASS);
+    render_queue.execute(gl_state, RenderPass::TRANSPARENT_PASS);
+  }
+
+  auto deferred_active() const -> bool {
+    return deferred_shading && gbuffer.ready();
+  }
+
+  auto shadows_active() const -> bool {
+    return shadows_enabled && dir_lights[0].enabled && shadows.ready();
+  }
+
+  // Draws each cascade's casters culled against its light space box. Static casters are only culled and
+  // drawn when the cascade was refitted, the rotating cubes are tested one by one every frame. The
+  // cascades share one gpu zone, a zone each would use up the profiler's queries
+  void render_shadows() {
+    ProfileZone zone{"shadows"};
+    GpuZone gpu_zone{"shadow cascades"};
+    shadows.fit(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.01f, shadow_distance, shadow_cascades,
+                dir_lights[0].direction, shadow_scene);
+    unsigned int shadow_id = {shadow_shader.id()};
+
+    shadows.begin();
+    for (unsigned int i{0}; i < shadows.count(); i++) {
+      auto start = std::chrono::high_resolution_clock::now();
+      ShadowCascade &cascade = {shadows.cascade(i)};
+      Frustum frustum{cascade.view_projection};
+      gl_state.use_program(shadow_id);
+      shadow_shader.set(shadow_view_projection, cascade.view_projection);
+
+      if (cascade.refit) {
+        shadows.begin_static(i);
+        shadow_queue.clear();
+        // levels are picked by how large the error is in shadow map texels
+        cascade.static_casters = queue_shadow_casters(frustum, false, [&](const AABB &) { return 1.0f / cascade.texel; });
+        shadow_queue.sort();
+        shadow_queue.execute(gl_state);
+      }
+
+      shadow_cubes.clear();
+      for (unsigned int cube{0}; cube < NUM_ROTATING_CUBES && cube < cube_count; cube++) {
+        if (frustum.classify(CUBE_BOUNDS.transformed(cube_instances[cube].model)) != Containment::OUTSIDE)
+          shadow_cubes.push_back(cube);
+      }
+      if (shadows.begin_dynamic(i, !shadow_cubes.empty())) {
+        shadow_queue.clear();
+        for (unsigned int cube : shadow_cubes) {
+          unsigned int constants = {shadow_queue.push_constants(cube_instances[cube].model, glm::mat3{1.0f})};
+          shadow_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, shadow_id, 0, cube_vao.vao(), 0.0f), &shadow_program, nullptr,
+                                       cube_vao.vao(), constants, 36, 0, 0, 0, 0, nullptr});
+        }
+        shadow_queue.execute(gl_state);
+      }
+      cascade.dynamic_casters = shadow_cubes.size();
+      auto end = std::chrono::high_resolution_clock::now();
+      cascade.cpu_ms = std::chrono::duration<float, std::milli>(end - start).count();
+    }
+    shadows.end();
+  }
+
+  // Queues the casters the bvh finds in frustum into shadow_queue, the rotating cubes only when moving
+  // is set. Static cubes go in one instanced draw, mesh levels are picked by texels_per_unit at each
+  // mesh's bounds. Returns how many casters were queued
+  template <typename Texels>
+  auto queue_shadow_casters(const Frustum &frustum, bool moving, Texels &&texels_per_unit) -> size_t {
+    std::vector<Mesh> &meshes = {backpack.meshes()};
+    glm::mat4 backpack_model = {model_transform(backpack_position)};
+    glm::mat3 axes = {backpack_model};
+    float scale = {std::max({glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2])})};
+    unsigned int shadow_id = {shadow_shader.id()};
+
+    shadow_cubes.clear();
+    shadow_meshes.clear();
+    scene_bvh.query(frustum, [&](unsigned int object) {
+      if (object < NUM_ROTATING_CUBES && !moving)
+        return;
+      if (object < cube_count) {
+        shadow_cubes.push_back(object);
+      } else {
+        shadow_meshes.push_back(object - cube_count);
+      }
+    });
+    shadow_instances.clear();
+    for (unsigned int cube : shadow_cubes) {
+      shadow_instances.push_back(cube_instances[cube]);
+    }
+    if (!shadow_instances.empty()) {
+      shadow_cube_vao.stream_instances(shadow_instances.size() * sizeof(InstanceData), shadow_instances.data());
+      shadow_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, shadow_id, 0, shadow_cube_vao.vao(), 0.0f), &shadow_program,
+                                   nullptr, shadow_cube_vao.vao(), 0, 36, 0, 0, static_cast<unsigned int>(shadow_instances.size()), 0,
+                                   nullptr});
+    }
+    for (unsigned int index : shadow_meshes) {
+      const Mesh &mesh = {meshes[index]};
+      float texels = {scale * texels_per_unit(mesh.bounds.transformed(backpack_model))};
+      unsigned int level = {mesh_lods ? mesh.lod_for(texels, lod_error_pixels) : 0};
+      const MeshLod &lod = {mesh.lods[level]};
+      unsigned int constants = {shadow_queue.push_constants(backpack_model * mesh.position_transform(), glm::mat3{1.0f})};
+      shadow_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, shadow_id, 0, mesh.vao(), 0.0f), &shadow_program, nullptr,
+                                   mesh.vao(), constants, lod.count, mesh.first_index() + lod.first, mesh.base_vertex(), 0,
+                                   mesh.index_type(), nullptr});
+    }
+    return shadow_cubes.size() + shadow_meshes.size();
+  }
+
+  auto light_shadows_active() const -> bool {
+    return light_shadows && shadow_atlas.ready();
+  }
+
+  // Asks the atlas for a shadow of every enabled spot and point light reaching into view, as important
+  // as the pixels its range covers on screen, and renders the tiles it schedules. Tiles the rotating
+  // cubes pass through are handed back as dirty every frame
+  void render_light_shadows() {
+    ProfileZone zone{"light shadows"};
+    Frustum view_frustum{projection * view};
+    float pixels_at_unit_distance = {SCR_HEIGHT / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f))};
+    auto request = [&](unsigned int index, bool point, const glm::vec3 &position, const glm::vec3 &direction, float outer_cutoff,
+                       float range) {
+      if (view_frustum.classify(AABB{position - range, position + range}) == Containment::OUTSIDE)
+        return;
+      float distance = {glm::length(position - camera.Position)};
+      float importance = {distance > range ? 2.0f * range * pixels_at_unit_distance / (distance - range) : (float)SCR_HEIGHT};
+      shadow_requests.push_back(
+          ShadowRequest{index, point, position, direction, outer_cutoff, range, std::min(importance, (float)SCR_HEIGHT)});
+    };
+    shadow_requests.clear();
+    for (unsigned int i{0}; i < spot_lights.size(); i++) {
+      const SpotLight &light = {spot_lights[i]};
+      if (light.enabled && light.cast_shadows)
+        request(i, false, light.position, light.direction, light.outer_cutoff, bounds_of(pack_spotlight(light)).radius);
+    }
+    for (unsigned int i{0}; i < point_lights.size(); i++) {
+      const PointLight &light = {point_lights[i]};
+      if (light.enabled && light.cast_shadows)
+        request(i, true, light.position, glm::vec3{0.0f}, 0.0f, bounds_of(pack_pointlight(light)).radius);
+    }
+    shadow_atlas.update(shadow_requests);
+
+    for (unsigned int i{0}; i < shadow_atlas.tiles().size(); i++) {
+      const AtlasTile &tile = {shadow_atlas.tile(i)};
+      if (tile.light < 0)
         continue;
-      render_lamp(light_cube_shader, spot_lights[i], spot_lights[i].position);
+      Frustum frustum{tile.view_projection};
+      bool moving = {false};
+      for (unsigned int cube{0}; cube < NUM_ROTATING_CUBES && cube < cube_count && !moving; cube++) {
+        moving = frustum.classify(CUBE_BOUNDS.transformed(cube_instances[cube].model)) != Containment::OUTSIDE;
+      }
+      shadow_atlas.touch(i, moving);
+    }
+    const std::vector<unsigned int> &scheduled = {shadow_atlas.schedule(static_cast<unsigned int>(shadow_tile_budget))};
+    atlas_tiles_rendered = scheduled.size();
+    if (scheduled.empty())
+      return;
+
+    // every scheduled tile is timed as one zone
+    GpuZone gpu_zone{"shadow atlas"};
+    shadow_atlas.begin();
+    gl_state.use_program(shadow_shader.id());
+    for (unsigned int index : scheduled) {
+      const AtlasTile &tile = {shadow_atlas.tile(index)};
+      shadow_atlas.begin_tile(index);
+      shadow_shader.set(shadow_view_projection, tile.view_projection);
+      shadow_queue.clear();
+      // a texel one unit from the light covers tile.texel, levels are picked at the mesh's nearest point
+      queue_shadow_casters(Frustum{tile.view_projection}, true,
+                           [&](const AABB &bounds) {
+                             glm::vec3 outside = {glm::max(glm::max(bounds.min - tile.eye, tile.eye - bounds.max), glm::vec3{0.0f})};
+                             return 1.0f / (tile.texel * std::max(glm::length(outside), ShadowAtlas::NEAR_PLANE));
+                           });
+      shadow_queue.sort();
+      shadow_queue.execute(gl_state);
     }
+    shadow_atlas.end();
+  }
+
+  // queues the visible cubes, model meshes and lamps
+  void submit_draws() {
+    ProfileZone zone{"submit"};
+    // the g-buffer pass draws exactly what forward shading would, only its programs differ
+    frame_variants.clear();
+    LightingVariant &cubes = {lighting_variant(cube_material.features())};
+    unsigned int cubes_id = {cubes.shader->id()};
 
-    // point lights
-    for (size_t i{0}; i < 4; i++) {
-      if (!point_lights[i].enabled)
+    // one command run per vertex array and material, submitted in command order (depth 0 keeps the
+    // stable sort from reordering them) so runs sharing a material become a single multi draw
+    if (gpu_driven()) {
+      render_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, cubes_id, cube_material.id(), indirect_cube_vao.vao(), 0.0f),
+                                   &cubes.indirect, &cube_material, indirect_cube_vao.vao(), 0, 1, cube_draw, 0, 0, 0, "cubes"});
+      std::vector<Mesh> &meshes = {backpack.meshes()};
+      for (size_t i{0}; i < meshes.size(); i++) {
+        const Material &material = {*meshes[i].material};
+        const LightingVariant &variant = {lighting_variant(material.features())};
+        unsigned int vao = {meshes[i].vao()};
+        render_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, variant.shader->id(), material.id(), vao, 0.0f),
+                                     &variant.indirect, &material, vao, 0, 1, mesh_draws[i], 0, 0, meshes[i].index_type(), "model"});
+      }
+    } else if (instanced_cubes && frustum_culling) {
+      visible_instances.clear();
+      for (unsigned int i : visible_cubes) {
+        visible_instances.push_back(cube_instances[i]);
+      }
+      culled_cube_vao.stream_instances(visible_instances.size() * sizeof(InstanceData), visible_instances.data());
+      if (!visible_instances.empty()) {
+        render_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, cubes_id, cube_material.id(), culled_cube_vao.vao(), 0.0f),
+                                     &cubes.lit, &cube_material, culled_cube_vao.vao(), 0, 36, 0, 0,
+                                     static_cast<unsigned int>(visible_instances.size()), 0, "cubes"});
+      }
+    } else if (instanced_cubes) {
+      render_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, cubes_id, cube_material.id(), cube_vao.vao(), 0.0f),
+                                   &cubes.lit, &cube_material, cube_vao.vao(), 0, 36, 0, 0,
+                                   static_cast<unsigned int>(cube_count), 0, "cubes"});
+    } else {
+      for (unsigned int i : visible_cubes) {
+        const InstanceData &instance = {cube_instances[i]};
+        unsigned int constants = {render_queue.push_constants(instance.model, instance.normal)};
+        float depth = {view_depth(glm::vec3{instance.model[3]})};
+        render_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, cubes_id, cube_material.id(), cube_vao.vao(), depth),
+                                     &cubes.lit, &cube_material, cube_vao.vao(), constants, 36, 0, 0, 0, 0, "cubes"});
+      }
+    }
+
+    // model
+    glm::mat4 backpack_model = {model_transform(backpack_position)};
+    glm::mat3 backpack_normal = {glm::transpose(glm::inverse(backpack_model))};
+    unsigned int backpack_constants = {~0u};
+    for (const Mesh &mesh : backpack.meshes()) {
+      if (!mesh.visible || gpu_driven())
         continue;
-      render_lamp(light_cube_shader, point_lights[i], point_lights[i].position);
+      const Material &material = {*mesh.material};
+      // quantized meshes carry their own dequantize transform (normals are unaffected by it), float ones
+      // share their constants so the queue can merge their draws
+      bool shared = {mesh.position_transform() == glm::mat4{1.0f}};
+      unsigned int constants = {shared ? backpack_constants : ~0u};
+      if (constants == ~0u) {
+        constants = render_queue.push_constants(backpack_model * mesh.position_transform(), backpack_normal);
+        backpack_constants = shared ? constants : backpack_constants;
+      }
+      float depth = {view_depth(glm::vec3{backpack_model * glm::vec4{(mesh.bounds.min + mesh.bounds.max) * 0.5f, 1.0f}})};
+      const MeshLod &lod = {mesh.lods[mesh.lod]};
+      const LightingVariant &variant = {lighting_variant(material.features())};
+      render_queue.submit(DrawItem{sort_key(RenderPass::OPAQUE_PASS, variant.shader->id(), material.id(), mesh.vao(), depth),
+                                   &variant.lit, &material, mesh.vao(), constants, lod.count, mesh.first_index() + lod.first, mesh.base_vertex(), 0,
+                                   mesh.index_type(), "model"});
+    }
+
+    // lamp objects
+    auto submit_lamp = [&](const LightSource &light, glm::vec3 position) {
+      glm::mat4 model = {glm::scale(glm::translate(glm::mat4{1.0f}, position), glm::vec3{0.3f})};
+      unsigned int constants = {render_queue.push_constants(model, glm::mat3{1.0f}, light.color)};
+      render_queue.submit(DrawItem{sort_key(RenderPass::UNLIT_PASS, light_cube_shader.id(), 0, light_vao.vao(), view_depth(position)),
+                                   &lamp_program, nullptr, light_vao.vao(), constants, 36, 0, 0, 0, 0, "lamps"});
+    };
+    for (const SpotLight &light : spot_lights) {
+      if (light.enabled)
+        submit_lamp(light, light.position);
+    }
+    for (const PointLight &light : point_lights) {
+      if (light.enabled)
+        submit_lamp(light, light.position);
+    }
+  }
+
+  // The variant drawing materials with these features on the path in use, compiled the first time it is
+  // asked for. Every variant handed out during a frame gets its per frame uniforms before the queue runs
+  auto lighting_variant(unsigned int features) -> LightingVariant & {
+    bool deferred_pass = {deferred_active()};
+    std::unique_ptr<LightingVariant> &variant = {lighting_variants[deferred_pass ? 1 : 0][features]};
+    if (!variant) {
+      const Shader &shader = {(deferred_pass ? gbuffer_shaders : lighting_shaders).get(features)};
+      shader.bind_block("Lights", LIGHTS_BINDING);
+      variant = std::make_unique<LightingVariant>();
+      variant->shader = &shader;
+      resolve_lighting(shader, variant->uniforms);
+      variant->lit = {&shader, variant->uniforms.model, variant->uniforms.normal_matrix, {}, shader.uniform<bool>("instanced")};
+      variant->indirect = variant->lit;
+      variant->indirect.indirect = true;
     }
+    if (std::find(frame_variants.begin(), frame_variants.end(), variant.get()) == frame_variants.end())
+      frame_variants.push_back(variant.get());
+    return *variant;
   }
 
-  void apply_spotlight(Stage &stage, const SpotLight &light, unsigned int place) {
-    glm::vec3 position = {stage.view * glm::vec4{light.position, 1.0}};
-    glm::vec3 light_dir = {glm::normalize(stage.view * glm::vec4{light.direction, 0.0f})};
+  // distance in front of the camera, the depth opaque draws are sorted by
+  auto view_depth(const glm::vec3 &position) const -> float {
+    return -(view * glm::vec4{position, 1.0f}).z;
+  }
+
+  // the handles every lighting style program shares, the ones a shader doesn't declare stay at -1
+  static void resolve_lighting(const Shader &shader, LightingUniforms &uniforms) {
+    uniforms.projection = shader.uniform<glm::mat4>("projection");
+    uniforms.view = shader.uniform<glm::mat4>("view");
+    uniforms.model = shader.uniform<glm::mat4>("model");
+    uniforms.normal_matrix = shader.uniform<glm::mat3>("normalMatrix");
+    uniforms.material.resolve(shader);
+    uniforms.material_shininess = shader.uniform<float>("material.shininess");
+    uniforms.emission_speed = shader.uniform<float>("emissionSpeed");
+    uniforms.emission_strength = shader.uniform<float>("emissionStrength");
+    uniforms.time = shader.uniform<float>("time");
+    uniforms.cluster_lights = shader.uniform<int>("clusterLights");
+    uniforms.cluster_ranges = shader.uniform<int>("clusterRanges");
+    uniforms.cluster_indices = shader.uniform<int>("clusterIndices");
+    uniforms.cluster_grid = shader.uniform<glm::ivec3>("clusterGrid");
+    uniforms.cluster_scale = shader.uniform<float>("clusterScale");
+    uniforms.cluster_bias = shader.uniform<float>("clusterBias");
+    uniforms.shadow_map = shader.uniform<int>("shadowMap");
+    uniforms.shadow_cascades = shader.uniform<int>("shadowCascades");
+    uniforms.shadow_matrices = shader.uniform<glm::mat4>("shadowMatrices");
+    uniforms.cascade_splits = shader.uniform<glm::vec4>("cascadeSplits");
+    uniforms.cascade_texels = shader.uniform<glm::vec4>("cascadeTexels");
+    uniforms.shadow_atlas = shader.uniform<int>("shadowAtlas");
+    uniforms.light_shadows = shader.uniform<int>("lightShadows");
+    uniforms.shadow_tiles = shader.uniform<int>("shadowTiles");
+    uniforms.atlas_shadows = shader.uniform<int>("atlasShadows");
+    uniforms.inverse_view = shader.uniform<glm::mat4>("inverseView");
+  }
+
+  void resolve_lighting_uniforms() {
+    for (unsigned int pass{0}; pass < DEFERRED_PASSES; pass++) {
+      const Shader &shader = {deferred_shaders.get(DEFERRED_KEYS[pass])};
+      shader.bind_block("Lights", LIGHTS_BINDING);
+      deferred_programs[pass] = &shader;
+      resolve_lighting(shader, deferred_lighting[pass]);
+      deferred[pass].inverse_projection = shader.uniform<glm::mat4>("inverseProjection");
+      deferred[pass].targets[GBUFFER_ALBEDO] = shader.uniform<int>("gAlbedo");
+      deferred[pass].targets[GBUFFER_NORMAL] = shader.uniform<int>("gNormal");
+      deferred[pass].targets[GBUFFER_EMISSION] = shader.uniform<int>("gEmission");
+      deferred[pass].targets[GBUFFER_DEPTH] = shader.uniform<int>("gDepth");
+      deferred[pass].light_bounds = shader.uniform<int>("lightBounds");
+      deferred[pass].first_light = shader.uniform<int>("firstLight");
+    }
+
+    lamp_program = {&light_cube_shader, light_cube_shader.uniform<glm::mat4>("model"), {},
+                    light_cube_shader.uniform<glm::vec3>("lightColor"), {}};
+    shadow_program = {&shadow_shader, shadow_shader.uniform<glm::mat4>("model"), {}, {}, shadow_shader.uniform<bool>("instanced")};
+    shadow_view_projection = shadow_shader.uniform<glm::mat4>("lightViewProjection");
+    lamp_view = light_cube_shader.uniform<glm::mat4>("view");
+    lamp_projection = light_cube_shader.uniform<glm::mat4>("projection");
+  }
+
+  // replaces every light past the scene's own with count short ranged point lights scattered over the cube floor
+  void spawn_light_field(size_t count) {
+    std::mt19937 rng{1337};
+    std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+
+    point_lights.resize(NUM_SCENE_LIGHTS + count);
+    for (size_t i{NUM_SCENE_LIGHTS}; i < point_lights.size(); i++) {
+      PointLight light{{unit(rng) * 30.0f, -5.5f + unit(rng) * 2.0f, unit(rng) * 40.0f}};
+      light.enabled = true;
+      light.color = glm::vec3{unit(rng), unit(rng), unit(rng)};
+      light.ambient_strength = 0.1f;
+      light.diffuse_strength = 8.0f;
+      light.specular_strength = 1.0f;
+      light.linear = 0.7f;
+      light.quadratic = 1.8f;
+      light.cast_shadows = false;
+      point_lights[i] = light;
+    }
+    lights_dirty = true;
+  }
+
+  LocalLightData pack_spotlight(const SpotLight &light) {
+    glm::vec3 position = {view * glm::vec4{light.position, 1.0}};
+    glm::vec3 light_dir = {glm::normalize(view * glm::vec4{light.direction, 0.0f})};
     glm::vec3 ambient = {light.color * light.ambient_strength};
     glm::vec3 diffuse = {ambient * light.diffuse_strength};
     glm::vec3 specular = {diffuse * light.specular_strength};
+    float cutoff = {glm::cos(glm::radians(light.cutoff))};
+    float outer_cutoff = {glm::cos(glm::radians(light.outer_cutoff))};
+
+    return LocalLightData{position, light.constant, light_dir, light.linear, ambient,
+                          light.quadratic, diffuse, cutoff, specular, outer_cutoff};
+  }
 
-    // uniforms
-    std::string k{std::to_string(place)};
-    stage.lighting_shader.set_bool("spotLights[" + k + "].enabled", light.enabled);
-    stage.lighting_shader.set_float("spotLights[" + k + "].position", position.x, position.y, position.z);
-    stage.lighting_shader.set_float("spotLights[" + k + "].direction", light_dir.x, light_dir.y, light_dir.z);
-    stage.lighting_shader.set_float("spotLights[" + k + "].ambient", ambient.x, ambient.y, ambient.z);
-    stage.lighting_shader.set_float("spotLights[" + k + "].diffuse", diffuse.x, diffuse.y, diffuse.z);
-    stage.lighting_shader.set_float("spotLights[" + k + "].specular", specular.x, specular.y, specular.z);
-    stage.lighting_shader.set_float("spotLights[" + k + "].constant", light.constant);
-    stage.lighting_shader.set_float("spotLights[" + k + "].linear", light.linear);
-    stage.lighting_shader.set_float("spotLights[" + k + "].quadratic", light.quadratic);
-    stage.lighting_shader.set_float("spotLights[" + k + "].cutoff", glm::cos(glm::radians(light.cutoff)));
-    stage.lighting_shader.set_float("spotLights[" + k + "].outerCutoff", glm::cos(glm::radians(light.outer_cutoff)));
-  }
-
-  void apply_pointlight(Stage &stage, const PointLight &light, unsigned int place) {
-    glm::vec3 pos{stage.view * glm::vec4{light.position, 1.0}};
+  LocalLightData pack_pointlight(const PointLight &light) {
+    glm::vec3 pos{view * glm::vec4{light.position, 1.0}};
     glm::vec3 ambient{light.color * light.ambient_strength};
     glm::vec3 diffuse{ambient * light.diffuse_strength};
     glm::vec3 specular{diffuse * light.specular_strength};
 
-    // uniforms
-    std::string k{std::to_string(place)};
-    stage.lighting_shader.set_bool("pointLights[" + k + "].enabled", light.enabled);
-    stage.lighting_shader.set_float("pointLights[" + k + "].position", pos.x, pos.y, pos.z);
-    stage.lighting_shader.set_float("pointLights[" + k + "].ambient", ambient.x, ambient.y, ambient.z);
-    stage.lighting_shader.set_float("pointLights[" + k + "].diffuse", diffuse.x, diffuse.y, diffuse.z);
-    stage.lighting_shader.set_float("pointLights[" + k + "].specular", specular.x, specular.y, specular.z);
-    stage.lighting_shader.set_float("pointLights[" + k + "].constant", light.constant);
-    stage.lighting_shader.set_float("pointLights[" + k + "].linear", light.linear);
-    stage.lighting_shader.set_float("pointLights[" + k + "].quadratic", light.quadratic);
+    return LocalLightData{pos, light.constant, glm::vec3{0.0f}, light.linear, ambient, light.quadratic,
+                          diffuse, POINT_LIGHT_CUTOFF, specular, POINT_LIGHT_CUTOFF - 1.0f};
+  }
+
+  LightBounds bounds_of(const LocalLightData &light) {
+    float intensity{glm::max(glm::max(light.ambient.x, light.ambient.y), light.ambient.z)};
+    intensity = glm::max(intensity, glm::max(glm::max(light.diffuse.x, light.diffuse.y), light.diffuse.z));
+    intensity = glm::max(intensity, glm::max(glm::max(light.specular.x, light.specular.y), light.specular.z));
+    return LightBounds{light.position, attenuation_range(intensity, light.constant, light.linear, light.quadratic)};
   }
 
-  void apply_directional(Stage &stage, const DirectionalLight &light, unsigned int place) {
-    glm::vec3 direction{glm::normalize(stage.view * glm::vec4{light.direction, 0.0f})};
+  DirLightData pack_directional(const DirectionalLight &light) {
+    glm::vec3 direction{glm::normalize(view * glm::vec4{light.direction, 0.0f})};
     glm::vec3 ambient{light.color * light.ambient_strength};
     glm::vec3 diffuse{ambient * light.diffuse_strength};
     glm::vec3 specular{diffuse * light.specular_strength};
 
-    // uniforms
-    std::string k{std::to_string(place)};
-    stage.lighting_shader.set_bool("dirLights[" + k + "].enabled", light.enabled);
-    stage.lighting_shader.set_float("dirLights[" + k + "].direction", direction.x, direction.y, direction.z);
-    stage.lighting_shader.set_float("dirLights[" + k + "].ambient", ambient.x, ambient.y, ambient.z);
-    stage.lighting_shader.set_float("dirLights[" + k + "].diffuse", diffuse.x, diffuse.y, diffuse.z);
-    stage.lighting_shader.set_float("dirLights[" + k + "].specular", specular.x, specular.y, specular.z);
+    return DirLightData{direction, 0.0f, ambient, 0.0f, diffuse, 0.0f, specular, 0.0f};
   }
 
-  void use_lighting(Stage &stage) {
-    stage.lighting_shader.use();
-    stage.lighting_shader.set_matrix("projection", stage.projection);
-    stage.lighting_shader.set_matrix("view", stage.view);
+  // repacks the enabled lights and rebuilds the clusters when a light was edited or the camera moved,
+  // the Lights block itself only re-uploads the byte range that differs from last time
+  void upload_lights() {
+    ProfileZone zone{"upload lights"};
+    if (!lights_dirty && view == lights_view && projection == lights_projection)
+      return;
 
+    glm::ivec4 &counts = {light_block.counts};
+    counts = glm::ivec4{0};
     for (size_t i{0}; i < 1; i++) {
-      apply_directional(stage, stage.dir_lights[i], i);
+      if (dir_lights[i].enabled && counts.x < static_cast<int>(MAX_DIR_LIGHTS))
+        light_block.dir_lights[counts.x++] = pack_directional(dir_lights[i]);
     }
-    for (size_t i{0}; i < 1; i++) {
-      apply_spotlight(stage, stage.spot_lights[i], i);
-    }
-    for (size_t i{0}; i < 4; i++) {
-      apply_pointlight(stage, stage.point_lights[i], i);
-    }
-
-    // material uniforms
-    stage.lighting_shader.set_int("material.diffuse", 0);
-    stage.lighting_shader.set_int("material.specular", 1);
-    stage.lighting_shader.set_int("material.emission", 2);
-    stage.lighting_shader.set_float("material.shininess", 1.0f / stage.material_shininess);
-    stage.lighting_shader.set_float("emissionSpeed", stage.emission_speed);
-    stage.lighting_shader.set_float("emissionStrength", stage.emission_strength);
-    stage.lighting_shader.set_float("time", static_cast<float>(glfwGetTime()));
-    stage.lighting_shader.set_bool("emissive", true);
-    stage.lighting_shader.set_bool("specular", true);
-    stage.lighting_shader.set_bool("diffuse", true);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, stage.diffuse_map);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, stage.specular_map);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, stage.emission_map);
+
+    local_lights.clear();
+    for (const SpotLight &light : spot_lights) {
+      if (light.enabled)
+        local_lights.push_back(pack_spotlight(light)), counts.y++;
+    }
+    for (const PointLight &light : point_lights) {
+      if (light.enabled)
+        local_lights.push_back(pack_pointlight(light)), counts.z++;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    local_bounds.clear();
+    for (const LocalLightData &light : local_lights) {
+      local_bounds.push_back(bounds_of(light));
+    }
+    clusters.set_projection(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.01f, 1000.0f);
+    clusters.assign(local_bounds);
+    auto end = std::chrono::high_resolution_clock::now();
+    cluster_build_ms = std::chrono::duration<float, std::milli>(end - start).count();
+    cluster_builds++;
+
+    light_buffer.update(&light_block, sizeof(LightBlock));
+    local_light_buffer.reserve(local_lights.size() * sizeof(LocalLightData));
+    local_light_buffer.update(local_lights.data(), local_lights.size() * sizeof(LocalLightData));
+    cluster_range_buffer.stream(clusters.ranges().data(), clusters.ranges().size() * sizeof(ClusterRange));
+    cluster_index_buffer.stream(clusters.indices().data(), clusters.indices().size() * sizeof(unsigned int));
+    if (!local_bounds.empty())
+      light_bounds_buffer.stream(local_bounds.data(), local_bounds.size() * sizeof(LightBounds));
+
+    shadow_records_dirty = true;
+    lights_dirty = false;
+    lights_view = view;
+    lights_projection = projection;
+  }
+
+  // which tiles every packed local light samples, in local_lights order. Rebuilt when the lights were
+  // repacked or the atlas moved, rendered or dropped tiles
+  void upload_shadow_records() {
+    bool tiles_changed = {shadow_atlas.take_changed()};
+    if (!tiles_changed && !shadow_records_dirty)
+      return;
+
+    light_shadow_records.clear();
+    for (unsigned int i{0}; i < spot_lights.size(); i++) {
+      if (spot_lights[i].enabled)
+        light_shadow_records.push_back(shadow_atlas.record(false, i));
+    }
+    for (unsigned int i{0}; i < point_lights.size(); i++) {
+      if (point_lights[i].enabled)
+        light_shadow_records.push_back(shadow_atlas.record(true, i));
+    }
+    if (!light_shadow_records.empty())
+      light_shadow_buffer.stream(light_shadow_records.data(), light_shadow_records.size() * sizeof(glm::vec4));
+    const std::vector<glm::vec4> &transforms = {shadow_atlas.transforms()};
+    if (tiles_changed && !transforms.empty())
+      shadow_tile_buffer.stream(transforms.data(), transforms.size() * sizeof(glm::vec4));
+    shadow_records_dirty = false;
+  }
+
+  // per frame uniforms of the lighting variants in use, the lights only upload once whichever comes first
+  void use_lighting(Stage &stage) {
+    for (const LightingVariant *variant : stage.frame_variants) {
+      const Shader &shader = {*variant->shader};
+      const LightingUniforms &uniforms = {variant->uniforms};
+      stage.gl_state.use_program(shader.id());
+      shader.set(uniforms.projection, stage.projection);
+      shader.set(uniforms.view, stage.view);
+      stage.bind_lights(shader, uniforms);
+
+      // material uniforms
+      uniforms.material.bind_samplers(shader);
+      shader.set(uniforms.material_shininess, 1.0f / stage.material_shininess);
+      shader.set(uniforms.emission_speed, stage.emission_speed);
+      shader.set(uniforms.emission_strength, stage.emission_strength);
+      shader.set(uniforms.time, stage.time);
+    }
+  }
+
+  // uploads the lights if needed and points the bound program at them and at every shadow map
+  void bind_lights(const Shader &shader, const LightingUniforms &uniforms) {
+    upload_lights();
+    light_buffer.bind_base(LIGHTS_BINDING);
+    shader.set(uniforms.cluster_lights, CLUSTER_LIGHTS_UNIT);
+    shader.set(uniforms.cluster_ranges, CLUSTER_RANGES_UNIT);
+    shader.set(uniforms.cluster_indices, CLUSTER_INDICES_UNIT);
+    shader.set(uniforms.cluster_grid, glm::ivec3{ClusterGrid::TILES_X, ClusterGrid::TILES_Y, ClusterGrid::SLICES});
+    shader.set(uniforms.cluster_scale, clusters.slice_scale());
+    shader.set(uniforms.cluster_bias, clusters.slice_bias());
+    for (unsigned int i{0}; i < 3; i++) {
+      gl_state.bind_texture(CLUSTER_LIGHTS_UNIT + i, GL_TEXTURE_BUFFER, cluster_textures[i]);
+    }
+
+    // the shadow sampler keeps a unit of its own even when unused, sampler types can't share one
+    shader.set(uniforms.shadow_map, SHADOW_MAP_UNIT);
+    gl_state.bind_texture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, shadows.texture());
+    unsigned int cascades = {shadows_active() ? shadows.count() : 0};
+    shader.set(uniforms.shadow_cascades, static_cast<int>(cascades));
+    if (cascades > 0) {
+      glm::mat4 matrices[MAX_CASCADES];
+      glm::vec4 splits{0.0f}, texels{0.0f};
+      shadows.shadow_matrices(view, matrices);
+      for (unsigned int i{0}; i < cascades; i++) {
+        splits[i] = shadows.cascade(i).split_far;
+        texels[i] = shadows.cascade(i).texel;
+      }
+      shader.set(uniforms.shadow_matrices, matrices, static_cast<int>(cascades));
+      shader.set(uniforms.cascade_splits, &splits, 1);
+      shader.set(uniforms.cascade_texels, &texels, 1);
+    }
+
+    // spot and point light shadows, a record per packed local light and 4 transform columns per tile
+    shader.set(uniforms.shadow_atlas, SHADOW_ATLAS_UNIT);
+    shader.set(uniforms.light_shadows, LIGHT_SHADOWS_UNIT);
+    shader.set(uniforms.shadow_tiles, SHADOW_TILES_UNIT);
+    gl_state.bind_texture(SHADOW_ATLAS_UNIT, GL_TEXTURE_2D, shadow_atlas.texture());
+    gl_state.bind_texture(LIGHT_SHADOWS_UNIT, GL_TEXTURE_BUFFER, atlas_textures[0]);
+    gl_state.bind_texture(SHADOW_TILES_UNIT, GL_TEXTURE_BUFFER, atlas_textures[1]);
+    bool atlas = {light_shadows_active()};
+    shader.set(uniforms.atlas_shadows, atlas ? 1 : 0);
+    if (atlas) {
+      shader.set(uniforms.inverse_view, glm::inverse(view));
+      upload_shadow_records();
+    }
+  }
+
+  // per frame uniforms of the g-buffer variants in use, the maps come with each draw's material
+  void use_gbuffer() {
+    for (const LightingVariant *variant : frame_variants) {
+      const Shader &shader = {*variant->shader};
+      const LightingUniforms &uniforms = {variant->uniforms};
+      gl_state.use_program(shader.id());
+      shader.set(uniforms.projection, projection);
+      shader.set(uniforms.view, view);
+      uniforms.material.bind_samplers(shader);
+      shader.set(uniforms.emission_speed, emission_speed);
+      shader.set(uniforms.time, time);
+    }
+  }
+
+  // binds the program of one deferred pass and gives it the frame's lights and the g-buffer
+  void use_deferred(DeferredPass pass) {
+    const Shader &shader = {*deferred_programs[pass]};
+    const LightingUniforms &uniforms = {deferred_lighting[pass]};
+    gl_state.use_program(shader.id());
+    bind_lights(shader, uniforms);
+    shader.set(uniforms.projection, projection);
+    shader.set(deferred[pass].inverse_projection, glm::inverse(projection));
+    shader.set(uniforms.material_shininess, 1.0f / material_shininess);
+    shader.set(uniforms.emission_strength, emission_strength);
+    for (unsigned int i{0}; i < GBUFFER_TARGETS; i++) {
+      shader.set(deferred[pass].targets[i], static_cast<int>(GBUFFER_UNIT + i));
+    }
+    shader.set(deferred[pass].light_bounds, LIGHT_BOUNDS_UNIT);
+  }
+
+  // true when a light's volume reaches far enough across the screen to be worth a stencil pass of its own.
+  // Never with the camera inside it, nothing can lie in front of the whole light then
+  auto stencil_volume(const LightBounds &light) const -> bool {
+    float distance = {-light.position.z - light.radius};
+    if (!stencil_light_volumes || distance <= 0.0f)
+      return false;
+    return light.radius * projection[1][1] / distance > stencil_volume_size;
+  }
+
+  // count volumes of the lights from first on, one instance each
+  void draw_light_volumes(DeferredPass pass, size_t first, size_t count) {
+    const Shader &shader = {*deferred_programs[pass]};
+    gl_state.use_program(shader.id());
+    shader.set(deferred[pass].first_light, static_cast<int>(first));
+    gl_stats().draw(light_volume_vertices, count);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, light_volume_vertices, static_cast<GLsizei>(count));
+  }
+
+  // Lights the g-buffer into the framebuffer it was copied to. The directional pass is one triangle over
+  // the screen that writes every covered pixel, then every point and spot light is a sphere added on top.
+  // Small volumes are drawn in instanced runs of their back faces, passing where the scene lies in front
+  // of them. A large volume first marks stencil bit 1 where exactly one of its faces lies behind the scene,
+  // which is inside it, and then lights only the marked pixels and clears them again. That keeps pixels in
+  // front of the whole light from shading. Stencil bit 0 rejects the pixels nothing was drawn to throughout
+  void render_deferred_lighting() {
+    ProfileZone zone{"deferred lighting"};
+    GpuZone gpu_zone{"deferred lighting"};
+    for (unsigned int i{0}; i < GBUFFER_TARGETS; i++) {
+      gl_state.bind_texture(GBUFFER_UNIT + i, GL_TEXTURE_2D, gbuffer.texture(static_cast<GBufferTarget>(i)));
+    }
+    gl_state.bind_texture(LIGHT_BOUNDS_UNIT, GL_TEXTURE_BUFFER, light_bounds_texture);
+    gl_state.bind_vertex_array(light_volume_vao.vao());
+    for (unsigned int pass{0}; pass < DEFERRED_PASSES; pass++) {
+      use_deferred(static_cast<DeferredPass>(pass));
+    }
+
+    // raw state below, put back the way the forward draws expect it at the end
+    bool depth_test = {glIsEnabled(GL_DEPTH_TEST) == GL_TRUE};
+    bool stencil_test = {glIsEnabled(GL_STENCIL_TEST) == GL_TRUE};
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_EQUAL, 1, 0x01);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_DEPTH_TEST);
+    gl_state.use_program(deferred_programs[DIRECTIONAL_LIGHT_PASS]->id());
+    gl_stats().draw(3);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    stencil_volumes = 0;
+    if (!local_lights.empty()) {
+      glEnable(GL_CULL_FACE);
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_ONE, GL_ONE);
+      size_t first{0};
+      for (size_t i{0}; i <= local_bounds.size(); i++) {
+        bool large = {i < local_bounds.size() && stencil_volume(local_bounds[i])};
+        if (i < local_bounds.size() && !large)
+          continue;
+
+        // the run of small volumes up to this one
+        if (i > first) {
+          glEnable(GL_DEPTH_TEST);
+          glDepthFunc(GL_GEQUAL);
+          glCullFace(GL_FRONT);
+          glStencilFunc(GL_EQUAL, 1, 0x01);
+          draw_light_volumes(LIGHT_VOLUME_PASS, first, i - first);
+        }
+        first = i + 1;
+        if (!large)
+          continue;
+
+        // both faces flip bit 1 where they fail the depth test, colors untouched
+        glDisable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glStencilMask(0x02);
+        glStencilFunc(GL_EQUAL, 1, 0x01);
+        glStencilOp(GL_KEEP, GL_INVERT, GL_KEEP);
+        draw_light_volumes(LIGHT_STENCIL_PASS, i, 1);
+
+        // the back faces cover every marked pixel once, each is lit and unmarked
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glDisable(GL_DEPTH_TEST);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glStencilFunc(GL_EQUAL, 3, 0x03);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+        draw_light_volumes(LIGHT_VOLUME_PASS, i, 1);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        glStencilMask(0xff);
+        stencil_volumes++;
+      }
+      glDisable(GL_BLEND);
+      glCullFace(GL_BACK);
+      glDisable(GL_CULL_FACE);
+    }
+    if (depth_test)
+      glEnable(GL_DEPTH_TEST);
+    else
+      glDisable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glStencilFunc(GL_ALWAYS, 0, 0xff);
+    if (!stencil_test)
+      glDisable(GL_STENCIL_TEST);
   }
 };
 
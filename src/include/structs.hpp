@@ -1,7 +1,10 @@
 #ifndef __VERTEX_H__
 #define __VERTEX_H__
 
+#include "resources.hpp"
+
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <string>
 
 struct Vertex {
@@ -10,10 +13,39 @@ struct Vertex {
   glm::vec2 tex_coords;
 };
 
+// how a mesh's vertices are laid out on the gpu, chosen when its model is loaded
+enum class VertexFormat { FLOAT, QUANTIZED };
+
+// the QUANTIZED layout, half a Vertex: unorm16 position inside the mesh bounds (w is padding), a snorm
+// 2_10_10_10 normal and half float uvs
+struct PackedVertex {
+  uint16_t position[4];
+  uint32_t normal;
+  uint32_t tex_coords;
+};
+
+// the full mesh and up to three simplified versions of it
+constexpr unsigned int MAX_LODS = {4};
+
+// one level of detail, a range of the mesh's index buffer. error is the largest object space distance
+// the simplified surface may be from the original
+struct MeshLod {
+  unsigned int first;
+  unsigned int count;
+  float error;
+};
+
+// per-instance attributes of an instanced draw; normal is the world space normal matrix
+struct InstanceData {
+  glm::mat4 model;
+  glm::mat3 normal;
+};
+
 struct Texture {
   unsigned int id;
   std::string type;
   std::string path;
+  TextureRef resource; // keeps id alive while any mesh samples it
 };
 
 #endif // __VERTEX_H__
\ No newline at end of file
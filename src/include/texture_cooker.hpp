@@ -0,0 +1,42 @@
+#ifndef __TEXTURE_COOKER_H__
+#define __TEXTURE_COOKER_H__
+
+#include <optional>
+#include <string>
+#include <vector>
+
+// BC1 (opaque colour), BC3 (colour and alpha), BC4 (one channel, RGTC1) and BC5 (two channels, RGTC2)
+enum class BlockFormat { BC1, BC3, BC4, BC5 };
+
+// a block compressed image with its whole mip chain, level 0 first
+struct CompressedTexture {
+  BlockFormat format{BlockFormat::BC1};
+  int width{};
+  int height{};
+  bool grey{false}; // a single channel cooked from grey rgb, sampled as rrr
+  std::vector<std::vector<unsigned char>> levels;
+
+  auto empty() const -> bool {
+    return levels.empty();
+  }
+};
+
+// Offline and on-demand texture cooking. Everything below is cpu only and safe on any thread, encoding
+// spreads block rows over the worker pool.
+
+// bytes per 4x4 block
+auto block_size(BlockFormat format) -> size_t;
+// the smallest format that keeps every channel the image actually uses
+auto choose_block_format(const unsigned char *pixels, int width, int height, int components, bool &grey) -> BlockFormat;
+// box filters a mip chain down to 1x1 and encodes every level, format overrides the choice (BC5 for normal maps)
+auto cook_texture(const unsigned char *pixels, int width, int height, int components,
+                  std::optional<BlockFormat> format = std::nullopt) -> CompressedTexture;
+
+// cooked files live next to their source as <source>.dds
+auto cooked_texture_path(const std::string &source) -> std::string;
+// false when the cooked file is missing, unreadable or older than its source
+auto load_cooked_texture(const std::string &source, CompressedTexture &texture) -> bool;
+auto write_dds(const std::string &path, const CompressedTexture &texture) -> bool;
+auto read_dds(const std::string &path, CompressedTexture &texture) -> bool;
+
+#endif // __TEXTURE_COOKER_H__
@@ -0,0 +1,62 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A fixed set of worker threads draining one job queue. Jobs never touch OpenGL, the context stays on
+// the main thread, and they shouldn't block waiting on other jobs.
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned int threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  template <typename Job> auto submit(Job &&job) -> std::future<std::invoke_result_t<Job>> {
+    using Result = std::invoke_result_t<Job>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Job>(job));
+    std::future<Result> result = {task->get_future()};
+    if (workers_.empty()) {
+      (*task)();
+      return result;
+    }
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      jobs_.emplace([task] { (*task)(); });
+    }
+    wake_.notify_one();
+    return result;
+  }
+
+  // runs job(i) for every i in [0, count) on the workers and the calling thread, returns when all are done.
+  // the caller keeps taking indices itself, so a pool busy with long jobs only slows it down
+  void parallel_for(unsigned int count, const std::function<void(unsigned int)> &job);
+
+  auto size() const -> unsigned int {
+    return static_cast<unsigned int>(workers_.size());
+  }
+
+private:
+  void work();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> jobs_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_{false};
+};
+
+// the pool shared by background work, one thread short of the core count so the main thread keeps its own,
+// but never empty so submitted jobs still run beside the main thread on a single core
+ThreadPool &worker_pool();
+
+#endif // __THREAD_POOL_H__
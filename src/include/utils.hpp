@@ -4,16 +4,31 @@
 #include "light_sources.hpp"
 #include "model.hpp"
 #include "shader.hpp"
+#include "structs.hpp"
+#include "texture_cooker.hpp"
+#include "vertex_array.hpp"
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <iostream>
 
-unsigned int load_texture(char const *path);
-unsigned int texture_from_file(const char *path, const std::string &directory);
+// a decoded image waiting for its upload, decoding is safe on any thread. compressed is used instead of
+// pixels whenever the driver supports its format
+struct ImageData {
+  std::string path;
+  int width{}, height{}, components{};
+  unsigned char *pixels{};
+  CompressedTexture compressed;
+};
 
-void render_cube(Shader &shader, float angle, glm::vec3 position, glm::mat4 view);
-void render_lamp(Shader &shader, LightSource light, glm::vec3 pos);
-void render_model(Model &obj_model, const Shader &shader, glm::vec3 pos);
+// with cooked set, prefers an up to date <path>.dds and cooks one from the source when there is none
+ImageData decode_image(const std::string &path, bool cooked = true);
+// uploads and frees the image, staging raw pixels through pixel_buffer when one is given
+unsigned int upload_texture(ImageData &image, unsigned int pixel_buffer = 0);
+TextureRef load_texture(char const *path);
+unsigned int texture_buffer(unsigned int buffer, GLenum format);
+
+InstanceData cube_instance(float angle, glm::vec3 position);
+glm::mat4 model_transform(glm::vec3 position);
 
 #endif // __UTILS_H__
\ No newline at end of file
@@ -1,8 +1,12 @@
 #ifndef __VERTEX_ARRAY_H__
 #define __VERTEX_ARRAY_H__
 
+#include "gl_stats.hpp"
+#include "resources.hpp"
+
 #include <glad/glad.h>
 #include <iostream>
+#include <utility>
 
 class VertexArray {
 public:
@@ -14,39 +18,114 @@ public:
     glBindBuffer(GL_ARRAY_BUFFER, vbo_);
     glBufferData(GL_ARRAY_BUFFER, data_size, data, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gl_stats().add(BUFFER_BYTES, data_size);
+  }
+
+  // owns its gl objects, so it moves but never copies
+  VertexArray(const VertexArray &) = delete;
+  VertexArray &operator=(const VertexArray &) = delete;
+
+  VertexArray(VertexArray &&other) noexcept {
+    *this = std::move(other);
+  }
+
+  VertexArray &operator=(VertexArray &&other) noexcept {
+    if (this == &other)
+      return *this;
+
+    release();
+    vao_ = std::exchange(other.vao_, 0);
+    vbo_ = std::exchange(other.vbo_, 0);
+    instance_vbo_ = std::exchange(other.instance_vbo_, 0);
+    instance_capacity_ = other.instance_capacity_;
+    vertex_size_ = other.vertex_size_;
+    location_ = other.location_;
+    next_offset_ = other.next_offset_;
+    return *this;
   }
 
   ~VertexArray() {
-    // glDeleteVertexArrays(1, &vao_);
-    // glDeleteBuffers(1, &vbo_);
+    release();
   }
 
   void bind() {
+    gl_stats().add(VAO_BINDS);
     glBindVertexArray(vao_);
     glBindBuffer(GL_ARRAY_BUFFER, vbo_);
   }
 
+  auto vao() const -> unsigned int {
+    return vao_;
+  }
+
   void unbind() {
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
   }
 
-  template <typename T> void push_data(unsigned int elements, bool normalized = false) {
+  // creates a second buffer holding one element per instance; every push_data after this reads from it
+  void push_instances(size_t data_size, size_t instance_size, const void *data, GLenum usage = GL_STATIC_DRAW) {
+    glBindVertexArray(vao_);
+    glGenBuffers(1, &instance_vbo_);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+    glBufferData(GL_ARRAY_BUFFER, data_size, data, usage);
+    if (data)
+      gl_stats().add(BUFFER_BYTES, data_size);
+
+    instance_capacity_ = data_size;
+    vertex_size_ = instance_size;
+    next_offset_ = 0;
+  }
+
+  // rewrites [offset, offset + size) bytes of the instance buffer
+  void update_instances(size_t offset, size_t size, const void *data) {
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+    gl_stats().add(BUFFER_BYTES, size);
+  }
+
+  // replaces the front of the instance buffer, orphaning the old storage so the driver doesn't wait on draws using it
+  void stream_instances(size_t size, const void *data) {
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+    glBufferData(GL_ARRAY_BUFFER, instance_capacity_, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    gl_stats().add(BUFFER_BYTES, size);
+  }
+
+  template <typename T> void push_data(unsigned int elements, bool normalized = false, unsigned int divisor = 0) {
+    push_attribute(get_vertex_type<T>(), elements, elements * sizeof(T), normalized, divisor);
+  }
+
+  // an attribute of any gl type taking size bytes, for packed formats like GL_INT_2_10_10_10_REV
+  void push_attribute(GLenum type, unsigned int elements, size_t size, bool normalized = false, unsigned int divisor = 0) {
     int normal_elements{normalized ? GL_TRUE : GL_FALSE};
-    int data_type{get_vertex_type<T>()};
-    void *start_point{(void *)(next_start_ * sizeof(T))};
+    void *start_point{(void *)next_offset_};
 
-    glVertexAttribPointer(location_, elements, data_type, normal_elements, vertex_size_, start_point);
+    glVertexAttribPointer(location_, elements, type, normal_elements, vertex_size_, start_point);
+    glVertexAttribDivisor(location_, divisor);
     glEnableVertexAttribArray(location_++);
-    next_start_ += elements;
+    next_offset_ += size;
   }
 
 private:
+  // deleted by the registry on the context thread, a stage can outlive the window
+  void release() {
+    ResourceRegistry &registry = {ResourceRegistry::instance()};
+    registry.defer_delete_vertex_array(vao_);
+    registry.defer_delete_buffer(vbo_);
+    registry.defer_delete_buffer(instance_vbo_);
+    vao_ = vbo_ = instance_vbo_ = 0;
+  }
+
   template <typename T> int get_vertex_type() {
     if constexpr (std::is_same_v<T, float>)
       return GL_FLOAT;
     if constexpr (std::is_same_v<T, unsigned int>)
       return GL_UNSIGNED_INT;
+    if constexpr (std::is_same_v<T, unsigned short>)
+      return GL_UNSIGNED_SHORT;
+    if constexpr (std::is_same_v<T, short>)
+      return GL_SHORT;
     if constexpr (std::is_same_v<T, unsigned char>)
       return GL_UNSIGNED_BYTE;
     throw std::runtime_error("The given type for the vao data is unsupported.");
@@ -54,9 +133,11 @@ private:
 
   unsigned int vao_{};
   unsigned int vbo_{};
+  unsigned int instance_vbo_{};
+  size_t instance_capacity_{};
   size_t vertex_size_{};
   unsigned int location_{};
-  unsigned int next_start_{};
+  size_t next_offset_{}; // bytes into the vertex
 };
 
 #endif // __VERTEX_ARRAY_H__
\ No newline at end of file
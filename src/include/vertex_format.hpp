@@ -0,0 +1,34 @@
+#ifndef __VERTEX_FORMAT_H__
+#define __VERTEX_FORMAT_H__
+
+#include "bounds.hpp"
+#include "structs.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// quantizes vertices into the PackedVertex layout, positions relative to bounds
+void pack_vertices(const Vertex *vertices, size_t count, const AABB &bounds, std::vector<PackedVertex> &packed);
+// maps the unorm positions of pack_vertices back into bounds, meant to be folded into the model matrix
+// so the vertex shader reads them like any other position
+auto dequantize_transform(const AABB &bounds) -> glm::mat4;
+
+// What a mesh is uploaded from in a vertex format: packed vertices and, when every index fits, 16 bit
+// indices for QUANTIZED, the arrays it was given for FLOAT. The pointers may lead into packed and
+// short_indices, so the streams aren't copied
+struct VertexStreams {
+  const void *vertices{};
+  size_t vertex_size{};
+  const void *indices{};
+  size_t index_size{};
+  std::vector<PackedVertex> packed;
+  std::vector<uint16_t> short_indices;
+
+  VertexStreams() = default;
+  VertexStreams(const VertexStreams &) = delete;
+  auto operator=(const VertexStreams &) -> VertexStreams & = delete;
+};
+void build_vertex_streams(VertexFormat format, const Vertex *vertices, size_t vertex_count, const unsigned int *indices,
+                          size_t index_count, const AABB &bounds, VertexStreams &streams);
+
+#endif // __VERTEX_FORMAT_H__
@@ -0,0 +1,89 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+
+auto MappedFile::open(const std::string &path) -> bool {
+  close();
+
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    file_ = nullptr;
+    return false;
+  }
+
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+    close();
+    return false;
+  }
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_) {
+    close();
+    return false;
+  }
+  data_ = static_cast<const unsigned char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    close();
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping_)
+    CloseHandle(mapping_);
+  if (file_)
+    CloseHandle(file_);
+  data_ = nullptr, mapping_ = nullptr, file_ = nullptr;
+  size_ = 0;
+}
+
+#else
+
+auto MappedFile::open(const std::string &path) -> bool {
+  close();
+
+  int file = {::open(path.c_str(), O_RDONLY)};
+  if (file == -1)
+    return false;
+
+  struct stat info {};
+  if (fstat(file, &info) != 0 || info.st_size == 0) {
+    ::close(file);
+    return false;
+  }
+  // the mapping keeps the file alive on its own
+  void *data = {mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0)};
+  ::close(file);
+  if (data == MAP_FAILED)
+    return false;
+
+  data_ = static_cast<const unsigned char *>(data);
+  size_ = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_)
+    munmap(const_cast<unsigned char *>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#endif
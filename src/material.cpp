@@ -0,0 +1,51 @@
+#include "material.hpp"
+
+#include <atomic>
+
+void MaterialUniforms::resolve(const Shader &shader) {
+  maps[DIFFUSE_MAP] = shader.uniform<int>("material.diffuse");
+  maps[SPECULAR_MAP] = shader.uniform<int>("material.specular");
+  maps[EMISSION_MAP] = shader.uniform<int>("material.emission");
+}
+
+void MaterialUniforms::bind_samplers(const Shader &shader) const {
+  for (unsigned int i{0}; i < MATERIAL_MAPS; i++) {
+    shader.set(maps[i], static_cast<int>(i));
+  }
+}
+
+Material::Material() {
+  static std::atomic<unsigned int> next_id{1};
+  id_ = next_id++;
+}
+
+void Material::set_map(MaterialMap map, TextureRef texture) {
+  maps_[map] = std::move(texture);
+}
+
+void Material::bind(GlState &state) const {
+  for (unsigned int i{0}; i < MATERIAL_MAPS; i++) {
+    if (maps_[i])
+      state.bind_texture(i, GL_TEXTURE_2D, maps_[i]->id);
+  }
+}
+
+auto Material::features() const -> unsigned int {
+  const bool switches[MATERIAL_MAPS] = {diffuse, specular, emissive};
+  unsigned int features = {0};
+  for (unsigned int i{0}; i < MATERIAL_MAPS; i++) {
+    if (maps_[i] && switches[i])
+      features |= 1u << i;
+  }
+  return features;
+}
+
+auto material_map(const std::string &type) -> MaterialMap {
+  if (type == "texture_diffuse")
+    return DIFFUSE_MAP;
+  if (type == "texture_specular")
+    return SPECULAR_MAP;
+  if (type == "texture_emission")
+    return EMISSION_MAP;
+  return MATERIAL_MAPS;
+}
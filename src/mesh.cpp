@@ -1,74 +1,71 @@
 #include "mesh.hpp"
-#include "model.hpp"
+#include "geometry_arena.hpp"
+#include "mesh_cache.hpp"
+#include "vertex_format.hpp"
 
-Mesh::Mesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const std::vector<Texture> &textures)
-    : vertices{vertices}, indices{indices}, textures{textures} {
-  setup_mesh();
-}
-
-void Mesh::setup_mesh() {
-  // generate ids
-  glGenVertexArrays(1, &vao_);
-  glGenBuffers(1, &vbo_);
-  glGenBuffers(1, &ebo_);
-  // bind the vertex array
-  glBindVertexArray(vao_);
-  // initialize the vertex buffer
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-  // initialize the index buffer
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-  // positions
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-  // normals
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, normal));
-  // textures
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, tex_coords));
+#include <algorithm>
 
-  glBindVertexArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
+// a coarser level has to be this far under the error budget before it replaces a finer one
+constexpr float LOD_HYSTERESIS = {0.75f};
 
-void Mesh::draw(const Shader &shader, const Model &parent) {
-  unsigned int diffuse_nr = {1};
-  unsigned int specular_nr = {1};
-  unsigned int emission_nr = {1};
-  bool has_diffuse = {false};
-  bool has_specular = {false};
-  bool has_emission = {false};
+// the occluder arrays of a mesh imported this run
+struct OccluderArrays {
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> indices;
+};
 
-  for (size_t i{0}; i < textures.size(); i++) {
-    glActiveTexture(GL_TEXTURE0 + i);
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::shared_ptr<Material> material,
+           std::vector<MeshLod> lods, VertexFormat format)
+    : vertices{std::move(vertices)}, indices{std::move(indices)}, material{std::move(material)}, lods{std::move(lods)} {
+  if (this->lods.empty())
+    this->lods.push_back(MeshLod{0, static_cast<unsigned int>(this->indices.size()), 0.0f});
+  auto occluder = std::make_shared<OccluderArrays>();
+  occluder->positions.reserve(this->vertices.size());
+  for (const Vertex &vertex : this->vertices) {
+    bounds.grow(vertex.position);
+    occluder->positions.push_back(vertex.position);
+  }
+  occluder->indices = this->indices;
+  occluder_positions = occluder->positions.data();
+  occluder_vertex_count = occluder->positions.size();
+  occluder_indices = occluder->indices.data();
+  occluder_source_ = occluder;
 
-    std::string number{};
+  VertexStreams streams{};
+  build_vertex_streams(format, this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), bounds, streams);
+  upload(streams.vertices, this->vertices.size(), streams.indices, this->indices.size(), streams.index_size, format);
+}
 
-    if (textures[i].type == "texture_diffuse") {
-      number = std::to_string(diffuse_nr++);
-      has_diffuse = parent.has_diffuse;
-    }
-    if (textures[i].type == "texture_specular") {
-      number = std::to_string(specular_nr++);
-      has_specular = parent.has_specular;
-    }
-    if (textures[i].type == "texture_emission") {
-      number = std::to_string(emission_nr++);
-      has_emission = parent.has_emission;
-    }
+Mesh::Mesh(const CookedMesh &cooked, std::shared_ptr<Material> material, VertexFormat format)
+    : occluder_positions{cooked.positions}, occluder_vertex_count{cooked.vertex_count}, occluder_indices{cooked.occluder_indices},
+      material{std::move(material)}, bounds{cooked.bounds}, lods{cooked.lods}, occluder_source_{cooked.file} {
+  if (lods.empty())
+    lods.push_back(MeshLod{0, cooked.index_count, 0.0f});
+  upload(cooked.vertices, cooked.vertex_count, cooked.indices, cooked.index_count, cooked.index_size, format);
+}
 
-    shader.set_int("material." + textures[i].type + number, i);
-    glBindTexture(GL_TEXTURE_2D, textures[i].id);
+void Mesh::select_lod(float pixels_per_unit, float max_pixels) {
+  lod = std::min(lod, static_cast<unsigned int>(lods.size()) - 1);
+  while (lod > 0 && lods[lod].error * pixels_per_unit > max_pixels) {
+    lod--;
+  }
+  while (lod + 1 < lods.size() && lods[lod + 1].error * pixels_per_unit < max_pixels * LOD_HYSTERESIS) {
+    lod++;
   }
+}
 
-  shader.set_bool("diffuse", has_diffuse);
-  shader.set_bool("specular", has_specular);
-  shader.set_bool("emissive", has_emission);
+auto Mesh::lod_for(float pixels_per_unit, float max_pixels) const -> unsigned int {
+  unsigned int level = {0};
+  while (level + 1 < lods.size() && lods[level + 1].error * pixels_per_unit <= max_pixels) {
+    level++;
+  }
+  return level;
+}
 
-  glBindVertexArray(vao_);
-  glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+void Mesh::upload(const void *vertices, size_t vertex_count, const void *indices, size_t index_count, size_t index_size,
+                  VertexFormat format) {
+  if (format == VertexFormat::QUANTIZED)
+    position_transform_ = dequantize_transform(bounds);
+  GpuMesh placed = {geometry_arena(format).allocate(vertices, vertex_count, indices, index_count, index_size)};
+  gpu_ = ResourceRegistry::instance().add_mesh(placed);
 }
@@ -0,0 +1,294 @@
+#include "mesh_cache.hpp"
+#include "mesh.hpp"
+#include "vertex_format.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// bump whenever the layout below, Vertex, PackedVertex or the mesh optimizer output changes
+constexpr uint32_t CACHE_VERSION = {4};
+constexpr char CACHE_MAGIC[4] = {'T', 'B', 'M', 'C'};
+constexpr size_t BLOB_ALIGNMENT = {16};
+
+// header | CacheTexture[texture_count] | CacheMesh[mesh_count] | uint32 texture refs | per mesh blobs
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t vertex_size;
+  uint32_t import_flags;
+  int64_t source_time;
+  uint64_t source_size;
+  uint32_t mesh_count;
+  uint32_t texture_count;
+  uint32_t texture_ref_count;
+  uint32_t vertex_format;
+};
+
+struct CacheTexture {
+  char type[32];
+  char path[224];
+};
+
+// the vertex and index streams as the format uploads them, float positions and 32 bit indices for the
+// occlusion buffer. With 32 bit streams the occluder indices are the same blob
+struct CacheMesh {
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint64_t position_offset;
+  uint64_t occluder_index_offset;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t index_size;
+  uint32_t first_texture_ref;
+  uint32_t texture_ref_count;
+  float min[3];
+  float max[3];
+  uint32_t lod_count;
+  uint32_t lod_first[MAX_LODS];
+  uint32_t lod_index_count[MAX_LODS];
+  float lod_error[MAX_LODS];
+};
+
+static auto cache_path(const std::string &source, VertexFormat format) -> std::string {
+  return source + (format == VertexFormat::QUANTIZED ? ".quantized" : "") + MeshCache::EXTENSION;
+}
+
+static auto vertex_size(VertexFormat format) -> size_t {
+  return format == VertexFormat::QUANTIZED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// the source's size and modification time, false when it can't be read
+static auto source_key(const std::string &source, int64_t &time, uint64_t &size) -> bool {
+  std::error_code error{};
+  auto modified = std::filesystem::last_write_time(source, error);
+  if (error)
+    return false;
+  size = std::filesystem::file_size(source, error);
+  if (error)
+    return false;
+
+  time = static_cast<int64_t>(modified.time_since_epoch().count());
+  return true;
+}
+
+static auto aligned(size_t offset) -> size_t {
+  return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+}
+
+// an aligned blob of count elements that ends inside the file
+static auto blob_fits(uint64_t offset, uint64_t count, size_t element_size, size_t file_size) -> bool {
+  return offset % BLOB_ALIGNMENT == 0 && offset <= file_size && count * element_size <= file_size - offset;
+}
+
+template <typename Index>
+static auto indices_below(const unsigned char *data, uint32_t count, uint32_t vertex_count) -> bool {
+  const Index *indices = {reinterpret_cast<const Index *>(data)};
+  return count == 0 || *std::max_element(indices, indices + count) < vertex_count;
+}
+
+auto MeshCache::open(const std::string &source, unsigned int import_flags, VertexFormat format) -> bool {
+  meshes_.clear();
+  textures_.clear();
+  file_ = std::make_shared<MappedFile>();
+
+  int64_t time{};
+  uint64_t size{};
+  if (!source_key(source, time, size) || !file_->open(cache_path(source, format))) {
+    file_.reset();
+    return false;
+  }
+
+  const unsigned char *data = {file_->data()};
+  size_t file_size = {file_->size()};
+  const CacheHeader *header = {reinterpret_cast<const CacheHeader *>(data)};
+  if (file_size < sizeof(CacheHeader) || std::memcmp(header->magic, CACHE_MAGIC, 4) != 0 ||
+      header->version != CACHE_VERSION || header->vertex_format != static_cast<uint32_t>(format) ||
+      header->vertex_size != vertex_size(format) || header->import_flags != import_flags || header->source_time != time ||
+      header->source_size != size) {
+    file_.reset();
+    return false;
+  }
+
+  size_t tables_end = {sizeof(CacheHeader) + header->texture_count * sizeof(CacheTexture) +
+                       header->mesh_count * sizeof(CacheMesh) + header->texture_ref_count * sizeof(uint32_t)};
+  if (tables_end > file_size) {
+    file_.reset();
+    return false;
+  }
+
+  const CacheTexture *textures = {reinterpret_cast<const CacheTexture *>(data + sizeof(CacheHeader))};
+  const CacheMesh *meshes = {reinterpret_cast<const CacheMesh *>(textures + header->texture_count)};
+  const uint32_t *refs = {reinterpret_cast<const uint32_t *>(meshes + header->mesh_count)};
+
+  for (uint32_t i{0}; i < header->texture_count; i++) {
+    textures_.push_back(Texture{0, std::string{textures[i].type, strnlen(textures[i].type, sizeof(textures[i].type))},
+                                std::string{textures[i].path, strnlen(textures[i].path, sizeof(textures[i].path))}, {}});
+  }
+
+  for (uint32_t i{0}; i < header->mesh_count; i++) {
+    const CacheMesh &mesh = {meshes[i]};
+    bool in_bounds = {(mesh.index_size == sizeof(uint16_t) || mesh.index_size == sizeof(unsigned int)) &&
+                      blob_fits(mesh.vertex_offset, mesh.vertex_count, header->vertex_size, file_size) &&
+                      blob_fits(mesh.index_offset, mesh.index_count, mesh.index_size, file_size) &&
+                      blob_fits(mesh.position_offset, mesh.vertex_count, sizeof(glm::vec3), file_size) &&
+                      blob_fits(mesh.occluder_index_offset, mesh.index_count, sizeof(unsigned int), file_size) &&
+                      uint64_t{mesh.first_texture_ref} + mesh.texture_ref_count <= header->texture_ref_count &&
+                      mesh.lod_count <= MAX_LODS};
+    for (uint32_t lod{0}; lod < mesh.lod_count && in_bounds; lod++) {
+      in_bounds = uint64_t{mesh.lod_first[lod]} + mesh.lod_index_count[lod] <= mesh.index_count;
+    }
+    // an index past the vertices would be read out of bounds by the occlusion buffer and the gpu
+    if (in_bounds) {
+      in_bounds = mesh.index_size == sizeof(uint16_t)
+                      ? indices_below<uint16_t>(data + mesh.index_offset, mesh.index_count, mesh.vertex_count)
+                      : indices_below<unsigned int>(data + mesh.index_offset, mesh.index_count, mesh.vertex_count);
+    }
+    if (in_bounds && mesh.occluder_index_offset != mesh.index_offset) {
+      in_bounds = indices_below<unsigned int>(data + mesh.occluder_index_offset, mesh.index_count, mesh.vertex_count);
+    }
+    if (!in_bounds) {
+      meshes_.clear();
+      textures_.clear();
+      file_.reset();
+      return false;
+    }
+
+    CookedMesh cooked{data + mesh.vertex_offset,
+                      mesh.vertex_count,
+                      data + mesh.index_offset,
+                      mesh.index_count,
+                      mesh.index_size,
+                      reinterpret_cast<const glm::vec3 *>(data + mesh.position_offset),
+                      reinterpret_cast<const unsigned int *>(data + mesh.occluder_index_offset),
+                      AABB{glm::vec3{mesh.min[0], mesh.min[1], mesh.min[2]}, glm::vec3{mesh.max[0], mesh.max[1], mesh.max[2]}},
+                      {},
+                      {},
+                      file_};
+    cooked.textures.assign(refs + mesh.first_texture_ref, refs + mesh.first_texture_ref + mesh.texture_ref_count);
+    for (uint32_t lod{0}; lod < mesh.lod_count; lod++) {
+      cooked.lods.push_back(MeshLod{mesh.lod_first[lod], mesh.lod_index_count[lod], mesh.lod_error[lod]});
+    }
+    meshes_.push_back(std::move(cooked));
+  }
+  return true;
+}
+
+auto MeshCache::write(const std::string &source, unsigned int import_flags, VertexFormat format, const Mesh *meshes,
+                      size_t mesh_count, const std::vector<std::vector<unsigned int>> &mesh_textures,
+                      const std::vector<Texture> &textures) -> bool {
+  CacheHeader header{};
+  std::memcpy(header.magic, CACHE_MAGIC, 4);
+  header.version = CACHE_VERSION;
+  header.vertex_size = static_cast<uint32_t>(vertex_size(format));
+  header.vertex_format = static_cast<uint32_t>(format);
+  header.import_flags = import_flags;
+  if (!source_key(source, header.source_time, header.source_size))
+    return false;
+
+  std::vector<CacheTexture> cache_textures(textures.size());
+  for (size_t i{0}; i < textures.size(); i++) {
+    if (textures[i].type.size() >= sizeof(CacheTexture::type) || textures[i].path.size() >= sizeof(CacheTexture::path))
+      return false;
+    std::memcpy(cache_textures[i].type, textures[i].type.c_str(), textures[i].type.size() + 1);
+    std::memcpy(cache_textures[i].path, textures[i].path.c_str(), textures[i].path.size() + 1);
+  }
+
+  std::vector<uint32_t> refs{};
+  std::vector<CacheMesh> cache_meshes(mesh_count);
+  for (size_t i{0}; i < mesh_count; i++) {
+    cache_meshes[i].first_texture_ref = static_cast<uint32_t>(refs.size());
+    cache_meshes[i].texture_ref_count = static_cast<uint32_t>(mesh_textures[i].size());
+    refs.insert(refs.end(), mesh_textures[i].begin(), mesh_textures[i].end());
+  }
+
+  header.mesh_count = static_cast<uint32_t>(cache_meshes.size());
+  header.texture_count = static_cast<uint32_t>(cache_textures.size());
+  header.texture_ref_count = static_cast<uint32_t>(refs.size());
+
+  // every blob starts aligned so the mapped arrays can be read in place
+  size_t offset = {aligned(sizeof(CacheHeader) + cache_textures.size() * sizeof(CacheTexture) +
+                           cache_meshes.size() * sizeof(CacheMesh) + refs.size() * sizeof(uint32_t))};
+  size_t tables_end = {offset};
+  // the streams each mesh uploads in format, converted once here instead of on every load
+  std::vector<VertexStreams> streams(mesh_count);
+  for (size_t i{0}; i < mesh_count; i++) {
+    const Mesh &mesh = {meshes[i]};
+    build_vertex_streams(format, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), mesh.bounds,
+                         streams[i]);
+    CacheMesh &cached = {cache_meshes[i]};
+    cached.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+    cached.index_count = static_cast<uint32_t>(mesh.indices.size());
+    cached.index_size = static_cast<uint32_t>(streams[i].index_size);
+    cached.vertex_offset = offset;
+    offset = aligned(offset + cached.vertex_count * streams[i].vertex_size);
+    cached.index_offset = offset;
+    offset = aligned(offset + cached.index_count * streams[i].index_size);
+    cached.position_offset = offset;
+    offset = aligned(offset + cached.vertex_count * sizeof(glm::vec3));
+    cached.occluder_index_offset = cached.index_offset;
+    if (streams[i].index_size != sizeof(unsigned int)) {
+      cached.occluder_index_offset = offset;
+      offset = aligned(offset + cached.index_count * sizeof(unsigned int));
+    }
+    for (int axis{0}; axis < 3; axis++) {
+      cached.min[axis] = meshes[i].bounds.min[axis];
+      cached.max[axis] = meshes[i].bounds.max[axis];
+    }
+    cached.lod_count = static_cast<uint32_t>(std::min<size_t>(meshes[i].lods.size(), MAX_LODS));
+    for (uint32_t lod{0}; lod < cached.lod_count; lod++) {
+      cached.lod_first[lod] = meshes[i].lods[lod].first;
+      cached.lod_index_count[lod] = meshes[i].lods[lod].count;
+      cached.lod_error[lod] = meshes[i].lods[lod].error;
+    }
+  }
+
+  // written beside the real file and renamed over it, a crash never leaves a half written cache behind
+  std::string path = {cache_path(source, format)};
+  std::string staging = {path + ".tmp"};
+  {
+    std::ofstream file{staging, std::ios::binary | std::ios::trunc};
+    if (!file)
+      return false;
+
+    auto pad_to = [&](size_t target) {
+      static const char zeros[BLOB_ALIGNMENT]{};
+      file.write(zeros, target - static_cast<size_t>(file.tellp()));
+    };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(cache_textures.data()), cache_textures.size() * sizeof(CacheTexture));
+    file.write(reinterpret_cast<const char *>(cache_meshes.data()), cache_meshes.size() * sizeof(CacheMesh));
+    file.write(reinterpret_cast<const char *>(refs.data()), refs.size() * sizeof(uint32_t));
+    pad_to(tables_end);
+    std::vector<glm::vec3> positions{};
+    for (size_t i{0}; i < mesh_count; i++) {
+      const CacheMesh &cached = {cache_meshes[i]};
+      file.write(reinterpret_cast<const char *>(streams[i].vertices), cached.vertex_count * streams[i].vertex_size);
+      pad_to(cached.index_offset);
+      file.write(reinterpret_cast<const char *>(streams[i].indices), cached.index_count * streams[i].index_size);
+      pad_to(cached.position_offset);
+      positions.clear();
+      for (const Vertex &vertex : meshes[i].vertices) {
+        positions.push_back(vertex.position);
+      }
+      file.write(reinterpret_cast<const char *>(positions.data()), positions.size() * sizeof(glm::vec3));
+      if (cached.occluder_index_offset != cached.index_offset) {
+        pad_to(cached.occluder_index_offset);
+        file.write(reinterpret_cast<const char *>(meshes[i].indices.data()), meshes[i].indices.size() * sizeof(unsigned int));
+      }
+      pad_to(aligned(static_cast<size_t>(file.tellp())));
+    }
+    if (!file)
+      return false;
+  }
+
+  std::error_code error{};
+  std::filesystem::rename(staging, path, error);
+  if (error) {
+    std::filesystem::remove(staging, error);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,518 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+
+// Forsyth's tuning, the lru cache is larger than the hardware one so vertices decay gradually
+constexpr unsigned int FORSYTH_CACHE_SIZE = {32};
+constexpr float LAST_TRIANGLE_SCORE = {0.75f};
+constexpr float CACHE_DECAY_POWER = {1.5f};
+constexpr float VALENCE_BOOST_SCALE = {2.0f};
+constexpr float VALENCE_BOOST_POWER = {0.5f};
+
+// a fifo cache as timestamps, a vertex is cached while fewer than size others were added after it
+class FifoCache {
+public:
+  FifoCache(size_t vertex_count, unsigned int size) : stamps_(vertex_count, 0), size_{size}, time_{size + 1} {}
+
+  // returns true on a miss
+  auto access(unsigned int vertex) -> bool {
+    if (time_ - stamps_[vertex] <= size_)
+      return false;
+    stamps_[vertex] = time_++;
+    return true;
+  }
+  void flush() {
+    time_ += size_ + 1;
+  }
+
+private:
+  std::vector<unsigned int> stamps_;
+  unsigned int size_;
+  unsigned int time_;
+};
+
+auto analyze_vertex_cache(const std::vector<unsigned int> &indices, size_t vertex_count, unsigned int cache_size) -> VertexCacheStats {
+  FifoCache cache{vertex_count, cache_size};
+  std::vector<bool> referenced(vertex_count, false);
+  size_t misses{0}, unique{0};
+  for (unsigned int index : indices) {
+    misses += cache.access(index);
+    if (!referenced[index]) {
+      referenced[index] = true;
+      unique++;
+    }
+  }
+
+  size_t triangles = {indices.size() / 3};
+  return VertexCacheStats{triangles ? static_cast<float>(misses) / triangles : 0.0f,
+                          unique ? static_cast<float>(misses) / unique : 0.0f};
+}
+
+void weld_vertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+  // Vertex is tightly packed floats, so bytes are compared directly (FNV-1a for the hash)
+  auto hash = [](const Vertex &vertex) {
+    const unsigned char *bytes = {reinterpret_cast<const unsigned char *>(&vertex)};
+    uint64_t value = {1469598103934665603ull};
+    for (size_t i{0}; i < sizeof(Vertex); i++) {
+      value = (value ^ bytes[i]) * 1099511628211ull;
+    }
+    return static_cast<size_t>(value);
+  };
+  auto equal = [](const Vertex &a, const Vertex &b) { return std::memcmp(&a, &b, sizeof(Vertex)) == 0; };
+
+  std::unordered_map<Vertex, unsigned int, decltype(hash), decltype(equal)> unique{vertices.size(), hash, equal};
+  std::vector<unsigned int> remap(vertices.size());
+  std::vector<Vertex> welded{};
+  welded.reserve(vertices.size());
+  for (size_t i{0}; i < vertices.size(); i++) {
+    auto found = unique.emplace(vertices[i], static_cast<unsigned int>(welded.size())).first;
+    if (found->second == welded.size()) {
+      welded.push_back(vertices[i]);
+    }
+    remap[i] = found->second;
+  }
+
+  for (unsigned int &index : indices) {
+    index = remap[index];
+  }
+  vertices = std::move(welded);
+}
+
+static auto forsyth_score(int cache_position, unsigned int remaining) -> float {
+  if (remaining == 0)
+    return -1.0f;
+
+  float score = {0.0f};
+  if (cache_position >= 0 && cache_position < 3) {
+    // the triangle just drawn, scored a bit lower so the next one doesn't reuse the same edge only
+    score = LAST_TRIANGLE_SCORE;
+  } else if (cache_position >= 3) {
+    float scale = {1.0f / (FORSYTH_CACHE_SIZE - 3)};
+    score = std::pow(1.0f - (cache_position - 3) * scale, CACHE_DECAY_POWER);
+  }
+  // vertices with few triangles left are finished first so they can leave the cache
+  return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining), -VALENCE_BOOST_POWER);
+}
+
+void optimize_vertex_cache(std::vector<unsigned int> &indices, size_t vertex_count) {
+  // degenerate triangles draw nothing, and one naming a vertex twice would be swapped out of that
+  // vertex's live range twice, taking a live triangle with it
+  size_t kept{0};
+  for (size_t i{0}; i + 2 < indices.size(); i += 3) {
+    unsigned int a = {indices[i]}, b = {indices[i + 1]}, c = {indices[i + 2]};
+    if (a == b || b == c || a == c)
+      continue;
+    indices[kept++] = a, indices[kept++] = b, indices[kept++] = c;
+  }
+  indices.resize(kept);
+
+  size_t triangle_count = {indices.size() / 3};
+  if (triangle_count == 0)
+    return;
+
+  // live triangles of every vertex, the first remaining[v] entries of its range in adjacency
+  std::vector<unsigned int> remaining(vertex_count, 0);
+  for (unsigned int index : indices) {
+    remaining[index]++;
+  }
+  std::vector<unsigned int> offsets(vertex_count + 1, 0);
+  for (size_t v{0}; v < vertex_count; v++) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<unsigned int> adjacency(indices.size());
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t i{0}; i < indices.size(); i++) {
+    adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> vertex_score(vertex_count);
+  for (size_t v{0}; v < vertex_count; v++) {
+    vertex_score[v] = forsyth_score(-1, remaining[v]);
+  }
+  std::vector<float> triangle_score(triangle_count);
+  for (size_t t{0}; t < triangle_count; t++) {
+    triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+  }
+
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<unsigned int> cache{}, next_cache{};
+  std::vector<unsigned int> result{};
+  result.reserve(indices.size());
+  size_t cursor{0};
+  int best = {static_cast<int>(std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin())};
+
+  while (result.size() < indices.size()) {
+    // dead end, nothing in the cache has triangles left so continue in input order
+    if (best < 0) {
+      while (emitted[cursor]) {
+        cursor++;
+      }
+      best = static_cast<int>(cursor);
+    }
+
+    const unsigned int *triangle = {&indices[best * 3]};
+    emitted[best] = true;
+    result.insert(result.end(), triangle, triangle + 3);
+
+    next_cache.clear();
+    for (int k{0}; k < 3; k++) {
+      unsigned int vertex = {triangle[k]};
+      // swap the triangle out of the vertex's live range
+      unsigned int *live = {&adjacency[offsets[vertex]]};
+      unsigned int *last = {live + --remaining[vertex]};
+      std::iter_swap(std::find(live, last + 1, static_cast<unsigned int>(best)), last);
+      if (std::find(next_cache.begin(), next_cache.end(), vertex) == next_cache.end())
+        next_cache.push_back(vertex);
+    }
+    for (unsigned int vertex : cache) {
+      if (std::find(next_cache.begin(), next_cache.end(), vertex) == next_cache.end())
+        next_cache.push_back(vertex);
+    }
+
+    // rescore everything that moved in the cache, including what just fell out of it
+    for (size_t i{0}; i < next_cache.size(); i++) {
+      unsigned int vertex = {next_cache[i]};
+      cache_position[vertex] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+      float score = {forsyth_score(cache_position[vertex], remaining[vertex])};
+      float delta = {score - vertex_score[vertex]};
+      vertex_score[vertex] = score;
+      for (unsigned int a{offsets[vertex]}; a < offsets[vertex] + remaining[vertex]; a++) {
+        triangle_score[adjacency[a]] += delta;
+      }
+    }
+
+    best = -1;
+    float best_score = {-1.0f};
+    next_cache.resize(std::min<size_t>(next_cache.size(), FORSYTH_CACHE_SIZE));
+    for (unsigned int vertex : next_cache) {
+      for (unsigned int a{offsets[vertex]}; a < offsets[vertex] + remaining[vertex]; a++) {
+        unsigned int candidate = {adjacency[a]};
+        if (triangle_score[candidate] > best_score) {
+          best_score = triangle_score[candidate];
+          best = static_cast<int>(candidate);
+        }
+      }
+    }
+    std::swap(cache, next_cache);
+  }
+
+  indices = std::move(result);
+}
+
+void optimize_overdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, float threshold) {
+  size_t triangle_count = {indices.size() / 3};
+  if (triangle_count < 2)
+    return;
+
+  // hard boundaries, where the cache optimized order already starts over with three misses
+  std::vector<unsigned int> misses(triangle_count, 0);
+  FifoCache stream{vertices.size(), STATS_CACHE_SIZE};
+  for (size_t i{0}; i < indices.size(); i++) {
+    misses[i / 3] += stream.access(indices[i]);
+  }
+  std::vector<size_t> hard{};
+  for (size_t t{0}; t < triangle_count; t++) {
+    if (t == 0 || misses[t] == 3)
+      hard.push_back(t);
+  }
+  hard.push_back(triangle_count);
+
+  // soft boundaries, wherever a cluster drawn from a cold cache is already within threshold of the
+  // acmr of the hard cluster around it, so moving it elsewhere costs little
+  std::vector<size_t> starts{};
+  FifoCache cold{vertices.size(), STATS_CACHE_SIZE};
+  for (size_t h{0}; h + 1 < hard.size(); h++) {
+    size_t end = {hard[h + 1]};
+    unsigned int hard_misses = {std::accumulate(misses.begin() + hard[h], misses.begin() + end, 0u)};
+    float limit = {threshold * hard_misses / (end - hard[h])};
+
+    size_t start = {hard[h]};
+    unsigned int cluster_misses{0};
+    cold.flush();
+    starts.push_back(start);
+    for (size_t t{start}; t < end; t++) {
+      for (int k{0}; k < 3; k++) {
+        cluster_misses += cold.access(indices[t * 3 + k]);
+      }
+      if (t + 1 < end && cluster_misses <= limit * (t + 1 - start)) {
+        start = t + 1;
+        cluster_misses = 0;
+        cold.flush();
+        starts.push_back(start);
+      }
+    }
+  }
+  starts.push_back(triangle_count);
+
+  // area weighted centroid and normal of each cluster
+  size_t cluster_count = {starts.size() - 1};
+  std::vector<glm::vec3> centroids(cluster_count, glm::vec3{0.0f});
+  std::vector<glm::vec3> normals(cluster_count, glm::vec3{0.0f});
+  std::vector<float> areas(cluster_count, 0.0f);
+  glm::vec3 mesh_centroid{0.0f};
+  float mesh_area = {0.0f};
+  for (size_t c{0}; c < cluster_count; c++) {
+    for (size_t t{starts[c]}; t < starts[c + 1]; t++) {
+      glm::vec3 a = {vertices[indices[t * 3]].position};
+      glm::vec3 b = {vertices[indices[t * 3 + 1]].position};
+      glm::vec3 d = {vertices[indices[t * 3 + 2]].position};
+      glm::vec3 normal = {glm::cross(b - a, d - a)};
+      float area = {glm::length(normal)};
+      centroids[c] += (a + b + d) * (area / 3.0f);
+      normals[c] += normal;
+      areas[c] += area;
+    }
+    mesh_centroid += centroids[c];
+    mesh_area += areas[c];
+    if (areas[c] > 0.0f)
+      centroids[c] /= areas[c];
+  }
+  if (mesh_area > 0.0f)
+    mesh_centroid /= mesh_area;
+
+  // clusters facing away from the center occlude the rest, so they go first
+  std::vector<float> sort_value(cluster_count);
+  for (size_t c{0}; c < cluster_count; c++) {
+    float length = {glm::length(normals[c])};
+    sort_value[c] = length > 0.0f ? glm::dot(centroids[c] - mesh_centroid, normals[c] / length) : 0.0f;
+  }
+  std::vector<size_t> order(cluster_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sort_value[a] > sort_value[b]; });
+
+  std::vector<unsigned int> result{};
+  result.reserve(indices.size());
+  for (size_t c : order) {
+    result.insert(result.end(), indices.begin() + starts[c] * 3, indices.begin() + starts[c + 1] * 3);
+  }
+  indices = std::move(result);
+}
+
+void optimize_vertex_fetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+  constexpr unsigned int UNUSED = {~0u};
+  std::vector<unsigned int> remap(vertices.size(), UNUSED);
+  std::vector<Vertex> ordered{};
+  ordered.reserve(vertices.size());
+  for (unsigned int &index : indices) {
+    if (remap[index] == UNUSED) {
+      remap[index] = static_cast<unsigned int>(ordered.size());
+      ordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices = std::move(ordered);
+}
+
+auto optimize_mesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) -> MeshOptimizeReport {
+  MeshOptimizeReport report{};
+  report.vertices_before = vertices.size();
+  report.before = analyze_vertex_cache(indices, vertices.size());
+
+  weld_vertices(vertices, indices);
+  optimize_vertex_cache(indices, vertices.size());
+  optimize_overdraw(indices, vertices);
+  optimize_vertex_fetch(vertices, indices);
+
+  report.vertices_after = vertices.size();
+  report.after = analyze_vertex_cache(indices, vertices.size());
+  return report;
+}
+
+// triangle counts of the simplified levels relative to the full mesh
+constexpr float LOD_RATIOS[MAX_LODS - 1] = {0.5f, 0.25f, 0.125f};
+// a level keeping more than this of the previous one's triangles is not worth its indices
+constexpr float LOD_MIN_REDUCTION = {0.85f};
+
+struct Collapse {
+  double cost;
+  unsigned int from;
+  unsigned int to;
+};
+
+// sum of squared distances to a set of planes, each plane p adds p * p^T
+static auto plane_quadric(const glm::dvec3 &a, const glm::dvec3 &b, const glm::dvec3 &c) -> glm::dmat4 {
+  glm::dvec3 normal = {glm::cross(b - a, c - a)};
+  double length = {glm::length(normal)};
+  if (length == 0.0)
+    return glm::dmat4{0.0};
+  normal /= length;
+  glm::dvec4 plane = {normal, -glm::dot(normal, a)};
+  return glm::outerProduct(plane, plane);
+}
+
+static auto quadric_error(const glm::dmat4 &quadric, const glm::vec3 &position) -> double {
+  glm::dvec4 point = {glm::dvec3{position}, 1.0};
+  return std::max(glm::dot(point, quadric * point), 0.0);
+}
+
+auto simplify_mesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, size_t target_count,
+                   float &error) -> std::vector<unsigned int> {
+  size_t vertex_count = {vertices.size()};
+  std::vector<unsigned int> result = {indices};
+  error = 0.0f;
+
+  // vertices sharing a position are split by a seam, any collapse would tear it open
+  auto position_hash = [](const glm::vec3 &position) {
+    return std::hash<float>{}(position.x) ^ (std::hash<float>{}(position.y) * 31) ^ (std::hash<float>{}(position.z) * 961);
+  };
+  std::unordered_map<glm::vec3, unsigned int, decltype(position_hash)> corners{vertex_count, position_hash};
+  std::vector<unsigned int> corner(vertex_count);
+  std::vector<unsigned int> corner_uses{};
+  for (size_t v{0}; v < vertex_count; v++) {
+    auto found = corners.emplace(vertices[v].position, static_cast<unsigned int>(corner_uses.size())).first;
+    if (found->second == corner_uses.size())
+      corner_uses.push_back(0);
+    corner_uses[found->second]++;
+    corner[v] = found->second;
+  }
+  std::vector<bool> locked(vertex_count, false);
+  for (size_t v{0}; v < vertex_count; v++) {
+    locked[v] = corner_uses[corner[v]] > 1;
+  }
+
+  // an edge used by a single triangle is on the border, between positions so seams count as interior
+  std::map<std::pair<unsigned int, unsigned int>, unsigned int> edge_uses{};
+  for (size_t i{0}; i < result.size(); i += 3) {
+    for (int k{0}; k < 3; k++) {
+      unsigned int a = {corner[result[i + k]]}, b = {corner[result[i + (k + 1) % 3]]};
+      edge_uses[std::minmax(a, b)]++;
+    }
+  }
+  std::vector<bool> border_corner(corner_uses.size(), false);
+  for (const auto &[edge, uses] : edge_uses) {
+    if (uses == 1)
+      border_corner[edge.first] = border_corner[edge.second] = true;
+  }
+
+  std::vector<glm::dmat4> quadrics(vertex_count, glm::dmat4{0.0});
+  for (size_t i{0}; i < result.size(); i += 3) {
+    glm::dmat4 quadric = {plane_quadric(vertices[result[i]].position, vertices[result[i + 1]].position,
+                                        vertices[result[i + 2]].position)};
+    for (int k{0}; k < 3; k++) {
+      quadrics[result[i + k]] += quadric;
+    }
+  }
+  for (size_t v{0}; v < vertex_count; v++) {
+    locked[v] = locked[v] || border_corner[corner[v]];
+  }
+
+  std::vector<unsigned int> remaining(vertex_count), offsets(vertex_count + 1), adjacency{};
+  std::vector<Collapse> collapses{};
+  std::vector<bool> touched(vertex_count);
+  std::vector<unsigned int> remap(vertex_count);
+
+  // each pass takes the cheapest collapses that don't share a neighbourhood, until the target is met
+  while (result.size() > target_count) {
+    std::fill(remaining.begin(), remaining.end(), 0);
+    for (unsigned int index : result) {
+      remaining[index]++;
+    }
+    for (size_t v{0}; v < vertex_count; v++) {
+      offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    adjacency.resize(result.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i{0}; i < result.size(); i++) {
+      adjacency[fill[result[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    collapses.clear();
+    for (size_t i{0}; i < result.size(); i += 3) {
+      for (int k{0}; k < 3; k++) {
+        unsigned int a = {result[i + k]}, b = {result[i + (k + 1) % 3]};
+        if (!locked[a])
+          collapses.push_back(Collapse{quadric_error(quadrics[a] + quadrics[b], vertices[b].position), a, b});
+        if (!locked[b])
+          collapses.push_back(Collapse{quadric_error(quadrics[a] + quadrics[b], vertices[a].position), b, a});
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+      return a.cost != b.cost ? a.cost < b.cost : a.from != b.from ? a.from < b.from : a.to < b.to;
+    });
+
+    // every collapse removes about two triangles
+    size_t budget = {std::max<size_t>((result.size() - target_count) / 6, 1)};
+    size_t collapsed{0};
+    std::fill(touched.begin(), touched.end(), false);
+    std::iota(remap.begin(), remap.end(), 0);
+    for (const Collapse &collapse : collapses) {
+      if (collapsed == budget)
+        break;
+      if (touched[collapse.from] || touched[collapse.to])
+        continue;
+
+      // moving from onto to must not turn any of from's other triangles over
+      bool flips = {false};
+      glm::vec3 target = {vertices[collapse.to].position};
+      for (unsigned int a{offsets[collapse.from]}; a < offsets[collapse.from + 1] && !flips; a++) {
+        const unsigned int *triangle = {&result[adjacency[a] * 3]};
+        if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+          continue;
+        glm::vec3 corners_before[3], corners_after[3];
+        for (int k{0}; k < 3; k++) {
+          corners_before[k] = vertices[triangle[k]].position;
+          corners_after[k] = triangle[k] == collapse.from ? target : corners_before[k];
+        }
+        glm::vec3 before = {glm::cross(corners_before[1] - corners_before[0], corners_before[2] - corners_before[0])};
+        glm::vec3 after = {glm::cross(corners_after[1] - corners_after[0], corners_after[2] - corners_after[0])};
+        flips = glm::dot(before, after) <= 0.0f;
+      }
+      if (flips)
+        continue;
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      error = std::max(error, static_cast<float>(std::sqrt(collapse.cost)));
+      // the triangles around from changed shape, their corners wait for the next pass
+      for (unsigned int a{offsets[collapse.from]}; a < offsets[collapse.from + 1]; a++) {
+        const unsigned int *triangle = {&result[adjacency[a] * 3]};
+        touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+      }
+      collapsed++;
+    }
+    if (collapsed == 0)
+      break;
+
+    // drop the triangles that collapsed to lines
+    size_t write{0};
+    for (size_t i{0}; i < result.size(); i += 3) {
+      unsigned int a = {remap[result[i]]}, b = {remap[result[i + 1]]}, c = {remap[result[i + 2]]};
+      if (a == b || b == c || c == a)
+        continue;
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+
+  return result;
+}
+
+auto build_lods(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) -> std::vector<MeshLod> {
+  std::vector<MeshLod> lods = {MeshLod{0, static_cast<unsigned int>(indices.size()), 0.0f}};
+  size_t full_count = {indices.size()};
+  size_t previous_count = {full_count};
+
+  // every level starts from the full mesh, so its error is measured against the original surface
+  for (float ratio : LOD_RATIOS) {
+    size_t target = {static_cast<size_t>(full_count / 3 * ratio) * 3};
+    float error{};
+    std::vector<unsigned int> level = {simplify_mesh(vertices, std::vector<unsigned int>(indices.begin(), indices.begin() + full_count), target, error)};
+    if (level.empty() || level.size() > previous_count * LOD_MIN_REDUCTION)
+      break;
+
+    optimize_vertex_cache(level, vertices.size());
+    lods.push_back(MeshLod{static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(level.size()), error});
+    indices.insert(indices.end(), level.begin(), level.end());
+    previous_count = level.size();
+  }
+  return lods;
+}
@@ -1,95 +1,262 @@
 #include "model.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
 #include "utils.hpp"
 
-Model::Model(const char *path) { load_model(path); }
+#include <algorithm>
+#include <future>
 
-void Model::draw(const Shader &shader) {
-  for (size_t i{0}; i < meshes_.size(); i++) {
-    meshes_[i].draw(shader, *this);
+// part of the cache key, a cooked file from different flags is never reused
+constexpr unsigned int IMPORT_FLAGS = {aiProcess_Triangulate | aiProcess_FlipUVs};
+
+// a mesh converted off the main thread, textures are slots in the model's textures_loaded_
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  MeshOptimizeReport report;
+  std::vector<MeshLod> lods;
+};
+
+static MeshData convert_mesh(const aiMesh *mesh) {
+  ProfileZone zone{"convert mesh"};
+  MeshData data{};
+  data.vertices.reserve(mesh->mNumVertices);
+  data.indices.reserve(mesh->mNumFaces * 3);
+
+  aiVector3D *texture_at = {mesh->mTextureCoords[0]};
+
+  for (size_t i{0}; i < mesh->mNumVertices; i++) {
+    aiVector3D position_at = {mesh->mVertices[i]};
+    aiVector3D normals_at = {mesh->mNormals[i]};
+
+    glm::vec3 position = {position_at.x, position_at.y, position_at.z};
+    glm::vec3 normal = {normals_at.x, normals_at.y, normals_at.z};
+    glm::vec2 tex_coords = {texture_at ? glm::vec2{texture_at[i].x, texture_at[i].y} : glm::vec2{0}};
+    data.vertices.push_back(Vertex{position, normal, tex_coords});
+  }
+
+  for (size_t i{0}; i < mesh->mNumFaces; i++) {
+    const aiFace &face = {mesh->mFaces[i]};
+    data.indices.insert(data.indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+  }
+
+  // assimp keeps one vertex per face corner, welding and reordering is left to the optimizer
+  data.report = optimize_mesh(data.vertices, data.indices);
+  data.lods = build_lods(data.vertices, data.indices);
+  return data;
+}
+
+// textures some other model already loaded are taken from the registry, the rest start decoding
+static auto decode_textures(std::vector<Texture> &textures, size_t first, const std::string &directory)
+    -> std::vector<std::future<ImageData>> {
+  ResourceRegistry &registry = {ResourceRegistry::instance()};
+  std::vector<std::future<ImageData>> images(textures.size() - first);
+  for (size_t i{first}; i < textures.size(); i++) {
+    std::string filename = {directory + '/' + textures[i].path};
+    if (TextureRef shared = registry.find_texture(filename)) {
+      textures[i].id = shared->id;
+      textures[i].resource = shared;
+      continue;
+    }
+    images[i - first] = worker_pool().submit([filename] { return decode_image(filename); });
   }
+  return images;
 }
 
+// uploads stay on this thread, staged through one pixel buffer that is orphaned for each image
+static void upload_textures(std::vector<Texture> &textures, size_t first, std::vector<std::future<ImageData>> &images) {
+  ProfileZone zone{"upload textures"};
+  ResourceRegistry &registry = {ResourceRegistry::instance()};
+  unsigned int pixel_buffer{};
+  glGenBuffers(1, &pixel_buffer);
+  for (size_t i{0}; i < images.size(); i++) {
+    if (!images[i].valid())
+      continue;
+
+    ImageData image = {images[i].get()};
+    Texture &texture = {textures[first + i]};
+    texture.resource = registry.add_texture(image.path, upload_texture(image, pixel_buffer));
+    texture.id = texture.resource->id;
+  }
+  glDeleteBuffers(1, &pixel_buffer);
+}
+
+Model::Model(const char *path, VertexFormat format) : format_{format} { load_model(path); }
+
 void Model::load_model(const std::string &path) {
+  ProfileZone zone{"Model::load_model"};
+  // another model from the same file and vertex format already owns the gpu copies
+  ResourceRegistry &registry = {ResourceRegistry::instance()};
+  std::string key = {format_ == VertexFormat::QUANTIZED ? path + "#quantized" : path};
+  if (ModelRef shared = registry.find_model(key)) {
+    source_ = shared;
+    meshes_ = *shared;
+    for (const Mesh &mesh : meshes_) {
+      if (std::find(materials_.begin(), materials_.end(), mesh.material) == materials_.end())
+        materials_.push_back(mesh.material);
+    }
+    return;
+  }
+
+  directory_ = path.substr(0, path.find_last_of('/'));
+  if (!load_cooked(path) && !import_model(path))
+    return;
+
+  source_ = registry.add_model(key, meshes_);
+}
+
+auto Model::import_model(const std::string &path) -> bool {
+  ProfileZone zone{"Model::import_model"};
   Assimp::Importer importer{};
-  const aiScene *scene = {importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs)};
+  const aiScene *scene = {importer.ReadFile(path, IMPORT_FLAGS)};
 
   if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
     std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-    return;
+    return false;
   }
 
-  directory_ = path.substr(0, path.find_last_of('/'));
-  process_node(scene->mRootNode, scene);
-}
+  std::vector<unsigned int> mesh_order{};
+  collect_meshes(scene->mRootNode, mesh_order);
 
-void Model::process_node(const aiNode *node, const aiScene *scene) {
+  // find every texture the meshes reference, each unique path is decoded once
+  std::vector<std::vector<unsigned int>> mesh_textures(mesh_order.size());
+  size_t first_texture = {textures_loaded_.size()};
+  size_t first_mesh = {meshes_.size()};
+  for (size_t i{0}; i < mesh_order.size(); i++) {
+    const aiMaterial *material = {scene->mMaterials[scene->mMeshes[mesh_order[i]]->mMaterialIndex]};
+    std::vector<unsigned int> diffuse_maps = {load_material_textures(material, aiTextureType_DIFFUSE, "texture_diffuse")};
+    mesh_textures[i].insert(mesh_textures[i].end(), diffuse_maps.begin(), diffuse_maps.end());
+    std::vector<unsigned int> specular_maps = {load_material_textures(material, aiTextureType_SPECULAR, "texture_specular")};
+    mesh_textures[i].insert(mesh_textures[i].end(), specular_maps.begin(), specular_maps.end());
+  }
 
-  for (size_t i{0}; i < node->mNumMeshes; i++) {
-    aiMesh *mesh = {scene->mMeshes[node->mMeshes[i]]};
-    meshes_.push_back(process_mesh(mesh, scene));
+  // decode images and convert meshes on the worker pool, the scene stays alive until every job is collected
+  std::vector<std::future<ImageData>> images = {decode_textures(textures_loaded_, first_texture, directory_)};
+  std::vector<std::future<MeshData>> converted{};
+  for (unsigned int index : mesh_order) {
+    const aiMesh *mesh = {scene->mMeshes[index]};
+    converted.push_back(worker_pool().submit([mesh] { return convert_mesh(mesh); }));
   }
+  upload_textures(textures_loaded_, first_texture, images);
 
-  for (size_t i{0}; i < node->mNumChildren; i++) {
-    process_node(node->mChildren[i], scene);
+  meshes_.reserve(meshes_.size() + converted.size());
+  for (size_t i{0}; i < converted.size(); i++) {
+    MeshData data = {converted[i].get()};
+    optimize_reports_.push_back(data.report);
+    meshes_.emplace_back(std::move(data.vertices), std::move(data.indices), material_for(mesh_textures[i]), std::move(data.lods), format_);
   }
-}
 
-Mesh Model::process_mesh(const aiMesh *mesh, const aiScene *scene) {
-  std::vector<Vertex> vertices{};
-  std::vector<unsigned int> indices{};
-  std::vector<Texture> textures{};
+  // the cache has its own texture table, slots are renumbered into it
+  std::vector<Texture> referenced{};
+  std::map<unsigned int, unsigned int> local_slots{};
+  for (std::vector<unsigned int> &slots : mesh_textures) {
+    for (unsigned int &slot : slots) {
+      auto found = local_slots.emplace(slot, static_cast<unsigned int>(referenced.size())).first;
+      if (found->second == referenced.size()) {
+        referenced.push_back(textures_loaded_[slot]);
+      }
+      slot = found->second;
+    }
+  }
+  if (!MeshCache::write(path, IMPORT_FLAGS, format_, meshes_.data() + first_mesh, meshes_.size() - first_mesh, mesh_textures, referenced)) {
+    std::cerr << "WARNING::MESH_CACHE::could not cook " << path << std::endl;
+  }
 
-  aiVector3D *texture_at = {mesh->mTextureCoords[0]};
+  // the gpu has the only copy the renderer needs from here on
+  for (size_t i{first_mesh}; i < meshes_.size(); i++) {
+    meshes_[i].vertices = {};
+    meshes_[i].indices = {};
+  }
+  return true;
+}
 
-  for (size_t i{0}; i < mesh->mNumVertices; i++) {
-    aiVector3D position_at = {mesh->mVertices[i]};
-    aiVector3D normals_at = {mesh->mNormals[i]};
+// builds the meshes straight from a mapped cache file, false when it is missing or out of date
+auto Model::load_cooked(const std::string &path) -> bool {
+  ProfileZone zone{"Model::load_cooked"};
+  MeshCache cache{};
+  if (!cache.open(path, IMPORT_FLAGS, format_))
+    return false;
 
-    glm::vec3 position = {position_at.x, position_at.y, position_at.z};
-    glm::vec3 normal = {normals_at.x, normals_at.y, normals_at.z};
-    glm::vec2 tex_coords = {texture_at ? glm::vec2{texture_at[i].x, texture_at[i].y} : glm::vec2{0}};
-    vertices.push_back(Vertex{position, normal, tex_coords});
+  // a stale or damaged file can name textures it doesn't have, import again and cook it over
+  for (const CookedMesh &cooked : cache.meshes()) {
+    for (unsigned int slot : cooked.textures) {
+      if (slot >= cache.textures().size())
+        return false;
+    }
   }
 
-  for (size_t i{0}; i < mesh->mNumFaces; i++) {
-    aiFace face = {mesh->mFaces[i]};
-    for (size_t j{0}; j < face.mNumIndices; j++) {
-      indices.push_back(face.mIndices[j]);
+  // cached slots index the file's own texture table, map them onto the shared one
+  std::vector<unsigned int> slots{};
+  size_t first_texture = {textures_loaded_.size()};
+  for (const Texture &texture : cache.textures()) {
+    auto found = texture_slots_.find(texture.path);
+    if (found == texture_slots_.end()) {
+      found = texture_slots_.emplace(texture.path, static_cast<unsigned int>(textures_loaded_.size())).first;
+      textures_loaded_.push_back(texture);
     }
+    slots.push_back(found->second);
+  }
+
+  std::vector<std::future<ImageData>> images = {decode_textures(textures_loaded_, first_texture, directory_)};
+  upload_textures(textures_loaded_, first_texture, images);
+
+  meshes_.reserve(meshes_.size() + cache.meshes().size());
+  for (const CookedMesh &cooked : cache.meshes()) {
+    std::vector<unsigned int> mesh_slots{};
+    for (unsigned int slot : cooked.textures) {
+      mesh_slots.push_back(slots[slot]);
+    }
+    meshes_.emplace_back(cooked, material_for(mesh_slots), format_);
+  }
+  return true;
+}
+
+auto Model::material_for(const std::vector<unsigned int> &slots) -> std::shared_ptr<Material> {
+  auto found = material_slots_.find(slots);
+  if (found != material_slots_.end())
+    return found->second;
+
+  // only the first map of each kind is sampled
+  auto material = std::make_shared<Material>();
+  for (auto slot = slots.rbegin(); slot != slots.rend(); slot++) {
+    const Texture &texture = {textures_loaded_[*slot]};
+    MaterialMap map = {material_map(texture.type)};
+    if (map != MATERIAL_MAPS)
+      material->set_map(map, texture.resource);
   }
+  material_slots_.emplace(slots, material);
+  materials_.push_back(material);
+  return material;
+}
+
+// flattens the node hierarchy into the order meshes are drawn in
+void Model::collect_meshes(const aiNode *node, std::vector<unsigned int> &meshes) const {
+  meshes.insert(meshes.end(), node->mMeshes, node->mMeshes + node->mNumMeshes);
 
-  if (mesh->mMaterialIndex >= 0) {
-    aiMaterial *material = {scene->mMaterials[mesh->mMaterialIndex]};
-    std::vector<Texture> diffuse_maps = {load_material_textures(material, aiTextureType_DIFFUSE, "texture_diffuse")};
-    textures.insert(textures.end(), diffuse_maps.begin(), diffuse_maps.end());
-    std::vector<Texture> specular_maps = {load_material_textures(material, aiTextureType_SPECULAR, "texture_specular")};
-    textures.insert(textures.end(), specular_maps.begin(), specular_maps.end());
+  for (size_t i{0}; i < node->mNumChildren; i++) {
+    collect_meshes(node->mChildren[i], meshes);
   }
-  return Mesh{vertices, indices, textures};
 }
 
-std::vector<Texture> Model::load_material_textures(const aiMaterial *mat, aiTextureType type, const std::string &type_name) {
-  std::vector<Texture> textures{};
+std::vector<unsigned int> Model::load_material_textures(const aiMaterial *mat, aiTextureType type, const std::string &type_name) {
+  std::vector<unsigned int> slots{};
 
-  for (size_t i{0}; i < mat->GetTextureCount(type); i++) {
+  for (unsigned int i{0}; i < mat->GetTextureCount(type); i++) {
     aiString str{};
     mat->GetTexture(type, i, &str);
 
-    bool skip = {false};
-
-    for (size_t j{0}; j < textures_loaded_.size(); j++) {
-      if (std::strcmp(textures_loaded_[j].path.data(), str.C_Str()) == 0) {
-        textures.push_back(textures_loaded_[j]);
-        skip = true;
-        break;
-      }
-    }
-    if (!skip) {
-      unsigned int id = {texture_from_file(str.C_Str(), directory_)};
-      Texture texture = {id, type_name, str.C_Str()};
-      textures.push_back(texture);
-      textures_loaded_.push_back(texture);
+    auto found = texture_slots_.find(str.C_Str());
+    if (found != texture_slots_.end()) {
+      slots.push_back(found->second);
+      continue;
     }
+
+    unsigned int slot = {static_cast<unsigned int>(textures_loaded_.size())};
+    textures_loaded_.push_back(Texture{0, type_name, str.C_Str(), {}});
+    texture_slots_.emplace(str.C_Str(), slot);
+    slots.push_back(slot);
   }
-  return textures;
+  return slots;
 }
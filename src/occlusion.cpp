@@ -0,0 +1,401 @@
+#include "occlusion.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// OCCLUSION_SCALAR keeps to the plain c++ path, the tests build both and compare them
+#if !defined(OCCLUSION_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define OCCLUSION_SSE2
+#endif
+// per lane variable shifts for the row masks
+#if defined(OCCLUSION_SSE2) && defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_AVX2
+#endif
+
+constexpr unsigned int OCCLUDERS_PER_BATCH = {16};
+constexpr int BAND_ROWS = {4}; // tile rows rasterized by one job
+constexpr float SPAN_EPSILON = {1.0f / 64.0f};
+
+// a triangle edge bounding a span from one side
+struct Edge {
+  float x0;
+  float y0;
+  float slope;
+};
+
+// the bits of pixels [begin, end) in a row, both in [0, 32]
+static auto span_bits(int begin, int end) -> uint32_t {
+  uint32_t from = {begin < 32 ? ~0u << begin : 0u};
+  uint32_t to = {end < 32 ? ~(~0u << end) : ~0u};
+  return from & to;
+}
+
+#ifdef OCCLUSION_SSE2
+// sse2 has no rounding, truncation corrected by one where it went the wrong way
+static auto floor_ps(__m128 value) -> __m128 {
+  __m128 truncated = {_mm_cvtepi32_ps(_mm_cvttps_epi32(value))};
+  return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), _mm_set1_ps(1.0f)));
+}
+
+static auto ceil_ps(__m128 value) -> __m128 {
+  __m128 truncated = {_mm_cvtepi32_ps(_mm_cvttps_epi32(value))};
+  return _mm_add_ps(truncated, _mm_and_ps(_mm_cmplt_ps(truncated, value), _mm_set1_ps(1.0f)));
+}
+
+static auto all_equal(__m128i a, __m128i b) -> bool {
+  return _mm_movemask_epi8(_mm_cmpeq_epi32(a, b)) == 0xffff;
+}
+
+// ~0u << n in every lane for n in [0, 32], where 32 gives 0
+static auto ones_shifted(__m128i n) -> __m128i {
+#ifdef OCCLUSION_AVX2
+  return _mm_sllv_epi32(_mm_set1_epi32(-1), n);
+#else
+  // 2^n built in a float's exponent, -2^n is then the shifted ones. Converting 2^31 overflows to the
+  // 0x80000000 it should be anyway, 32 is masked
+  __m128i power = {_mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)))};
+  return _mm_andnot_si128(_mm_cmpeq_epi32(n, _mm_set1_epi32(32)), _mm_sub_epi32(_mm_setzero_si128(), power));
+#endif
+}
+
+// merges a triangle's coverage of a tile into its working layer
+static void merge(OcclusionTile &tile, __m128i coverage, float depth) {
+  if (depth >= tile.reference)
+    return;
+  __m128i mask = {_mm_load_si128(reinterpret_cast<const __m128i *>(tile.mask))};
+  // a triangle far behind the working layer would drag all of it back, starting the layer over from it
+  // keeps whichever of the two is closer to the reference
+  if (all_equal(mask, _mm_setzero_si128()) || depth - tile.working > tile.reference - depth) {
+    mask = coverage;
+    tile.working = depth;
+  } else {
+    mask = _mm_or_si128(mask, coverage);
+    tile.working = std::max(tile.working, depth);
+  }
+  if (all_equal(mask, _mm_set1_epi32(-1))) {
+    tile.reference = tile.working;
+    tile.working = 0.0f;
+    mask = _mm_setzero_si128();
+  }
+  _mm_store_si128(reinterpret_cast<__m128i *>(tile.mask), mask);
+}
+#else
+static void merge(OcclusionTile &tile, const uint32_t coverage[4], float depth) {
+  if (depth >= tile.reference)
+    return;
+  bool empty = {(tile.mask[0] | tile.mask[1] | tile.mask[2] | tile.mask[3]) == 0};
+  bool restart = {empty || depth - tile.working > tile.reference - depth};
+  bool full = {true};
+  for (int i{0}; i < 4; i++) {
+    tile.mask[i] = restart ? coverage[i] : tile.mask[i] | coverage[i];
+    full = full && tile.mask[i] == ~0u;
+  }
+  tile.working = restart ? depth : std::max(tile.working, depth);
+  if (full) {
+    tile.reference = tile.working;
+    tile.working = 0.0f;
+    std::fill(tile.mask, tile.mask + 4, 0u);
+  }
+}
+#endif
+
+static void transform_positions(const glm::mat4 &transform, const glm::vec3 *positions, size_t count, glm::vec4 *clip) {
+#ifdef OCCLUSION_SSE2
+  __m128 columns[4];
+  for (int i{0}; i < 4; i++) {
+    columns[i] = _mm_loadu_ps(&transform[i][0]);
+  }
+  for (size_t i{0}; i < count; i++) {
+    __m128 x = {_mm_mul_ps(columns[0], _mm_set1_ps(positions[i].x))};
+    __m128 y = {_mm_mul_ps(columns[1], _mm_set1_ps(positions[i].y))};
+    __m128 z = {_mm_mul_ps(columns[2], _mm_set1_ps(positions[i].z))};
+    _mm_storeu_ps(&clip[i].x, _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, columns[3])));
+  }
+#else
+  // summed in the same order as the sse2 path so both give the same coverage
+  for (size_t i{0}; i < count; i++) {
+    clip[i] = (transform[0] * positions[i].x + transform[1] * positions[i].y) + (transform[2] * positions[i].z + transform[3]);
+  }
+#endif
+}
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height)
+    : width_{width}, height_{height}, tiles_x_{static_cast<int>((width + TILE_WIDTH - 1) / TILE_WIDTH)},
+      tiles_y_{static_cast<int>((height + TILE_HEIGHT - 1) / TILE_HEIGHT)} {
+  static_assert(TILE_WIDTH == 32 && TILE_HEIGHT == 4, "a tile is one 32 bit mask per row, one row per sse lane");
+  tiles_.resize(static_cast<size_t>(tiles_x_) * tiles_y_);
+}
+
+void OcclusionBuffer::clear(const glm::mat4 &view_projection) {
+  view_projection_ = view_projection;
+  std::fill(tiles_.begin(), tiles_.end(), OcclusionTile{{0u, 0u, 0u, 0u}, std::numeric_limits<float>::max(), 0.0f});
+  occluders_.clear();
+}
+
+void OcclusionBuffer::add_occluder(const glm::vec3 *positions, size_t vertex_count, const unsigned int *indices,
+                                   size_t index_count, const glm::mat4 &model) {
+  occluders_.push_back(Occluder{positions, vertex_count, indices, index_count, view_projection_ * model});
+}
+
+void OcclusionBuffer::rasterize() {
+  unsigned int batches = {static_cast<unsigned int>((occluders_.size() + OCCLUDERS_PER_BATCH - 1) / OCCLUDERS_PER_BATCH)};
+  batches_.resize(batches);
+  worker_pool().parallel_for(batches, [this](unsigned int batch) { setup_batch(batch); });
+
+  triangles_ = 0;
+  for (const Batch &batch : batches_) {
+    triangles_ += batch.triangles.size();
+  }
+  // bands of tile rows never share a tile, their jobs need no locking
+  worker_pool().parallel_for(static_cast<unsigned int>(bands()), [this](unsigned int band) { rasterize_band(band); });
+}
+
+auto OcclusionBuffer::bands() const -> int {
+  return (tiles_y_ + BAND_ROWS - 1) / BAND_ROWS;
+}
+
+// projects a run of occluders, keeping the triangles that can cover a pixel center
+void OcclusionBuffer::setup_batch(unsigned int index) {
+  Batch &batch = {batches_[index]};
+  batch.triangles.clear();
+
+  size_t end = {std::min(occluders_.size(), size_t{index + 1} * OCCLUDERS_PER_BATCH)};
+  for (size_t i{size_t{index} * OCCLUDERS_PER_BATCH}; i < end; i++) {
+    const Occluder &occluder = {occluders_[i]};
+    batch.clip.resize(occluder.vertex_count);
+    transform_positions(occluder.transform, occluder.positions, occluder.vertex_count, batch.clip.data());
+
+    for (size_t j{0}; j + 2 < occluder.index_count; j += 3) {
+      ScreenTriangle triangle{{}, {}, 0.0f, 0, 0, 0, 0};
+      bool clipped{false};
+      for (int k{0}; k < 3 && !clipped; k++) {
+        const glm::vec4 &corner = {batch.clip[occluder.indices[j + k]]};
+        // anything reaching past the near plane is dropped whole, a missing occluder only hides less
+        clipped = corner.w <= 0.0f || corner.z < -corner.w;
+        triangle.x[k] = (corner.x / corner.w * 0.5f + 0.5f) * width_;
+        triangle.y[k] = (corner.y / corner.w * 0.5f + 0.5f) * height_;
+        triangle.depth = std::max(triangle.depth, corner.w);
+      }
+      if (clipped)
+        continue;
+
+      float area = {(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+                    (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0])};
+      if (!(std::abs(area) > 0.0f))
+        continue;
+      if (area < 0.0f) {
+        std::swap(triangle.x[1], triangle.x[2]);
+        std::swap(triangle.y[1], triangle.y[2]);
+      }
+
+      // the pixels whose centers lie within the triangle's bounds, without any it covers nothing
+      float min_x = {std::min({triangle.x[0], triangle.x[1], triangle.x[2]})};
+      float max_x = {std::max({triangle.x[0], triangle.x[1], triangle.x[2]})};
+      float min_y = {std::min({triangle.y[0], triangle.y[1], triangle.y[2]})};
+      float max_y = {std::max({triangle.y[0], triangle.y[1], triangle.y[2]})};
+      if (!(max_x > 0.0f && min_x < width_ && max_y > 0.0f && min_y < height_))
+        continue;
+      triangle.x_begin = static_cast<int>(std::ceil(std::max(min_x - 0.5f, 0.0f)));
+      triangle.x_end = static_cast<int>(std::floor(std::min(max_x + 0.5f, static_cast<float>(width_))));
+      triangle.y_begin = static_cast<int>(std::ceil(std::max(min_y - 0.5f, 0.0f)));
+      triangle.y_end = static_cast<int>(std::floor(std::min(max_y + 0.5f, static_cast<float>(height_))));
+      if (triangle.x_begin >= triangle.x_end || triangle.y_begin >= triangle.y_end)
+        continue;
+      batch.triangles.push_back(triangle);
+    }
+  }
+
+  // counting sort into the bands, a triangle crossing a band border is listed in both
+  int band_height = {BAND_ROWS * TILE_HEIGHT};
+  batch.band_offsets.assign(bands() + 1, 0);
+  for (const ScreenTriangle &triangle : batch.triangles) {
+    for (int band{triangle.y_begin / band_height}; band <= (triangle.y_end - 1) / band_height; band++) {
+      batch.band_offsets[band + 1]++;
+    }
+  }
+  for (int band{0}; band < bands(); band++) {
+    batch.band_offsets[band + 1] += batch.band_offsets[band];
+  }
+  batch.band_triangles.resize(batch.band_offsets.back());
+  for (unsigned int i{0}; i < batch.triangles.size(); i++) {
+    const ScreenTriangle &triangle = {batch.triangles[i]};
+    for (int band{triangle.y_begin / band_height}; band <= (triangle.y_end - 1) / band_height; band++) {
+      batch.band_triangles[batch.band_offsets[band]++] = i;
+    }
+  }
+  // filling moved every offset to the next band's start
+  for (int band{bands()}; band > 0; band--) {
+    batch.band_offsets[band] = batch.band_offsets[band - 1];
+  }
+  batch.band_offsets[0] = 0;
+}
+
+void OcclusionBuffer::rasterize_band(unsigned int band) {
+  int first_row = {static_cast<int>(band) * BAND_ROWS};
+  int last_row = {std::min(first_row + BAND_ROWS, tiles_y_) - 1};
+  for (const Batch &batch : batches_) {
+    for (unsigned int i{batch.band_offsets[band]}; i < batch.band_offsets[band + 1]; i++) {
+      rasterize_triangle(batch.triangles[batch.band_triangles[i]], first_row, last_row);
+    }
+  }
+}
+
+// Each row's coverage is a span between the innermost left and right edge at the row's pixel centers.
+void OcclusionBuffer::rasterize_triangle(const ScreenTriangle &triangle, int first_row, int last_row) {
+  int y_begin = {std::max(first_row * TILE_HEIGHT, triangle.y_begin)};
+  int y_end = {std::min((last_row + 1) * TILE_HEIGHT, triangle.y_end)};
+  int tile_x_begin = {triangle.x_begin / TILE_WIDTH};
+  int tile_x_end = {(triangle.x_end + TILE_WIDTH - 1) / TILE_WIDTH};
+
+  // edges as lines through a corner, x = x0 + slope * (y - y0). Counter clockwise with y up, the ones
+  // running down bound the span from the left and the ones running up from the right, each moved in a
+  // little against rounding. Flat edges are left to the row limits
+  Edge left[2], right[2];
+  int lefts{0}, rights{0};
+  for (int k{0}; k < 3; k++) {
+    float x0 = {triangle.x[k]}, y0 = {triangle.y[k]};
+    float x1 = {triangle.x[(k + 1) % 3]}, y1 = {triangle.y[(k + 1) % 3]};
+    if (y1 == y0)
+      continue;
+    float slope = {(x1 - x0) / (y1 - y0)};
+    if (y1 < y0) {
+      left[lefts++] = Edge{x0 + SPAN_EPSILON, y0, slope};
+    } else {
+      right[rights++] = Edge{x0 - SPAN_EPSILON, y0, slope};
+    }
+  }
+
+#ifdef OCCLUSION_SSE2
+  __m128 left_x[2], left_y[2], left_slope[2], right_x[2], right_y[2], right_slope[2];
+  for (int k{0}; k < lefts; k++) {
+    left_x[k] = _mm_set1_ps(left[k].x0), left_y[k] = _mm_set1_ps(left[k].y0), left_slope[k] = _mm_set1_ps(left[k].slope);
+  }
+  for (int k{0}; k < rights; k++) {
+    right_x[k] = _mm_set1_ps(right[k].x0), right_y[k] = _mm_set1_ps(right[k].y0), right_slope[k] = _mm_set1_ps(right[k].slope);
+  }
+  __m128 zero = {_mm_setzero_ps()}, half = {_mm_set1_ps(0.5f)}, width = {_mm_set1_ps(static_cast<float>(width_))};
+  __m128 tile_width = {_mm_set1_ps(static_cast<float>(TILE_WIDTH))};
+  __m128i first_y = {_mm_set1_epi32(y_begin)}, last_y = {_mm_set1_epi32(y_end - 1)};
+#endif
+
+  for (int row{y_begin / TILE_HEIGHT}; row <= (y_end - 1) / TILE_HEIGHT; row++) {
+    int y = {row * TILE_HEIGHT};
+#ifdef OCCLUSION_SSE2
+    // one pixel row per lane, pixel x is covered when x + 0.5 lies within the span
+    __m128i rows = {_mm_add_epi32(_mm_set1_epi32(y), _mm_setr_epi32(0, 1, 2, 3))};
+    __m128 center = {_mm_add_ps(_mm_cvtepi32_ps(rows), half)};
+    __m128 span_left = {half}, span_right = {_mm_sub_ps(width, half)};
+    for (int k{0}; k < lefts; k++) {
+      span_left = _mm_max_ps(span_left, _mm_add_ps(left_x[k], _mm_mul_ps(left_slope[k], _mm_sub_ps(center, left_y[k]))));
+    }
+    for (int k{0}; k < rights; k++) {
+      span_right = _mm_min_ps(span_right, _mm_add_ps(right_x[k], _mm_mul_ps(right_slope[k], _mm_sub_ps(center, right_y[k]))));
+    }
+    // rows outside the triangle get an empty span
+    __m128 outside = {_mm_castsi128_ps(_mm_or_si128(_mm_cmplt_epi32(rows, first_y), _mm_cmpgt_epi32(rows, last_y)))};
+    span_left = _mm_or_ps(_mm_andnot_ps(outside, _mm_min_ps(span_left, width)), _mm_and_ps(outside, width));
+    __m128 begin = {ceil_ps(_mm_sub_ps(span_left, half))};
+    __m128 end = {floor_ps(_mm_add_ps(_mm_max_ps(span_right, zero), half))};
+
+    for (int tile_x{tile_x_begin}; tile_x < tile_x_end; tile_x++) {
+      OcclusionTile &tile = {tiles_[static_cast<size_t>(row) * tiles_x_ + tile_x]};
+      if (triangle.depth >= tile.reference)
+        continue;
+      __m128 origin = {_mm_set1_ps(static_cast<float>(tile_x * TILE_WIDTH))};
+      __m128i from = {_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_sub_ps(begin, origin), zero), tile_width))};
+      __m128i to = {_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_sub_ps(end, origin), zero), tile_width))};
+      __m128i coverage = {_mm_andnot_si128(ones_shifted(to), ones_shifted(from))};
+      if (!all_equal(coverage, _mm_setzero_si128()))
+        merge(tile, coverage, triangle.depth);
+    }
+#else
+    int begin[TILE_HEIGHT], end[TILE_HEIGHT];
+    for (int i{0}; i < TILE_HEIGHT; i++) {
+      float center = {y + i + 0.5f};
+      float span_left = {0.5f}, span_right = {width_ - 0.5f};
+      for (int k{0}; k < lefts; k++) {
+        span_left = std::max(span_left, left[k].x0 + left[k].slope * (center - left[k].y0));
+      }
+      for (int k{0}; k < rights; k++) {
+        span_right = std::min(span_right, right[k].x0 + right[k].slope * (center - right[k].y0));
+      }
+      bool outside = {y + i < y_begin || y + i >= y_end};
+      begin[i] = outside ? static_cast<int>(width_) : static_cast<int>(std::ceil(std::min(span_left, static_cast<float>(width_)) - 0.5f));
+      end[i] = static_cast<int>(std::floor(std::max(span_right, 0.0f) + 0.5f));
+    }
+
+    for (int tile_x{tile_x_begin}; tile_x < tile_x_end; tile_x++) {
+      OcclusionTile &tile = {tiles_[static_cast<size_t>(row) * tiles_x_ + tile_x]};
+      if (triangle.depth >= tile.reference)
+        continue;
+      uint32_t coverage[TILE_HEIGHT];
+      uint32_t any{0};
+      for (int i{0}; i < TILE_HEIGHT; i++) {
+        int origin = {tile_x * TILE_WIDTH};
+        coverage[i] = span_bits(std::clamp(begin[i] - origin, 0, TILE_WIDTH), std::clamp(end[i] - origin, 0, TILE_WIDTH));
+        any |= coverage[i];
+      }
+      if (any != 0)
+        merge(tile, coverage, triangle.depth);
+    }
+#endif
+  }
+}
+
+auto OcclusionBuffer::occluded(const AABB &box) const -> bool {
+  float min_x = {std::numeric_limits<float>::max()}, min_y = {std::numeric_limits<float>::max()};
+  float max_x = {-std::numeric_limits<float>::max()}, max_y = {-std::numeric_limits<float>::max()};
+  float nearest = {std::numeric_limits<float>::max()};
+  for (int i{0}; i < 8; i++) {
+    glm::vec3 corner = {i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z};
+    glm::vec4 clip = {view_projection_ * glm::vec4{corner, 1.0f}};
+    // boxes reaching the near plane are always drawn
+    if (clip.w <= 0.0f || clip.z < -clip.w)
+      return false;
+    float x = {(clip.x / clip.w * 0.5f + 0.5f) * width_}, y = {(clip.y / clip.w * 0.5f + 0.5f) * height_};
+    min_x = std::min(min_x, x), max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y), max_y = std::max(max_y, y);
+    nearest = std::min(nearest, clip.w);
+  }
+
+  // the pixels around the box's projection, every center it can reach is among them
+  int x_begin = {static_cast<int>(std::floor(std::max(min_x - 0.5f, 0.0f)))};
+  int x_end = {static_cast<int>(std::ceil(std::min(max_x + 0.5f, static_cast<float>(width_))))};
+  int y_begin = {static_cast<int>(std::floor(std::max(min_y - 0.5f, 0.0f)))};
+  int y_end = {static_cast<int>(std::ceil(std::min(max_y + 0.5f, static_cast<float>(height_))))};
+  if (x_begin >= x_end || y_begin >= y_end)
+    return false;
+
+  for (int row{y_begin / TILE_HEIGHT}; row <= (y_end - 1) / TILE_HEIGHT; row++) {
+    for (int tile_x{x_begin / TILE_WIDTH}; tile_x <= (x_end - 1) / TILE_WIDTH; tile_x++) {
+      const OcclusionTile &tile = {tiles_[static_cast<size_t>(row) * tiles_x_ + tile_x]};
+      if (nearest > tile.reference)
+        continue;
+      if (nearest <= tile.working)
+        return false;
+      // behind the working layer, which has to cover every pixel the box touches in this tile
+      int origin = {tile_x * TILE_WIDTH};
+      uint32_t bits = {span_bits(std::clamp(x_begin - origin, 0, TILE_WIDTH), std::clamp(x_end - origin, 0, TILE_WIDTH))};
+#ifdef OCCLUSION_SSE2
+      __m128i y = {_mm_add_epi32(_mm_set1_epi32(row * TILE_HEIGHT), _mm_setr_epi32(0, 1, 2, 3))};
+      __m128i rows = {_mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(y, _mm_set1_epi32(y_begin)),
+                                                    _mm_cmpgt_epi32(y, _mm_set1_epi32(y_end - 1))),
+                                       _mm_set1_epi32(static_cast<int>(bits)))};
+      __m128i mask = {_mm_load_si128(reinterpret_cast<const __m128i *>(tile.mask))};
+      if (!all_equal(_mm_andnot_si128(mask, rows), _mm_setzero_si128()))
+        return false;
+#else
+      for (int i{0}; i < TILE_HEIGHT; i++) {
+        int y = {row * TILE_HEIGHT + i};
+        if (y >= y_begin && y < y_end && (bits & ~tile.mask[i]) != 0)
+          return false;
+      }
+#endif
+    }
+  }
+  return true;
+}
@@ -0,0 +1,162 @@
+#include "profiler.hpp"
+
+#include <glad/glad.h>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+
+// small stable ids for the trace's thread lanes, the main thread is the first to record
+static auto thread_index() -> unsigned int {
+  static std::atomic<unsigned int> next_index{0};
+  thread_local unsigned int index = {next_index++};
+  return index;
+}
+
+static thread_local unsigned int zone_depth = {0};
+
+auto Profiler::now() const -> double {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch_).count();
+}
+
+void Profiler::record(const char *name, double start, double duration, unsigned int depth) {
+  ProfileEvent event = {name, start, duration, thread_index(), depth};
+  std::lock_guard<std::mutex> lock{mutex_};
+  current_frame_.push_back(event);
+  if (recording_ && trace_.size() < MAX_TRACE_EVENTS) {
+    trace_.push_back(event);
+  }
+}
+
+void Profiler::begin_gpu(const char *name) {
+  if (gpu_depth_++ > 0) {
+    gpu_nested_++;
+    return;
+  }
+  if (gpu_used_ == GPU_ZONES) {
+    gpu_dropped_++;
+    return;
+  }
+
+  GpuQuery &query = {gpu_queries_[gpu_slot_][gpu_used_]};
+  if (query.query == 0) {
+    glGenQueries(1, &query.query);
+  }
+  query.name = name;
+  query.start = now();
+  query.pending = true;
+  glBeginQuery(GL_TIME_ELAPSED, query.query);
+  gpu_open_ = true;
+}
+
+// only the outermost zone's end closes the query
+void Profiler::end_gpu() {
+  if (gpu_depth_ == 0 || --gpu_depth_ > 0 || !gpu_open_)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  gpu_open_ = false;
+  gpu_used_++;
+}
+
+void Profiler::end_frame() {
+  double frame_end = {now()};
+
+  // the other slot was issued a frame ago, its results are usually ready by now
+  size_t read_slot = {(gpu_slot_ + 1) % GPU_SLOTS};
+  std::vector<ProfileEvent> gpu_events{};
+  for (GpuQuery &query : gpu_queries_[read_slot]) {
+    if (!query.pending)
+      continue;
+    GLint available{0};
+    glGetQueryObjectiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      gpu_dropped_++;
+      continue;
+    }
+    GLuint64 elapsed{0};
+    glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &elapsed);
+    gpu_events.push_back(ProfileEvent{query.name, query.start, elapsed / 1000.0, GPU_THREAD, 0});
+    query.pending = false;
+  }
+  // whatever still isn't ready is given up, its query gets reused this frame
+  gpu_slot_ = read_slot;
+  gpu_used_ = 0;
+  for (GpuQuery &query : gpu_queries_[gpu_slot_]) {
+    query.pending = false;
+  }
+  last_gpu_dropped_ = gpu_dropped_;
+  last_gpu_nested_ = gpu_nested_;
+  gpu_dropped_ = 0;
+  gpu_nested_ = 0;
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (const ProfileEvent &event : gpu_events) {
+    current_frame_.push_back(event);
+    if (recording_ && trace_.size() < MAX_TRACE_EVENTS) {
+      trace_.push_back(event);
+    }
+  }
+  last_frame_.swap(current_frame_);
+  current_frame_.clear();
+  last_frame_start_ = frame_start_;
+  last_frame_end_ = frame_end;
+  frame_start_ = frame_end;
+}
+
+void Profiler::shutdown() {
+  for (auto &slot : gpu_queries_) {
+    for (GpuQuery &query : slot) {
+      if (query.query != 0) {
+        glDeleteQueries(1, &query.query);
+      }
+      query = {};
+    }
+  }
+}
+
+void Profiler::set_recording(bool recording) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  recording_ = recording;
+}
+
+auto Profiler::trace_events() const -> size_t {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return trace_.size();
+}
+
+auto Profiler::write_trace(const std::string &path) -> bool {
+  std::vector<ProfileEvent> events{};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    events.swap(trace_);
+  }
+
+  std::ofstream file{path};
+  if (!file)
+    return false;
+
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+  for (const ProfileEvent &event : events) {
+    file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.thread == GPU_THREAD ? "gpu" : "cpu")
+         << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+         << "}";
+  }
+  file << "\n]}\n";
+  return static_cast<bool>(file);
+}
+
+auto profiler() -> Profiler & {
+  static Profiler instance{};
+  return instance;
+}
+
+ProfileZone::ProfileZone(const char *name) : name_{name}, start_{profiler().now()} {
+  zone_depth++;
+}
+
+ProfileZone::~ProfileZone() {
+  zone_depth--;
+  Profiler &instance = {profiler()};
+  instance.record(name_, start_, instance.now() - start_, zone_depth);
+}
@@ -0,0 +1,141 @@
+#include "program_cache.hpp"
+#include "gl_ext.hpp"
+#include "mapped_file.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// bump whenever the layout below changes
+constexpr uint32_t CACHE_VERSION = {1};
+constexpr char CACHE_MAGIC[4] = {'T', 'B', 'P', 'C'};
+
+// header | binary
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t length;
+};
+
+static auto cache_path(uint64_t key) -> std::string {
+  char name[32]{};
+  std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+  return (std::filesystem::path{ProgramCache::DIRECTORY} / name).string();
+}
+
+auto ProgramCache::enabled() const -> bool {
+  return enabled_ && has_program_binary();
+}
+
+// FNV-1a over the driver strings and every source, a zero byte after each so their boundaries count
+auto ProgramCache::key(const std::vector<const std::string *> &sources) -> uint64_t {
+  if (driver_.empty()) {
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+      const char *value = {reinterpret_cast<const char *>(glGetString(name))};
+      driver_ += value ? value : "";
+      driver_ += '\n';
+    }
+  }
+
+  uint64_t hash = {1469598103934665603ull};
+  auto add = [&](const std::string &text) {
+    for (unsigned char byte : text) {
+      hash = (hash ^ byte) * 1099511628211ull;
+    }
+    hash = hash * 1099511628211ull;
+  };
+  add(driver_);
+  for (const std::string *source : sources) {
+    add(*source);
+  }
+  return hash;
+}
+
+auto ProgramCache::load(uint64_t key) -> unsigned int {
+  if (!enabled()) {
+    misses_++;
+    return 0;
+  }
+
+  std::string path = {cache_path(key)};
+  MappedFile file{};
+  if (!file.open(path)) {
+    misses_++;
+    return 0;
+  }
+
+  const CacheHeader *header = {reinterpret_cast<const CacheHeader *>(file.data())};
+  bool valid = {file.size() >= sizeof(CacheHeader) && std::memcmp(header->magic, CACHE_MAGIC, 4) == 0 &&
+                header->version == CACHE_VERSION && header->key == key && sizeof(CacheHeader) + header->length <= file.size()};
+  unsigned int program = {0};
+  if (valid) {
+    program = glCreateProgram();
+    glProgramBinary(program, header->format, file.data() + sizeof(CacheHeader), static_cast<GLsizei>(header->length));
+    int linked{GL_FALSE};
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    valid = linked == GL_TRUE;
+  }
+  file.close();
+
+  if (!valid) {
+    if (program != 0)
+      glDeleteProgram(program);
+    std::error_code error{};
+    std::filesystem::remove(path, error);
+    rejected_++;
+    misses_++;
+    return 0;
+  }
+  hits_++;
+  return program;
+}
+
+auto ProgramCache::store(uint64_t key, unsigned int program) -> bool {
+  if (!enabled())
+    return false;
+
+  int length{0};
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return false;
+
+  std::vector<char> binary(length);
+  GLenum format{0};
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+  CacheHeader header{};
+  std::memcpy(header.magic, CACHE_MAGIC, 4);
+  header.version = CACHE_VERSION;
+  header.key = key;
+  header.format = format;
+  header.length = static_cast<uint32_t>(length);
+
+  // written beside the real file and renamed over it, a crash never leaves half a binary behind
+  std::error_code error{};
+  std::filesystem::create_directories(DIRECTORY, error);
+  std::string path = {cache_path(key)};
+  std::string staging = {path + ".tmp"};
+  {
+    std::ofstream file{staging, std::ios::binary | std::ios::trunc};
+    if (!file)
+      return false;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(binary.data(), length);
+    if (!file)
+      return false;
+  }
+
+  std::filesystem::rename(staging, path, error);
+  if (error) {
+    std::filesystem::remove(staging, error);
+    return false;
+  }
+  return true;
+}
+
+auto program_cache() -> ProgramCache & {
+  static ProgramCache cache{};
+  return cache;
+}
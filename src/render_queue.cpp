@@ -0,0 +1,201 @@
+#include "render_queue.hpp"
+#include "gl_ext.hpp"
+#include "gpu_culling.hpp"
+#include "gl_stats.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr unsigned int DEPTH_BITS = {24};
+constexpr unsigned int VAO_BITS = {16};
+constexpr unsigned int MATERIAL_BITS = {12};
+constexpr unsigned int PROGRAM_BITS = {8};
+constexpr unsigned int PASS_SHIFT = {DEPTH_BITS + VAO_BITS + MATERIAL_BITS + PROGRAM_BITS};
+
+auto sort_key(RenderPass pass, unsigned int program, unsigned int material, unsigned int vao, float depth) -> uint64_t {
+  // a non negative float's bits order the same as its value, the top 24 keep about 15 bits of mantissa
+  uint32_t bits{};
+  depth = std::max(depth, 0.0f);
+  std::memcpy(&bits, &depth, sizeof(bits));
+  uint64_t depth_key = {bits >> (32 - DEPTH_BITS)};
+  if (pass == RenderPass::TRANSPARENT_PASS) {
+    depth_key = ((1ull << DEPTH_BITS) - 1) - depth_key;
+  }
+
+  uint64_t key = {static_cast<uint64_t>(pass)};
+  key = (key << PROGRAM_BITS) | (program & ((1u << PROGRAM_BITS) - 1));
+  key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+  key = (key << VAO_BITS) | (vao & ((1u << VAO_BITS) - 1));
+  return (key << DEPTH_BITS) | depth_key;
+}
+
+auto RenderQueue::push_constants(const glm::mat4 &model, const glm::mat3 &normal, const glm::vec3 &color) -> unsigned int {
+  constants_.push_back(DrawConstants{model, normal, color});
+  return static_cast<unsigned int>(constants_.size() - 1);
+}
+
+void RenderQueue::submit(const DrawItem &item) {
+  order_.push_back(SortEntry{item.key, static_cast<unsigned int>(items_.size())});
+  items_.push_back(item);
+}
+
+// lsd radix sort a byte at a time, bytes every key shares are skipped
+void RenderQueue::sort() {
+  if (order_.size() < 2)
+    return;
+
+  scratch_.resize(order_.size());
+  for (unsigned int shift{0}; shift < 64; shift += 8) {
+    size_t counts[256]{};
+    for (const SortEntry &entry : order_) {
+      counts[(entry.key >> shift) & 0xff]++;
+    }
+    if (counts[(order_[0].key >> shift) & 0xff] == order_.size())
+      continue;
+
+    size_t offset = {0};
+    for (size_t &count : counts) {
+      size_t bucket = {count};
+      count = offset;
+      offset += bucket;
+    }
+    for (const SortEntry &entry : order_) {
+      scratch_[counts[(entry.key >> shift) & 0xff]++] = entry;
+    }
+    order_.swap(scratch_);
+  }
+}
+
+// same state and the same kind of draw, so only the index ranges differ
+static auto mergeable(const DrawItem &a, const DrawItem &b) -> bool {
+  return a.program == b.program && a.material == b.material && a.vao == b.vao && a.constants == b.constants &&
+         a.index_type == b.index_type && b.instances == 0 && a.zone == b.zone;
+}
+
+void RenderQueue::execute(GlState &state) const {
+  execute_range(state, 0, order_.size());
+}
+
+// keys start with their pass, so after sorting a pass is one run of the order
+void RenderQueue::execute(GlState &state, RenderPass pass) const {
+  auto in_pass = [&](const SortEntry &entry) { return (entry.key >> PASS_SHIFT) < static_cast<uint64_t>(pass); };
+  auto first = std::partition_point(order_.begin(), order_.end(), in_pass);
+  auto last = std::partition_point(first, order_.end(),
+                                   [&](const SortEntry &entry) { return (entry.key >> PASS_SHIFT) == static_cast<uint64_t>(pass); });
+  execute_range(state, first - order_.begin(), last - order_.begin());
+}
+
+void RenderQueue::execute_range(GlState &state, size_t begin, size_t end) const {
+  // uniform values written to the current program, forgotten whenever the program changes
+  const RenderProgram *program = {nullptr};
+  const Material *material = {nullptr};
+  unsigned int constants = {~0u};
+  int instanced = {-1};
+  const char *zone = {nullptr};
+
+  for (size_t i{begin}; i < end; i++) {
+    const DrawItem &item = {items_[order_[i].item]};
+    if (item.zone != zone) {
+      if (zone)
+        profiler().end_gpu();
+      if (item.zone)
+        profiler().begin_gpu(item.zone);
+      zone = item.zone;
+    }
+    const Shader &shader = {*item.program->shader};
+    if (item.program != program) {
+      state.use_program(shader.id());
+      program = item.program;
+      material = nullptr;
+      constants = ~0u;
+      instanced = -1;
+    }
+
+    if (item.material && item.material != material) {
+      item.material->bind(state);
+      material = item.material;
+    }
+    if (!program->indirect && item.instances == 0 && item.constants != constants) {
+      const DrawConstants &values = {constants_[item.constants]};
+      shader.set(program->model, values.model);
+      shader.set(program->normal_matrix, values.normal);
+      shader.set(program->color, values.color);
+      constants = item.constants;
+    }
+    // indirect draws are always instanced, by however many objects survived culling
+    bool instancing = {item.instances != 0 || program->indirect};
+    if (static_cast<int>(instancing) != instanced) {
+      instanced = instancing;
+      shader.set(program->instanced, instanced != 0);
+    }
+
+    state.bind_vertex_array(item.vao);
+    size_t index_size = {item.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int)};
+    const void *first_index = {(const void *)(item.first * index_size)};
+
+    // consecutive commands go out together, how many triangles they draw is only known on the gpu
+    if (program->indirect) {
+      unsigned int commands = {item.count};
+      size_t run = {i + 1};
+      for (; run < end; run++) {
+        const DrawItem &next = {items_[order_[run].item]};
+        if (!mergeable(item, next) || next.first != item.first + commands)
+          break;
+        commands += next.count;
+      }
+      gl_stats().add(DRAW_CALLS);
+      const void *offset = {(const void *)(item.first * sizeof(IndirectCommand))};
+      if (item.index_type != 0) {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, item.index_type, offset, commands, sizeof(IndirectCommand));
+      } else {
+        glMultiDrawArraysIndirect(GL_TRIANGLES, offset, commands, sizeof(IndirectCommand));
+      }
+      i = run - 1;
+      continue;
+    }
+
+    // indexed items that differ only in their ranges go out as one multi draw
+    size_t run = {i + 1};
+    while (item.index_type != 0 && item.instances == 0 && run < end && mergeable(item, items_[order_[run].item])) {
+      run++;
+    }
+    if (run > i + 1) {
+      multi_counts_.clear();
+      multi_offsets_.clear();
+      multi_base_vertices_.clear();
+      size_t indices{0};
+      for (size_t j{i}; j < run; j++) {
+        const DrawItem &merged = {items_[order_[j].item]};
+        multi_counts_.push_back(static_cast<GLsizei>(merged.count));
+        multi_offsets_.push_back((const void *)(merged.first * index_size));
+        multi_base_vertices_.push_back(merged.base_vertex);
+        indices += merged.count;
+      }
+      gl_stats().draw(indices);
+      glMultiDrawElementsBaseVertex(GL_TRIANGLES, multi_counts_.data(), item.index_type, multi_offsets_.data(),
+                                    static_cast<GLsizei>(multi_counts_.size()), multi_base_vertices_.data());
+      i = run - 1;
+      continue;
+    }
+
+    gl_stats().draw(item.count, std::max(item.instances, 1u));
+    if (item.index_type != 0 && item.instances != 0) {
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.count, item.index_type, first_index, item.instances, item.base_vertex);
+    } else if (item.index_type != 0) {
+      glDrawElementsBaseVertex(GL_TRIANGLES, item.count, item.index_type, first_index, item.base_vertex);
+    } else if (item.instances != 0) {
+      glDrawArraysInstanced(GL_TRIANGLES, item.first, item.count, item.instances);
+    } else {
+      glDrawArrays(GL_TRIANGLES, item.first, item.count);
+    }
+  }
+  if (zone)
+    profiler().end_gpu();
+}
+
+void RenderQueue::clear() {
+  items_.clear();
+  constants_.clear();
+  order_.clear();
+}
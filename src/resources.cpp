@@ -0,0 +1,126 @@
+#include "resources.hpp"
+#include "geometry_arena.hpp"
+#include "mesh.hpp"
+#include "utils.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+auto ResourceRegistry::instance() -> ResourceRegistry & {
+  static ResourceRegistry registry{};
+  return registry;
+}
+
+void ResourceRegistry::retire(std::vector<unsigned int> &dead, unsigned int id) {
+  std::lock_guard<std::mutex> lock{pending_mutex_};
+  if (!closed_ && id != 0) {
+    dead.push_back(id);
+  }
+}
+
+auto ResourceRegistry::find_texture(const std::string &key) -> TextureRef {
+  auto found = textures_.find(key);
+  return found == textures_.end() ? nullptr : found->second.lock();
+}
+
+auto ResourceRegistry::add_texture(const std::string &key, unsigned int id) -> TextureRef {
+  TextureRef texture{new GpuTexture{id}, [this](const GpuTexture *texture) {
+                       retire(dead_textures_, texture->id);
+                       delete texture;
+                     }};
+  textures_[key] = texture;
+  return texture;
+}
+
+auto ResourceRegistry::load_texture(const std::string &path) -> TextureRef {
+  if (TextureRef texture = find_texture(path))
+    return texture;
+
+  ImageData image = {decode_image(path)};
+  return add_texture(path, upload_texture(image));
+}
+
+auto ResourceRegistry::add_mesh(const GpuMesh &mesh) -> MeshRef {
+  MeshRef ref{new GpuMesh{mesh}, [this](const GpuMesh *mesh) {
+                if (mesh->arena)
+                  mesh->arena->release(*mesh);
+                delete mesh;
+              }};
+  meshes_.push_back(ref);
+  return ref;
+}
+
+auto ResourceRegistry::find_model(const std::string &key) -> ModelRef {
+  auto found = models_.find(key);
+  return found == models_.end() ? nullptr : found->second.lock();
+}
+
+auto ResourceRegistry::add_model(const std::string &key, std::vector<Mesh> meshes) -> ModelRef {
+  ModelRef model = {std::make_shared<const std::vector<Mesh>>(std::move(meshes))};
+  models_[key] = model;
+  return model;
+}
+
+void ResourceRegistry::defer_delete_buffer(unsigned int buffer) {
+  retire(dead_buffers_, buffer);
+}
+
+void ResourceRegistry::defer_delete_vertex_array(unsigned int vao) {
+  retire(dead_vertex_arrays_, vao);
+}
+
+void ResourceRegistry::defer_delete_texture(unsigned int texture) {
+  retire(dead_textures_, texture);
+}
+
+void ResourceRegistry::defer_delete_framebuffer(unsigned int framebuffer) {
+  retire(dead_framebuffers_, framebuffer);
+}
+
+void ResourceRegistry::collect() {
+  {
+    std::lock_guard<std::mutex> lock{pending_mutex_};
+    if (!dead_textures_.empty())
+      glDeleteTextures(static_cast<GLsizei>(dead_textures_.size()), dead_textures_.data());
+    if (!dead_buffers_.empty())
+      glDeleteBuffers(static_cast<GLsizei>(dead_buffers_.size()), dead_buffers_.data());
+    if (!dead_vertex_arrays_.empty())
+      glDeleteVertexArrays(static_cast<GLsizei>(dead_vertex_arrays_.size()), dead_vertex_arrays_.data());
+    if (!dead_framebuffers_.empty())
+      glDeleteFramebuffers(static_cast<GLsizei>(dead_framebuffers_.size()), dead_framebuffers_.data());
+    dead_textures_.clear();
+    dead_buffers_.clear();
+    dead_vertex_arrays_.clear();
+    dead_framebuffers_.clear();
+  }
+
+  // forget the keys of expired entries so the tables don't grow with every load
+  auto expired = [](const auto &entry) { return entry.second.expired(); };
+  for (auto it = textures_.begin(); it != textures_.end();) {
+    it = expired(*it) ? textures_.erase(it) : std::next(it);
+  }
+  for (auto it = models_.begin(); it != models_.end();) {
+    it = expired(*it) ? models_.erase(it) : std::next(it);
+  }
+  meshes_.erase(std::remove_if(meshes_.begin(), meshes_.end(), [](const auto &mesh) { return mesh.expired(); }), meshes_.end());
+}
+
+void ResourceRegistry::shutdown() {
+  collect();
+  std::lock_guard<std::mutex> lock{pending_mutex_};
+  closed_ = true;
+}
+
+auto ResourceRegistry::textures() const -> size_t {
+  return std::count_if(textures_.begin(), textures_.end(), [](const auto &entry) { return !entry.second.expired(); });
+}
+
+auto ResourceRegistry::meshes() const -> size_t {
+  return std::count_if(meshes_.begin(), meshes_.end(), [](const auto &mesh) { return !mesh.expired(); });
+}
+
+auto ResourceRegistry::pending() -> size_t {
+  std::lock_guard<std::mutex> lock{pending_mutex_};
+  return dead_textures_.size() + dead_buffers_.size() + dead_vertex_arrays_.size() + dead_framebuffers_.size();
+}
@@ -1,29 +1,49 @@
 #include "shader.hpp"
+#include "gl_ext.hpp"
+#include "gl_stats.hpp"
+#include "profiler.hpp"
+#include "program_cache.hpp"
 
-unsigned int createShader(const char *code, unsigned int type) {
-   int success;
-   char infoLog[512];
+#include <algorithm>
 
+// submits the source, whether it compiled is only asked once the program is finished
+unsigned int createShader(const char *code, unsigned int type) {
    unsigned int output = glCreateShader(type);
    glShaderSource(output, 1, &code, nullptr);
    glCompileShader(output);
-   glGetShaderiv(output, GL_COMPILE_STATUS, &success);
+   return output;
+}
 
+void checkShader(unsigned int shader) {
+   int success;
+   char infoLog[512];
+
+   glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
    if (success == GL_FALSE) {
-      glGetShaderInfoLog(output, 512, nullptr, infoLog);
-      const char *shaderType = (type == GL_VERTEX_SHADER) ? "VERTEX" : (type == GL_FRAGMENT_SHADER) ? "FRAGMENT" : "UNSUPPORTED";
+      int type;
+      glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+      glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+      const char *shaderType = (type == GL_VERTEX_SHADER)     ? "VERTEX"
+                               : (type == GL_FRAGMENT_SHADER) ? "FRAGMENT"
+                               : (type == GL_COMPUTE_SHADER)  ? "COMPUTE"
+                                                              : "UNSUPPORTED";
       std::cerr << "ERROR::SHADER::" << shaderType << "::COMPILATION_FAILED\n" << infoLog << std::endl;
    }
-
-   return output;
 }
 
-unsigned int createProgram(unsigned int vertex, unsigned int fragment) {
+// links without waiting for the result, the shaders stay attached until the program is finished
+unsigned int createProgram(std::initializer_list<unsigned int> shaders) {
    unsigned int id = glCreateProgram();
-   glAttachShader(id, vertex);
-   glAttachShader(id, fragment);
+   for (unsigned int shader : shaders) {
+      glAttachShader(id, shader);
+   }
+   if (program_cache().enabled())
+      glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
    glLinkProgram(id);
+   return id;
+}
 
+auto checkProgram(unsigned int id) -> bool {
    int success;
    char infoLog[512];
 
@@ -32,11 +52,7 @@ unsigned int createProgram(unsigned int vertex, unsigned int fragment) {
       glGetProgramInfoLog(id, 512, nullptr, infoLog);
       std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
    }
-
-   glDeleteShader(vertex);
-   glDeleteShader(fragment);
-
-   return id;
+   return success == GL_TRUE;
 }
 
 const std::string parseShaderCode(const char *shaderPath) {
@@ -57,59 +73,253 @@ const std::string parseShaderCode(const char *shaderPath) {
    return shaderStream.str();
 }
 
+// the defines go right after the #version line, which has to stay first. #line keeps the numbers in
+// compile errors pointing at the file
+const std::string injectDefines(const std::string &code, const std::vector<std::string> &defines) {
+   if (defines.empty())
+      return code;
+
+   size_t version = code.find("#version");
+   size_t start = version == std::string::npos ? 0 : code.find('\n', version);
+   start = start == std::string::npos ? code.size() : start + 1;
+   int line = 1;
+   for (size_t i{0}; i < start; i++) {
+      line += code[i] == '\n';
+   }
+
+   std::string injected{code.substr(0, start)};
+   for (const std::string &define : defines) {
+      injected += "#define " + define + "\n";
+   }
+   injected += "#line " + std::to_string(line) + "\n";
+   return injected + code.substr(start);
+}
+
 Shader::Shader(const char *vertexPath, const char *fragmentPath) {
-   // Parse
-   const std::string vShaderCode = parseShaderCode(vertexPath);
-   const std::string fShaderCode = parseShaderCode(fragmentPath);
+   *this = from_source(parseShaderCode(vertexPath), parseShaderCode(fragmentPath));
+}
 
-   // Create
-   unsigned int vertex = createShader(vShaderCode.c_str(), GL_VERTEX_SHADER);
-   unsigned int fragment = createShader(fShaderCode.c_str(), GL_FRAGMENT_SHADER);
-   id_ = createProgram(vertex, fragment);
+auto Shader::from_source(const std::string &vertexCode, const std::string &fragmentCode,
+                         const std::vector<std::string> &defines) -> Shader {
+   ProfileZone zone{"Shader::compile"};
+   const std::string vShaderCode = injectDefines(vertexCode, defines);
+   const std::string fShaderCode = injectDefines(fragmentCode, defines);
+
+   Shader shader;
+   shader.key_ = program_cache().key({&vShaderCode, &fShaderCode});
+   shader.id_ = program_cache().load(shader.key_);
+   if (shader.id_ != 0) {
+      shader.reflect_uniforms();
+      return shader;
+   }
+
+   shader.stages_[0] = createShader(vShaderCode.c_str(), GL_VERTEX_SHADER);
+   shader.stages_[1] = createShader(fShaderCode.c_str(), GL_FRAGMENT_SHADER);
+   shader.id_ = createProgram({shader.stages_[0], shader.stages_[1]});
+   return shader;
+}
+
+Shader::Shader(const char *computePath) {
+   ProfileZone zone{"Shader::compile"};
+   const std::string cShaderCode = parseShaderCode(computePath);
+   key_ = program_cache().key({&cShaderCode});
+   id_ = program_cache().load(key_);
+   if (id_ != 0) {
+      reflect_uniforms();
+      return;
+   }
+
+   stages_[0] = createShader(cShaderCode.c_str(), GL_COMPUTE_SHADER);
+   id_ = createProgram({stages_[0]});
+   finish();
+}
+
+// without parallel compiling the driver did the work inside the gl calls, or does it when first asked
+auto Shader::ready() const -> bool {
+   if (finished() || !has_parallel_compile())
+      return true;
+   int done{GL_FALSE};
+   glGetProgramiv(id_, GL_COMPLETION_STATUS_KHR, &done);
+   return done == GL_TRUE;
+}
+
+void Shader::finish() {
+   if (finished())
+      return;
+
+   ProfileZone zone{"Shader::finish"};
+   for (unsigned int &stage : stages_) {
+      if (stage == 0)
+         continue;
+      checkShader(stage);
+      glDetachShader(id_, stage);
+      glDeleteShader(stage);
+      stage = 0;
+   }
+   if (checkProgram(id_))
+      program_cache().store(key_, id_);
+   reflect_uniforms();
+}
+
+void finish_shaders(std::initializer_list<Shader *> shaders) {
+   std::vector<Shader *> pending{shaders};
+   while (!pending.empty()) {
+      auto done = std::find_if(pending.begin(), pending.end(), [](const Shader *shader) { return shader->ready(); });
+      if (done == pending.end())
+         done = pending.begin();
+      (*done)->finish();
+      pending.erase(done);
+   }
+}
+
+ShaderVariants::ShaderVariants(const char *vertexPath, const char *fragmentPath, std::vector<std::string> features)
+    : vertex_code_{parseShaderCode(vertexPath)}, fragment_code_{parseShaderCode(fragmentPath)}, features_{std::move(features)} {}
+
+void ShaderVariants::prepare(unsigned int key) {
+   if (variants_.count(key) != 0)
+      return;
+
+   std::vector<std::string> defines;
+   for (size_t i{0}; i < features_.size(); i++) {
+      if (key & (1u << i))
+         defines.push_back(features_[i]);
+   }
+   variants_.emplace(key, Shader::from_source(vertex_code_, fragment_code_, defines));
+}
+
+auto ShaderVariants::get(unsigned int key) -> const Shader & {
+   prepare(key);
+   Shader &shader = variants_.at(key);
+   shader.finish();
+   return shader;
+}
+
+void Shader::reflect_uniforms() {
+   int count{}, max_length{};
+   glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &count);
+   glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+   std::string name(max_length, '\0');
+   for (int i{0}; i < count; i++) {
+      int length{}, size{};
+      unsigned int type{};
+      glGetActiveUniform(id_, i, max_length, &length, &size, &type, name.data());
+      std::string uniform{name.substr(0, length)};
+      uniforms_[uniform] = glGetUniformLocation(id_, uniform.c_str());
+
+      // arrays of basic types report only their first element as "name[0]"
+      size_t bracket{uniform.rfind("[0]")};
+      if (size > 1 && bracket == uniform.size() - 3) {
+         std::string base{uniform.substr(0, bracket)};
+         uniforms_[base] = uniforms_[uniform];
+         for (int k{1}; k < size; k++) {
+            std::string element{base + "[" + std::to_string(k) + "]"};
+            uniforms_[element] = glGetUniformLocation(id_, element.c_str());
+         }
+      }
+   }
 }
 
 void Shader::use() {
+   gl_stats().add(PROGRAM_BINDS);
    glUseProgram(id_);
 }
 
+void Shader::bind_block(const std::string &name, unsigned int binding) const {
+   unsigned int index = glGetUniformBlockIndex(id_, name.c_str());
+   if (index != GL_INVALID_INDEX) {
+      glUniformBlockBinding(id_, index, binding);
+   }
+}
+
+auto Shader::location(const std::string &name) const -> int {
+   auto found = uniforms_.find(name);
+   return found == uniforms_.end() ? -1 : found->second;
+}
+
+void Shader::set(Uniform<bool> uniform, bool value) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform1i(uniform.location, (int)value);
+}
+
+void Shader::set(Uniform<int> uniform, int value) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform1i(uniform.location, value);
+}
+
+void Shader::set(Uniform<float> uniform, float value) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform1f(uniform.location, value);
+}
+
+void Shader::set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform3f(uniform.location, value.x, value.y, value.z);
+}
+
+void Shader::set(Uniform<glm::ivec3> uniform, const glm::ivec3 &value) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform3i(uniform.location, value.x, value.y, value.z);
+}
+
+void Shader::set(Uniform<glm::mat3> uniform, const glm::mat3 &value) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniformMatrix3fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4 &value) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void Shader::set(Uniform<glm::vec4> uniform, const glm::vec4 *values, int count) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform4fv(uniform.location, count, glm::value_ptr(values[0]));
+}
+
+void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4 *values, int count) const {
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniformMatrix4fv(uniform.location, count, GL_FALSE, glm::value_ptr(values[0]));
+}
+
 void Shader::set_bool(const std::string &name, bool value) const {
-   unsigned int location = glGetUniformLocation(id_, name.c_str());
-   glUniform1i(location, (int)value);
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform1i(location(name), (int)value);
 }
 
 void Shader::set_int(const std::string &name, int value) const {
-   unsigned int location = glGetUniformLocation(id_, name.c_str());
-   glUniform1i(location, value);
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform1i(location(name), value);
 }
 
 void Shader::set_float(const std::string &name, float v0) const {
-   unsigned int location = glGetUniformLocation(id_, name.c_str());
-   glUniform1f(location, v0);
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform1f(location(name), v0);
 }
 
 void Shader::set_float(const std::string &name, float v0, float v1) const {
-   unsigned int location = glGetUniformLocation(id_, name.c_str());
-   glUniform2f(location, v0, v1);
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform2f(location(name), v0, v1);
 }
 
 void Shader::set_float(const std::string &name, float v0, float v1, float v2) const {
-   unsigned int location = glGetUniformLocation(id_, name.c_str());
-   glUniform3f(location, v0, v1, v2);
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform3f(location(name), v0, v1, v2);
 }
 
 void Shader::set_float(const std::string &name, float v0, float v1, float v2, float v3) const {
-   unsigned int location = glGetUniformLocation(id_, name.c_str());
-   glUniform4f(location, v0, v1, v2, v3);
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniform4f(location(name), v0, v1, v2, v3);
 }
 
 void Shader::set_matrix(const std::string &name, const glm::mat4 &matrix) const
 {
-   unsigned int transform_loc = glGetUniformLocation(id_, name.c_str());
-   glUniformMatrix4fv(transform_loc, 1, GL_FALSE, glm::value_ptr(matrix));
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniformMatrix4fv(location(name), 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
 void Shader::set_matrix(const std::string &name, const glm::mat3 &matrix) const
 {
-   unsigned int transform_loc = glGetUniformLocation(id_, name.c_str());
-   glUniformMatrix3fv(transform_loc, 1, GL_FALSE, glm::value_ptr(matrix));
+   gl_stats().add(UNIFORM_UPLOADS);
+   glUniformMatrix3fv(location(name), 1, GL_FALSE, glm::value_ptr(matrix));
 }
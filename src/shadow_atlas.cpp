@@ -0,0 +1,333 @@
+#include "shadow_atlas.hpp"
+#include "resources.hpp"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// depth slope and constant offsets while rendering casters, lighting.frag adds a normal offset on top
+constexpr float SLOPE_OFFSET = {2.0f};
+constexpr float CONSTANT_OFFSET = {4.0f};
+
+// cube faces +x, -x, +y, -y, +z, -z as lighting.frag picks them, with the usual cube map up vectors
+static const glm::vec3 FACE_DIRECTIONS[6] = {{1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+                                             {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}};
+static const glm::vec3 FACE_UPS[6] = {{0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+                                      {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
+
+ShadowAtlas::~ShadowAtlas() {
+  if (!ready())
+    return;
+  ResourceRegistry &registry = {ResourceRegistry::instance()};
+  registry.defer_delete_texture(texture_);
+  registry.defer_delete_framebuffer(framebuffer_);
+}
+
+void ShadowAtlas::setup(unsigned int size) {
+  size_ = size;
+  cells_ = size / MIN_TILE;
+  occupied_.assign(cells_ * cells_, 0);
+  int framebuffer = {0};
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture_, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void ShadowAtlas::update(std::vector<ShadowRequest> &requests) {
+  std::sort(requests.begin(), requests.end(),
+            [](const ShadowRequest &a, const ShadowRequest &b) { return a.importance > b.importance; });
+
+  // lights no longer asked for give their tiles back before anyone claims more
+  for (AtlasLight &light : lights_) {
+    light.seen = false;
+  }
+  for (const ShadowRequest &request : requests) {
+    auto found = light_slots_.find(key(request.point, request.light));
+    if (found != light_slots_.end())
+      lights_[found->second].seen = true;
+  }
+  for (auto it = light_slots_.begin(); it != light_slots_.end();) {
+    if (lights_[it->second].seen) {
+      ++it;
+      continue;
+    }
+    release(lights_[it->second]);
+    free_lights_.push_back(it->second);
+    it = light_slots_.erase(it);
+  }
+
+  for (size_t i{0}; i < requests.size(); i++) {
+    const ShadowRequest &request = {requests[i]};
+    auto found = light_slots_.find(key(request.point, request.light));
+    unsigned int slot = {};
+    if (found != light_slots_.end()) {
+      slot = found->second;
+    } else {
+      if (free_lights_.empty()) {
+        free_lights_.push_back(static_cast<unsigned int>(lights_.size()));
+        lights_.emplace_back();
+      }
+      slot = free_lights_.back();
+      free_lights_.pop_back();
+      lights_[slot] = AtlasLight{request, 0, 0, 0, true};
+      light_slots_[key(request.point, request.light)] = slot;
+    }
+
+    AtlasLight &light = {lights_[slot]};
+    const ShadowRequest &last = {light.request};
+    bool moved = {last.position != request.position || last.range != request.range ||
+                  (!request.point && (last.direction != request.direction || last.outer_cutoff != request.outer_cutoff))};
+    light.request = request;
+
+    // one size of slack either way so a light near a boundary doesn't keep reallocating, it moves once
+    // it wants four times or a quarter of what it has
+    float coverage = {std::max(request.importance, 1.0f)};
+    unsigned int wanted = {MIN_TILE};
+    while (wanted < MAX_TILE && static_cast<float>(wanted) < coverage) {
+      wanted *= 2;
+    }
+    if (light.tile_count > 0 && (wanted > light.size * 2 || wanted * 2 < light.size))
+      release(light);
+
+    if (light.tile_count > 0) {
+      if (moved)
+        aim(lights_[slot]);
+      continue;
+    }
+
+    // the largest size that fits, then the space of the least important lights after this one
+    bool claimed = {false};
+    size_t last_request = {requests.size()};
+    while (!claimed) {
+      for (unsigned int size{wanted}; size >= MIN_TILE && !claimed; size /= 2) {
+        claimed = claim(slot, size);
+      }
+      if (claimed || last_request <= i + 1)
+        break;
+      const ShadowRequest &victim_request = {requests[--last_request]};
+      auto victim = light_slots_.find(key(victim_request.point, victim_request.light));
+      if (victim != light_slots_.end())
+        release(lights_[victim->second]);
+    }
+    if (claimed)
+      aim(lights_[slot]);
+  }
+}
+
+void ShadowAtlas::touch(unsigned int index, bool moving) {
+  AtlasTile &tile = {tiles_[index]};
+  if (moving || tile.moving)
+    tile.dirty = true;
+  tile.moving_seen = moving;
+}
+
+auto ShadowAtlas::schedule(unsigned int budget) -> const std::vector<unsigned int> & {
+  scheduled_.clear();
+  for (unsigned int i{0}; i < tiles_.size(); i++) {
+    AtlasTile &tile = {tiles_[i]};
+    if (tile.light < 0 || !tile.dirty)
+      continue;
+    tile.waited++;
+    scheduled_.push_back(i);
+  }
+
+  // never rendered tiles first, they hold nothing yet and keep their light unshadowed
+  auto priority = [&](unsigned int index) {
+    const AtlasTile &tile = {tiles_[index]};
+    return lights_[tile.light].request.importance * static_cast<float>(tile.waited);
+  };
+  size_t count = {std::min(scheduled_.size(), size_t{budget})};
+  std::partial_sort(scheduled_.begin(), scheduled_.begin() + count, scheduled_.end(), [&](unsigned int a, unsigned int b) {
+    if (tiles_[a].valid != tiles_[b].valid)
+      return !tiles_[a].valid;
+    return priority(a) > priority(b);
+  });
+  scheduled_.resize(count);
+  return scheduled_;
+}
+
+void ShadowAtlas::begin() {
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &saved_framebuffer_);
+  glGetIntegerv(GL_VIEWPORT, saved_viewport_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glEnable(GL_SCISSOR_TEST);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(SLOPE_OFFSET, CONSTANT_OFFSET);
+}
+
+void ShadowAtlas::begin_tile(unsigned int index) {
+  AtlasTile &tile = {tiles_[index]};
+  int x = {static_cast<int>(tile.origin.x)};
+  int y = {static_cast<int>(tile.origin.y)};
+  int size = {static_cast<int>(tile.size)};
+  glViewport(x, y, size, size);
+  glScissor(x, y, size, size);
+  glClear(GL_DEPTH_BUFFER_BIT);
+
+  // clip space to the tile's square of the atlas and depth in [0, 1]
+  float scale = {0.5f * tile.size / size_};
+  glm::vec3 offset = {glm::vec2{tile.origin} / static_cast<float>(size_) + scale, 0.5f};
+  glm::mat4 to_atlas = {glm::scale(glm::translate(glm::mat4{1.0f}, offset), glm::vec3{scale, scale, 0.5f})};
+  tile.transform = to_atlas * tile.view_projection;
+  transforms_.resize(std::max(transforms_.size(), size_t{index + 1} * 4));
+  for (unsigned int column{0}; column < 4; column++) {
+    transforms_[index * 4 + column] = tile.transform[column];
+  }
+  tile.valid = true;
+  tile.dirty = false;
+  tile.moving = tile.moving_seen;
+  tile.waited = 0;
+  changed_ = true;
+}
+
+void ShadowAtlas::end() {
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glDisable(GL_SCISSOR_TEST);
+  glBindFramebuffer(GL_FRAMEBUFFER, saved_framebuffer_);
+  glViewport(saved_viewport_[0], saved_viewport_[1], saved_viewport_[2], saved_viewport_[3]);
+}
+
+auto ShadowAtlas::record(bool point, unsigned int light) const -> glm::vec4 {
+  auto found = light_slots_.find(key(point, light));
+  if (found == light_slots_.end())
+    return glm::vec4{-1.0f, 0.0f, 0.0f, 0.0f};
+  const AtlasLight &entry = {lights_[found->second]};
+  for (unsigned int i{0}; i < entry.tile_count; i++) {
+    if (!tiles_[entry.first_tile + i].valid)
+      return glm::vec4{-1.0f, 0.0f, 0.0f, 0.0f};
+  }
+  if (entry.tile_count == 0)
+    return glm::vec4{-1.0f, 0.0f, 0.0f, 0.0f};
+  return glm::vec4{static_cast<float>(entry.first_tile), tiles_[entry.first_tile].texel, 0.0f, 0.0f};
+}
+
+auto ShadowAtlas::take_changed() -> bool {
+  bool changed = {changed_};
+  changed_ = false;
+  return changed;
+}
+
+auto ShadowAtlas::used_tiles() const -> size_t {
+  return std::count_if(tiles_.begin(), tiles_.end(), [](const AtlasTile &tile) { return tile.light >= 0; });
+}
+
+auto ShadowAtlas::dirty_tiles() const -> size_t {
+  return std::count_if(tiles_.begin(), tiles_.end(), [](const AtlasTile &tile) { return tile.light >= 0 && tile.dirty; });
+}
+
+// first fit over the cells a tile of this size can be aligned to
+auto ShadowAtlas::allocate(unsigned int size, glm::uvec2 &origin) -> bool {
+  unsigned int span = {size / MIN_TILE};
+  for (unsigned int y{0}; y < cells_; y += span) {
+    for (unsigned int x{0}; x < cells_; x += span) {
+      bool free = {true};
+      for (unsigned int row{y}; row < y + span && free; row++) {
+        for (unsigned int column{x}; column < x + span && free; column++) {
+          free = occupied_[row * cells_ + column] == 0;
+        }
+      }
+      if (!free)
+        continue;
+      for (unsigned int row{y}; row < y + span; row++) {
+        std::fill_n(occupied_.begin() + row * cells_ + x, span, uint8_t{1});
+      }
+      origin = glm::uvec2{x, y} * MIN_TILE;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ShadowAtlas::release(AtlasLight &light) {
+  for (unsigned int i{0}; i < light.tile_count; i++) {
+    AtlasTile &tile = {tiles_[light.first_tile + i]};
+    glm::uvec2 cell = {tile.origin / MIN_TILE};
+    unsigned int span = {tile.size / MIN_TILE};
+    for (unsigned int row{cell.y}; row < cell.y + span; row++) {
+      std::fill_n(occupied_.begin() + row * cells_ + cell.x, span, uint8_t{0});
+    }
+    tile = AtlasTile{};
+  }
+  if (light.tile_count > 0)
+    changed_ = true;
+  light.tile_count = 0;
+  light.size = 0;
+}
+
+auto ShadowAtlas::claim(unsigned int slot, unsigned int size) -> bool {
+  AtlasLight &light = {lights_[slot]};
+  unsigned int count = {light.request.point ? 6u : 1u};
+
+  // a run of free tile slots, or new ones at the end
+  unsigned int first = {0};
+  unsigned int run = {0};
+  for (; first + run < tiles_.size() && run < count;) {
+    if (tiles_[first + run].light < 0) {
+      run++;
+    } else {
+      first += run + 1;
+      run = 0;
+    }
+  }
+  if (tiles_.size() < first + count)
+    tiles_.resize(first + count);
+
+  for (unsigned int i{0}; i < count; i++) {
+    AtlasTile &tile = {tiles_[first + i]};
+    if (!allocate(size, tile.origin)) {
+      light.first_tile = first;
+      light.tile_count = i;
+      release(light);
+      return false;
+    }
+    tile.size = size;
+    tile.light = static_cast<int>(slot);
+  }
+  light.first_tile = first;
+  light.tile_count = count;
+  light.size = size;
+  return true;
+}
+
+// points every tile of the light the way it faces now, they keep what they hold until rendered
+void ShadowAtlas::aim(AtlasLight &light) {
+  const ShadowRequest &request = {light.request};
+  float range = {std::max(std::min(request.range, MAX_RANGE), NEAR_PLANE * 2.0f)};
+  float angle = {fov(light)};
+  glm::mat4 projection = {glm::perspective(angle, 1.0f, NEAR_PLANE, range)};
+  for (unsigned int i{0}; i < light.tile_count; i++) {
+    glm::vec3 direction = {request.point ? FACE_DIRECTIONS[i] : glm::normalize(request.direction)};
+    glm::vec3 up = {request.point ? FACE_UPS[i]
+                                  : std::abs(direction.y) > 0.99f ? glm::vec3{1.0f, 0.0f, 0.0f} : glm::vec3{0.0f, 1.0f, 0.0f}};
+    AtlasTile &tile = {tiles_[light.first_tile + i]};
+    tile.view_projection = projection * glm::lookAt(request.position, request.position + direction, up);
+    tile.eye = request.position;
+    tile.texel = 2.0f * std::tan(angle * 0.5f) / light.size;
+    tile.dirty = true;
+  }
+}
+
+// a cube face or the spot's cone, widened so BORDER_TEXELS of the tile lie outside it
+auto ShadowAtlas::fov(const AtlasLight &light) const -> float {
+  float base = {light.request.point ? glm::radians(90.0f) : glm::radians(std::min(2.0f * light.request.outer_cutoff, 160.0f))};
+  float inner = {static_cast<float>(light.size - 2 * BORDER_TEXELS) / light.size};
+  return 2.0f * std::atan(std::tan(base * 0.5f) / inner);
+}
@@ -0,0 +1,184 @@
+#include "shadows.hpp"
+#include "resources.hpp"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// depth slope and constant offsets while rendering casters, lighting.frag adds a normal offset on top
+constexpr float SLOPE_OFFSET = {2.0f};
+constexpr float CONSTANT_OFFSET = {2.0f};
+
+ShadowCascades::~ShadowCascades() {
+  if (!ready())
+    return;
+  ResourceRegistry &registry = {ResourceRegistry::instance()};
+  registry.defer_delete_texture(static_maps_);
+  registry.defer_delete_texture(maps_);
+  for (unsigned int i{0}; i < MAX_CASCADES; i++) {
+    registry.defer_delete_framebuffer(static_framebuffers_[i]);
+    registry.defer_delete_framebuffer(framebuffers_[i]);
+  }
+}
+
+void ShadowCascades::setup(unsigned int resolution) {
+  resolution_ = resolution;
+  int framebuffer = {0};
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+  // outside every map counts as lit
+  const float border[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  auto create = [&](unsigned int &texture, unsigned int *framebuffers, bool compare) {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, MAX_CASCADES, 0, GL_DEPTH_COMPONENT,
+                 GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    if (compare) {
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+
+    glGenFramebuffers(MAX_CASCADES, framebuffers);
+    for (unsigned int i{0}; i < MAX_CASCADES; i++) {
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+      glDrawBuffer(GL_NONE);
+      glReadBuffer(GL_NONE);
+    }
+  };
+  create(static_maps_, static_framebuffers_, false);
+  create(maps_, framebuffers_, true);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  invalidate();
+}
+
+void ShadowCascades::fit(const glm::mat4 &view, float fov_y, float aspect, float near, float distance, unsigned int count,
+                         const glm::vec3 &light_direction, const AABB &scene) {
+  count = std::max(1u, std::min(count, MAX_CASCADES));
+  glm::vec3 direction = {glm::normalize(light_direction)};
+  // the light turning or the scene bounds changing moves every caster in every map
+  if (scene.min != scene_.min || scene.max != scene_.max) {
+    scene_ = scene;
+    invalidate();
+  }
+  if (direction != direction_) {
+    direction_ = direction;
+    glm::vec3 up = {std::abs(direction.y) > 0.99f ? glm::vec3{1.0f, 0.0f, 0.0f} : glm::vec3{0.0f, 1.0f, 0.0f}};
+    light_rotation_ = glm::mat3{glm::lookAt(glm::vec3{0.0f}, direction, up)};
+    invalidate();
+  }
+  count_ = count;
+
+  // a slice's corners sit on two rings around the view axis, its smallest sphere is centered on that
+  // axis and only depends on the split depths, so it keeps its size however the camera turns
+  glm::mat4 inverse_view = {glm::inverse(view)};
+  float corner = {std::tan(fov_y * 0.5f) * std::sqrt(1.0f + aspect * aspect)};
+  float split_near = {near};
+  for (unsigned int i{0}; i < count; i++) {
+    float t = {static_cast<float>(i + 1) / count};
+    float uniform_split = {near + (distance - near) * t};
+    float log_split = {near * std::pow(distance / near, t)};
+    float split_far = {uniform_split + (log_split - uniform_split) * SPLIT_LAMBDA};
+
+    float depth = {std::min((split_near + split_far) * 0.5f * (1.0f + corner * corner), split_far)};
+    float radius = {std::hypot(depth - split_near, split_near * corner)};
+    radius = std::max(radius, std::hypot(split_far - depth, split_far * corner));
+    glm::vec3 center = {inverse_view * glm::vec4{0.0f, 0.0f, -depth, 1.0f}};
+
+    ShadowCascade &cascade = {cascades_[i]};
+    cascade.split_near = split_near;
+    cascade.split_far = split_far;
+    fit_cascade(cascade, center, radius);
+    split_near = split_far;
+  }
+}
+
+void ShadowCascades::fit_cascade(ShadowCascade &cascade, const glm::vec3 &center, float radius) {
+  glm::vec3 light_center = {light_rotation_ * center};
+  glm::vec2 offset = {glm::abs(glm::vec2{light_center} - cascade.center)};
+  bool inside = {std::max(offset.x, offset.y) + radius <= cascade.half_extent};
+  if (!cascade.refit && inside && radius == cascade.radius)
+    return;
+
+  cascade.radius = radius;
+  cascade.half_extent = radius * FIT_PADDING;
+  cascade.texel = 2.0f * cascade.half_extent / resolution_;
+  cascade.center = glm::floor(glm::vec2{light_center} / cascade.texel + 0.5f) * cascade.texel;
+
+  // deep enough for every caster in the scene, wherever it sits along the light
+  float z_min = {std::numeric_limits<float>::max()};
+  float z_max = {-std::numeric_limits<float>::max()};
+  for (int i{0}; i < 8; i++) {
+    glm::vec3 corner = {i & 1 ? scene_.max.x : scene_.min.x, i & 2 ? scene_.max.y : scene_.min.y,
+                         i & 4 ? scene_.max.z : scene_.min.z};
+    float z = {(light_rotation_ * corner).z};
+    z_min = std::min(z_min, z);
+    z_max = std::max(z_max, z);
+  }
+  glm::vec2 low = {cascade.center - cascade.half_extent};
+  glm::vec2 high = {cascade.center + cascade.half_extent};
+  glm::mat4 projection = {glm::ortho(low.x, high.x, low.y, high.y, -z_max - 1.0f, -z_min + 1.0f)};
+  cascade.view_projection = projection * glm::mat4{light_rotation_};
+  cascade.refit = true;
+  cascade.refits++;
+}
+
+void ShadowCascades::invalidate() {
+  for (ShadowCascade &cascade : cascades_) {
+    cascade.refit = true;
+  }
+}
+
+void ShadowCascades::begin() {
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &saved_framebuffer_);
+  glGetIntegerv(GL_VIEWPORT, saved_viewport_);
+  glViewport(0, 0, resolution_, resolution_);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(SLOPE_OFFSET, CONSTANT_OFFSET);
+}
+
+void ShadowCascades::begin_static(unsigned int cascade) {
+  glBindFramebuffer(GL_FRAMEBUFFER, static_framebuffers_[cascade]);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+auto ShadowCascades::begin_dynamic(unsigned int cascade, bool has_dynamic) -> bool {
+  ShadowCascade &target = {cascades_[cascade]};
+  if (!target.refit && !has_dynamic && !target.dynamic)
+    return false;
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, static_framebuffers_[cascade]);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers_[cascade]);
+  int size = {static_cast<int>(resolution_)};
+  glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffers_[cascade]);
+  target.dynamic = has_dynamic;
+  return true;
+}
+
+void ShadowCascades::end() {
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, saved_framebuffer_);
+  glViewport(saved_viewport_[0], saved_viewport_[1], saved_viewport_[2], saved_viewport_[3]);
+  for (unsigned int i{0}; i < count_; i++) {
+    cascades_[i].refit = false;
+  }
+}
+
+void ShadowCascades::shadow_matrices(const glm::mat4 &view, glm::mat4 *matrices) const {
+  // clip space [-1, 1] to texture coordinates and depth in [0, 1]
+  glm::mat4 bias = {glm::scale(glm::translate(glm::mat4{1.0f}, glm::vec3{0.5f}), glm::vec3{0.5f})};
+  glm::mat4 inverse_view = {glm::inverse(view)};
+  for (unsigned int i{0}; i < count_; i++) {
+    matrices[i] = bias * cascades_[i].view_projection * inverse_view;
+  }
+}
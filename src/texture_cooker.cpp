@@ -0,0 +1,434 @@
+#include "texture_cooker.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// one mip level expanded to rgba8
+struct MipLevel {
+  int width;
+  int height;
+  std::vector<unsigned char> rgba;
+};
+
+struct Color {
+  float r, g, b;
+};
+
+static auto expand_rgba(const unsigned char *pixels, int width, int height, int components) -> MipLevel {
+  MipLevel level{width, height, std::vector<unsigned char>(static_cast<size_t>(width) * height * 4)};
+  for (size_t i{0}; i < static_cast<size_t>(width) * height; i++) {
+    const unsigned char *in = {pixels + i * components};
+    unsigned char *out = {&level.rgba[i * 4]};
+    // stb_image gives grey, grey + alpha, rgb or rgba
+    out[0] = in[0];
+    out[1] = components >= 3 ? in[1] : in[0];
+    out[2] = components >= 3 ? in[2] : in[0];
+    out[3] = components == 2 ? in[1] : components == 4 ? in[3] : 255;
+  }
+  return level;
+}
+
+// 2x2 box filter, odd edges reuse their last row or column
+static auto downsample(const MipLevel &source) -> MipLevel {
+  MipLevel level{std::max(1, source.width / 2), std::max(1, source.height / 2), {}};
+  level.rgba.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+  for (int y{0}; y < level.height; y++) {
+    int y0 = {std::min(y * 2, source.height - 1)};
+    int y1 = {std::min(y * 2 + 1, source.height - 1)};
+    for (int x{0}; x < level.width; x++) {
+      int x0 = {std::min(x * 2, source.width - 1)};
+      int x1 = {std::min(x * 2 + 1, source.width - 1)};
+      for (int c{0}; c < 4; c++) {
+        int sum = {source.rgba[(static_cast<size_t>(y0) * source.width + x0) * 4 + c] + source.rgba[(static_cast<size_t>(y0) * source.width + x1) * 4 + c] +
+                   source.rgba[(static_cast<size_t>(y1) * source.width + x0) * 4 + c] + source.rgba[(static_cast<size_t>(y1) * source.width + x1) * 4 + c]};
+        level.rgba[(static_cast<size_t>(y) * level.width + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+      }
+    }
+  }
+  return level;
+}
+
+static auto to_565(const Color &color) -> uint16_t {
+  int r = {std::clamp(static_cast<int>(color.r * 31.0f / 255.0f + 0.5f), 0, 31)};
+  int g = {std::clamp(static_cast<int>(color.g * 63.0f / 255.0f + 0.5f), 0, 63)};
+  int b = {std::clamp(static_cast<int>(color.b * 31.0f / 255.0f + 0.5f), 0, 31)};
+  return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+static auto from_565(uint16_t packed) -> Color {
+  int r = {packed >> 11 & 31};
+  int g = {packed >> 5 & 63};
+  int b = {packed & 31};
+  return Color{static_cast<float>(r << 3 | r >> 2), static_cast<float>(g << 2 | g >> 4), static_cast<float>(b << 3 | b >> 2)};
+}
+
+static auto distance(const Color &a, const Color &b) -> float {
+  float r = {a.r - b.r}, g = {a.g - b.g}, bl = {a.b - b.b};
+  return r * r + g * g + bl * bl;
+}
+
+// picks the nearest of the four palette entries for every pixel, returns the packed indices and total error
+static auto bc1_indices(const Color (&pixels)[16], uint16_t c0, uint16_t c1, float &error) -> uint32_t {
+  Color a = {from_565(c0)}, b = {from_565(c1)};
+  Color palette[4] = {a, b, {(2 * a.r + b.r) / 3, (2 * a.g + b.g) / 3, (2 * a.b + b.b) / 3},
+                      {(a.r + 2 * b.r) / 3, (a.g + 2 * b.g) / 3, (a.b + 2 * b.b) / 3}};
+  uint32_t indices{0};
+  error = 0.0f;
+  for (int i{0}; i < 16; i++) {
+    int best{0};
+    float best_distance = {distance(pixels[i], palette[0])};
+    for (int p{1}; p < 4; p++) {
+      float d = {distance(pixels[i], palette[p])};
+      if (d < best_distance)
+        best = p, best_distance = d;
+    }
+    indices |= static_cast<uint32_t>(best) << (i * 2);
+    error += best_distance;
+  }
+  return indices;
+}
+
+// orders the endpoints for four colour mode, remapping nothing since indices are picked afterwards
+static void order_endpoints(uint16_t &c0, uint16_t &c1) {
+  if (c0 < c1)
+    std::swap(c0, c1);
+}
+
+static void encode_bc1(const unsigned char (&block)[16][4], unsigned char *out) {
+  Color pixels[16];
+  Color mean{0, 0, 0};
+  for (int i{0}; i < 16; i++) {
+    pixels[i] = Color{static_cast<float>(block[i][0]), static_cast<float>(block[i][1]), static_cast<float>(block[i][2])};
+    mean.r += pixels[i].r / 16, mean.g += pixels[i].g / 16, mean.b += pixels[i].b / 16;
+  }
+
+  // the principal axis of the block's colours, by power iteration on their covariance
+  float cov[6]{};
+  for (const Color &p : pixels) {
+    float r = {p.r - mean.r}, g = {p.g - mean.g}, b = {p.b - mean.b};
+    cov[0] += r * r, cov[1] += r * g, cov[2] += r * b, cov[3] += g * g, cov[4] += g * b, cov[5] += b * b;
+  }
+  // start from the bounding box diagonal, it is rarely far from the answer
+  Color low_corner{255, 255, 255}, high_corner{0, 0, 0};
+  for (const Color &p : pixels) {
+    low_corner = Color{std::min(low_corner.r, p.r), std::min(low_corner.g, p.g), std::min(low_corner.b, p.b)};
+    high_corner = Color{std::max(high_corner.r, p.r), std::max(high_corner.g, p.g), std::max(high_corner.b, p.b)};
+  }
+  Color axis{high_corner.r - low_corner.r, high_corner.g - low_corner.g, high_corner.b - low_corner.b};
+  for (int i{0}; i < 6; i++) {
+    Color next{cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b, cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+               cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b};
+    float length = {std::max({std::abs(next.r), std::abs(next.g), std::abs(next.b)})};
+    if (length < 1e-6f)
+      break;
+    axis = Color{next.r / length, next.g / length, next.b / length};
+  }
+
+  float low = {0.0f}, high = {0.0f};
+  for (const Color &p : pixels) {
+    float t = {(p.r - mean.r) * axis.r + (p.g - mean.g) * axis.g + (p.b - mean.b) * axis.b};
+    low = std::min(low, t), high = std::max(high, t);
+  }
+  float length = {axis.r * axis.r + axis.g * axis.g + axis.b * axis.b};
+  if (length > 0.0f) {
+    low /= length, high /= length;
+  }
+  auto endpoint = [&](float t) { return Color{mean.r + axis.r * t, mean.g + axis.g * t, mean.b + axis.b * t}; };
+
+  uint16_t c0 = {to_565(endpoint(high))}, c1 = {to_565(endpoint(low))};
+  order_endpoints(c0, c1);
+  float error{};
+  uint32_t indices = {c0 == c1 ? 0 : bc1_indices(pixels, c0, c1, error)};
+
+  // one least squares pass refitting both endpoints to the chosen indices
+  if (c0 != c1) {
+    static constexpr float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa{0}, ab{0}, bb{0};
+    Color ax{0, 0, 0}, bx{0, 0, 0};
+    for (int i{0}; i < 16; i++) {
+      float a = {WEIGHTS[indices >> (i * 2) & 3]}, b = {1.0f - a};
+      aa += a * a, ab += a * b, bb += b * b;
+      ax.r += a * pixels[i].r, ax.g += a * pixels[i].g, ax.b += a * pixels[i].b;
+      bx.r += b * pixels[i].r, bx.g += b * pixels[i].g, bx.b += b * pixels[i].b;
+    }
+    float det = {aa * bb - ab * ab};
+    if (std::abs(det) > 1e-6f) {
+      Color a{(ax.r * bb - bx.r * ab) / det, (ax.g * bb - bx.g * ab) / det, (ax.b * bb - bx.b * ab) / det};
+      Color b{(bx.r * aa - ax.r * ab) / det, (bx.g * aa - ax.g * ab) / det, (bx.b * aa - ax.b * ab) / det};
+      uint16_t r0 = {to_565(a)}, r1 = {to_565(b)};
+      order_endpoints(r0, r1);
+      float refined_error{};
+      uint32_t refined = {r0 == r1 ? 0 : bc1_indices(pixels, r0, r1, refined_error)};
+      if (r0 != r1 && refined_error < error) {
+        c0 = r0, c1 = r1, indices = refined;
+      }
+    }
+  }
+
+  out[0] = c0 & 0xff, out[1] = c0 >> 8;
+  out[2] = c1 & 0xff, out[3] = c1 >> 8;
+  for (int i{0}; i < 4; i++) {
+    out[4 + i] = indices >> (i * 8) & 0xff;
+  }
+}
+
+// eight interpolated values between the block's extremes, 3 bit indices
+static void encode_bc4(const unsigned char (&block)[16][4], int channel, unsigned char *out) {
+  int low{255}, high{0};
+  for (int i{0}; i < 16; i++) {
+    low = std::min(low, static_cast<int>(block[i][channel]));
+    high = std::max(high, static_cast<int>(block[i][channel]));
+  }
+
+  out[0] = static_cast<unsigned char>(high);
+  out[1] = static_cast<unsigned char>(low);
+  uint64_t indices{0};
+  if (high != low) {
+    int palette[8] = {high, low};
+    for (int i{1}; i < 7; i++) {
+      palette[i + 1] = ((7 - i) * high + i * low) / 7;
+    }
+    for (int i{0}; i < 16; i++) {
+      int value = {block[i][channel]};
+      int best{0};
+      for (int p{1}; p < 8; p++) {
+        if (std::abs(palette[p] - value) < std::abs(palette[best] - value))
+          best = p;
+      }
+      indices |= static_cast<uint64_t>(best) << (i * 3);
+    }
+  }
+  for (int i{0}; i < 6; i++) {
+    out[2 + i] = indices >> (i * 8) & 0xff;
+  }
+}
+
+static void encode_block(BlockFormat format, const unsigned char (&block)[16][4], unsigned char *out) {
+  switch (format) {
+  case BlockFormat::BC1:
+    encode_bc1(block, out);
+    break;
+  case BlockFormat::BC3:
+    encode_bc4(block, 3, out);
+    encode_bc1(block, out + 8);
+    break;
+  case BlockFormat::BC4:
+    encode_bc4(block, 0, out);
+    break;
+  case BlockFormat::BC5:
+    encode_bc4(block, 0, out);
+    encode_bc4(block, 1, out + 8);
+    break;
+  }
+}
+
+static auto encode_level(BlockFormat format, const MipLevel &level) -> std::vector<unsigned char> {
+  unsigned int blocks_x = {static_cast<unsigned int>((level.width + 3) / 4)};
+  unsigned int blocks_y = {static_cast<unsigned int>((level.height + 3) / 4)};
+  size_t size = {block_size(format)};
+  std::vector<unsigned char> data(blocks_x * blocks_y * size);
+
+  worker_pool().parallel_for(blocks_y, [&](unsigned int by) {
+    unsigned char block[16][4];
+    for (unsigned int bx{0}; bx < blocks_x; bx++) {
+      // blocks hanging over the edge repeat the last row and column
+      for (int i{0}; i < 16; i++) {
+        int x = {std::min(static_cast<int>(bx * 4) + i % 4, level.width - 1)};
+        int y = {std::min(static_cast<int>(by * 4) + i / 4, level.height - 1)};
+        std::memcpy(block[i], &level.rgba[(static_cast<size_t>(y) * level.width + x) * 4], 4);
+      }
+      encode_block(format, block, &data[(by * blocks_x + bx) * size]);
+    }
+  });
+  return data;
+}
+
+auto block_size(BlockFormat format) -> size_t {
+  return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+auto choose_block_format(const unsigned char *pixels, int width, int height, int components, bool &grey) -> BlockFormat {
+  grey = false;
+  if (components == 1)
+    return BlockFormat::BC4;
+  if (components == 2)
+    return BlockFormat::BC3;
+
+  bool opaque = {true};
+  bool monochrome = {true};
+  for (size_t i{0}; i < static_cast<size_t>(width) * height; i++) {
+    const unsigned char *pixel = {pixels + i * components};
+    monochrome = monochrome && pixel[0] == pixel[1] && pixel[1] == pixel[2];
+    opaque = opaque && (components == 3 || pixel[3] == 255);
+  }
+
+  // grey maps (specular) keep all their precision in one channel and are sampled back as rrr
+  if (monochrome && opaque) {
+    grey = true;
+    return BlockFormat::BC4;
+  }
+  return opaque ? BlockFormat::BC1 : BlockFormat::BC3;
+}
+
+auto cook_texture(const unsigned char *pixels, int width, int height, int components, std::optional<BlockFormat> format) -> CompressedTexture {
+  CompressedTexture texture{};
+  texture.width = width;
+  texture.height = height;
+  texture.format = format ? *format : choose_block_format(pixels, width, height, components, texture.grey);
+
+  MipLevel level = {expand_rgba(pixels, width, height, components)};
+  while (true) {
+    texture.levels.push_back(encode_level(texture.format, level));
+    if (level.width == 1 && level.height == 1)
+      break;
+    level = downsample(level);
+  }
+  return texture;
+}
+
+// dds container, only the legacy header with a four character code is written and understood
+
+static constexpr auto four_cc(char a, char b, char c, char d) -> uint32_t {
+  return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 24;
+}
+
+constexpr uint32_t DDS_MAGIC = {four_cc('D', 'D', 'S', ' ')};
+// stored in the first reserved word, marks single channel textures sampled as rrr
+constexpr uint32_t GREY_TAG = {four_cc('G', 'R', 'E', 'Y')};
+
+struct DdsPixelFormat {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t four_cc;
+  uint32_t rgb_bits;
+  uint32_t masks[4];
+};
+
+struct DdsHeader {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t linear_size;
+  uint32_t depth;
+  uint32_t mip_count;
+  uint32_t reserved[11];
+  DdsPixelFormat format;
+  uint32_t caps[4];
+  uint32_t reserved2;
+};
+static_assert(sizeof(DdsHeader) == 124, "dds header must match the file layout");
+
+static auto format_code(BlockFormat format) -> uint32_t {
+  switch (format) {
+  case BlockFormat::BC1:
+    return four_cc('D', 'X', 'T', '1');
+  case BlockFormat::BC3:
+    return four_cc('D', 'X', 'T', '5');
+  case BlockFormat::BC4:
+    return four_cc('A', 'T', 'I', '1');
+  case BlockFormat::BC5:
+    return four_cc('A', 'T', 'I', '2');
+  }
+  return 0;
+}
+
+static auto level_size(BlockFormat format, int width, int height, size_t level) -> size_t {
+  size_t w = {static_cast<size_t>(std::max(1, width >> level))};
+  size_t h = {static_cast<size_t>(std::max(1, height >> level))};
+  return (w + 3) / 4 * ((h + 3) / 4) * block_size(format);
+}
+
+auto write_dds(const std::string &path, const CompressedTexture &texture) -> bool {
+  DdsHeader header{};
+  header.size = sizeof(DdsHeader);
+  header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+  header.height = texture.height;
+  header.width = texture.width;
+  header.linear_size = static_cast<uint32_t>(texture.levels.empty() ? 0 : texture.levels[0].size());
+  header.mip_count = static_cast<uint32_t>(texture.levels.size());
+  header.reserved[0] = texture.grey ? GREY_TAG : 0;
+  header.format.size = sizeof(DdsPixelFormat);
+  header.format.flags = 0x4; // four cc
+  header.format.four_cc = format_code(texture.format);
+  header.caps[0] = 0x1000 | 0x400000 | 0x8; // texture, mipmap, complex
+
+  // written beside the real file and renamed over it, so a half written file is never picked up
+  std::string staging = {path + ".tmp"};
+  {
+    std::ofstream file{staging, std::ios::binary | std::ios::trunc};
+    if (!file)
+      return false;
+    file.write(reinterpret_cast<const char *>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const std::vector<unsigned char> &level : texture.levels) {
+      file.write(reinterpret_cast<const char *>(level.data()), level.size());
+    }
+    if (!file)
+      return false;
+  }
+
+  std::error_code error{};
+  std::filesystem::rename(staging, path, error);
+  if (error) {
+    std::filesystem::remove(staging, error);
+    return false;
+  }
+  return true;
+}
+
+auto read_dds(const std::string &path, CompressedTexture &texture) -> bool {
+  std::ifstream file{path, std::ios::binary};
+  uint32_t magic{};
+  DdsHeader header{};
+  if (!file.read(reinterpret_cast<char *>(&magic), sizeof(magic)) || !file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    return false;
+  if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || !(header.format.flags & 0x4) || header.width == 0 || header.height == 0)
+    return false;
+
+  CompressedTexture result{};
+  bool known{false};
+  for (BlockFormat format : {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5}) {
+    if (format_code(format) == header.format.four_cc)
+      result.format = format, known = true;
+  }
+  if (!known)
+    return false;
+
+  result.width = static_cast<int>(header.width);
+  result.height = static_cast<int>(header.height);
+  result.grey = header.reserved[0] == GREY_TAG;
+  size_t levels = {header.flags & 0x20000 ? std::max(1u, header.mip_count) : 1u};
+  for (size_t i{0}; i < levels; i++) {
+    std::vector<unsigned char> level(level_size(result.format, result.width, result.height, i));
+    if (!file.read(reinterpret_cast<char *>(level.data()), level.size()))
+      return false;
+    result.levels.push_back(std::move(level));
+  }
+
+  texture = std::move(result);
+  return true;
+}
+
+auto cooked_texture_path(const std::string &source) -> std::string {
+  return source + ".dds";
+}
+
+auto load_cooked_texture(const std::string &source, CompressedTexture &texture) -> bool {
+  std::error_code error{};
+  std::string path = {cooked_texture_path(source)};
+  auto cooked_time = std::filesystem::last_write_time(path, error);
+  if (error)
+    return false;
+  auto source_time = std::filesystem::last_write_time(source, error);
+  if (error || cooked_time < source_time)
+    return false;
+
+  return read_dds(path, texture);
+}
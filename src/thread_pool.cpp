@@ -0,0 +1,76 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned int threads) {
+  for (unsigned int i{0}; i < threads; i++) {
+    workers_.emplace_back([this] { work(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::work() {
+  while (true) {
+    std::function<void()> job{};
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty())
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop();
+    }
+    job();
+  }
+}
+
+void ThreadPool::parallel_for(unsigned int count, const std::function<void(unsigned int)> &job) {
+  // helpers that only start after everything is claimed find nothing left and never touch job
+  struct Batch {
+    std::atomic<unsigned int> next{0};
+    unsigned int done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto batch = std::make_shared<Batch>();
+
+  auto drain = [batch, count, &job] {
+    unsigned int ran{0};
+    for (unsigned int i{batch->next++}; i < count; i = batch->next++) {
+      job(i);
+      ran++;
+    }
+    if (ran == 0)
+      return;
+
+    std::lock_guard<std::mutex> lock{batch->mutex};
+    batch->done += ran;
+    if (batch->done == count)
+      batch->finished.notify_one();
+  };
+
+  unsigned int helpers = {std::min(size(), count > 0 ? count - 1 : 0)};
+  for (unsigned int i{0}; i < helpers; i++) {
+    submit(drain);
+  }
+  drain();
+
+  std::unique_lock<std::mutex> lock{batch->mutex};
+  batch->finished.wait(lock, [&] { return batch->done == count; });
+}
+
+ThreadPool &worker_pool() {
+  static ThreadPool pool{std::max(2u, std::thread::hardware_concurrency()) - 1};
+  return pool;
+}
@@ -1,4 +1,7 @@
 #include "utils.hpp"
+#include "gl_ext.hpp"
+#include "gl_stats.hpp"
+#include "profiler.hpp"
 #include "shader.hpp"
 #include "light_sources.hpp"
 #include "model.hpp"
@@ -6,106 +9,156 @@
 // #include <GLFW/glfw3.h>
 #include <stb_image.hpp>
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
 
 // loading
 
-unsigned int load_texture(char const *path) {
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
-
-  int width, height, nrComponents;
-  unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-  if (data) {
-    GLenum format;
-    if (nrComponents == 1)
-      format = GL_RED;
-    else if (nrComponents == 3)
-      format = GL_RGB;
-    else if (nrComponents == 4)
-      format = GL_RGBA;
+ImageData decode_image(const std::string &path, bool cooked) {
+  ProfileZone zone{"decode_image"};
+  ImageData image{path, 0, 0, 0, nullptr, {}};
+  if (cooked && load_cooked_texture(path, image.compressed))
+    return image;
+
+  image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+  if (cooked && image.pixels) {
+    image.compressed = cook_texture(image.pixels, image.width, image.height, image.components);
+    // failing to save only means cooking it again next time
+    write_dds(cooked_texture_path(path), image.compressed);
+  }
+  return image;
+}
 
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+static auto compressed_format(const CompressedTexture &texture) -> GLenum {
+  switch (texture.format) {
+  case BlockFormat::BC1:
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case BlockFormat::BC3:
+    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  case BlockFormat::BC4:
+    return GL_COMPRESSED_RED_RGTC1;
+  case BlockFormat::BC5:
+    return GL_COMPRESSED_RG_RGTC2;
+  }
+  return GL_NONE;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// rgtc is core, s3tc is an extension every desktop driver ships but is still worth checking once
+static auto supports_compressed(const CompressedTexture &texture) -> bool {
+  static const bool s3tc = {has_gl_extension("GL_EXT_texture_compression_s3tc")};
+  return s3tc || texture.format == BlockFormat::BC4 || texture.format == BlockFormat::BC5;
+}
 
-    stbi_image_free(data);
-  } else {
-    std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
+// every level comes precomputed, nothing is left for glGenerateMipmap
+static void upload_compressed(const CompressedTexture &texture) {
+  GLenum format = {compressed_format(texture)};
+  for (size_t i{0}; i < texture.levels.size(); i++) {
+    int width = {std::max(1, texture.width >> i)};
+    int height = {std::max(1, texture.height >> i)};
+    glCompressedTexImage2D(GL_TEXTURE_2D, i, format, width, height, 0, texture.levels[i].size(), texture.levels[i].data());
+    gl_stats().add(TEXTURE_BYTES, texture.levels[i].size());
   }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels.size()) - 1);
 
-  return textureID;
+  if (texture.grey) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+  }
 }
 
-unsigned int texture_from_file(const char *path, const std::string &directory) {
-  std::string filename = {std::string(path)};
-  filename = directory + '/' + filename;
-
+unsigned int upload_texture(ImageData &image, unsigned int pixel_buffer) {
   unsigned int textureID{};
   glGenTextures(1, &textureID);
 
-  int width{}, height{}, nrComponents{};
-  unsigned char *data = {stbi_load(filename.c_str(), &width, &height, &nrComponents, 0)};
-  if (data) {
-    GLenum format;
-    if (nrComponents == 1)
-      format = GL_RED;
-    else if (nrComponents == 3)
-      format = GL_RGB;
-    else if (nrComponents == 4)
-      format = GL_RGBA;
-
+  if (!image.compressed.empty() && supports_compressed(image.compressed)) {
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
+    upload_compressed(image.compressed);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    stbi_image_free(data);
-  } else {
-    std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
+    stbi_image_free(image.pixels);
+    image.pixels = nullptr;
+    image.compressed = {};
+    return textureID;
   }
 
+  // a cooked file the driver can't sample, go back to the source image
+  if (!image.pixels && !image.compressed.empty()) {
+    image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &image.components, 0);
+  }
+  image.compressed = {};
+
+  if (!image.pixels) {
+    std::cout << "Texture failed to load at path: " << image.path << std::endl;
+    return textureID;
+  }
+
+  GLenum format = {GL_RGBA};
+  if (image.components == 1)
+    format = GL_RED;
+  else if (image.components == 3)
+    format = GL_RGB;
+
+  // the copy into a fresh buffer returns at once, the driver transfers it to the texture asynchronously
+  const void *source = {image.pixels};
+  if (pixel_buffer != 0) {
+    size_t size = {static_cast<size_t>(image.width) * image.height * image.components};
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    void *staging = {glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)};
+    std::memcpy(staging, image.pixels, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    source = nullptr;
+  }
+
+  // rows of 1 and 3 channel images aren't 4 byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glBindTexture(GL_TEXTURE_2D, textureID);
+  glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, source);
+  gl_stats().add(TEXTURE_BYTES, static_cast<size_t>(image.width) * image.height * image.components);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  if (pixel_buffer != 0) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  stbi_image_free(image.pixels);
+  image.pixels = nullptr;
+
   return textureID;
 }
 
-// rendering
-
-void render_cube(Shader &shader, float angle, glm::vec3 position, glm::mat4 view) {
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::translate(model, position);
-  model = glm::rotate(model, angle, glm::vec3(1.0f, 0.3f, 0.5f));
-  shader.set_matrix("model", model);
-  shader.set_matrix("normalView", glm::mat3{glm::transpose(glm::inverse(view * model))});
-  glDrawArrays(GL_TRIANGLES, 0, 36);
+TextureRef load_texture(char const *path) {
+  return ResourceRegistry::instance().load_texture(path);
 }
 
-void render_lamp(Shader &shader, LightSource light, glm::vec3 pos) {
-  glm::vec3 color{light.color};
-  glm::mat4 model{glm::translate(glm::mat4{1.0f}, pos)};
-  model = glm::scale(model, glm::vec3{0.3f});
+unsigned int texture_buffer(unsigned int buffer, GLenum format) {
+  unsigned int textureID{};
+  glGenTextures(1, &textureID);
+  glBindTexture(GL_TEXTURE_BUFFER, textureID);
+  glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
 
-  shader.set_float("lightColor", color.x, color.y, color.z);
-  shader.set_matrix("model", model);
-  glDrawArrays(GL_TRIANGLES, 0, 36);
+  return textureID;
 }
 
-void render_model(Model &obj_model, const Shader &shader, glm::vec3 pos) {
-  glm::mat4 model = {glm::translate(glm::mat4{1.0f}, pos)};
-  model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-  shader.set_matrix("model", model);
-  shader.set_bool("diffuse", obj_model.has_diffuse);
-  shader.set_bool("specular", obj_model.has_specular);
-  shader.set_bool("emissive", obj_model.has_emission);
-  obj_model.draw(shader);
+// transforms
+
+InstanceData cube_instance(float angle, glm::vec3 position) {
+  glm::mat4 model = glm::mat4(1.0f);
+  model = glm::translate(model, position);
+  model = glm::rotate(model, angle, glm::vec3(1.0f, 0.3f, 0.5f));
+  return InstanceData{model, glm::mat3{glm::transpose(glm::inverse(model))}};
 }
 
+glm::mat4 model_transform(glm::vec3 position) {
+  glm::mat4 model = {glm::translate(glm::mat4{1.0f}, position)};
+  return glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
+}
@@ -0,0 +1,50 @@
+#include "vertex_format.hpp"
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+// flat meshes have a zero extent on some axis, every position on it then packs to 0
+static auto quantize_extent(const AABB &bounds) -> glm::vec3 {
+  return glm::max(bounds.max - bounds.min, glm::vec3{1e-6f});
+}
+
+void pack_vertices(const Vertex *vertices, size_t count, const AABB &bounds, std::vector<PackedVertex> &packed) {
+  glm::vec3 scale = {65535.0f / quantize_extent(bounds)};
+  packed.resize(count);
+  for (size_t i{0}; i < count; i++) {
+    const Vertex &vertex = {vertices[i]};
+    glm::vec3 position = {glm::clamp((vertex.position - bounds.min) * scale + 0.5f, glm::vec3{0.0f}, glm::vec3{65535.0f})};
+    packed[i].position[0] = static_cast<uint16_t>(position.x);
+    packed[i].position[1] = static_cast<uint16_t>(position.y);
+    packed[i].position[2] = static_cast<uint16_t>(position.z);
+    packed[i].position[3] = 0;
+    packed[i].normal = glm::packSnorm3x10_1x2(glm::vec4{vertex.normal, 0.0f});
+    packed[i].tex_coords = glm::packHalf2x16(vertex.tex_coords);
+  }
+}
+
+auto dequantize_transform(const AABB &bounds) -> glm::mat4 {
+  return glm::scale(glm::translate(glm::mat4{1.0f}, bounds.min), quantize_extent(bounds));
+}
+
+void build_vertex_streams(VertexFormat format, const Vertex *vertices, size_t vertex_count, const unsigned int *indices,
+                          size_t index_count, const AABB &bounds, VertexStreams &streams) {
+  streams.vertices = vertices;
+  streams.vertex_size = sizeof(Vertex);
+  streams.indices = indices;
+  streams.index_size = sizeof(unsigned int);
+  if (format != VertexFormat::QUANTIZED)
+    return;
+
+  pack_vertices(vertices, vertex_count, bounds, streams.packed);
+  streams.vertices = streams.packed.data();
+  streams.vertex_size = sizeof(PackedVertex);
+  // every index of a mesh this small fits in 16 bits
+  if (vertex_count <= 0xffff) {
+    streams.short_indices.assign(indices, indices + index_count);
+    streams.indices = streams.short_indices.data();
+    streams.index_size = sizeof(uint16_t);
+  }
+}
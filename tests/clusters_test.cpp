@@ -0,0 +1,100 @@
+#include "clusters.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <random>
+
+// ClusterGrid::assign against lights whose clusters are known, and against a brute force sphere/box test
+// over every cluster for a random field
+
+static auto lights_in(const ClusterGrid &grid, unsigned int cluster) -> std::vector<unsigned int> {
+  const ClusterRange &range = {grid.ranges()[cluster]};
+  std::vector<unsigned int> lights = {grid.indices().begin() + range.offset,
+                                      grid.indices().begin() + range.offset + range.count};
+  std::sort(lights.begin(), lights.end());
+  return lights;
+}
+
+static auto touches(const LightBounds &light, const std::pair<glm::vec3, glm::vec3> &box) -> bool {
+  glm::vec3 nearest = {glm::clamp(light.position, box.first, box.second)};
+  glm::vec3 offset = {light.position - nearest};
+  return glm::dot(offset, offset) <= light.radius * light.radius;
+}
+
+static auto count_listed(const ClusterGrid &grid) -> size_t {
+  size_t listed{0};
+  for (const ClusterRange &range : grid.ranges()) {
+    listed += range.count;
+  }
+  return listed;
+}
+
+int main() {
+  ClusterGrid grid{};
+  grid.set_projection(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+
+  grid.assign({});
+  CHECK(grid.ranges().size() == ClusterGrid::COUNT);
+  CHECK(grid.indices().empty());
+
+  // behind the camera and past the far plane
+  grid.assign({LightBounds{{0.0f, 0.0f, 5.0f}, 1.0f}, LightBounds{{0.0f, 0.0f, -150.0f}, 10.0f}});
+  CHECK(grid.indices().empty());
+  CHECK(count_listed(grid) == 0);
+
+  // a tiny light in the middle of one cluster lands in it, and otherwise only in neighbours whose
+  // (conservative, overlapping) boxes reach that far
+  unsigned int target = {grid.cluster_of(3, 4, 10)};
+  std::pair<glm::vec3, glm::vec3> box = {grid.bounds_of(target)};
+  grid.assign({LightBounds{(box.first + box.second) * 0.5f, 1e-3f}});
+  CHECK(lights_in(grid, target) == std::vector<unsigned int>{0});
+  for (unsigned int z{0}; z < ClusterGrid::SLICES; z++) {
+    for (unsigned int y{0}; y < ClusterGrid::TILES_Y; y++) {
+      for (unsigned int x{0}; x < ClusterGrid::TILES_X; x++) {
+        bool neighbour = {x + 1 >= 3 && x <= 4 && y + 1 >= 4 && y <= 5 && z + 1 >= 10 && z <= 11};
+        if (!neighbour)
+          CHECK(grid.ranges()[grid.cluster_of(x, y, z)].count == 0);
+      }
+    }
+  }
+  CHECK(grid.slice_of(-(box.first.z + box.second.z) * 0.5f) == 10);
+
+  // a light around the whole frustum reaches every cluster
+  grid.assign({LightBounds{{0.0f, 0.0f, -50.0f}, 500.0f}});
+  CHECK(grid.indices().size() == ClusterGrid::COUNT);
+  for (unsigned int c{0}; c < ClusterGrid::COUNT; c++) {
+    CHECK(grid.ranges()[c].count == 1);
+  }
+
+  // a random field, enough lights to take the parallel path, matches brute force and the serial path
+  std::mt19937 rng{7};
+  std::uniform_real_distribution<float> side{-40.0f, 40.0f};
+  std::uniform_real_distribution<float> depth{-110.0f, 5.0f};
+  std::uniform_real_distribution<float> radius{0.2f, 6.0f};
+  std::vector<LightBounds> field{};
+  for (int i{0}; i < 400; i++) {
+    field.push_back(LightBounds{{side(rng), side(rng), depth(rng)}, radius(rng)});
+  }
+
+  grid.assign(field, false);
+  std::vector<ClusterRange> serial_ranges = {grid.ranges()};
+  std::vector<unsigned int> serial_indices = {grid.indices()};
+
+  size_t mismatched{0};
+  for (unsigned int c{0}; c < ClusterGrid::COUNT; c++) {
+    std::vector<unsigned int> expected{};
+    for (unsigned int i{0}; i < field.size(); i++) {
+      if (touches(field[i], grid.bounds_of(c)))
+        expected.push_back(i);
+    }
+    mismatched += lights_in(grid, c) != expected;
+  }
+  CHECK(mismatched == 0);
+
+  grid.assign(field, true);
+  CHECK(grid.indices() == serial_indices);
+  CHECK(std::equal(serial_ranges.begin(), serial_ranges.end(), grid.ranges().begin(),
+                   [](const ClusterRange &a, const ClusterRange &b) { return a.offset == b.offset && a.count == b.count; }));
+
+  return test_result();
+}
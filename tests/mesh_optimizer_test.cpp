@@ -0,0 +1,94 @@
+#include "mesh_optimizer.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <random>
+
+// optimize_mesh on an unwelded grid in shuffled triangle order: the triangles survive, the cache does
+// better and two runs agree byte for byte, which is what cooking the result relies on
+
+using Triangle = std::array<float, 9>;
+
+// triangles by position, each rotated to start at its smallest corner so winding is kept but the
+// starting corner the optimizer picked doesn't matter
+static auto triangles_of(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices) -> std::vector<Triangle> {
+  std::vector<Triangle> triangles{};
+  for (size_t i{0}; i + 2 < indices.size(); i += 3) {
+    std::array<std::array<float, 3>, 3> corners{};
+    for (int k{0}; k < 3; k++) {
+      const glm::vec3 &p = {vertices[indices[i + k]].position};
+      corners[k] = {p.x, p.y, p.z};
+    }
+    std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end()), corners.end());
+    Triangle triangle{};
+    for (int k{0}; k < 9; k++) {
+      triangle[k] = corners[k / 3][k % 3];
+    }
+    triangles.push_back(triangle);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+// a size x size grid of quads, every corner its own vertex and the triangles shuffled
+static void make_grid(unsigned int size, std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+  std::vector<std::array<glm::vec2, 3>> triangles{};
+  for (unsigned int y{0}; y < size; y++) {
+    for (unsigned int x{0}; x < size; x++) {
+      glm::vec2 a = {x, y}, b = {x + 1, y}, c = {x + 1, y + 1}, d = {x, y + 1};
+      triangles.push_back({a, b, c});
+      triangles.push_back({a, c, d});
+    }
+  }
+  std::mt19937 rng{3};
+  std::shuffle(triangles.begin(), triangles.end(), rng);
+
+  for (const std::array<glm::vec2, 3> &triangle : triangles) {
+    for (const glm::vec2 &corner : triangle) {
+      indices.push_back(static_cast<unsigned int>(vertices.size()));
+      vertices.push_back(Vertex{glm::vec3{corner.x, 0.0f, corner.y}, glm::vec3{0.0f, 1.0f, 0.0f}, corner / float(size)});
+    }
+  }
+}
+
+int main() {
+  std::vector<Vertex> vertices{};
+  std::vector<unsigned int> indices{};
+  make_grid(32, vertices, indices);
+  std::vector<Triangle> input = {triangles_of(vertices, indices)};
+
+  std::vector<Vertex> first_vertices = {vertices};
+  std::vector<unsigned int> first_indices = {indices};
+  MeshOptimizeReport report = {optimize_mesh(first_vertices, first_indices)};
+
+  // weld and reorder keep every triangle
+  CHECK(triangles_of(first_vertices, first_indices) == input);
+  CHECK(report.vertices_before == vertices.size());
+  CHECK(report.vertices_after == 33 * 33);
+  CHECK(first_vertices.size() == 33 * 33);
+
+  // shuffled input barely reuses anything, the optimized order does
+  CHECK(report.after.acmr < report.before.acmr);
+  CHECK(report.after.acmr < 1.0f);
+
+  std::vector<Vertex> second_vertices = {vertices};
+  std::vector<unsigned int> second_indices = {indices};
+  optimize_mesh(second_vertices, second_indices);
+  CHECK(second_indices == first_indices);
+  CHECK(second_vertices.size() == first_vertices.size() &&
+        std::memcmp(second_vertices.data(), first_vertices.data(), first_vertices.size() * sizeof(Vertex)) == 0);
+
+  // degenerate triangles are dropped before anything else, so they change nothing about the order
+  std::vector<unsigned int> clean = {first_indices};
+  optimize_vertex_cache(clean, first_vertices.size());
+  std::vector<unsigned int> degenerate = {first_indices};
+  degenerate.insert(degenerate.begin() + 30, {5, 5, 6});
+  degenerate.insert(degenerate.end(), {7, 8, 7, 9, 9, 9});
+  optimize_vertex_cache(degenerate, first_vertices.size());
+  CHECK(degenerate == clean);
+  CHECK(triangles_of(first_vertices, degenerate) == input);
+
+  return test_result();
+}
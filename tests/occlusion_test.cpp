@@ -0,0 +1,130 @@
+#include "occlusion.hpp"
+#include "test.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+
+// OcclusionBuffer against walls whose coverage is known, at screen sizes that do and don't fill whole
+// tiles. The same file builds once more with OCCLUSION_SCALAR, that run writes its tiles for a random
+// scene and this one compares them, so the simd and scalar paths have to agree bit for bit.
+
+// walls facing the camera, kept alive until rasterize has read them. Each is one large triangle, the
+// edges are pulled in a little so pixel centers right on a quad's diagonal would belong to neither half
+struct Scene {
+  std::vector<std::vector<glm::vec3>> walls;
+};
+
+static const unsigned int WALL_INDICES[3] = {0, 1, 2};
+
+static void add_wall(OcclusionBuffer &buffer, Scene &scene, glm::vec2 a, glm::vec2 b, glm::vec2 c, float z) {
+  scene.walls.push_back({{a, z}, {b, z}, {c, z}});
+  buffer.add_occluder(scene.walls.back().data(), 3, WALL_INDICES, 3, glm::mat4{1.0f});
+}
+
+static auto box(glm::vec3 center, float half) -> AABB {
+  return AABB{center - glm::vec3{half}, center + glm::vec3{half}};
+}
+
+// looking down -z from the origin
+static auto view_projection(unsigned int width, unsigned int height) -> glm::mat4 {
+  glm::mat4 projection = {glm::perspective(glm::radians(60.0f), static_cast<float>(width) / height, 0.1f, 100.0f)};
+  return projection * glm::lookAt(glm::vec3{0.0f}, glm::vec3{0.0f, 0.0f, -1.0f}, glm::vec3{0.0f, 1.0f, 0.0f});
+}
+
+static void check_walls(unsigned int width, unsigned int height) {
+  OcclusionBuffer buffer{width, height};
+  Scene scene{};
+  // half the screen's extent at a depth, and a pixel's size at the walls
+  float half_height = {20.0f * std::tan(glm::radians(30.0f))};
+  float half_width = {half_height * width / height};
+  float pixel = {half_height / height};
+
+  // one wall over the whole screen
+  buffer.clear(view_projection(width, height));
+  add_wall(buffer, scene, {-1000.0f, -1000.0f}, {1000.0f, -1000.0f}, {0.0f, 1000.0f}, -10.0f);
+  buffer.rasterize();
+  CHECK(buffer.occluded(box({0.0f, 0.0f, -20.0f}, 1.0f)));
+  CHECK(!buffer.occluded(box({0.0f, 0.0f, -5.0f}, 1.0f)));
+  // straddling the wall
+  CHECK(!buffer.occluded(box({0.0f, 0.0f, -10.0f}, 1.0f)));
+  // in the screen's corners, where the last tiles are only partly inside the buffer
+  CHECK(buffer.occluded(box({half_width * 0.9f, half_height * 0.9f, -20.0f}, half_height * 0.05f)));
+  CHECK(buffer.occluded(box({-half_width * 0.9f, -half_height * 0.9f, -20.0f}, half_height * 0.05f)));
+  // reaching through the near plane or behind the camera, never hidden
+  CHECK(!buffer.occluded(AABB{{-1.0f, -1.0f, -50.0f}, {1.0f, 1.0f, -0.05f}}));
+  CHECK(!buffer.occluded(box({0.0f, 0.0f, 20.0f}, 1.0f)));
+
+  // two walls with a gap down the middle six pixels wide, the boxes behind them are twice as far away
+  float gap = {3.0f * pixel};
+  buffer.clear(view_projection(width, height));
+  add_wall(buffer, scene, {-gap, -1000.0f}, {-gap, 1000.0f}, {-1000.0f, 0.0f}, -10.0f);
+  add_wall(buffer, scene, {gap, -1000.0f}, {1000.0f, 0.0f}, {gap, 1000.0f}, -10.0f);
+  buffer.rasterize();
+  CHECK(!buffer.occluded(box({0.0f, 0.0f, -20.0f}, gap)));
+  CHECK(buffer.occluded(box({-half_width * 0.5f, 0.0f, -20.0f}, gap)));
+  CHECK(buffer.occluded(box({half_width * 0.5f, 0.0f, -20.0f}, gap)));
+}
+
+// a few hundred triangles of random size and depth over a buffer that isn't a whole number of tiles
+static auto random_scene_tiles() -> std::vector<uint32_t> {
+  constexpr unsigned int WIDTH = {333}, HEIGHT = {125};
+  OcclusionBuffer buffer{WIDTH, HEIGHT};
+  std::mt19937 rng{7};
+  std::uniform_real_distribution<float> across{-30.0f, 30.0f}, size{0.1f, 8.0f}, depth{-60.0f, -2.0f};
+  std::vector<glm::vec3> positions{};
+  for (int i{0}; i < 300; i++) {
+    float z = {depth(rng)};
+    for (int k{0}; k < 3; k++) {
+      positions.push_back({across(rng) * -z / 30.0f, across(rng) * -z / 60.0f, z - size(rng)});
+    }
+  }
+  std::vector<unsigned int> indices(positions.size());
+  for (unsigned int i{0}; i < indices.size(); i++) {
+    indices[i] = i;
+  }
+
+  buffer.clear(view_projection(WIDTH, HEIGHT));
+  for (size_t first{0}; first < indices.size(); first += 30) {
+    buffer.add_occluder(positions.data(), positions.size(), indices.data() + first, 30, glm::mat4{1.0f});
+  }
+  buffer.rasterize();
+  CHECK(buffer.triangles() > 0);
+
+  // the depths as their bits, they have to match exactly
+  std::vector<uint32_t> tiles{};
+  for (const OcclusionTile &tile : buffer.tiles()) {
+    uint32_t depths[2]{};
+    std::memcpy(depths, &tile.reference, sizeof(float));
+    std::memcpy(depths + 1, &tile.working, sizeof(float));
+    tiles.insert(tiles.end(), tile.mask, tile.mask + 4);
+    tiles.insert(tiles.end(), depths, depths + 2);
+  }
+  return tiles;
+}
+
+// occlusion_test [--write path | --compare path]
+int main(int argc, char **argv) {
+  check_walls(1200, 800);
+  check_walls(100, 30);
+  check_walls(33, 5);
+
+  std::vector<uint32_t> tiles = {random_scene_tiles()};
+  std::string mode = {argc == 3 ? argv[1] : ""};
+  if (mode == "--write") {
+    std::ofstream file{argv[2], std::ios::binary};
+    file.write(reinterpret_cast<const char *>(tiles.data()), tiles.size() * sizeof(uint32_t));
+    CHECK(static_cast<bool>(file));
+  } else if (mode == "--compare") {
+    std::ifstream file{argv[2], std::ios::binary};
+    std::vector<uint32_t> expected(tiles.size());
+    file.read(reinterpret_cast<char *>(expected.data()), expected.size() * sizeof(uint32_t));
+    CHECK(file.gcount() == static_cast<std::streamsize>(expected.size() * sizeof(uint32_t)) && file.peek() == EOF);
+    CHECK(expected == tiles);
+  }
+  return test_result();
+}
@@ -0,0 +1,27 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <cstdio>
+
+// The smallest possible harness: CHECK reports the failed condition and keeps going, the test's main
+// returns test_result() so ctest sees a nonzero exit when anything failed.
+inline auto test_failures() -> int & {
+  static int failures{0};
+  return failures;
+}
+
+#define CHECK(condition)                                                                                   \
+  do {                                                                                                     \
+    if (!(condition)) {                                                                                    \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);                   \
+      test_failures()++;                                                                                   \
+    }                                                                                                      \
+  } while (false)
+
+inline auto test_result() -> int {
+  if (test_failures() != 0)
+    std::fprintf(stderr, "%d checks failed\n", test_failures());
+  return test_failures() == 0 ? 0 : 1;
+}
+
+#endif // __TEST_H__
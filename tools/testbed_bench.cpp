@@ -0,0 +1,301 @@
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "camera_path.hpp"
+#include "gl_ext.hpp"
+#include "gl_stats.hpp"
+#include "profiler.hpp"
+#include "program_cache.hpp"
+#include "stage.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Renders the stage offscreen at a fixed timestep and reports how long frames took. Needs no window or
+// gpu: the context comes from EGL, surfaceless when the driver offers it, so Mesa's llvmpipe will do.
+// Run it from the repository root, where the shaders and resources are.
+//
+//   testbed_bench [--frames N] [--warmup N] [--path camera.path] [--lights N] [--cubes N] [--cpu-culling]
+//                 [--no-occlusion] [--shadows] [--no-light-shadows] [--deferred] [--stencil-volumes]
+//                 [--no-program-cache] [--out bench.json]
+//
+// The path replays a recorded camera/light fly through (see camera_path.hpp), without one the camera
+// holds its starting pose. Timings are wall clock per frame including a glFinish, counters are per
+// frame averages, and the hash is FNV-1a over the final frame's pixels. --cubes grows the floor grid to
+// N cubes and --cpu-culling keeps the stage off its gpu driven path on 4.3 contexts, to compare the two.
+// --no-occlusion turns off the software occlusion culling the cpu path does after frustum culling.
+// --shadows turns on the directional light and with it the cascaded shadow maps. --no-light-shadows
+// leaves the spot and point lights without their shadow atlas. --deferred shades through the g-buffer
+// instead of forward, --stencil-volumes also stencil masks its large light volumes. --no-program-cache
+// compiles every shader instead of loading the binaries kept in shader_cache, setup_ms with and without
+// it is what the cache saves at startup. cluster_build_ms averages the frames that rebuilt the light
+// clusters, compare it across --lights counts.
+
+struct BenchOptions {
+  int frames = {600};
+  int warmup = {30};
+  int lights = {0};
+  int cubes = {0};
+  bool cpu_culling = {false};
+  bool occlusion = {true};
+  bool shadows = {false};
+  bool light_shadows = {true};
+  bool deferred = {false};
+  bool stencil_volumes = {false};
+  bool program_cache = {true};
+  std::string path;
+  std::string out = {"bench.json"};
+};
+
+static auto parse_options(int argc, char **argv, BenchOptions &options) -> bool {
+  for (int i{1}; i < argc; i++) {
+    std::string arg = {argv[i]};
+    bool has_value = {i + 1 < argc};
+    if (arg == "--frames" && has_value) {
+      options.frames = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--warmup" && has_value) {
+      options.warmup = std::max(0, std::atoi(argv[++i]));
+    } else if (arg == "--lights" && has_value) {
+      options.lights = std::max(0, std::atoi(argv[++i]));
+    } else if (arg == "--cubes" && has_value) {
+      options.cubes = std::max(0, std::atoi(argv[++i]));
+    } else if (arg == "--cpu-culling") {
+      options.cpu_culling = true;
+    } else if (arg == "--no-occlusion") {
+      options.occlusion = false;
+    } else if (arg == "--shadows") {
+      options.shadows = true;
+    } else if (arg == "--no-light-shadows") {
+      options.light_shadows = false;
+    } else if (arg == "--deferred") {
+      options.deferred = true;
+    } else if (arg == "--stencil-volumes") {
+      options.stencil_volumes = true;
+    } else if (arg == "--no-program-cache") {
+      options.program_cache = false;
+    } else if (arg == "--path" && has_value) {
+      options.path = argv[++i];
+    } else if (arg == "--out" && has_value) {
+      options.out = argv[++i];
+    } else {
+      std::cerr << "usage: testbed_bench [--frames N] [--warmup N] [--path camera.path] [--lights N] [--cubes N] [--cpu-culling] "
+                   "[--no-occlusion] [--shadows] [--no-light-shadows] [--deferred] [--stencil-volumes] [--no-program-cache] "
+                   "[--out bench.json]"
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// a current 3.3 core context with no surface, the stage renders into its own framebuffer
+static auto create_context() -> bool {
+  EGLDisplay display = {EGL_NO_DISPLAY};
+  auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_API))
+    return false;
+
+  // the context never draws to a surface, any desktop gl config works and none is needed where
+  // EGL_KHR_no_config_context is supported
+  const EGLint config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config = {EGL_NO_CONFIG_KHR};
+  EGLint configs{0};
+  if (!eglChooseConfig(display, config_attributes, &config, 1, &configs) || configs == 0) {
+    config = EGL_NO_CONFIG_KHR;
+  }
+
+  const EGLint context_attributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                       EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+  EGLContext context = {eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes)};
+  if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    return false;
+
+  if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)))
+    return false;
+  load_gl_4_3(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+  load_shader_extensions(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+  return true;
+}
+
+static auto create_framebuffer(int width, int height) -> bool {
+  unsigned int framebuffer{}, renderbuffers[2]{};
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glGenRenderbuffers(2, renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+  glViewport(0, 0, width, height);
+  return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+static auto framebuffer_hash(int width, int height) -> unsigned long long {
+  std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  unsigned long long hash = {1469598103934665603ull};
+  for (unsigned char byte : pixels) {
+    hash = (hash ^ byte) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// nearest rank percentile of sorted values
+static auto percentile(const std::vector<double> &sorted, double p) -> double {
+  size_t rank = {static_cast<size_t>(p / 100.0 * sorted.size() + 0.5)};
+  return sorted[std::min(std::max(rank, size_t{1}), sorted.size()) - 1];
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options{};
+  if (!parse_options(argc, argv, options))
+    return 2;
+
+  std::vector<PathKey> path{};
+  if (!options.path.empty() && !load_camera_path(options.path, path)) {
+    std::cerr << "ERROR::BENCH::could not read camera path " << options.path << std::endl;
+    return 1;
+  }
+
+  if (!create_context()) {
+    std::cerr << "ERROR::BENCH::could not create an offscreen OpenGL 3.3 context" << std::endl;
+    return 1;
+  }
+
+  static Stage stage{};
+  if (!create_framebuffer(stage.SCR_WIDTH, stage.SCR_HEIGHT)) {
+    std::cerr << "ERROR::BENCH::offscreen framebuffer is incomplete" << std::endl;
+    return 1;
+  }
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_STENCIL_TEST);
+
+  if (options.cubes > 0) {
+    stage.cube_count = options.cubes;
+  }
+  stage.gpu_culling = !options.cpu_culling;
+  stage.occlusion_culling = options.occlusion;
+  stage.light_shadows = options.light_shadows;
+  stage.deferred_shading = options.deferred;
+  stage.stencil_light_volumes = options.stencil_volumes;
+  program_cache().set_enabled(options.program_cache);
+  auto setup_start = std::chrono::steady_clock::now();
+  stage.setup();
+  stage.dir_lights[0].enabled = options.shadows;
+  if (options.lights > 0) {
+    stage.light_field = options.lights;
+    stage.spawn_light_field(options.lights);
+  }
+  glFinish();
+  double setup_ms = {std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setup_start).count()};
+
+  const float STEP = {1.0f / 60.0f};
+  float path_start = {path.empty() ? 0.0f : path.front().time};
+  std::vector<double> frame_ms{};
+  GlStats::Frame totals{};
+  std::vector<double> cluster_ms{};
+
+  for (int frame{0}; frame < options.warmup + options.frames; frame++) {
+    auto start = std::chrono::steady_clock::now();
+    if (!path.empty()) {
+      stage.apply_path_key(sample_camera_path(path, path_start + frame * STEP));
+    }
+    size_t cluster_builds = {stage.cluster_builds};
+    stage.update(STEP);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    stage.render();
+    glFinish();
+    ResourceRegistry::instance().collect();
+    double elapsed = {std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()};
+
+    gl_stats().end_frame();
+    profiler().end_frame();
+    if (frame < options.warmup)
+      continue;
+    frame_ms.push_back(elapsed);
+    if (stage.cluster_builds != cluster_builds)
+      cluster_ms.push_back(stage.cluster_build_ms);
+    for (unsigned int i{0}; i < FRAME_COUNTERS; i++) {
+      totals[i] += gl_stats().last(static_cast<FrameCounter>(i));
+    }
+  }
+
+  unsigned long long hash = {framebuffer_hash(stage.SCR_WIDTH, stage.SCR_HEIGHT)};
+  GLenum error = {glGetError()};
+
+  double total_ms{0.0};
+  for (double ms : frame_ms) {
+    total_ms += ms;
+  }
+  std::vector<double> sorted = {frame_ms};
+  std::sort(sorted.begin(), sorted.end());
+  double cluster_total_ms{0.0};
+  double cluster_max_ms{0.0};
+  for (double ms : cluster_ms) {
+    cluster_total_ms += ms;
+    cluster_max_ms = std::max(cluster_max_ms, ms);
+  }
+
+  std::ofstream file{options.out};
+  if (!file) {
+    std::cerr << "ERROR::BENCH::could not write " << options.out << std::endl;
+    return 1;
+  }
+  char hash_text[17]{};
+  std::snprintf(hash_text, sizeof(hash_text), "%016llx", hash);
+  file << "{\n";
+  file << "  \"renderer\": \"" << reinterpret_cast<const char *>(glGetString(GL_RENDERER)) << "\",\n";
+  file << "  \"frames\": " << options.frames << ",\n";
+  file << "  \"warmup\": " << options.warmup << ",\n";
+  file << "  \"path\": \"" << options.path << "\",\n";
+  file << "  \"lights\": " << options.lights << ",\n";
+  file << "  \"cubes\": " << stage.cube_count << ",\n";
+  file << "  \"gpu_culling\": " << (stage.gpu_driven() ? "true" : "false") << ",\n";
+  file << "  \"shadows\": " << (stage.shadows_active() ? "true" : "false") << ",\n";
+  file << "  \"light_shadows\": " << (stage.light_shadows_active() ? "true" : "false") << ",\n";
+  file << "  \"deferred\": " << (stage.deferred_active() ? "true" : "false") << ",\n";
+  file << "  \"stencil_volumes\": " << stage.stencil_volumes << ",\n";
+  file << "  \"occlusion_culling\": " << (stage.occlusion_culling ? "true" : "false") << ",\n";
+  file << "  \"setup_ms\": " << setup_ms << ",\n";
+  const ProgramCache &programs = {program_cache()};
+  file << "  \"program_cache\": {\"enabled\": " << (programs.enabled() ? "true" : "false") << ", \"hits\": " << programs.hits()
+       << ", \"misses\": " << programs.misses() << ", \"rejected\": " << programs.rejected() << "},\n";
+  file << "  \"parallel_compile\": " << (has_parallel_compile() ? "true" : "false") << ",\n";
+  file << "  \"frame_ms\": {\"mean\": " << total_ms / frame_ms.size() << ", \"p50\": " << percentile(sorted, 50.0)
+       << ", \"p95\": " << percentile(sorted, 95.0) << ", \"p99\": " << percentile(sorted, 99.0) << ", \"max\": " << sorted.back()
+       << "},\n";
+  file << "  \"cluster_build_ms\": {\"mean\": " << (cluster_ms.empty() ? 0.0 : cluster_total_ms / cluster_ms.size())
+       << ", \"max\": " << cluster_max_ms << ", \"builds\": " << cluster_ms.size() << "},\n";
+  file << "  \"counters\": {";
+  for (unsigned int i{0}; i < FRAME_COUNTERS; i++) {
+    file << (i == 0 ? "" : ", ") << '"' << frame_counter_name(static_cast<FrameCounter>(i))
+         << "\": " << static_cast<double>(totals[i]) / frame_ms.size();
+  }
+  file << "},\n";
+  file << "  \"gl_error\": " << error << ",\n";
+  file << "  \"hash\": \"" << hash_text << "\"\n";
+  file << "}\n";
+
+  std::cout << "p50 " << percentile(sorted, 50.0) << " ms | p95 " << percentile(sorted, 95.0) << " ms | p99 "
+            << percentile(sorted, 99.0) << " ms | hash " << hash_text << " -> " << options.out << std::endl;
+
+  ResourceRegistry::instance().shutdown();
+  profiler().shutdown();
+  return error == GL_NO_ERROR ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "texture_cooker.hpp"
+
+#include <stb_image.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+// Cooks every image given on the command line (directories are searched recursively) into a block
+// compressed <image>.dds next to it, the same files the testbed would otherwise cook on first load.
+//
+//   texture_cooker [--force] [--normal] <image or directory>...
+//
+// --force recooks files that are already up to date, --normal encodes two channel BC5 normal maps.
+
+static auto is_image(const std::filesystem::path &path) -> bool {
+  std::string extension = {path.extension().string()};
+  for (char &c : extension) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp";
+}
+
+static void collect(const std::filesystem::path &path, std::vector<std::filesystem::path> &images) {
+  if (std::filesystem::is_directory(path)) {
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+      if (entry.is_regular_file() && is_image(entry.path()))
+        images.push_back(entry.path());
+    }
+  } else if (is_image(path)) {
+    images.push_back(path);
+  }
+}
+
+int main(int argc, char **argv) {
+  bool force = {false};
+  bool normal = {false};
+  std::vector<std::filesystem::path> images{};
+  for (int i{1}; i < argc; i++) {
+    if (std::strcmp(argv[i], "--force") == 0)
+      force = true;
+    else if (std::strcmp(argv[i], "--normal") == 0)
+      normal = true;
+    else
+      collect(argv[i], images);
+  }
+
+  if (images.empty()) {
+    std::cerr << "usage: texture_cooker [--force] [--normal] <image or directory>..." << std::endl;
+    return 1;
+  }
+
+  // the testbed flips every image on load, cooked files have to match
+  stbi_set_flip_vertically_on_load(true);
+
+  int failed{0};
+  for (const std::filesystem::path &image : images) {
+    std::string source = {image.generic_string()};
+    CompressedTexture texture{};
+    if (!force && load_cooked_texture(source, texture)) {
+      std::cout << "up to date  " << source << std::endl;
+      continue;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int width{}, height{}, components{};
+    unsigned char *pixels = {stbi_load(source.c_str(), &width, &height, &components, 0)};
+    if (!pixels) {
+      std::cerr << "failed      " << source << ": " << stbi_failure_reason() << std::endl;
+      failed++;
+      continue;
+    }
+
+    texture = normal ? cook_texture(pixels, width, height, components, BlockFormat::BC5) : cook_texture(pixels, width, height, components);
+    stbi_image_free(pixels);
+    if (!write_dds(cooked_texture_path(source), texture)) {
+      std::cerr << "failed      " << cooked_texture_path(source) << ": could not write" << std::endl;
+      failed++;
+      continue;
+    }
+
+    static const char *FORMATS[] = {"BC1", "BC3", "BC4", "BC5"};
+    double ms = {std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()};
+    std::cout << "cooked      " << source << " (" << width << "x" << height << " " << FORMATS[static_cast<int>(texture.format)]
+              << ", " << texture.levels.size() << " levels, " << ms << " ms)" << std::endl;
+  }
+  return failed == 0 ? 0 : 1;
+}